@@ -100,6 +100,10 @@ PZG_SOURCES = $$ZG_DIR/src/private/PZGCaffeine.cpp              \
               $$ZG_DIR/src/private/PZGDatabaseState.cpp         \
               $$ZG_DIR/src/private/PZGDatabaseStateInfo.cpp     \
               $$ZG_DIR/src/private/PZGDatabaseUpdate.cpp        \
+              $$ZG_DIR/src/private/PZGDurableLog.cpp            \
+              $$ZG_DIR/src/private/PZGMulticastFEC.cpp          \
+              $$ZG_DIR/src/private/PZGBatchedUDPSocketDataIO.cpp \
+              $$ZG_DIR/src/private/PZGFanOutPacketDataIO.cpp     \
               $$ZG_DIR/src/private/PZGConstants.cpp             \
               $$ZG_DIR/src/private/PZGBeaconData.cpp            \
               $$ZG_DIR/src/private/PZGHeartbeatPeerInfo.cpp     \
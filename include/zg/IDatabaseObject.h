@@ -185,6 +185,21 @@ protected:
    virtual status_t RequestResetDatabaseStateToDefault();
    virtual status_t RequestReplaceDatabaseState(const MessageRef & newDatabaseStateMsg);
    virtual status_t RequestUpdateDatabaseState(const MessageRef & databaseUpdateMsg);
+   virtual status_t RequestReadBarrier(uint64 * optRetBarrierID = NULL, bool probeSeniorPeer = true);
+
+   /** Called when a read barrier that was set up by calling RequestReadBarrier() on this object has been passed,
+     * i.e. when our local database has caught up to the state the senior peer's database was in when the barrier was requested.
+     * See ZGPeerSession::RequestReadBarrier() for details.  Default implementation is a no-op.
+     * @param barrierID the ID that RequestReadBarrier() returned for the barrier
+     * @param databaseStateID the current database-state ID of our local database
+     */
+   virtual void ReadBarrierPassed(uint64 barrierID, uint64 databaseStateID) {(void) barrierID; (void) databaseStateID;}
+
+   /** Called instead of ReadBarrierPassed() if the database's senior peer changed before the read barrier could be passed.
+     * See ZGPeerSession::ReadBarrierLost() for details.  Default implementation is a no-op.
+     * @param barrierID the ID that RequestReadBarrier() returned for the barrier
+     */
+   virtual void ReadBarrierLost(uint64 barrierID) {(void) barrierID;}
 
 protected:
    /** Call this method to send a Message to another MessageTreeDatabaseObject.
@@ -10,8 +10,11 @@ namespace zg
 #define ZG_VERSION_STRING "1.20"  /**< The current version of the ZG distribution, expressed as an ASCII string */
 #define ZG_VERSION        (12000) /**< Current version, expressed as decimal Mmmbb, where (M) is the number before the decimal point, (mm) is the number after the decimal point, and (bb) is reserved */
 
-#define ZG_COMPATIBILITY_VERSION (0) /**< I'll increment this value whenever ZG's protocol changes in such a way that it breaks compatibility with older versions of ZG */
+#define ZG_COMPATIBILITY_VERSION (1) /**< I'll increment this value whenever ZG's protocol changes in such a way that it breaks compatibility with older versions of ZG */
 
+#define B_REPLICATION_BUSY B_ERROR("Replication Busy") /**< Returned by ZGPeerSession::RequestUpdateDatabaseState() when admission control (in reject mode) says there's no headroom, or passed to ZGPeerSession::DatabaseUpdateCommitted() when the senior peer's admission-control queue was full */
+#define B_STALE_DATABASE_STATE B_ERROR("Stale Database State") /**< Passed to ZGPeerSession::DatabaseUpdateCommitted() when a conditional update's expected database-state ID didn't match */
+#define B_DATABASE_UPDATE_FAILED B_ERROR("Database Update Failed") /**< Passed to ZGPeerSession::DatabaseUpdateCommitted() when the senior peer wasn't able to execute an update */
 #define INVALID_TIME_OFFSET ((int64)(((uint64)-1)/2)) /** Guard value:  Similar to MUSCLE_TIME_NEVER, but for an int64 (relative-offset) time-value rather than an absolute uint64 timestamp */
 
 /** Enumeration of port numbers that will be the same for all ZG systems (not currently used) */
@@ -50,6 +50,8 @@ protected:
    virtual void PeerHasComeOnline(const ZGPeerID & peerID, const ConstMessageRef & optPeerInfo);
    virtual void PeerHasGoneOffline(const ZGPeerID & peerID, const ConstMessageRef & optPeerInfo);
    virtual void MessageReceivedFromPeer(const ZGPeerID & fromPeerID, const MessageRef & msg);
+   virtual void ReadBarrierPassed(uint32 whichDatabase, uint64 barrierID, uint64 databaseStateID);
+   virtual void ReadBarrierLost(uint32 whichDatabase, uint64 barrierID);
 
 private:
    status_t SendMessageToDatabaseObject(const ZGPeerID & targetPeerID, const ConstMessageRef & msg, uint32 targetDBIdx, uint32 sourceDBIdx);
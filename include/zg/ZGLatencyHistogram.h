@@ -0,0 +1,131 @@
+#ifndef ZGLatencyHistogram_h
+#define ZGLatencyHistogram_h
+
+#include "util/String.h"
+#include "zg/ZGNameSpace.h"
+
+namespace zg
+{
+
+/** The stages of a database-update's trip through the system that are timed when latency tracing is enabled.
+  * @see ZGPeerSettings::SetLatencyTracingEnabled()
+  */
+enum {
+   ZG_LATENCY_STAGE_SUBMIT_TO_SENIOR_START = 0,        ///< from the Request*DatabaseState() call to when the senior peer started executing the update (measured on the senior peer)
+   ZG_LATENCY_STAGE_SENIOR_EXECUTE,                    ///< how long the senior peer took to execute the update (measured on the senior peer)
+   ZG_LATENCY_STAGE_SENIOR_COMMIT_TO_MULTICAST_SEND,   ///< from the senior peer's completion of the update to when its multicast I/O thread sent it (measured on the junior peers)
+   ZG_LATENCY_STAGE_MULTICAST_SEND_TO_JUNIOR_RECEIVE,  ///< from the senior peer's multicast I/O thread to the junior peer's multicast I/O thread (measured on the junior peers)
+   ZG_LATENCY_STAGE_JUNIOR_RECEIVE_TO_APPLY,           ///< from the junior peer's receipt of the update to when it had finished applying it (measured on the junior peers)
+   ZG_LATENCY_STAGE_SUBMIT_TO_JUNIOR_APPLY,            ///< end-to-end:  from the Request*DatabaseState() call to when the junior peer had finished applying the update
+   NUM_ZG_LATENCY_STAGES                               ///< guard value
+};
+
+/** Returns a short human-readable name for the given ZG_LATENCY_STAGE_* value, or "???" if the value isn't valid. */
+MUSCLE_NODISCARD inline const char * GetLatencyStageName(uint32 whichStage)
+{
+   static const char * const _stageNames[] = {
+      "submit->senior start",
+      "senior execute",
+      "senior commit->multicast send",
+      "multicast send->junior receive",
+      "junior receive->apply",
+      "submit->junior apply",
+   };
+   return (whichStage < ARRAYITEMS(_stageNames)) ? _stageNames[whichStage] : "???";
+}
+
+/** A fixed-size histogram of latency samples (in microseconds).  Each power-of-two range of latencies is
+  * split into four buckets, so percentiles are accurate to within 25%, and adding a sample is O(1) with no allocations.
+  */
+class ZGLatencyHistogram
+{
+public:
+   /** Default constructor -- creates an empty histogram */
+   ZGLatencyHistogram() {Clear();}
+
+   /** Adds a sample to the histogram.
+     * @param micros the latency to add, in microseconds
+     */
+   void AddSample(uint64 micros)
+   {
+      _buckets[GetBucketIndex(micros)]++;
+      if ((_numSamples == 0)||(micros < _minMicros)) _minMicros = micros;
+      if (micros > _maxMicros) _maxMicros = micros;
+      _totalMicros += micros;
+      _numSamples++;
+   }
+
+   /** Removes all samples from the histogram */
+   void Clear()
+   {
+      memset(_buckets, 0, sizeof(_buckets));
+      _numSamples = _totalMicros = _minMicros = _maxMicros = 0;
+   }
+
+   /** Returns the number of samples that have been added since the last call to Clear() */
+   MUSCLE_NODISCARD uint64 GetNumSamples() const {return _numSamples;}
+
+   /** Returns the smallest sample added, or 0 if there are no samples */
+   MUSCLE_NODISCARD uint64 GetMinMicros() const {return _minMicros;}
+
+   /** Returns the largest sample added, or 0 if there are no samples */
+   MUSCLE_NODISCARD uint64 GetMaxMicros() const {return _maxMicros;}
+
+   /** Returns the mean of the samples added, or 0 if there are no samples */
+   MUSCLE_NODISCARD uint64 GetMeanMicros() const {return (_numSamples > 0) ? (_totalMicros/_numSamples) : 0;}
+
+   /** Returns an (upper-bound) estimate of the given percentile of the samples added, or 0 if there are no samples.
+     * @param fraction the percentile to return, expressed as a fraction (e.g. 0.99 for the 99th percentile)
+     */
+   MUSCLE_NODISCARD uint64 GetPercentileMicros(double fraction) const
+   {
+      if (_numSamples == 0) return 0;
+
+      const uint64 targetCount = muscleMax((uint64)1, (uint64)((fraction*_numSamples)+0.5));
+      uint64 count = 0;
+      for (uint32 i=0; i<NUM_BUCKETS; i++)
+      {
+         count += _buckets[i];
+         if (count >= targetCount) return muscleClamp(GetBucketUpperBound(i), _minMicros, _maxMicros);
+      }
+      return _maxMicros;
+   }
+
+   /** Returns a one-line human-readable summary of this histogram's contents */
+   MUSCLE_NODISCARD String ToString() const
+   {
+      if (_numSamples == 0) return "no samples";
+      return String("n=%1 min=%2 mean=%3 p50=%4 p99=%5 p999=%6 max=%7 (microseconds)").Arg(_numSamples).Arg(_minMicros).Arg(GetMeanMicros()).Arg(GetPercentileMicros(0.5)).Arg(GetPercentileMicros(0.99)).Arg(GetPercentileMicros(0.999)).Arg(_maxMicros);
+   }
+
+private:
+   enum {NUM_BUCKETS = 252};  // 4 buckets for values 0-3, then 4 buckets for each power of two from 2^2 through 2^63
+
+   MUSCLE_NODISCARD static uint32 GetBucketIndex(uint64 micros)
+   {
+      if (micros < 4) return (uint32) micros;
+
+      uint32 highBit = 2;
+      while((micros>>(highBit+1)) != 0) highBit++;
+      return (4*(highBit-1)) + (uint32)((micros>>(highBit-2))&3);
+   }
+
+   MUSCLE_NODISCARD static uint64 GetBucketUpperBound(uint32 idx)
+   {
+      if (idx < 4) return idx;
+
+      const uint32 highBit = (idx/4)+1;
+      const uint64 subIdx  = idx%4;
+      return (((5+subIdx)<<(highBit-2))-1);
+   }
+
+   uint64 _buckets[NUM_BUCKETS];
+   uint64 _numSamples;
+   uint64 _totalMicros;
+   uint64 _minMicros;
+   uint64 _maxMicros;
+};
+
+}  // end namespace zg
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "zg/INetworkTimeProvider.h"
 #include "zg/INetworkInterfaceFilter.h"
+#include "zg/ZGLatencyHistogram.h"
 #include "zg/ZGPeerID.h"
 #include "zg/ZGPeerSettings.h"
 #include "zg/ZGStdinSession.h"               // for ITextCommandReceiver
@@ -15,6 +16,7 @@
 #include "zg/private/PZGBeaconData.h"
 #include "zg/private/PZGDatabaseState.h"
 #include "zg/private/PZGDatabaseUpdate.h"
+#include "zg/private/PZGDurableLog.h"
 #include "zg/private/PZGUpdateBackOrderKey.h"
 
 namespace zg_private
@@ -108,6 +110,19 @@ public:
    /** Returns the ZGPeerID of the senior peer of this system, or an invalid ZGPeerID if there currently is no senior peer (that we know of). */
    MUSCLE_NODISCARD const ZGPeerID & GetSeniorPeerID() const {return _seniorPeerID;}
 
+   /** Returns the ZGPeerID of the senior peer of the specified database, or an invalid ZGPeerID if that database currently has no senior peer (that we know of).
+     * This is the same as GetSeniorPeerID() unless per-database senior peers are enabled.
+     * @param whichDB index of the database to inquire about
+     * @see ZGPeerSettings::SetPerDatabaseSeniorPeersEnabled()
+     */
+   MUSCLE_NODISCARD const ZGPeerID & GetDatabaseSeniorPeerID(uint32 whichDB) const {return _databaseSeniorPeerIDs.IsIndexValid(whichDB) ? _databaseSeniorPeerIDs[whichDB] : GetDefaultObjectForType<ZGPeerID>();}
+
+   /** Returns true iff this peer is currently the senior peer of the specified database.
+     * This is the same as IAmTheSeniorPeer() unless per-database senior peers are enabled.
+     * @param whichDB index of the database to inquire about
+     */
+   MUSCLE_NODISCARD bool IAmTheDatabaseSeniorPeer(uint32 whichDB) const {return ((GetDatabaseSeniorPeerID(whichDB).IsValid())&&(GetDatabaseSeniorPeerID(whichDB) == _localPeerID));}
+
    /** Returns the current time according to the network-time-clock, in microseconds.
      * The intent of this clock is to be the same on all peers in the system.  However, this means that it may occasionally
      * change (break monotonicity) in order to synchronize with the other peers in the system.
@@ -196,9 +211,91 @@ protected:
      * Note that this method only sends the request; the actual database-update will happen (if it happens) some time after this method returns.
      * @param whichDatabase the index of the database whose state should be updated.
      * @param databaseUpdateMsg a Message containing instructions/data that SeniorUpdateLocalDatabase() can use later on to transition the database to a new database state.
+     * @param optRetTicketID if non-NULL, a ticket ID identifying this request will be written here on success.  The senior peer will then report
+     *                       the request's outcome back to this peer, and DatabaseUpdateCommitted() and DatabaseUpdateAppliedLocally() will be called
+     *                       with this ticket ID, so that many update-requests can be in flight at once without losing track of them.
+     *                       Ticket IDs are unique only within this peer, and are never zero.  Defaults to NULL (no ticket; no callbacks).
+     * @returns B_NO_ERROR if the the update-request was successfully sent to the senior peer, or an error code if the request could not be sent.
+     *          If admission control is enabled in reject mode (see ZGPeerSettings::SetAdmissionControlParametersForDatabase()), returns
+     *          B_REPLICATION_BUSY without sending the request if GetDatabaseUpdateHeadroom() currently returns zero.
+     */
+   status_t RequestUpdateDatabaseState(uint32 whichDatabase, const MessageRef & databaseUpdateMsg, uint64 * optRetTicketID = NULL);
+
+   /** Same as RequestUpdateDatabaseState(), except that the senior peer will only execute the update if its copy of the database is
+     * still in the specified database-state when the update comes up for execution (compare-and-set).  Otherwise the update is rejected
+     * without being executed, and (if a ticket was requested) DatabaseUpdateCommitted() is called with B_STALE_DATABASE_STATE.
+     * This allows read-modify-write updates to be computed locally (e.g. on a junior peer) with optimistic concurrency:  read the database,
+     * note GetCurrentDatabaseStateID(), compute the update, and if it is rejected, wait for the local database to catch up and try again.
+     * Conditional updates are never batched together with other updates by group-commit.
+     * @param whichDatabase the index of the database whose state should be updated.
+     * @param expectedDatabaseStateID the database-state ID the senior peer's database must be in for the update to be executed.
+     * @param databaseUpdateMsg a Message containing instructions/data that SeniorUpdateLocalDatabase() can use later on to transition the database to a new database state.
+     * @param optRetTicketID if non-NULL, a ticket ID identifying this request will be written here on success (see RequestUpdateDatabaseState() for details)
      * @returns B_NO_ERROR if the the update-request was successfully sent to the senior peer, or an error code if the request could not be sent.
      */
-   status_t RequestUpdateDatabaseState(uint32 whichDatabase, const MessageRef & databaseUpdateMsg);
+   status_t RequestConditionalUpdateDatabaseState(uint32 whichDatabase, uint64 expectedDatabaseStateID, const MessageRef & databaseUpdateMsg, uint64 * optRetTicketID = NULL);
+
+   /** Called when the senior peer has finished handling an update-request that this peer sent via RequestUpdateDatabaseState() with a ticket.
+     * Tickets are reported in the order the senior peer handled their requests.  Default implementation is a no-op.
+     * @param whichDatabase the index of the database the update-request was for
+     * @param ticketID the ticket ID that RequestUpdateDatabaseState() returned for the request
+     * @param result B_NO_ERROR if the update was executed, B_STALE_DATABASE_STATE if it was a conditional update whose expected
+     *               database-state ID didn't match, B_REPLICATION_BUSY if admission control rejected it because the senior peer was
+     *               already holding back too many update-requests, or B_DATABASE_UPDATE_FAILED if the senior peer wasn't able to execute it.
+     * @param databaseStateID on success, the database-state ID that the update produced on the senior peer.  (If group-commit is enabled,
+     *                        several update-requests may share the same database-state ID)  On failure, the senior peer's current database-state ID.
+     * @note if the senior peer goes away before executing the request, this method may never be called for that ticket.
+     */
+   virtual void DatabaseUpdateCommitted(uint32 whichDatabase, uint64 ticketID, status_t result, uint64 databaseStateID) {(void) whichDatabase; (void) ticketID; (void) result; (void) databaseStateID;}
+
+   /** Called after DatabaseUpdateCommitted() reported a successful update, as soon as this peer's local copy of the database has reached
+     * (at least) the update's database-state ID, so that code which needs read-your-writes semantics knows when it is safe to read.
+     * On the senior peer this is called immediately after DatabaseUpdateCommitted().  Default implementation is a no-op.
+     * @param whichDatabase the index of the database the update-request was for
+     * @param ticketID the ticket ID that RequestUpdateDatabaseState() returned for the request
+     * @param databaseStateID the database-state ID that the update produced
+     */
+   virtual void DatabaseUpdateAppliedLocally(uint32 whichDatabase, uint64 ticketID, uint64 databaseStateID) {(void) whichDatabase; (void) ticketID; (void) databaseStateID;}
+
+   /** Called instead of DatabaseUpdateAppliedLocally() if the database's senior peer fails over (i.e. changes other than by a
+     * graceful hand-off) after DatabaseUpdateCommitted() reported a successful update, but before this peer's local copy of the
+     * database reached the update's database-state ID.  In that case the
+     * database-state ID reported by the old senior peer may not be part of the new senior peer's history, so the update may or may not
+     * end up being applied; code that needs read-your-writes semantics should re-read (or re-submit) as appropriate.  Default implementation is a no-op.
+     * @param whichDatabase the index of the database the update-request was for
+     * @param ticketID the ticket ID that RequestUpdateDatabaseState() returned for the request
+     */
+   virtual void DatabaseUpdateTicketLost(uint32 whichDatabase, uint64 ticketID) {(void) whichDatabase; (void) ticketID;}
+
+   /** Call this to set up a read barrier on the specified database:  ReadBarrierPassed() will be called (asynchronously) once this peer's
+     * local copy of the database has caught up to the state the senior peer's copy was in when the barrier was requested.  Reads done
+     * from within ReadBarrierPassed() will therefore observe every update the senior peer had committed before this call, which gives
+     * linearizable reads from any peer without having to send the reads themselves to the senior peer.
+     * @param whichDatabase the index of the database to set up the read barrier on
+     * @param optRetBarrierID if non-NULL, the ID of the new read barrier will be written here on success.  Barrier IDs are unique only within this peer.
+     * @param probeSeniorPeer if true (the default), a small unicast probe is sent to the senior peer to learn its current database-state ID.
+     *                        If false, the senior peer's database-state ID from its most recent beacon is used instead, which saves a round
+     *                        trip but may miss updates the senior peer committed since that beacon was sent.
+     * @returns B_NO_ERROR if the read barrier was set up, or an error code on failure.
+     */
+   status_t RequestReadBarrier(uint32 whichDatabase, uint64 * optRetBarrierID = NULL, bool probeSeniorPeer = true);
+
+   /** Called when a read barrier set up by RequestReadBarrier() has been passed.  Default implementation is a no-op.
+     * @param whichDatabase the index of the database the read barrier was for
+     * @param barrierID the ID that RequestReadBarrier() returned for the barrier
+     * @param databaseStateID the current database-state ID of our local database
+     * @note if the senior peer goes away before answering a probe, this method may never be called for that barrier.
+     */
+   virtual void ReadBarrierPassed(uint32 whichDatabase, uint64 barrierID, uint64 databaseStateID) {(void) whichDatabase; (void) barrierID; (void) databaseStateID;}
+
+   /** Called instead of ReadBarrierPassed() if the database's senior peer fails over before this peer's local database has reached the
+     * barrier's target state, or if the probed peer turns out not to be the senior peer any more (and we don't know of a different
+     * senior peer to ask instead).  The barrier's target can't be known or waited for in those cases, so call RequestReadBarrier()
+     * again if you still need the barrier.  Default implementation is a no-op.
+     * @param whichDatabase the index of the database the read barrier was for
+     * @param barrierID the ID that RequestReadBarrier() returned for the barrier
+     */
+   virtual void ReadBarrierLost(uint32 whichDatabase, uint64 barrierID) {(void) whichDatabase; (void) barrierID;}
 
    /** This method will be called when a message is sent to us by another peer.
      * A subclass may override this method to catch any user-defined Messages that other
@@ -321,6 +418,71 @@ protected:
      */
    void PrintDatabaseUpdateLog(int32 whichDatabase = -1) const;
 
+   /** Prints the latency histograms of the specified database(s) to stdout.  Only useful if latency tracing is enabled.
+     * @param whichDatabase Index of the database to print out the histograms of, or leave set to -1 to print out the histograms of all databases.
+     * @see ZGPeerSettings::SetLatencyTracingEnabled()
+     */
+   void PrintDatabaseLatencyHistograms(int32 whichDatabase = -1) const;
+
+   /** Returns a pointer to the histogram of the latencies of the specified stage of the specified database's updates,
+     * as measured on this peer, or NULL if either argument is out of range.  The histograms are only populated if latency
+     * tracing is enabled; note that some stages are measured only on the senior peer, and others only on the junior peers.
+     * @param whichDatabase Index of the database to get a histogram of
+     * @param whichStage a ZG_LATENCY_STAGE_* value
+     * @see ZGPeerSettings::SetLatencyTracingEnabled()
+     */
+   MUSCLE_NODISCARD const ZGLatencyHistogram * GetDatabaseLatencyHistogram(uint32 whichDatabase, uint32 whichStage) const;
+
+   /** Removes all samples from the latency histograms of the specified database(s).
+     * @param whichDatabase Index of the database whose histograms should be cleared, or leave set to -1 to clear the histograms of all databases.
+     */
+   void ClearDatabaseLatencyHistograms(int32 whichDatabase = -1);
+
+   /** Returns how far behind the senior peer's copy of the specified database the specified junior peer's copy is,
+     * measured in database-states (i.e. updates), according to the junior peer's most recent report.  Junior peers report their
+     * database-states to the senior peer via unicast whenever they change (but no more than ten times per second), so this
+     * information is only available on the senior peer.
+     * @param whichDatabase Index of the database to get the lag of
+     * @param juniorPeerID ID of the junior peer to get the lag of
+     * @returns the junior peer's lag, or (uint64)-1 if we aren't the senior peer or haven't received a report from that peer.
+     */
+   MUSCLE_NODISCARD uint64 GetJuniorPeerDatabaseLag(uint32 whichDatabase, const ZGPeerID & juniorPeerID) const;
+
+   /** Computes the minimum, maximum and mean lag (measured in database-states, as with GetJuniorPeerDatabaseLag())
+     * of all the junior peers that have reported their state of the specified database to us.  Only useful on the senior peer.
+     * @param whichDatabase Index of the database to get the lag statistics of
+     * @param retMinLag on return, the smallest lag of any reporting junior peer is written here
+     * @param retMaxLag on return, the largest lag of any reporting junior peer is written here
+     * @param retMeanLag on return, the mean lag of the reporting junior peers is written here
+     * @returns the number of junior peers that have reported their state.  If zero, the returned lags are all zero.
+     */
+   uint32 GetDatabaseReplicationLag(uint32 whichDatabase, uint64 & retMinLag, uint64 & retMaxLag, double & retMeanLag) const;
+
+   /** Returns the number of additional update-requests the specified database can currently accept before admission control
+     * (see ZGPeerSettings::SetAdmissionControlParametersForDatabase()) will start holding them back.  On the senior peer this is computed
+     * from the current junior-peer lag and multicast backlog (minus any requests already being held back); on a junior peer it is the value
+     * the senior peer advertised in its most recent beacon, so it may be slightly out of date.  Producers can poll this to throttle themselves.
+     * @param whichDatabase Index of the database to get the headroom of
+     * @returns the update-headroom, or (uint64)-1 if admission control is disabled for that database (or no limit currently applies).
+     */
+   MUSCLE_NODISCARD uint64 GetDatabaseUpdateHeadroom(uint32 whichDatabase) const;
+
+   /** Returns a Message containing this peer's replication-health counters, which can help diagnose throughput problems.
+     * The top-level int64 fields are the network-level counters:  "multicast_bytes_sent", "multicast_bytes_received",
+     * "multicast_duplicates" (multicast Messages dropped because we'd already received them), "unicast_bytes_sent",
+     * "unicast_bytes_received", "backorders_served" and "full_resends_served" (the last two count requests from junior peers).
+     * The "databases" field holds one sub-Message per database (in index order), each with an int32 "database" index,
+     * int64 "state_id", "backorders_requested", "full_resends", "checksum_mismatches", "log_trims", "stale_updates"
+     * (conditional updates rejected by this peer as the senior peer) and "log_bytes" fields,
+     * an int32 "log_depth" field (the number of updates currently in its update-log), a double "log_depth_mean" field, and
+     * (as computed by GetDatabaseReplicationLag()) an int32 "juniors_reporting" field, int64 "junior_lag_min" and "junior_lag_max"
+     * fields, a double "junior_lag_mean" field, an int64 "update_headroom" field (as returned by GetDatabaseUpdateHeadroom()),
+     * and an int32 "delayed_updates" field (the number of update-requests currently being held back by admission control).
+     * All counters are cumulative since this session was created.
+     * @returns a reference to the new Message on success, or an error code on failure.
+     */
+   MUSCLE_NODISCARD MessageRef GetReplicationStatistics() const;
+
    /** From the IDiscoveryServerSessionController API:  Given an incoming discovery-ping, returns a
      * useful output discovery-pong to go back to the client.
      * @param pingMsg containing the incoming ping
@@ -359,8 +521,10 @@ protected:
 private:
    void ScheduleSetBeaconData();
    void ShutdownChildSessions();
-   status_t SendRequestToSeniorPeer(uint32 whichDatabase, uint32 whatCode, const ConstMessageRef & userMsg);
+   status_t SendRequestToSeniorPeer(uint32 whichDatabase, uint32 whatCode, const ConstMessageRef & userMsg, uint64 ticketID = 0, const uint64 * optExpectedStateID = NULL);
+   status_t RequestUpdateDatabaseStateAux(uint32 whichDatabase, const MessageRef & databaseUpdateMsg, const uint64 * optExpectedStateID, uint64 * optRetTicketID);
    status_t HandleDatabaseUpdateRequest(const ZGPeerID & fromPeerID, const ConstMessageRef & msg, bool isMessageMeantForSeniorPeer);
+   status_t ForwardRequestToDatabaseSeniorPeer(const ZGPeerID & fromPeerID, uint32 whichDatabase, const ConstMessageRef & msg);
    status_t SendDatabaseUpdateViaMulticast(const zg_private::ConstPZGDatabaseUpdateRef  & dbUp);
    status_t RequestBackOrderFromSeniorPeer(const zg_private::PZGUpdateBackOrderKey & ubok, bool dueToChecksumError);
    zg_private::ConstPZGBeaconDataRef GetNewSeniorBeaconData() const;
@@ -368,17 +532,34 @@ private:
    status_t SendUnicastInternalMessageToPeer(const ZGPeerID & destinationPeerID, const ConstMessageRef & msg);
    status_t SendMulticastInternalMessageToAllPeers(const ConstMessageRef & internalMsg);
    void VerifyOrFixLocalDatabaseChecksum(uint32 whichDB);
+   void JuniorDatabaseStateChanged();  // called by our PZGDatabaseStates when their local database-state ID has advanced
+   MUSCLE_NODISCARD bool IsJuniorDatabaseStatesReportReady() const;
+   void SetDatabaseSeniorPeerIDs(const Queue<ZGPeerID> & newDatabaseSeniorPeerIDs, const ZGPeerID & handoffFromPeerID = ZGPeerID());
+   void GetRemoteDatabaseSeniorPeerIDs(Hashtable<ZGPeerID, Void> & retPeerIDs) const;
+   MUSCLE_NODISCARD bool IAmTheSeniorPeerOfAnyDatabase() const;
+   MUSCLE_NODISCARD ZGPeerID GetPreferredDatabaseSeniorPeerID(uint32 whichDB) const;
+   void CheckDatabaseSeniorHandoffs();
+   void UpdateDatabaseSeniorPeerIDsFromBeacon(const ZGPeerID & sourcePeerID, const Queue<ZGPeerID> & beaconSeniorPeerIDs);
+   void ReportJuniorDatabaseStatesToSeniorPeer(uint64 now);
+   MUSCLE_NODISCARD uint32 GetMulticastBacklog() const;
+   void ReportUpdateTicketCommitted(const ZGPeerID & requesterID, uint32 whichDatabase, uint64 ticketID, uint32 updateResult, uint64 databaseStateID);
+   status_t SendReadBarrierMessage(const ZGPeerID & destinationPeerID, uint32 whatCode, uint32 whichDatabase, uint64 barrierID, uint64 databaseStateID, bool isNotSeniorReply = false);
 
    // These methods are called from the PZGNetworkIOSession code
    void PrivateMessageReceivedFromPeer(const ZGPeerID & peerID, const MessageRef & msg);
-   void BeaconDataChanged(const zg_private::ConstPZGBeaconDataRef & beaconData);
-   void BackOrderResultReceived(const zg_private::PZGUpdateBackOrderKey & ubok, const zg_private::ConstPZGDatabaseUpdateRef & optUpdateData);
-   zg_private::ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint32 whichDatabase, uint64 updateID) const;
+   void BeaconDataChanged(const ZGPeerID & sourcePeerID, const zg_private::ConstPZGBeaconDataRef & beaconData);
+   void OrderedFullPeersListChanged(const Queue<ZGPeerID> & orderedFullPeerIDs);
+   void BackOrderResultReceived(const zg_private::PZGUpdateBackOrderKey & ubok, const zg_private::ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply);
+   zg_private::ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint32 whichDatabase, uint64 updateID, bool * optRetReadFromDisk = NULL) const;
+   zg_private::PZGDatabaseStateInfo GetLocalDatabaseStateInfo(uint32 whichDatabase) const;
 
    const ZGPeerSettings _peerSettings;
 
    const ZGPeerID _localPeerID;
    ZGPeerID _seniorPeerID;
+   Queue<ZGPeerID> _databaseSeniorPeerIDs;  // database index -> that database's senior peer (all the same as _seniorPeerID, unless per-database senior peers are enabled)
+   Queue<ZGPeerID> _orderedFullPeerIDs;     // the online full peers, most-senior first
+   Hashtable<uint32, ZGPeerID> _unconfirmedDatabaseHandoffs;  // database index -> peer we handed it off to, until that peer's beacon shows it has taken over
 
    AbstractReflectSessionRef _networkIOSession;
    bool _iAmFullyAttached;
@@ -388,8 +569,13 @@ private:
    friend class zg_private::PZGNetworkIOSession;
 #endif
 
+   zg_private::PZGDurableLog _durableLog;  // must be declared before _databases, since they keep a pointer to it
    Queue<zg_private::PZGDatabaseState> _databases;
    bool _setBeaconDataPending;
+   bool _juniorDatabaseStatesReportPending;     // true iff our database-state IDs have changed since our last PZG_PEER_COMMAND_JUNIOR_DATABASE_STATES report
+   uint64 _nextJuniorDatabaseStatesReportTime;  // we won't send another PZG_PEER_COMMAND_JUNIOR_DATABASE_STATES report before this time
+   uint64 _lastUpdateTicketID;                  // the ticket ID most recently returned by RequestUpdateDatabaseState()
+   uint64 _lastReadBarrierID;                   // the barrier ID most recently returned by RequestReadBarrier()
 
    Hashtable<ZGPeerID, ConstMessageRef> _onlinePeers;
 };
@@ -40,7 +40,9 @@ public:
      * @param numDatabases The number of replicated databases this system should maintain.
      * @param systemIsOnLocalhostOnly If true, we'll send/receive multicast packets on loopback interfaces only.  If false, we'll use all interfaces.
      * @param peerType One of the PEER_TYPE_* values.  Defaults to PEER_TYPE_FULL_PEER, meaning that this peer is willing to handle
-     *                 both junior-peer and senior-peer duties, if necessary.
+     *                 both junior-peer and senior-peer duties, if necessary.  Specify PEER_TYPE_JUNIOR_ONLY for a read-replica
+     *                 peer that will never become the senior peer; junior-only peers send slimmer heartbeats, take no part in
+     *                 senior-peer election, and aren't listed in the full peers' heartbeats, so adding them is cheap.
      */
    ZGPeerSettings(const String & signature, const String & systemName, uint8 numDatabases, bool systemIsOnLocalhostOnly, uint16 peerType = PEER_TYPE_FULL_PEER)
       : _signature(signature)
@@ -54,6 +56,12 @@ public:
       , _maxMissingHeartbeats(4)
       , _beaconsPerSecond(4)
       , _multicastBehavior(ZG_MULTICAST_BEHAVIOR_AUTO)
+      , _durableSnapshotInterval(10000)
+      , _multicastPacingBytesPerSecond(0)
+      , _multicastPacingBurstBytes(64*1024)
+      , _multicastFECGroupSize(0)
+      , _latencyTracingEnabled(false)
+      , _perDatabaseSeniorPeersEnabled(false)
       , _outgoingHeartbeatPacketIDCounter(0)
    {
       // empty
@@ -76,7 +84,7 @@ public:
      */
    MUSCLE_NODISCARD const ConstMessageRef & GetPeerAttributes() const {return _optPeerAttributes;}
 
-   /** Returns the PEER_TYPE_* value of this peer (currently only PEER_TYPE_FULL_PEER is supported) */
+   /** Returns the PEER_TYPE_* value of this peer (as specified in our constructor) */
    MUSCLE_NODISCARD uint16 GetPeerType()                        const {return _peerType;}
 
    /** Returns the heartbeats-per-second value for htis peer (currently defaults to 6) */
@@ -169,6 +177,215 @@ public:
      */
    MUSCLE_NODISCARD uint64 GetMaximumUpdateLogSizeForDatabase(uint32 whichDB) const {return _maxUpdateLogSizeBytes.GetWithDefault(whichDB, 2*1024*1024);}
 
+   /** Call this to enable adaptive update-log sizing for the specified database.  In adaptive mode, the junior peers
+     * periodically report their current database-state IDs to the senior peer, and the senior peer trims its update-log
+     * down to (minNumBytes) whenever all of the junior peers already have the updates being trimmed, while retaining up to
+     * the limit specified by SetMaximumUpdateLogSizeForDatabase() whenever any junior peer is lagging behind (so that the
+     * lagging peer can catch up via back-orders rather than having to request a full-database resend).
+     * Adaptive mode is disabled by default.  All peers in the system should specify the same adaptive-sizing parameters.
+     * @param whichDB The database you want to enable or disable adaptive update-log sizing for
+     * @param minNumBytes The number of bytes of update-log the senior peer should retain even when no junior peer needs them
+     *                    (e.g. to serve peers that have only just come online).  If set to 0, adaptive mode will be disabled.
+     */
+   void SetAdaptiveUpdateLogSizingForDatabase(uint32 whichDB, uint64 minNumBytes) {(void) _minUpdateLogSizeBytes.PutOrRemove(whichDB, minNumBytes);}
+
+   /** Returns the minimum update-log size specified for the given database via SetAdaptiveUpdateLogSizingForDatabase(),
+     * or 0 if adaptive update-log sizing isn't enabled for that database.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD uint64 GetMinimumUpdateLogSizeForDatabase(uint32 whichDB) const {return _minUpdateLogSizeBytes.GetWithDefault(whichDB, 0);}
+
+   /** Returns true iff adaptive update-log sizing has been enabled for any of our databases */
+   MUSCLE_NODISCARD bool IsAdaptiveUpdateLogSizingEnabled() const {return _minUpdateLogSizeBytes.HasItems();}
+
+   /** Call this to control how the specified database's update-log entries are stored in RAM.  Update-payloads are always
+     * zlib-compressed (since that's the form they are sent over the network in), and their compressed size is what counts against
+     * the limit set by SetMaximumUpdateLogSizeForDatabase().  By default, however, an update-log entry may also hold on to its
+     * uncompressed payload Message (e.g. on the senior peer, which created it), so the update-log's actual RAM usage can be many times
+     * its nominal size.  In compressed-update-log mode, update-log entries retain only their compressed payloads, and inflate them
+     * temporarily when they need to be executed or examined, so that the same RAM budget holds many times more update-history.
+     * @param whichDB The database you want to specify update-log compression parameters for
+     * @param keepCompressed If true, the database's update-log entries will be kept in compressed form only.  Default is false.
+     * @param compressionLevel The zlib compression level (0-9) the senior peer should use when compressing this database's
+     *                         update-payloads.  Lower levels are faster; higher levels give smaller payloads.  Default is 9.
+     */
+   void SetUpdateLogCompressionForDatabase(uint32 whichDB, bool keepCompressed, uint32 compressionLevel = 9)
+   {
+      (void) _compressedUpdateLogs.PutOrRemove(whichDB, keepCompressed);
+      (void) _payloadCompressionLevels.Put(whichDB, muscleMin(compressionLevel, (uint32)9));
+   }
+
+   /** Returns true iff the specified database's update-log entries should be kept in compressed form only.  Default is false.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD bool IsUpdateLogCompressedForDatabase(uint32 whichDB) const {return _compressedUpdateLogs.GetWithDefault(whichDB, false);}
+
+   /** Returns the zlib compression level (0-9) that should be used to compress the specified database's update-payloads.  Default is 9.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD uint32 GetPayloadCompressionLevelForDatabase(uint32 whichDB) const {return _payloadCompressionLevels.GetWithDefault(whichDB, 9);}
+
+   /** Call this to enable group-commit mode for the specified database.  In group-commit mode, the senior peer
+     * will hold on to incoming database-update requests for up to (maxAddedLatencyMicros) microseconds (or until
+     * (maxBatchSize) requests have been gathered, whichever comes first) and then execute them all together,
+     * producing a single database-update (and a single update-log entry and a single multicast transmission)
+     * for the whole batch.  This greatly reduces per-update overhead when many small updates are being requested.
+     * Group-commit mode is disabled by default.  Note that when group-commit mode is enabled, one database-state-ID
+     * may encompass more than one call to SeniorUpdateLocalDatabase(), so code that depends on a one-to-one
+     * correspondence between updates and state IDs (e.g. the UndoStackMessageTreeDatabaseObject class) should not be used with it.
+     * Likewise, a batched database-update records only the ID of the peer that requested the batch's first update as its source
+     * (each requester still gets its own commit report for its own ticket, if it asked for one).
+     * All peers in the system should specify the same group-commit parameters.
+     * @param whichDB The database you want to specify group-commit parameters for
+     * @param maxBatchSize The maximum number of update-requests to coalesce into a single database-update.
+     *                     If set to 0 or 1, group-commit mode will be disabled for that database.
+     * @param maxAddedLatencyMicros The maximum number of microseconds an update-request may be delayed in order to be batched
+     *                              together with subsequent update-requests.  If set to 0, only the update-requests that arrive
+     *                              during the same event-loop iteration will be batched together.
+     */
+   void SetGroupCommitParametersForDatabase(uint32 whichDB, uint32 maxBatchSize, uint64 maxAddedLatencyMicros)
+   {
+      (void) _groupCommitMaxBatchSizes.PutOrRemove(whichDB, (maxBatchSize > 1) ? maxBatchSize : 0);
+      (void) _groupCommitMaxAddedLatencies.PutOrRemove(whichDB, (maxBatchSize > 1) ? maxAddedLatencyMicros : 0);
+   }
+
+   /** Returns the maximum number of update-requests that may be coalesced into a single database-update for the specified database.
+     * A return value of 1 indicates that group-commit mode is disabled for that database (which is the default).
+     * @param whichDB The database you want to retrieve the group-commit batch size for
+     */
+   MUSCLE_NODISCARD uint32 GetGroupCommitMaxBatchSizeForDatabase(uint32 whichDB) const {return _groupCommitMaxBatchSizes.GetWithDefault(whichDB, 1);}
+
+   /** Returns the maximum number of microseconds that an update-request may be delayed in order to batch it together with others.
+     * @param whichDB The database you want to retrieve the group-commit latency limit for
+     */
+   MUSCLE_NODISCARD uint64 GetGroupCommitMaxAddedLatencyForDatabase(uint32 whichDB) const {return _groupCommitMaxAddedLatencies.GetWithDefault(whichDB, 0);}
+
+   /** Call this to enable admission control (writer back-pressure) for the specified database.  When enabled, the senior peer
+     * computes an update-headroom value (see ZGPeerSession::GetDatabaseUpdateHeadroom()) from the lag of the slowest junior peer
+     * and from the number of database-updates still waiting to be sent via multicast.  When the headroom reaches zero, the senior
+     * peer holds on to any further incoming update-requests (requested via ZGPeerSession::RequestUpdateDatabaseState()) until the
+     * headroom has recovered, so that junior peers can catch up before they fall off the end of the update-log and need full resends.
+     * (Junior peers that have already fallen off the end of the update-log aren't counted, since holding back requests won't help them,
+     * and if too many requests are already being held back, further ones are rejected, with DatabaseUpdateCommitted() reporting B_REPLICATION_BUSY)
+     * In reject mode, RequestUpdateDatabaseState() will additionally return B_REPLICATION_BUSY (rather than sending the request)
+     * whenever the most recently advertised headroom is zero, so that the calling code can throttle itself.
+     * Admission control is disabled by default.  All peers in the system should specify the same admission-control parameters.
+     * @param whichDB The database you want to specify admission-control parameters for
+     * @param maxJuniorLag The maximum number of database-states any junior peer may lag behind the senior peer before new
+     *                     update-requests are held back.  If set to 0, junior-peer lag will not be considered.
+     * @param maxMulticastBacklog The maximum number of database-updates that may be waiting to be sent via multicast (e.g. because
+     *                            of multicast pacing) before new update-requests are held back.  If set to 0, the backlog will not be considered.
+     * @param rejectWhenBusy If true, RequestUpdateDatabaseState() will return B_REPLICATION_BUSY when there is no headroom.  Defaults to false.
+     */
+   void SetAdmissionControlParametersForDatabase(uint32 whichDB, uint64 maxJuniorLag, uint32 maxMulticastBacklog, bool rejectWhenBusy = false)
+   {
+      (void) _admissionControlMaxJuniorLags.PutOrRemove(whichDB, maxJuniorLag);
+      (void) _admissionControlMaxMulticastBacklogs.PutOrRemove(whichDB, maxMulticastBacklog);
+      (void) _admissionControlRejectWhenBusy.PutOrRemove(whichDB, rejectWhenBusy);
+   }
+
+   /** Returns the maximum junior-peer lag specified for the given database via SetAdmissionControlParametersForDatabase(), or 0 if none was specified.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD uint64 GetAdmissionControlMaxJuniorLagForDatabase(uint32 whichDB) const {return _admissionControlMaxJuniorLags.GetWithDefault(whichDB, 0);}
+
+   /** Returns the maximum multicast backlog specified for the given database via SetAdmissionControlParametersForDatabase(), or 0 if none was specified.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD uint32 GetAdmissionControlMaxMulticastBacklogForDatabase(uint32 whichDB) const {return _admissionControlMaxMulticastBacklogs.GetWithDefault(whichDB, 0);}
+
+   /** Returns true iff RequestUpdateDatabaseState() should return B_REPLICATION_BUSY when the given database has no update-headroom.
+     * @param whichDB The database you want to know about
+     */
+   MUSCLE_NODISCARD bool IsAdmissionControlRejectModeForDatabase(uint32 whichDB) const {return _admissionControlRejectWhenBusy.GetWithDefault(whichDB, false);}
+
+   /** Call this to enable durable storage of this peer's databases.  When enabled, each database's state is periodically
+     * saved to a snapshot file in the specified directory, and every database-update executed after the snapshot is appended
+     * to a log file there as well (all file-writing is done by a separate thread).  When the peer is restarted, it will restore
+     * each database from those files, so that a restarted system can resume from its last durable state rather than from the
+     * default state.  The senior peer will also use the logged updates to satisfy junior peers' back-order requests for
+     * updates that are too old to still be in its in-memory update-log.  Default is an empty string (i.e. durable storage is disabled).
+     * @param dirPath Path to the directory to store the files in.  Each peer on a host must be given its own directory.
+     */
+   void SetDurableStorageDirectory(const String & dirPath) {_durableStorageDir = dirPath;}
+
+   /** Returns the directory path that was previously passed to SetDurableStorageDirectory(), or an empty String if durable storage is disabled. */
+   MUSCLE_NODISCARD const String & GetDurableStorageDirectory() const {return _durableStorageDir;}
+
+   /** Sets the number of database-updates that may be appended to a database's log file before a new snapshot of the database is saved.
+     * Smaller values mean faster restarts and less disk usage; larger values mean less work for the main thread (which has to
+     * call SaveLocalDatabaseToMessage() to create each snapshot) and more history available for back-orders.  Default value is 10000.
+     * @param numUpdates The number of updates per snapshot.  If set to 0, we'll act as if it was set to 1.
+     */
+   void SetDurableSnapshotInterval(uint32 numUpdates) {_durableSnapshotInterval = muscleMax(numUpdates, (uint32)1);}
+
+   /** Returns the number of database-updates that may be logged between snapshots (as specified by SetDurableSnapshotInterval()) */
+   MUSCLE_NODISCARD uint32 GetDurableSnapshotInterval() const {return _durableSnapshotInterval;}
+
+   /** Call this to enable pacing of the senior peer's outgoing multicast database-update traffic.  When enabled, outgoing
+     * database-updates are sent through a token-bucket rate-limiter rather than all at once, so that a large burst of updates
+     * won't overflow the network switch's or the junior peers' socket buffers (which would otherwise lead to lost packets,
+     * back-orders, and possibly full-database resends).  The pacer also backs off automatically whenever junior peers
+     * request back-orders (which indicates that they lost some multicast packets), and then gradually recovers to the specified rate.
+     * Pacing is disabled by default.
+     * @param maxBytesPerSecond The maximum long-term rate at which to send database-update data, in bytes per second, or 0 to disable pacing.
+     * @param maxBurstBytes The maximum number of bytes that may be sent back-to-back after an idle period.  Defaults to 64KB.
+     */
+   void SetMulticastPacingParameters(uint64 maxBytesPerSecond, uint32 maxBurstBytes = 64*1024)
+   {
+      _multicastPacingBytesPerSecond = maxBytesPerSecond;
+      _multicastPacingBurstBytes     = muscleMax(maxBurstBytes, (uint32)1);
+   }
+
+   /** Returns the maximum multicast database-update send rate (in bytes per second) specified by SetMulticastPacingParameters(), or 0 if pacing is disabled. */
+   MUSCLE_NODISCARD uint64 GetMulticastPacingBytesPerSecond() const {return _multicastPacingBytesPerSecond;}
+
+   /** Returns the maximum multicast database-update burst size (in bytes) specified by SetMulticastPacingParameters() */
+   MUSCLE_NODISCARD uint32 GetMulticastPacingBurstBytes() const {return _multicastPacingBurstBytes;}
+
+   /** Call this to enable forward-error-correction on the multicast data channel.  When enabled, after every (groupSize)
+     * database-update (or user) Messages it sends via multicast, this peer will also send a parity Message containing the XOR
+     * of those Messages' data.  A receiving peer that missed exactly one of those Messages can then reconstruct it locally,
+     * instead of having to request a back-order from the senior peer.  This costs roughly (1/groupSize) additional bandwidth.
+     * Receivers always make use of any parity Messages they receive, so only the sending peers need to have this set.
+     * FEC is disabled by default.
+     * @param groupSize The number of data Messages per parity Message, or 0 to disable FEC.  Smaller values can recover from more
+     *                  frequent losses, but use more bandwidth.
+     */
+   void SetMulticastFECGroupSize(uint32 groupSize) {_multicastFECGroupSize = (groupSize > 1) ? groupSize : 0;}
+
+   /** Returns the number of multicast data Messages per FEC parity Message, as specified by SetMulticastFECGroupSize(), or 0 if FEC is disabled. */
+   MUSCLE_NODISCARD uint32 GetMulticastFECGroupSize() const {return _multicastFECGroupSize;}
+
+   /** Call this to enable end-to-end latency tracing of database updates.  When enabled, each database-update is stamped (in network time)
+     * when it is requested, when the senior peer executes it, when the senior peer's multicast thread sends it, when a junior peer's
+     * multicast thread receives it, and when the junior peer has finished applying it, and the intervals between those stamps are
+     * tallied into per-database latency histograms that can be retrieved via ZGPeerSession::GetDatabaseLatencyHistogram()
+     * or printed via the "print latency" text command.  Tracing adds 16 bytes to each traced update.
+     * Latency tracing is disabled by default.
+     * @param enable true to enable latency tracing on this peer, false to disable it.
+     */
+   void SetLatencyTracingEnabled(bool enable) {_latencyTracingEnabled = enable;}
+
+   /** Returns true iff latency tracing is enabled, as specified by SetLatencyTracingEnabled() */
+   MUSCLE_NODISCARD bool IsLatencyTracingEnabled() const {return _latencyTracingEnabled;}
+
+   /** Call this to give each database its own senior peer, so that the work of executing and multicasting database-updates
+     * is spread across the full peers rather than all falling on the one senior peer.  When enabled, each database's preferred
+     * senior peer is chosen from the online full peers by rendezvous hashing, so with (D) databases and (P) full peers online,
+     * each full peer is preferred for roughly D/P databases, and a peer joining or leaving only affects the databases it is (or was)
+     * preferred for.  A database's senior peer hands the database off to its preferred peer only once that peer has reported that
+     * it is fully caught up; if a database's senior peer goes offline, the system's senior peer takes the database over.  The system's senior peer
+     * (as returned by ZGPeerSession::GetSeniorPeerID()) continues to handle system-wide duties such as network-time synchronization.
+     * All peers in a system must use the same setting.  Disabled by default (i.e. the system's senior peer is senior for every database).
+     * @param enable true to enable per-database senior peers, false to disable them.
+     * @see ZGPeerSession::GetDatabaseSeniorPeerID()
+     */
+   void SetPerDatabaseSeniorPeersEnabled(bool enable) {_perDatabaseSeniorPeersEnabled = enable;}
+
+   /** Returns true iff per-database senior peers are enabled, as specified by SetPerDatabaseSeniorPeersEnabled() */
+   MUSCLE_NODISCARD bool ArePerDatabaseSeniorPeersEnabled() const {return _perDatabaseSeniorPeersEnabled;}
+
 private:
 #ifndef DOXYGEN_SHOULD_IGNORE_THIS
    friend class zg_private::PZGHeartbeatThreadState;
@@ -187,6 +404,21 @@ private:
    uint32 _beaconsPerSecond;           // how many beacon-packets we should send out per second if we are the senior peer
    uint32 _multicastBehavior;          // our ZG_MULTICAST_BEHAVIOR_* value
    Hashtable<uint32, uint64> _maxUpdateLogSizeBytes;
+   Hashtable<uint32, uint64> _minUpdateLogSizeBytes;         // database index -> minimum update-log size, for databases using adaptive update-log sizing
+   Hashtable<uint32, bool> _compressedUpdateLogs;            // database index -> true iff its update-log entries should be kept compressed-only
+   Hashtable<uint32, uint32> _payloadCompressionLevels;      // database index -> zlib compression level for its update-payloads
+   Hashtable<uint32, uint32> _groupCommitMaxBatchSizes;      // database index -> max number of update-requests per batch
+   Hashtable<uint32, uint64> _groupCommitMaxAddedLatencies;  // database index -> max microseconds an update-request may be held back
+   Hashtable<uint32, uint64> _admissionControlMaxJuniorLags;         // database index -> max junior-peer lag before update-requests are held back
+   Hashtable<uint32, uint32> _admissionControlMaxMulticastBacklogs;  // database index -> max multicast backlog before update-requests are held back
+   Hashtable<uint32, bool> _admissionControlRejectWhenBusy;          // database index -> true iff RequestUpdateDatabaseState() should return B_REPLICATION_BUSY when busy
+   String _durableStorageDir;          // if non-empty, the directory where we should store our databases' snapshots and log files
+   uint32 _durableSnapshotInterval;    // how many updates to append to a database's log file before saving a new snapshot
+   uint64 _multicastPacingBytesPerSecond;  // max rate for outgoing multicast database-updates, or 0 if pacing is disabled
+   uint32 _multicastPacingBurstBytes;      // max number of bytes of outgoing multicast database-updates to send back-to-back
+   uint32 _multicastFECGroupSize;          // number of outgoing multicast data Messages per FEC parity Message, or 0 if FEC is disabled
+   bool _latencyTracingEnabled;            // true iff we should stamp and tally the latencies of our database updates
+   bool _perDatabaseSeniorPeersEnabled;    // true iff each database should be assigned its own senior peer
    mutable uint32 _outgoingHeartbeatPacketIDCounter;
 };
 
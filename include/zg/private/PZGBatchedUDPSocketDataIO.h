@@ -0,0 +1,92 @@
+#ifndef PZGBatchedUDPSocketDataIO_h
+#define PZGBatchedUDPSocketDataIO_h
+
+#include "dataio/UDPSocketDataIO.h"
+#include "util/ByteBuffer.h"
+#include "zg/private/PZGNameSpace.h"
+
+#if defined(__linux__) && !defined(ZG_AVOID_RECVMMSG)
+# define PZG_USE_RECVMMSG 1
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <time.h>
+# ifndef MUSCLE_AVOID_IPV6
+#  define PZG_USE_SENDMMSG 1  // our batched-send code only knows how to address IPv6 sockets
+# endif
+#endif
+
+namespace zg_private
+{
+
+/** A UDPSocketDataIO that (under Linux) receives incoming packets in batches, via a single recvmmsg() call per batch,
+  * into a pre-allocated slab of packet-buffers.  Subsequent Read()/ReadFrom() calls are then served out of the slab
+  * without any further system calls, until the slab has been consumed.  Each packet's receive time is taken from the
+  * kernel's receive-timestamp for that packet (when available), so that packets at the end of a batch aren't
+  * mis-timestamped as having arrived when the batch was read.
+  * On other OS's (or if recvmmsg() isn't supported at run time), this class falls back to reading one packet per system call,
+  * exactly as UDPSocketDataIO does.  WritePackets() similarly sends a whole queue of packets with one sendmmsg() call per batch.
+  */
+class PZGBatchedUDPSocketDataIO : public UDPSocketDataIO
+{
+public:
+   /** Constructor.
+     * @param sock the non-blocking UDP socket to read from and write to
+     * @param maxPacketSize the largest packet (in bytes) we expect to receive.  Larger packets will be truncated.
+     */
+   PZGBatchedUDPSocketDataIO(const ConstSocketRef & sock, uint32 maxPacketSize = 2048);
+
+   virtual io_status_t Read(void * buffer, uint32 size) {return ReadFrom(buffer, size, _lastPacketSource);}
+   virtual io_status_t ReadFrom(void * buffer, uint32 size, IPAddressAndPort & retPacketSource);
+   MUSCLE_NODISCARD virtual const IPAddressAndPort & GetSourceOfLastReadPacket() const {return _lastPacketSource;}
+
+   /** Returns the time (in GetRunTime64() microseconds) at which the most recently read packet arrived at this host */
+   MUSCLE_NODISCARD uint64 GetLocalReceiveTimeOfLastReadPacket() const {return _lastPacketReceiveTime;}
+
+   /** Returns true iff we are currently receiving packets via recvmmsg() (false means we are using the one-packet-per-call fallback) */
+   MUSCLE_NODISCARD bool IsBatchingEnabled() const {return _batchingEnabled;}
+
+   /** Returns true iff WritePackets() will currently try to send packets via sendmmsg() (false means the caller should send them one at a time) */
+   MUSCLE_NODISCARD bool IsSendBatchingEnabled() const {return _sendBatchingEnabled;}
+
+   /** Sends packets from the head of (packets) to our packet-send-destination, using one sendmmsg() call per batch of packets.
+     * @param packets the packets to send.  Packets that were sent are removed from the head of this Queue; any that remain
+     *                should be sent later, when our socket is ready-for-write again.
+     * @returns the number of bytes sent (which may be zero, if the socket's send-buffer is full), or an error code on failure.
+     *          Returns B_UNIMPLEMENTED if batched sends aren't available (e.g. on non-Linux OS's, or for IPv4 destinations),
+     *          in which case the caller should send the packets one at a time via Write() instead.
+     */
+   io_status_t WritePackets(Queue<ConstByteBufferRef> & packets);
+
+private:
+   IPAddressAndPort _lastPacketSource;
+   uint64 _lastPacketReceiveTime;
+   bool _batchingEnabled;          // true iff we're receiving via recvmmsg()
+   bool _sendBatchingEnabled;      // true iff WritePackets() sends via sendmmsg() (tracked separately, since either call may be unsupported without the other)
+
+#ifdef PZG_USE_RECVMMSG
+   enum {PZG_MAX_PACKETS_PER_BATCH = 32};
+
+   status_t ReceiveNextBatch();
+
+   const uint32 _maxPacketSize;
+   ByteBuffer _slab;               // PZG_MAX_PACKETS_PER_BATCH packet-buffers of (_maxPacketSize) bytes each
+   uint32 _numPacketsInBatch;      // how many packets our most recent recvmmsg() call filled in
+   uint32 _nextPacketIndex;        // index of the next packet in the batch to be returned by ReadFrom()
+   uint64 _packetReceiveTimes[PZG_MAX_PACKETS_PER_BATCH];
+
+   struct mmsghdr _msgHeaders[PZG_MAX_PACKETS_PER_BATCH];
+   struct iovec _iovecs[PZG_MAX_PACKETS_PER_BATCH];
+   struct sockaddr_storage _sourceAddresses[PZG_MAX_PACKETS_PER_BATCH];
+   char _controlBufs[PZG_MAX_PACKETS_PER_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+#endif
+
+#ifdef PZG_USE_SENDMMSG
+   struct mmsghdr _sendMsgHeaders[PZG_MAX_PACKETS_PER_BATCH];
+   struct iovec _sendIovecs[PZG_MAX_PACKETS_PER_BATCH];
+#endif
+};
+DECLARE_REFTYPES(PZGBatchedUDPSocketDataIO);
+
+}  // end namespace zg_private
+
+#endif
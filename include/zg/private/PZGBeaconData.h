@@ -1,6 +1,7 @@
 #ifndef PZGBeaconData_h
 #define PZGBeaconData_h
 
+#include "zg/ZGPeerID.h"
 #include "zg/private/PZGDatabaseStateInfo.h"
 #include "util/FlatCountable.h"
 #include "util/Queue.h"
@@ -23,7 +24,7 @@ public:
 
    MUSCLE_NODISCARD virtual bool IsFixedSize()     const   {return false;}
    MUSCLE_NODISCARD virtual uint32 TypeCode()      const   {return PZG_BEACON_DATA;}
-   MUSCLE_NODISCARD virtual uint32 FlattenedSize() const   {return sizeof(uint32) + SaturatingUnsignedMultiply(_dbis.GetNumItems(),PZGDatabaseStateInfo::FlattenedSize());}
+   MUSCLE_NODISCARD virtual uint32 FlattenedSize() const   {return (2*sizeof(uint32)) + SaturatingUnsignedMultiply(_dbis.GetNumItems(),PZGDatabaseStateInfo::FlattenedSize()) + SaturatingUnsignedMultiply(_databaseSeniorPeerIDs.GetNumItems(),ZGPeerID::FlattenedSize());}
 
    virtual void Flatten(DataFlattener flat) const;
    virtual status_t Unflatten(DataUnflattener & unflat);
@@ -38,11 +39,19 @@ public:
 
    void SetDatabaseStateInfos(const Queue<PZGDatabaseStateInfo> & dbis) {_dbis = dbis;}
 
+   /** Returns the sending peer's idea of which peer is the senior peer of each database (only used when per-database
+     * senior peers are enabled; otherwise the returned Queue is empty).  This is how a database's senior peer hands
+     * the database off to another peer, and how newly-arrived peers learn which peer is the senior peer of which database.
+     */
+   MUSCLE_NODISCARD const Queue<ZGPeerID> & GetDatabaseSeniorPeerIDs() const {return _databaseSeniorPeerIDs;}
+   MUSCLE_NODISCARD Queue<ZGPeerID> & GetDatabaseSeniorPeerIDs() {return _databaseSeniorPeerIDs;}
+
    void Print(const OutputPrinter & p) const;
    MUSCLE_NODISCARD String ToString() const;
 
 private:
    Queue<PZGDatabaseStateInfo> _dbis;
+   Queue<ZGPeerID> _databaseSeniorPeerIDs;  // database index -> the sender's idea of that database's senior peer
 };
 DECLARE_REFTYPES(PZGBeaconData);
 
@@ -16,6 +16,18 @@ enum {
    PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE,   // contains a PZGDatabaseUpdate object which will handle all cases
    PZG_PEER_COMMAND_USER_MESSAGE,             // contains an arbitrary user-specified Message
    PZG_PEER_COMMAND_USER_TEXT_MESSAGE,        // eg for "all peers echo hi"
+   PZG_PEER_COMMAND_JUNIOR_DATABASE_STATES,   // junior -> senior:  the junior's current database-state IDs (for lag tracking and adaptive update-log sizing)
+   PZG_PEER_COMMAND_UPDATE_COMMITTED,         // senior -> requester:  the database-state ID produced by a ticketed update-request (or 0 if it failed)
+   PZG_PEER_COMMAND_READ_BARRIER_PROBE,       // requester -> senior:  please tell me your current database-state ID (for a read barrier)
+   PZG_PEER_COMMAND_READ_BARRIER_REPLY,       // senior -> requester:  the database-state ID the requester's read barrier must wait for
+};
+
+// Outcomes of a ticketed update-request, as reported back to the requester in a PZG_PEER_COMMAND_UPDATE_COMMITTED Message
+enum {
+   PZG_UPDATE_RESULT_COMMITTED = 0,   // the update was executed successfully
+   PZG_UPDATE_RESULT_FAILED,          // the senior peer wasn't able to execute the update
+   PZG_UPDATE_RESULT_STALE,           // the update's expected database-state ID didn't match, so it wasn't executed
+   PZG_UPDATE_RESULT_BUSY,            // admission control was already holding back too many requests, so the update was rejected
 };
 
 extern const String PZG_PEER_NAME_USER_MESSAGE;
@@ -25,6 +37,15 @@ extern const String PZG_PEER_NAME_DATABASE_UPDATE_ID;
 extern const String PZG_PEER_NAME_TEXT;
 extern const String PZG_PEER_NAME_CHECKSUM_MISMATCH;
 extern const String PZG_PEER_NAME_BACK_ORDER;
+extern const String PZG_PEER_NAME_SUBMIT_TIME;             // latency tracing:  network time at which a database-update was requested
+extern const String PZG_PEER_NAME_MULTICAST_SEND_TIME;     // latency tracing:  network time at which the senior's multicast thread sent a database-update
+extern const String PZG_PEER_NAME_MULTICAST_RECEIVE_TIME;  // latency tracing:  network time at which a junior's multicast thread received a database-update
+extern const String PZG_PEER_NAME_TICKET_ID;               // requester-assigned ID of an update-request, as returned by ZGPeerSession::RequestUpdateDatabaseState()
+extern const String PZG_PEER_NAME_READ_BARRIER_ID;         // requester-assigned ID of a read barrier, as returned by ZGPeerSession::RequestReadBarrier()
+extern const String PZG_PEER_NAME_EXPECTED_STATE_ID;       // conditional updates:  the database-state ID the senior's database must be in for the update to be executed
+extern const String PZG_PEER_NAME_UPDATE_RESULT;           // one of the PZG_UPDATE_RESULT_* values
+extern const String PZG_PEER_NAME_NOT_SENIOR;              // read-barrier replies:  set if the probed peer wasn't the database's senior peer, and so couldn't answer
+extern const String PZG_PEER_NAME_ORIGINAL_REQUESTER;      // ZGPeerID of the peer that sent an update-request that a former senior peer has forwarded on to the current one
 
 // This is a special/magic database-update-ID value that represents a request for a resend of the entire database
 #define DATABASE_UPDATE_ID_FULL_UPDATE ((uint64)-1)
@@ -1,10 +1,13 @@
 #ifndef PZGDatabaseState_h
 #define PZGDatabaseState_h
 
+#include "zg/ZGLatencyHistogram.h"
 #include "zg/private/PZGNameSpace.h"
 #include "zg/private/PZGDatabaseStateInfo.h"
 #include "zg/private/PZGDatabaseUpdate.h"
+#include "zg/private/PZGDurableLog.h"
 #include "zg/private/PZGUpdateBackOrderKey.h"
+#include "zg/private/PZGUpdateLog.h"
 #include "util/NestCount.h"
 #include "util/PulseNode.h"
 
@@ -14,6 +17,7 @@ namespace zg
 class INetworkTimeProvider;
 class ZGPeerID;
 class ZGPeerSession;
+class ZGPeerSettings;
 }
 
 namespace zg_private
@@ -25,25 +29,116 @@ class PZGDatabaseState : public PulseNode
 public:
    PZGDatabaseState();
 
-   void SetParameters(ZGPeerSession * master, uint32 whichDatabase, uint64 maxPayloadBytesInLog);
+   void SetParameters(ZGPeerSession * master, uint32 whichDatabase, const ZGPeerSettings & peerSettings, PZGDurableLog * optDurableLog);
 
    status_t HandleDatabaseUpdateRequest(const ZGPeerID & fromPeerID, const ConstMessageRef & msg, const ConstPZGDatabaseUpdateRef & optDBUp, const INetworkTimeProvider & networkTimeProvider);
 
-   MUSCLE_NODISCARD virtual uint64 GetPulseTime(const PulseArgs & args) {return muscleMin(_rescanLogPending?0:MUSCLE_TIME_NEVER, PulseNode::GetPulseTime(args));}
+   MUSCLE_NODISCARD virtual uint64 GetPulseTime(const PulseArgs & args) {return muscleMin(_rescanLogPending?0:MUSCLE_TIME_NEVER, _groupCommitFlushTime, _admissionRecheckTime, PulseNode::GetPulseTime(args));}
    virtual void Pulse(const PulseArgs & args);
 
    void PrintDatabaseStateInfo() const;
    void PrintDatabaseUpdateLog() const;
+   void PrintLatencyHistograms() const;
+   void PrintJuniorLags() const;
+
+   /** Returns our latency histogram for the specified ZG_LATENCY_STAGE_* value, or NULL if (whichStage) isn't valid. */
+   MUSCLE_NODISCARD const ZGLatencyHistogram * GetLatencyHistogram(uint32 whichStage) const {return (whichStage < NUM_ZG_LATENCY_STAGES) ? &_latencyHistograms[whichStage] : NULL;}
+
+   /** Removes all samples from our latency histograms */
+   void ClearLatencyHistograms() {for (uint32 i=0; i<NUM_ZG_LATENCY_STAGES; i++) _latencyHistograms[i].Clear();}
 
    PZGDatabaseStateInfo GetDatabaseStateInfo() const;
 
+   /** Adds this database's replication-health counters to (msg), as described in ZGPeerSession::GetReplicationStatistics(). */
+   status_t SaveReplicationStatisticsToMessage(Message & msg) const;
+
    void SeniorDatabaseStateInfoChanged(const PZGDatabaseStateInfo & seniorDBInfo);
 
+   /** Called on the senior peer when a junior peer has reported its current database-state ID (for lag tracking and adaptive update-log sizing)
+     * @param juniorPeerID the ID of the reporting junior peer
+     * @param juniorStateID the junior peer's current database-state ID for this database
+     */
+   void JuniorDatabaseStateReported(const ZGPeerID & juniorPeerID, uint64 juniorStateID);
+
+   /** Called when a junior peer has gone offline, or when we need to forget all junior peers' reported states.
+     * @param juniorPeerID the ID of the peer whose reported state we should forget, or an invalid ZGPeerID to forget all of them.
+     */
+   void ForgetJuniorDatabaseState(const ZGPeerID & juniorPeerID);
+
+   /** Returns how many database-states the specified junior peer is behind our own (senior) database-state,
+     * according to its most recent report, or (uint64)-1 if we don't have a report from that peer.
+     */
+   MUSCLE_NODISCARD uint64 GetJuniorLag(const ZGPeerID & juniorPeerID) const
+   {
+      const uint64 * juniorStateID = _juniorStateIDs.Get(juniorPeerID);
+      return juniorStateID ? ((_localDatabaseStateID > *juniorStateID) ? (_localDatabaseStateID-*juniorStateID) : 0) : (uint64)-1;
+   }
+
+   /** Returns true iff we (as this database's senior peer) can hand this database off to the specified junior peer right now without
+     * losing anything:  i.e. that peer has reported that it is fully caught up with us, and we have no update-requests waiting to be executed.
+     * @param juniorPeerID the ID of the junior peer we'd like to hand this database off to
+     */
+   MUSCLE_NODISCARD bool IsReadyForSeniorHandoffTo(const ZGPeerID & juniorPeerID) const {return ((_pendingSeniorUpdates.IsEmpty())&&(_delayedSeniorUpdateRequests.IsEmpty())&&(GetJuniorLag(juniorPeerID) == 0));}
+
+   /** Computes the minimum, maximum and mean lag (in database-states) of the junior peers that have reported their states to us.
+     * @returns the number of junior peers that have reported their states (if zero, the other values are all set to zero).
+     */
+   uint32 GetJuniorLagStatistics(uint64 & retMinLag, uint64 & retMaxLag, double & retMeanLag) const;
+
+   /** Returns true iff adaptive update-log sizing is enabled for this database */
+   MUSCLE_NODISCARD bool IsAdaptiveUpdateLogSizingEnabled() const {return (_minPayloadBytesInLog > 0);}
+
    void ScheduleLogContentsRescan();
    void RescanUpdateLogIfNecessary();
 
-   void BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData);
-   ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint64 updateID, const INetworkTimeProvider & networkTimeProvider) const;
+   /** Executes any senior-update-requests that are being held back for group-commit purposes. */
+   void FlushPendingSeniorUpdates();
+
+   /** Called on the requesting peer when the senior peer has reported the successful execution of one of our ticketed update-requests.
+     * @param ticketID the ticket ID that RequestUpdateDatabaseState() returned for the request
+     * @param databaseStateID the database-state ID the update produced
+     */
+   void UpdateTicketCommitted(uint64 ticketID, uint64 databaseStateID);
+
+   /** Called when this database's senior peer has changed.  Reports any tickets and read barriers our local database has already
+     * reached as applied/passed.  After a failover, the rest are reported as lost, since the new senior peer's database-state IDs
+     * won't necessarily match the old one's.
+     * @param isHandoff true iff the old senior peer handed the database off to the new one, in which case the new senior peer
+     *                  continues the old one's update history, and the remaining tickets and read barriers are kept.
+     */
+   void DatabaseSeniorPeerChanged(bool isHandoff);
+
+   /** Called on the requesting peer when it has learned which database-state one of its read barriers must wait for.
+     * @param barrierID the ID that RequestReadBarrier() returned for the barrier
+     * @param databaseStateID the database-state ID our local database must reach before the barrier is passed
+     */
+   void ReadBarrierTargetReceived(uint64 barrierID, uint64 databaseStateID);
+
+   /** Returns the senior peer's current database-state ID, as far as we know (i.e. our own state ID if we are the senior peer) */
+   MUSCLE_NODISCARD uint64 GetSeniorDatabaseStateID() const {return muscleMax(_seniorDatabaseStateID, _localDatabaseStateID);}
+
+   /** Returns true iff admission control is enabled for this database */
+   MUSCLE_NODISCARD bool IsAdmissionControlEnabled() const {return ((_admissionMaxJuniorLag > 0)||(_admissionMaxMulticastBacklog > 0));}
+
+   /** Returns the number of additional database-updates that may currently be requested before admission control will
+     * start holding requests back, or (uint64)-1 if admission control is disabled.  On a junior peer, this is the value
+     * advertised in the senior peer's most recent beacon.
+     */
+   MUSCLE_NODISCARD uint64 GetUpdateHeadroom() const;
+
+   /** Executes any senior-update-requests that are being held back by admission control, for as long as there is headroom to do so.
+     * @param force if true, all held-back requests are executed regardless of the current headroom.
+     */
+   void ReleaseDelayedSeniorUpdates(bool force);
+
+   /** Called when the senior peer has replied to one of our back-order requests.
+     * @param ubok the key of the back-order that was replied to
+     * @param optUpdateData the update that was sent back to us, or a NULL reference if none was.
+     * @param isFinalReply true iff this is the last call we'll get for (ubok).  Always true for non-range back-orders;
+     *                     a range back-order gets one non-final call per received update, and then a final call with no update.
+     */
+   void BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply);
+   ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint64 updateID, const INetworkTimeProvider & networkTimeProvider, bool * optRetReadFromDisk = NULL) const;
    ConstMessageRef GetDatabaseUpdatePayloadByID(uint64 updateID) const;
 
    MUSCLE_NODISCARD bool IsInJuniorDatabaseUpdateContext(uint64 * optRetSeniorNetworkTime64) const
@@ -61,16 +156,33 @@ public:
    void ResetLocalDatabaseToDefaultState();
    void VerifyOrFixLocalDatabaseChecksum();
 
+   /** Restores our local database to the state most recently saved in our PZGDurableLog (if any). */
+   status_t RestoreFromDurableLog();
+
 private:
    void RescanUpdateLog();
    status_t AddDatabaseUpdateToUpdateLog(const ConstPZGDatabaseUpdateRef & dbUp);
    void RemoveDatabaseUpdateFromUpdateLog(const ConstPZGDatabaseUpdateRef & dbUp);
    void ClearUpdateLog();
+   void TrimUpdateLogThrough(uint64 lastUpdateID);
    void SeniorUpdateCompleted(const PZGDatabaseUpdateRef & dbUp, uint64 startTime, const ConstMessageRef & payloadMsg, const INetworkTimeProvider & networkTimeProvider);
+   status_t SeniorExecuteDatabaseUpdate(const ZGPeerID & fromPeerID, uint64 submitTime, uint64 ticketID, const MessageRef & userDBUpdateMsg, const INetworkTimeProvider & networkTimeProvider);
+   void RecordDatabaseUpdateDurably(const ConstPZGDatabaseUpdateRef & dbUp);
+   void SaveDurableSnapshot();
+   status_t SeniorExecuteDatabaseUpdateBatch(uint64 submitTime, const Queue<MessageRef> & userDBUpdateMsgs, const Queue<ZGPeerID> & requesterIDs, const Queue<uint64> & ticketIDs, const INetworkTimeProvider & networkTimeProvider);
+   void AddLatencySample(uint32 whichStage, uint64 fromNetworkTime, uint64 toNetworkTime);
+   void RecordJuniorLatencySamples(const PZGDatabaseUpdate & dbUp);
 
    status_t RequestBackOrderFromSeniorPeer(const PZGUpdateBackOrderKey & ubok, bool dueToChecksumError);
+   void BackOrderRangeResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply);
+   void GetBackOrderedRanges(const ZGPeerID & targetPeerID, Hashtable<uint64, uint64> & retRanges) const;
    MUSCLE_NODISCARD uint64 GetTargetDatabaseStateID() const {return muscleMax(_updateLog.GetLastKeyWithDefault(), _seniorDatabaseStateID);}
    MUSCLE_NODISCARD bool IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(uint64 databaseUpdateID) const;
+   MUSCLE_NODISCARD bool ShouldTrimSeniorUpdateLog() const;
+   MUSCLE_NODISCARD uint64 CalculateSeniorUpdateHeadroom() const;
+   status_t SeniorAcceptDatabaseUpdate(const ZGPeerID & fromPeerID, uint64 submitTime, uint64 ticketID, uint64 expectedStateID, const MessageRef & userDBUpdateMsg, const INetworkTimeProvider & networkTimeProvider);
+   void ReportLocallyAppliedUpdateTickets();
+   void ReportPassedReadBarriers();
 
    status_t JuniorExecuteDatabaseReplace(const PZGDatabaseUpdate & dbUp);
    status_t JuniorExecuteDatabaseUpdate(const PZGDatabaseUpdate & dbUp);
@@ -82,9 +194,13 @@ private:
    ZGPeerSession * _master;
    uint32 _whichDatabase;
 
-   OrderedKeysHashtable<uint64, ConstPZGDatabaseUpdateRef> _updateLog;  // update ID -> update date, for recent updates
+   PZGUpdateLog _updateLog;          // update ID -> update data, for recent updates
    uint64 _maxPayloadBytesInLog;     // we should start trimming the log when (_totalPayloadBytesInLog > _maxPayloadBytesInLog)
+   uint64 _minPayloadBytesInLog;     // if non-zero, adaptive mode:  the senior may trim the log down to this size when no junior needs the trimmed updates
+   uint64 _maxUpdateLogGapSlots;     // if adding an update would leave more than this many empty slots in the log, we clear the log instead
    uint64 _totalPayloadBytesInLog;   // always set to be equal to the total number of message-bytes in the log
+   bool _keepUpdateLogCompressed;    // if true, our update-log entries shouldn't hold on to their inflated payload Messages
+   uint8 _payloadCompressionLevel;   // zlib level to use when compressing the payloads of the updates we create
    uint64 _totalElapsedMillisInLog;  // always set to be equal to the total milliseconds of all updates currently in the _updateLog
    uint64 _localDatabaseStateID;     // ID of the state our own local copy of the database is currently in
    uint64 _seniorDatabaseStateID;    // the senior peer's current database state ID (according to the most recent beacon packet we received from him)
@@ -96,11 +212,47 @@ private:
    bool _printDatabaseStatesComparisonOnNextReplace;  // for easier debugging
 
    Hashtable<PZGUpdateBackOrderKey, Void> _backorders;  // update-resends we have on order from the senior peer
+   Hashtable<ZGPeerID, uint64> _juniorStateIDs;         // (senior only) junior peer ID -> its most recently reported database-state ID
 
    NestCount _inJuniorDatabaseUpdate;
    NestCount _inSeniorDatabaseUpdate;
 
    uint64 _seniorUpdateTimeForJuniorUpdate;  // only meaningful when we're inside JuniorExecuteDatabaseUpdateAux()
+
+   uint32 _groupCommitMaxBatchSize;           // if greater than 1, we'll batch senior-update-requests together into a single PZGDatabaseUpdate
+   uint64 _groupCommitMaxAddedLatency;        // max number of microseconds we'll hold a senior-update-request in _pendingSeniorUpdates
+   uint64 _groupCommitFlushTime;              // when we need to call FlushPendingSeniorUpdates(), or MUSCLE_TIME_NEVER if _pendingSeniorUpdates is empty
+   Queue<MessageRef> _pendingSeniorUpdates;   // senior-update-requests that are waiting to be executed as part of the next batch
+   Queue<ZGPeerID> _pendingSeniorUpdateRequesters;  // IDs of the peers that requested the updates in _pendingSeniorUpdates
+   Queue<uint64> _pendingSeniorUpdateTickets;       // ticket IDs of the updates in _pendingSeniorUpdates (0 means no ticket)
+   uint64 _pendingSeniorUpdatesSubmitTime;    // network time at which the first update in _pendingSeniorUpdates was requested (or 0 if unknown)
+
+   uint64 _admissionMaxJuniorLag;                    // if non-zero, we'll hold back senior-update-requests while any junior peer lags by this many states
+   uint32 _admissionMaxMulticastBacklog;             // if non-zero, we'll hold back senior-update-requests while this many updates are waiting to be multicast
+   uint64 _admissionRecheckTime;                     // when we should next check whether held-back requests can be released, or MUSCLE_TIME_NEVER
+   uint64 _seniorUpdateHeadroom;                     // (junior only) the update-headroom advertised in the senior peer's most recent beacon
+   Queue<ConstMessageRef> _delayedSeniorUpdateRequests;  // senior-update-requests that admission control is holding back
+   Queue<ZGPeerID> _delayedSeniorUpdateRequesters;       // IDs of the peers that sent the requests in _delayedSeniorUpdateRequests
+
+   Hashtable<uint64, uint64> _updateTicketsAwaitingLocalApply;  // (requester) ticket ID -> committed database-state ID, for tickets we haven't applied locally yet
+   Hashtable<uint64, uint64> _readBarriersAwaitingLocalApply;   // (requester) read-barrier ID -> database-state ID our local database needs to reach
+
+   PZGDurableLog * _durableLog;               // if non-NULL, we'll store our snapshots and updates here
+   uint32 _durableSnapshotInterval;           // how many updates we'll append to (_durableLog) before saving a new snapshot
+   uint32 _updatesSinceDurableSnapshot;       // how many updates we've appended to (_durableLog) since our last snapshot
+   bool _verifyRestoredStateOnNextBeacon;     // true iff we restored our state from (_durableLog) and haven't compared it to the senior peer's yet
+
+   bool _latencyTracingEnabled;               // if true, we'll stamp our updates with trace-times and tally their latencies
+   ZGLatencyHistogram _latencyHistograms[NUM_ZG_LATENCY_STAGES];  // ZG_LATENCY_STAGE_* -> latencies of that stage
+
+   // Replication-health counters (these are only ever accessed from the main thread)
+   uint64 _numBackOrdersRequested;            // how many update-back-orders we've requested from the senior peer
+   uint64 _numFullResendsRequested;           // how many full-database-resends we've requested from the senior peer
+   uint64 _numChecksumMismatches;             // how many times our checksum didn't match the one specified by a junior update
+   uint64 _numUpdatesTrimmedFromLog;          // how many updates we've removed from the head of our update-log to stay within its memory budget
+   uint64 _numStaleUpdatesRejected;           // how many conditional update-requests we've rejected (as the senior peer) because their expected state ID didn't match
+   uint64 _updateLogDepthTotal;               // sum of our update-log's item-counts, sampled each time an update is added to it
+   uint64 _numUpdateLogDepthSamples;          // how many samples (_updateLogDepthTotal) contains
 };
 
 }  // end namespace zg_private
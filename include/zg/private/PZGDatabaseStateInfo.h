@@ -19,13 +19,13 @@ class PZGDatabaseStateInfo : public PseudoFlattenable<PZGDatabaseStateInfo>
 public:
    PZGDatabaseStateInfo();
    PZGDatabaseStateInfo(const PZGDatabaseStateInfo & stateInfo);
-   PZGDatabaseStateInfo(uint64 currentDatabaseID, uint64 oldestDatabaseIDInLog, uint32 dbChecksum);
+   PZGDatabaseStateInfo(uint64 currentDatabaseID, uint64 oldestDatabaseIDInLog, uint32 dbChecksum, uint64 updateHeadroom = (uint64)-1);
 
    PZGDatabaseStateInfo & operator=(const PZGDatabaseStateInfo & rhs);
 
    MUSCLE_NODISCARD static MUSCLE_CONSTEXPR bool IsFixedSize()     {return true;}
    MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 TypeCode()      {return PZG_DATABASE_STATE_INFO;}
-   MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 FlattenedSize() {return sizeof(_currentDatabaseStateID)+sizeof(_oldestDatabaseIDInLog)+sizeof(_dbChecksum);}
+   MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 FlattenedSize() {return sizeof(_currentDatabaseStateID)+sizeof(_oldestDatabaseIDInLog)+sizeof(_dbChecksum)+sizeof(_updateHeadroom);}
 
    void Flatten(DataFlattener flat) const;
    status_t Unflatten(DataUnflattener & unflat);
@@ -36,6 +36,7 @@ public:
    MUSCLE_NODISCARD uint64 GetCurrentDatabaseStateID() const {return _currentDatabaseStateID;}
    MUSCLE_NODISCARD uint64 GetOldestDatabaseIDInLog()  const {return _oldestDatabaseIDInLog;}
    MUSCLE_NODISCARD uint32 GetDBChecksum()             const {return _dbChecksum;}
+   MUSCLE_NODISCARD uint64 GetUpdateHeadroom()         const {return _updateHeadroom;}
 
    /** Calculates and returns a 32-bit checksum based on all the current contents of this object; not to be confused with the DBChecksum field! */
    MUSCLE_NODISCARD uint32 CalculateChecksum() const;
@@ -47,6 +48,7 @@ private:
    uint64 _currentDatabaseStateID; // ID of the state this database is currently in, on the machine that created this PZGDatabaseStateInfo
    uint64 _oldestDatabaseIDInLog;  // ID of the oldest database update that is still in the update log, on the machine that created this PZGDatabaseStateInfo
    uint32 _dbChecksum;             // 32-bit checksum computed from the current state of the database
+   uint64 _updateHeadroom;         // how many more update-requests the senior peer will currently accept without delay, or (uint64)-1 if admission control is disabled
 };
 
 }  // end namespace zg_private
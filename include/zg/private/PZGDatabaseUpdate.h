@@ -14,9 +14,14 @@ enum {
    PZG_DATABASE_UPDATE_TYPE_RESET,    // resets the database's state to its well-known default state
    PZG_DATABASE_UPDATE_TYPE_REPLACE,  // fully replaces the database's state with the state contained in the attached data
    PZG_DATABASE_UPDATE_TYPE_UPDATE,   // uses the attached data to incrementally update the database's state
+   PZG_DATABASE_UPDATE_TYPE_BATCH,    // uses each of the attached sub-Messages (in order) to incrementally update the database's state
    NUM_PZG_DATABASE_UPDATE_TYPES,     // guard value
 };
 
+enum {
+   PZG_DATABASE_UPDATE_FLAG_TRACED = (1<<0),  // the flattened update includes latency-tracing timestamps
+};
+
 /** This class represents an update (full or incremental) to an existing database. */
 class PZGDatabaseUpdate : public FlatCountable
 {
@@ -44,6 +49,13 @@ public:
    MUSCLE_NODISCARD uint32 GetPreUpdateDBChecksum()     const {return _preUpdateDBChecksum;}
    MUSCLE_NODISCARD uint32 GetPostUpdateDBChecksum()    const {return _postUpdateDBChecksum;}
 
+   // Latency-tracing timestamps, all expressed as timestamps of the GetNetworkTime64() clock, or 0 if unknown
+   MUSCLE_NODISCARD uint64 GetRequestSubmitTimeMicros()  const {return _requestSubmitTimeMicros;}
+   MUSCLE_NODISCARD uint64 GetSeniorCommitTimeMicros()   const {return _seniorCommitTimeMicros;}
+   MUSCLE_NODISCARD uint64 GetMulticastSendTimeMicros()  const {return _multicastSendTimeMicros;}
+   MUSCLE_NODISCARD uint64 GetJuniorReceiveTimeMicros()  const {return _juniorReceiveTimeMicros;}
+   MUSCLE_NODISCARD bool IsTraced() const {return ((_requestSubmitTimeMicros > 0)||(_seniorCommitTimeMicros > 0));}
+
    MUSCLE_NODISCARD const ConstMessageRef & GetPayloadBufferAsMessage() const;
    MUSCLE_NODISCARD const ConstByteBufferRef & GetPayloadBuffer() const;
 
@@ -56,7 +68,12 @@ public:
    void SetPreUpdateDBChecksum(uint32 preDBChecksum)   {_preUpdateDBChecksum     = preDBChecksum;}
    void SetSeniorElapsedTimeMillis(uint16 millis)      {_seniorElapsedTimeMillis = millis;}
    void SetPostUpdateDBChecksum(uint32 postDBChecksum) {_postUpdateDBChecksum    = postDBChecksum;}
+   void SetRequestSubmitTimeMicros(uint64 micros)      {_requestSubmitTimeMicros = micros;}
+   void SetSeniorCommitTimeMicros(uint64 micros)       {_seniorCommitTimeMicros  = micros;}
+   void SetMulticastSendTimeMicros(uint64 micros)      {_multicastSendTimeMicros = micros;}  // not part of the flattened data
+   void SetJuniorReceiveTimeMicros(uint64 micros)      {_juniorReceiveTimeMicros = micros;}  // not part of the flattened data
    void SetPayloadMessage(const ConstMessageRef & payloadMsg);
+   void SetPayloadCompressionLevel(uint8 level)        {_payloadCompressionLevel = level;}  // zlib level to use when demand-compressing the payload Message
    void UncachePayloadBufferAsMessage() const;
 
    MUSCLE_NODISCARD uint32 CalculateChecksum() const;
@@ -71,10 +88,15 @@ private:
    uint16 _databaseIndex;             // Index of the database (within this replicated-database-arena) that this update is intended for
    uint16 _seniorElapsedTimeMillis;   // how many milliseconds it took to execute this update on the senior peer
    uint64 _seniorStartTimeMicros;     // when SeniorUpdated() started executing on the senior peer, expressed as a timestamp of the GetNetworkTime64() clock
-   ZGPeerID _sourcePeerID;            // ID of the peer that requested this update
+   ZGPeerID _sourcePeerID;            // ID of the peer that requested this update (for a PZG_DATABASE_UPDATE_TYPE_BATCH update, only the peer that requested the batch's first sub-update)
    uint64 _updateID;                  // State-ID that this update will place the database into when applied.
    uint32 _preUpdateDBChecksum;       // 32-bit checksum of our database as it was before this update was applied
    uint32 _postUpdateDBChecksum;      // 32-bit checksum of our database as it was after this update was applied
+   uint8 _payloadCompressionLevel;    // zlib level used when demand-calculating _updateBuf from _updateMsg (not part of the flattened data)
+   uint64 _requestSubmitTimeMicros;   // when the update was requested (flattened only if IsTraced())
+   uint64 _seniorCommitTimeMicros;    // when the senior peer finished executing the update (flattened only if IsTraced())
+   uint64 _multicastSendTimeMicros;   // when the senior peer's multicast thread sent the update (taken from the multicast Message; not part of the flattened data)
+   uint64 _juniorReceiveTimeMicros;   // when our multicast thread received the update (taken from the multicast Message; not part of the flattened data)
 
    mutable ConstByteBufferRef _updateBuf; // demand-allocated from _updateMsg
    mutable ConstMessageRef _updateMsg;    // demand-allocated from _updateBuf
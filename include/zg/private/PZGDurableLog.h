@@ -0,0 +1,150 @@
+#ifndef PZGDurableLog_h
+#define PZGDurableLog_h
+
+#include <atomic>
+#include "system/Mutex.h"
+#include "system/Thread.h"
+#include "dataio/FileDataIO.h"
+#include "zg/private/PZGNameSpace.h"
+#include "zg/private/PZGDatabaseUpdate.h"
+
+namespace zg_private
+{
+
+enum {
+   PZG_DURABLE_LOG_COMMAND_APPEND_UPDATE = 1684824432, // 'dlap'
+   PZG_DURABLE_LOG_COMMAND_SAVE_SNAPSHOT = 1684829038, // 'dlsn'
+};
+
+enum {PZG_DURABLE_SNAPSHOT_FILE_MAGIC = 2053596275}; // 'zgds'
+
+/** Main-thread bookkeeping about one append-only log-segment file.  Each segment file holds a contiguous
+  * run of PZGDatabaseUpdates, starting with the update whose ID is one greater than the snapshot it follows.
+  */
+class PZGDurableLogSegment
+{
+public:
+   PZGDurableLogSegment() : _firstUpdateID(0), _nextRecordOffset(0) {/* empty */}
+
+   void Reset(uint64 firstUpdateID) {_firstUpdateID = firstUpdateID; _recordOffsets.Clear(); _nextRecordOffset = 0;}
+
+   MUSCLE_NODISCARD bool ContainsUpdate(uint64 updateID) const {return ((updateID >= _firstUpdateID)&&((updateID-_firstUpdateID) < _recordOffsets.GetNumItems()));}
+
+   uint64 _firstUpdateID;          // ID of the first update in this segment (also used to name the segment's file)
+   Queue<uint64> _recordOffsets;   // byte-offset of each record in the segment file, indexed by (updateID-_firstUpdateID)
+   uint64 _nextRecordOffset;       // byte-offset where the next appended record will be written
+};
+
+/** Reported by the internal thread to the main thread when it was unable to append a record to a log-segment file */
+class PZGDurableLogWriteFailure
+{
+public:
+   PZGDurableLogWriteFailure() : _segmentFirstUpdateID(0), _numRecordsWritten(0) {/* empty */}
+   PZGDurableLogWriteFailure(uint64 segmentFirstUpdateID, uint32 numRecordsWritten) : _segmentFirstUpdateID(segmentFirstUpdateID), _numRecordsWritten(numRecordsWritten) {/* empty */}
+
+   uint64 _segmentFirstUpdateID;  // which log-segment file the failure happened in
+   uint32 _numRecordsWritten;     // how many records were safely written to that file before the failure (anything after them is garbage)
+};
+
+/** This class manages an optional on-disk copy of each database's recent history, so that a restarted
+  * peer (or a whole restarted system) can resume from its last durable state instead of from the default state.
+  * Each database is stored as a snapshot file (a flattened PZGDatabaseUpdate of type PZG_DATABASE_UPDATE_TYPE_REPLACE)
+  * plus an append-only log-segment file holding the PZGDatabaseUpdates executed since that snapshot.  The log-segment
+  * that preceded the current snapshot is also kept, so that older updates can still be served to junior peers as back-orders.
+  * All file-writing is done by an internal thread, so that disk latency never stalls the main thread.
+  */
+class PZGDurableLog : private Thread
+{
+public:
+   PZGDurableLog();
+   ~PZGDurableLog();
+
+   /** Sets the directory our files will be kept in.  Must be called before Start().
+     * @param dirPath path to the directory to store our files in, or an empty string to disable durable storage.
+     * @param numDatabases how many databases we will be storing.
+     */
+   void SetParameters(const String & dirPath, uint32 numDatabases);
+
+   /** Returns true iff durable storage was enabled via SetParameters() */
+   MUSCLE_NODISCARD bool IsEnabled() const {return _dirPath.HasChars();}
+
+   /** Reads in the most recently stored state of the specified database.  Must be called before any updates
+     * or snapshots of the specified database are handed to this object.
+     * @param whichDB index of the database to read the state of
+     * @param retSnapshot on return, contains the most recent snapshot of the database, or a NULL reference if there was none.
+     * @param retUpdates on return, contains the (valid) PZGDatabaseUpdates that were logged after (retSnapshot), in order.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t LoadDatabaseState(uint32 whichDB, ConstPZGDatabaseUpdateRef & retSnapshot, Queue<ConstPZGDatabaseUpdateRef> & retUpdates);
+
+   /** Starts the internal file-writing thread. */
+   status_t Start();
+
+   /** Stops the internal file-writing thread, after it has written out everything we've handed to it so far. */
+   void Stop();
+
+   /** Hands the specified database update to the internal thread to be appended to the current log-segment.
+     * @param whichDB index of the database the update applies to
+     * @param dbUp the update to append.  Its update ID must be one greater than the most recently appended (or snapshotted) state ID.
+     * @returns B_NO_ERROR on success, or an error code on failure (in which case the caller should save a new snapshot instead).
+     *          This method also fails if the internal thread has been unable to write an earlier update of this database
+     *          to disk, since the current log-segment file is no longer usable in that case.
+     */
+   status_t AppendDatabaseUpdate(uint32 whichDB, const ConstPZGDatabaseUpdateRef & dbUp);
+
+   /** Hands the specified full-database-state to the internal thread to be saved as the database's new snapshot.
+     * Once the snapshot is safely stored, a new log-segment is started and any no-longer-needed segment files are deleted.
+     * @param whichDB index of the database to save a snapshot of
+     * @param fullStateUpdate a PZG_DATABASE_UPDATE_TYPE_REPLACE update containing the database's full state.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveSnapshot(uint32 whichDB, const ConstPZGDatabaseUpdateRef & fullStateUpdate);
+
+   /** Reads a previously-appended database update back in from disk.  Called from the main thread.
+     * @param whichDB index of the database to read the update of
+     * @param updateID the ID of the update to read
+     * @returns a reference to the update on success, or a NULL reference if it isn't available on disk.
+     */
+   ConstPZGDatabaseUpdateRef ReadDatabaseUpdate(uint32 whichDB, uint64 updateID) const;
+
+   /** Returns the ID of the oldest update of the specified database that is available via ReadDatabaseUpdate(), or ((uint64)-1) if there are none. */
+   MUSCLE_NODISCARD uint64 GetOldestAvailableUpdateID(uint32 whichDB) const;
+
+protected:
+   virtual status_t MessageReceivedFromOwner(const MessageRef & msgRef, uint32 numLeft);
+
+private:
+   String GetSnapshotFilePath(uint32 whichDB) const;
+   String GetSegmentFilePath(uint32 whichDB, uint64 firstUpdateID) const;
+   status_t ReadSegmentFile(uint32 whichDB, PZGDurableLogSegment & segment, Queue<ConstPZGDatabaseUpdateRef> * optRetUpdates) const;
+   MUSCLE_NODISCARD bool HandleWriteFailure(uint32 whichDB);
+
+   // called from within the internal thread only
+   status_t WriteSnapshotFile(uint32 whichDB, const PZGDatabaseUpdate & fullStateUpdate, uint64 prevSegmentFirstID);
+   status_t StartNewSegmentFile(uint32 whichDB, uint64 newSegmentFirstID, uint64 keepSegmentFirstID);
+   void FlushSegmentFiles();
+   void ReportWriteFailure(uint32 whichDB);
+
+   String _dirPath;
+
+   // accessed from the main thread only
+   Queue<PZGDurableLogSegment> _currentSegments;    // one per database:  the segment new updates are being appended to
+   Queue<PZGDurableLogSegment> _previousSegments;   // one per database:  the segment that preceded the current snapshot (or empty)
+
+   // accessed from the internal thread only (except within LoadDatabaseState(), before the database has any pending commands)
+   Queue<FileDataIORef> _segmentFiles;              // one per database:  the open file we append new updates to
+   Queue<uint64> _threadCurrentSegmentIDs;          // one per database:  first-update-ID of the segment file we're appending to
+   Queue<uint64> _threadPreviousSegmentIDs;         // one per database:  first-update-ID of the previous segment file, or ((uint64)-1)
+   Queue<uint32> _threadNumRecordsWritten;          // one per database:  how many records we've successfully appended to the current segment file
+   Queue<bool> _threadSegmentFailed;                // one per database:  true iff we've given up on the current segment file until the next snapshot
+   bool _filesNeedFlush;
+
+   // shared by both threads
+   Mutex _writeFailuresMutex;
+   Hashtable<uint32, PZGDurableLogWriteFailure> _writeFailures;  // database index -> write-failure the main thread hasn't handled yet (guarded by _writeFailuresMutex)
+   std::atomic<bool> _hasWriteFailures;             // true iff (_writeFailures) might be non-empty, so the main thread usually doesn't need to lock the Mutex
+};
+
+}  // end namespace zg_private
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PZGFanOutPacketDataIO_h
+#define PZGFanOutPacketDataIO_h
+
+#include "dataio/PacketDataIO.h"
+#include "util/ByteBuffer.h"
+#include "util/Queue.h"
+#include "zg/private/PZGBatchedUDPSocketDataIO.h"
+
+namespace zg_private
+{
+
+/** A write-only PacketDataIO that sends every packet written to it out via each of a set of child PacketDataIOs.
+  * Each packet is copied exactly once, into a ref-counted ByteBuffer that is then shared by all of the children's
+  * outgoing-packet queues.  That way a PacketTunnelIOGateway that uses this object as its DataIO flattens and fragments
+  * each outgoing Message only once, no matter how many network interfaces the Message is being sent on.
+  * The queued packets are transmitted by calling FlushQueuedPackets() when a child's socket is ready-for-write.
+  */
+class PZGFanOutPacketDataIO : public PacketDataIO
+{
+public:
+   /** Constructor.
+     * @param childIOs the PacketDataIOs that our packets should be sent out via (typically one per network interface)
+     */
+   PZGFanOutPacketDataIO(const Queue<PacketDataIORef> & childIOs);
+
+   virtual io_status_t Read(void *, uint32) {return B_UNIMPLEMENTED;}
+   virtual io_status_t ReadFrom(void *, uint32, IPAddressAndPort &) {return B_UNIMPLEMENTED;}
+
+   /** Enqueues a copy of the given packet to be sent by each of our child DataIOs.  Never blocks.
+     * @param buffer the packet's bytes
+     * @param size the number of bytes in the packet
+     * @returns (size) on success, or an error code on failure.
+     */
+   virtual io_status_t Write(const void * buffer, uint32 size);
+   virtual io_status_t WriteTo(const void * buffer, uint32 size, const IPAddressAndPort & packetDest);
+
+   virtual void FlushOutput() {/* empty */}
+   virtual void Shutdown() {_children.Clear();}
+
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetReadSelectSocket()  const {return GetNullSocket();}
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetWriteSelectSocket() const {return GetNullSocket();}
+
+   MUSCLE_NODISCARD virtual uint32 GetMaximumPacketSize() const;
+   MUSCLE_NODISCARD virtual const IPAddressAndPort & GetSourceOfLastReadPacket() const {return GetDefaultObjectForType<IPAddressAndPort>();}
+   MUSCLE_NODISCARD virtual const IPAddressAndPort & GetPacketSendDestination() const {return GetDefaultObjectForType<IPAddressAndPort>();}
+   virtual status_t SetPacketSendDestination(const IPAddressAndPort &) {return B_UNIMPLEMENTED;}  // each child sends to its own destination
+
+   /** Returns true iff the specified child DataIO has packets queued up that are waiting to be sent.
+     * @param childIdx index of the child DataIO (in the Queue that was passed to our constructor)
+     */
+   MUSCLE_NODISCARD bool HasQueuedPackets(uint32 childIdx) const {return ((childIdx < _children.GetNumItems())&&(_children[childIdx]._packets.HasItems()));}
+
+   /** Sends as many of the specified child DataIO's queued packets as it will currently accept.
+     * @param childIdx index of the child DataIO (in the Queue that was passed to our constructor)
+     * @returns the number of bytes sent, or an error code on failure.  On failure, all of the child's
+     *          queued packets are discarded, so that the caller won't keep retrying a send that can't succeed.
+     */
+   io_status_t FlushQueuedPackets(uint32 childIdx);
+
+   /** Returns the number of packets we've discarded because a child DataIO's outgoing-packet queue was full, or its sends failed */
+   MUSCLE_NODISCARD uint64 GetNumPacketsDropped() const {return _numPacketsDropped;}
+
+private:
+   enum {PZG_FANOUT_MAX_QUEUED_PACKETS_PER_CHILD = 8192};  // so that a stalled network interface can't use up all our memory
+
+   class PZGFanOutChild
+   {
+   public:
+      PZGFanOutChild() : _batchedIO(NULL) {/* empty */}
+      PZGFanOutChild(const PacketDataIORef & dio) : _dio(dio), _batchedIO(dynamic_cast<PZGBatchedUDPSocketDataIO *>(dio())) {/* empty */}
+
+      PacketDataIORef _dio;
+      PZGBatchedUDPSocketDataIO * _batchedIO;  // non-NULL iff (_dio) supports sending packets in batches
+      Queue<ConstByteBufferRef> _packets;      // packets that are waiting to be sent via (_dio)
+   };
+
+   void DropQueuedPackets(PZGFanOutChild & child);
+
+   Queue<PZGFanOutChild> _children;
+   uint64 _numPacketsDropped;
+};
+DECLARE_REFTYPES(PZGFanOutPacketDataIO);
+
+}  // end namespace zg_private
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PZGFullStateTransfer_h
+#define PZGFullStateTransfer_h
+
+#include "util/ByteBuffer.h"
+#include "zg/ZGPeerID.h"
+#include "zg/private/PZGNameSpace.h"
+#include "zg/private/PZGUpdateBackOrderKey.h"
+
+namespace zg_private
+{
+
+/** Identifies one particular state of one particular database, for caching purposes. */
+class PZGFullStateCacheKey
+{
+public:
+   PZGFullStateCacheKey() : _whichDatabase(0), _stateID(0), _dbChecksum(0) {/* empty */}
+   PZGFullStateCacheKey(uint32 whichDatabase, uint64 stateID, uint32 dbChecksum) : _whichDatabase(whichDatabase), _stateID(stateID), _dbChecksum(dbChecksum) {/* empty */}
+
+   MUSCLE_NODISCARD uint32 GetDatabaseIndex() const {return _whichDatabase;}
+   MUSCLE_NODISCARD uint64 GetStateID()       const {return _stateID;}
+   MUSCLE_NODISCARD uint32 GetDBChecksum()    const {return _dbChecksum;}
+
+   bool operator == (const PZGFullStateCacheKey & rhs) const {return ((_whichDatabase == rhs._whichDatabase)&&(_stateID == rhs._stateID)&&(_dbChecksum == rhs._dbChecksum));}
+   bool operator != (const PZGFullStateCacheKey & rhs) const {return !(*this==rhs);}
+
+   MUSCLE_NODISCARD uint32 HashCode() const {return (_whichDatabase*333)+CalculateHashCode(_stateID)+_dbChecksum;}
+
+private:
+   uint32 _whichDatabase;
+   uint64 _stateID;
+   uint32 _dbChecksum;
+};
+
+/** Senior-side record of one flattened full-database-state (i.e. a flattened PZG_DATABASE_UPDATE_TYPE_REPLACE PZGDatabaseUpdate)
+  * that is being streamed to one or more junior peers.  It's cached for a while after it was last requested, so that
+  * other junior peers requesting the same database-state can share it, and so that an interrupted transfer can be
+  * resumed from where it left off instead of starting over.
+  */
+class PZGFlattenedFullState
+{
+public:
+   PZGFlattenedFullState() : _transferID(0), _expirationTime(MUSCLE_TIME_NEVER) {/* empty */}
+   PZGFlattenedFullState(uint64 transferID, const ConstByteBufferRef & bytes, uint64 expirationTime) : _transferID(transferID), _bytes(bytes), _expirationTime(expirationTime) {/* empty */}
+
+   uint64 _transferID;        // unique (per senior peer) ID of this particular flattening of the database's state
+   ConstByteBufferRef _bytes; // the flattened PZGDatabaseUpdate
+   uint64 _expirationTime;    // when we can drop our reference to (_bytes)
+};
+
+/** Senior-side state of one chunked full-database-state transfer to one junior peer. */
+class PZGOutgoingFullStateTransfer
+{
+public:
+   PZGOutgoingFullStateTransfer() : _transferID(0), _numBytesSent(0), _numBytesAcked(0) {/* empty */}
+
+   MUSCLE_NODISCARD uint32 GetTotalSize() const {return _bytes() ? _bytes()->GetNumBytes() : 0;}
+
+   PZGUpdateBackOrderKey _ubok;  // the back-order that this transfer is the reply to
+   uint64 _transferID;           // ID of the PZGFlattenedFullState we are sending
+   ConstByteBufferRef _bytes;    // the flattened PZGDatabaseUpdate we are sending
+   uint32 _numBytesSent;         // how many bytes of (_bytes) we have handed to TCP so far
+   uint32 _numBytesAcked;        // how many bytes of (_bytes) the junior peer has told us it has received
+};
+
+/** Junior-side state of one partially-received full-database-state transfer.  It's kept across TCP disconnects
+  * so that, when the full-database-state is re-requested, the senior peer can resume sending where it left off.
+  */
+class PZGIncomingFullStateTransfer
+{
+public:
+   PZGIncomingFullStateTransfer() : _transferID(0), _numBytesReceived(0) {/* empty */}
+
+   MUSCLE_NODISCARD bool IsFrom(const ZGPeerID & seniorPeerID, uint64 transferID, uint32 totalSize) const {return ((_seniorPeerID == seniorPeerID)&&(_transferID == transferID)&&(_bytes.GetNumBytes() == totalSize));}
+
+   ZGPeerID _seniorPeerID;     // the senior peer who is sending us the data
+   uint64 _transferID;         // the senior peer's ID for the data
+   ByteBuffer _bytes;          // pre-allocated to the full size of the flattened PZGDatabaseUpdate
+   uint32 _numBytesReceived;   // how many bytes of (_bytes) have been received so far
+};
+
+}  // end namespace zg_private
+
+#endif
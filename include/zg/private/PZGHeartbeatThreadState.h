@@ -42,7 +42,9 @@ public:
 private:
    friend class PZGHeartbeatSession;
 
-   MUSCLE_NODISCARD bool PeersListMatchesIgnoreOrdering(const Queue<ConstPZGHeartbeatPeerInfoRef> & infoQ) const;
+   MUSCLE_NODISCARD bool PeersListMatchesIgnoreOrdering(const Queue<ConstPZGHeartbeatPeerInfoRef> & infoQ, uint32 numLocalFullPeers) const;
+   MUSCLE_NODISCARD bool IsFullPeer(const ZGPeerID & pid) const;
+   MUSCLE_NODISCARD uint32 GetNumFullPeers() const;
    MUSCLE_NODISCARD ZGPeerID GetKingmakerPeerID() const;
    MUSCLE_NODISCARD PZGHeartbeatSourceKey GetKingmakerPeerSource() const;
    MUSCLE_NODISCARD Queue<ZGPeerID> CalculateOrderedPeersList();
@@ -51,13 +53,13 @@ private:
    void ScheduleUpdateToNetworkTimeOffset() {_updateToNetworkTimeOffsetPending = true;}
    void UpdateToNetworkTimeOffset();
    status_t SendHeartbeatPackets();
-   MUSCLE_NODISCARD const ZGPeerID & GetSeniorPeerID() const {return _lastSourcesSentToMaster.GetFirstKeyWithDefault().GetPeerID();}
+   MUSCLE_NODISCARD const ZGPeerID & GetSeniorPeerID() const {return _officialSeniorPeerID;}
    MUSCLE_NODISCARD bool IAmTheSeniorPeer() const {return GetSeniorPeerID() == _hbSettings()->GetLocalPeerID();}
    MessageRef UpdateOfficialPeersList(bool forceUpdate);
    MUSCLE_NODISCARD bool IsAtLeastHalfAttached() const {return (_now >= _halfAttachedTime);}
    MUSCLE_NODISCARD bool IsFullyAttached()       const {return (_now >= _fullyAttachedTime);}
 
-   PZGHeartbeatPacketWithMetaDataRef ParseHeartbeatPacketBuffer(const ByteBuffer & defBuf, const IPAddressAndPort & sourceIAP, uint64 localReceiveTimeMicros);
+   PZGHeartbeatPacketWithMetaDataRef ParseHeartbeatPacketBuffer(const uint8 * dsb, uint32 numBytes, const IPAddressAndPort & sourceIAP, uint64 localReceiveTimeMicros);
    void IntroduceSource(const PZGHeartbeatSourceKey & source, const PZGHeartbeatPacketWithMetaDataRef & newHB, uint64 localExpirationTimeMicros);
    void ExpireSource(const PZGHeartbeatSourceKey & source);
 
@@ -89,6 +91,8 @@ private:
 
    ByteBuffer _rawScratchBuf;
    ByteBuffer _deflatedScratchBuf;
+   enum {PZG_HEARTBEAT_MAX_RECEIVE_PACKET_SIZE = 2048};
+   uint8 _receiveScratchBuf[PZG_HEARTBEAT_MAX_RECEIVE_PACKET_SIZE];  // fixed-size, so we don't have to resize a ByteBuffer for every received packet
    Hashtable<uint32, uint64> _recentlySentHeartbeatLocalSendTimes;  // hbPacket ID -> local-send-time
 
    Hashtable<PZGHeartbeatSourceKey, PZGHeartbeatSourceStateRef> _onlineSources;
@@ -98,6 +102,7 @@ private:
    bool _forceOfficialPeersUpdate;
 
    Hashtable<PZGHeartbeatSourceKey, Void> _lastSourcesSentToMaster;
+   ZGPeerID _officialSeniorPeerID;  // the most-senior full peer in (_lastSourcesSentToMaster), or an invalid ID if there are no full peers online
 
    uint16 _heartbeatSourceTagCounter;  // used to give a succinct-yet-unique ID to each heartbeat-destination we send out
    Queue<PacketDataIORef> _mdioKeys;   // used to detect when the DataIOs have changed
@@ -0,0 +1,111 @@
+#ifndef PZGMessageHandoffQueue_h
+#define PZGMessageHandoffQueue_h
+
+#include <atomic>
+#include "message/Message.h"
+#include "zg/private/PZGNameSpace.h"
+
+namespace zg_private
+{
+
+/** A lock-free single-producer/single-consumer FIFO queue of MessageRefs, used to hand Messages from a PZGThreadedSession's
+  * internal thread to the main thread without locking a mutex for each Message.  The queue is a linked list of fixed-size
+  * ring segments, so pushing a Message never blocks and never fails due to the queue being "full"; a new segment is
+  * allocated once per PZG_HANDOFF_SEGMENT_SIZE Messages, and the consumer frees each segment once it has been emptied.
+  * @note Push() must only ever be called by one thread (the producer), and Pop() by one other thread (the consumer).
+  */
+class PZGMessageHandoffQueue
+{
+public:
+   PZGMessageHandoffQueue() : _headSegment(newnothrow PZGHandoffSegment), _headIndex(0), _numPopped(0), _tailSegment(_headSegment), _tailIndex(0), _numPushed(0) {/* empty */}
+
+   ~PZGMessageHandoffQueue()
+   {
+      while(_headSegment)
+      {
+         PZGHandoffSegment * next = _headSegment->_next.load();
+         delete _headSegment;
+         _headSegment = next;
+      }
+   }
+
+   /** Appends a Message to the tail of the queue.  Must only be called by the producer thread.
+     * @param msg the Message to append
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY if a new segment couldn't be allocated.
+     */
+   status_t Push(const MessageRef & msg)
+   {
+      MRETURN_OOM_ON_NULL(_tailSegment);
+
+      if (_tailIndex == PZG_HANDOFF_SEGMENT_SIZE)
+      {
+         PZGHandoffSegment * newSegment = newnothrow PZGHandoffSegment;
+         MRETURN_OOM_ON_NULL(newSegment);
+         _tailSegment->_next.store(newSegment, std::memory_order_release);
+         _tailSegment = newSegment;
+         _tailIndex   = 0;
+      }
+
+      _tailSegment->_slots[_tailIndex++] = msg;
+      _tailSegment->_numWritten.store(_tailIndex, std::memory_order_release);  // publishes the Message to the consumer
+      _numPushed.store(_numPushed.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+      return B_NO_ERROR;
+   }
+
+   /** Removes the Message at the head of the queue.  Must only be called by the consumer thread.
+     * @param retMsg on success, the removed Message is written here
+     * @returns true on success, or false if the queue was empty.
+     */
+   bool Pop(MessageRef & retMsg)
+   {
+      if (_headSegment == NULL) return false;
+
+      if (_headIndex == PZG_HANDOFF_SEGMENT_SIZE)
+      {
+         PZGHandoffSegment * next = _headSegment->_next.load(std::memory_order_acquire);
+         if (next == NULL) return false;
+
+         delete _headSegment;  // the producer has moved on to (next), so it won't touch this segment again
+         _headSegment = next;
+         _headIndex   = 0;
+      }
+
+      if (_headIndex >= _headSegment->_numWritten.load(std::memory_order_acquire)) return false;
+
+      MessageRef & slot = _headSegment->_slots[_headIndex++];
+      retMsg = slot;
+      slot.Reset();  // so the Message doesn't stay alive until the segment gets deleted
+      _numPopped.store(_numPopped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+      return true;
+   }
+
+   /** Returns the approximate number of Messages currently in the queue (exact, if neither thread is modifying the queue) */
+   MUSCLE_NODISCARD uint32 GetNumItems() const {return (uint32) (_numPushed.load(std::memory_order_relaxed)-_numPopped.load(std::memory_order_relaxed));}
+
+private:
+   enum {PZG_HANDOFF_SEGMENT_SIZE = 256};
+
+   class PZGHandoffSegment
+   {
+   public:
+      PZGHandoffSegment() : _numWritten(0), _next(NULL) {/* empty */}
+
+      MessageRef _slots[PZG_HANDOFF_SEGMENT_SIZE];
+      std::atomic<uint32> _numWritten;            // number of (_slots) the producer has filled in so far
+      std::atomic<PZGHandoffSegment *> _next;     // set by the producer when this segment is full
+   };
+
+   // These members are accessed only by the consumer thread
+   PZGHandoffSegment * _headSegment;
+   uint32 _headIndex;
+   std::atomic<uint64> _numPopped;
+
+   // These members are accessed only by the producer thread
+   PZGHandoffSegment * _tailSegment;
+   uint32 _tailIndex;
+   std::atomic<uint64> _numPushed;
+};
+
+}  // end namespace zg_private
+
+#endif
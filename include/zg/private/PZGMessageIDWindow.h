@@ -0,0 +1,92 @@
+#ifndef PZGMessageIDWindow_h
+#define PZGMessageIDWindow_h
+
+#include "support/MuscleSupport.h"
+#include "util/Hashtable.h"
+#include "zg/ZGPeerID.h"
+#include "zg/private/PZGNameSpace.h"
+
+namespace zg_private
+{
+
+/** Sliding-window duplicate-detector for the (monotonically increasing) message IDs of the multicast Messages sent by one peer.
+  * Keeps one bit for each of the most recent PZG_MESSAGE_ID_WINDOW_SIZE message IDs, so that checking for (and recording)
+  * a message ID is O(1) and uses a fixed amount of memory, no matter how fast the Messages are arriving.
+  * Message IDs older than the window are treated as duplicates, since by then any legitimate copy has long since arrived
+  * (and a Message that really was lost will be recovered via the usual back-order mechanism anyway).
+  */
+class PZGMessageIDWindow
+{
+public:
+   PZGMessageIDWindow() : _highestMessageID(0), _hasReceivedAny(false) {memset(_bits, 0, sizeof(_bits));}
+
+   /** Records the receipt of a Message with the given message ID.
+     * @param messageID the message ID of the Message that was received
+     * @returns true if this is the first time we've seen (messageID), or false if it is a duplicate (or too old to tell).
+     */
+   bool MarkReceived(uint32 messageID)
+   {
+      if (_hasReceivedAny == false)
+      {
+         _hasReceivedAny   = true;
+         _highestMessageID = messageID;
+         SetBit(messageID);
+         return true;
+      }
+
+      const int32 delta = (int32)(messageID-_highestMessageID);  // signed, so that message-ID wraparound is handled correctly
+      if (delta > 0)
+      {
+         // Slide the window forward, clearing the bits of the message IDs that are now entering it
+         if (delta >= (int32)PZG_MESSAGE_ID_WINDOW_SIZE) memset(_bits, 0, sizeof(_bits));
+                                                    else for (int32 i=1; i<delta; i++) ClearBit(_highestMessageID+i);
+         _highestMessageID = messageID;
+         SetBit(messageID);
+         return true;
+      }
+
+      if (-delta >= (int32)PZG_MESSAGE_ID_WINDOW_SIZE) return false;  // too old to be in our window
+      if (IsBitSet(messageID)) return false;                           // duplicate
+
+      SetBit(messageID);
+      return true;
+   }
+
+private:
+   enum {PZG_MESSAGE_ID_WINDOW_SIZE = 2048};  // must be a multiple of 64
+
+   MUSCLE_NODISCARD bool IsBitSet(uint32 messageID) const {const uint32 b = messageID % PZG_MESSAGE_ID_WINDOW_SIZE; return ((_bits[b/64] & (((uint64)1)<<(b%64))) != 0);}
+   void SetBit(  uint32 messageID) {const uint32 b = messageID % PZG_MESSAGE_ID_WINDOW_SIZE; _bits[b/64] |=  (((uint64)1)<<(b%64));}
+   void ClearBit(uint32 messageID) {const uint32 b = messageID % PZG_MESSAGE_ID_WINDOW_SIZE; _bits[b/64] &= ~(((uint64)1)<<(b%64));}
+
+   uint64 _bits[PZG_MESSAGE_ID_WINDOW_SIZE/64];  // ring buffer of received-flags, indexed by (messageID % PZG_MESSAGE_ID_WINDOW_SIZE)
+   uint32 _highestMessageID;                     // the highest message ID we've received so far
+   bool _hasReceivedAny;
+};
+
+/** The maximum number of peers that MarkMulticastMessageReceived() will keep a PZGMessageIDWindow for at once */
+enum {PZG_MAX_TRACKED_MULTICAST_SOURCES = 256};
+
+/** Records the receipt of a multicast Message from the given peer, using (recentlyReceived) to keep one PZGMessageIDWindow per peer.
+  * If (sourcePeerID) isn't already in the table and the table already holds PZG_MAX_TRACKED_MULTICAST_SOURCES windows, the
+  * oldest windows are removed to make room, so that the table can't grow without bound if lots of peers come and go.
+  * @param recentlyReceived the table of per-peer windows to check and update
+  * @param sourcePeerID the ID of the peer that sent the Message
+  * @param messageID the message ID of the Message that was received
+  * @returns true if this is the first copy of that Message we've received, or false if it's a duplicate.
+  */
+static inline bool MarkMulticastMessageReceived(Hashtable<ZGPeerID, PZGMessageIDWindow> & recentlyReceived, const ZGPeerID & sourcePeerID, uint32 messageID)
+{
+   PZGMessageIDWindow * window = recentlyReceived.Get(sourcePeerID);
+   if (window == NULL)
+   {
+      while(recentlyReceived.GetNumItems() >= PZG_MAX_TRACKED_MULTICAST_SOURCES) (void) recentlyReceived.RemoveFirst();
+      window = recentlyReceived.PutAndGet(sourcePeerID);
+      if (window == NULL) return true;  // out of memory?  Better to pass on a duplicate than to drop a Message
+   }
+   return window->MarkReceived(messageID);
+}
+
+}  // end namespace zg_private
+
+#endif
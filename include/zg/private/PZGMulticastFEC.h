@@ -0,0 +1,92 @@
+#ifndef PZGMulticastFEC_h
+#define PZGMulticastFEC_h
+
+#include "message/Message.h"
+#include "util/ByteBuffer.h"
+#include "zg/ZGPeerID.h"
+#include "zg/private/PZGNameSpace.h"
+
+namespace zg_private
+{
+
+enum {PZG_MULTICAST_FEC_PARITY_MESSAGE = 1885431410}; // 'pafr' -- what-code of our multicast parity Messages
+
+/** Identifies one multicast Message sent by one peer */
+class PZGFECMessageKey
+{
+public:
+   PZGFECMessageKey() : _messageID(0) {/* empty */}
+   PZGFECMessageKey(const ZGPeerID & sourcePeerID, uint32 messageID) : _sourcePeerID(sourcePeerID), _messageID(messageID) {/* empty */}
+
+   bool operator == (const PZGFECMessageKey & rhs) const {return ((_sourcePeerID == rhs._sourcePeerID)&&(_messageID == rhs._messageID));}
+   bool operator != (const PZGFECMessageKey & rhs) const {return !(*this==rhs);}
+
+   MUSCLE_NODISCARD uint32 HashCode() const {return _sourcePeerID.HashCode()+_messageID;}
+
+private:
+   ZGPeerID _sourcePeerID;
+   uint32 _messageID;
+};
+
+/** Sender-side forward-error-correction for the multicast data channel.  For every group of (K) data Messages
+  * we send, this class produces one parity Message containing the XOR of the K Messages' flattened bytes.  A receiver
+  * that got all but one of the group's Messages (plus the parity Message) can then reconstruct the missing Message locally,
+  * instead of having to wait for the next beacon to notice the gap and then request a back-order from the senior peer.
+  * FEC is done per-Message rather than per-UDP-packet, since a Message that loses any one of its packets is lost in its entirety anyway.
+  */
+class PZGMulticastFECEncoder
+{
+public:
+   PZGMulticastFECEncoder() : _groupSize(0) {/* empty */}
+
+   /** Sets the number of data Messages per parity Message.  0 or 1 disables FEC. */
+   void SetGroupSize(uint32 groupSize) {_groupSize = (groupSize > 1) ? groupSize : 0; Reset();}
+
+   /** Returns true iff FEC is enabled */
+   MUSCLE_NODISCARD bool IsEnabled() const {return (_groupSize > 0);}
+
+   /** Must be called for each data Message we send out via multicast, in the order they are sent.
+     * @param messageID the multicast-tag ID of the Message (as seen by the receivers)
+     * @param msg the Message that is being sent
+     * @returns a parity Message to send after (msg) if (msg) completed a group, or a NULL reference otherwise.
+     */
+   MessageRef DataMessageSent(uint32 messageID, const Message & msg);
+
+private:
+   void Reset() {_messageIDs.Clear(); _messageLengths.Clear(); _parityBytes.Clear();}
+
+   uint32 _groupSize;
+   Queue<int32> _messageIDs;      // multicast-tag IDs of the Messages in the current group
+   Queue<int32> _messageLengths;  // flattened sizes of the Messages in the current group
+   ByteBuffer _parityBytes;       // XOR of the flattened Messages in the current group (zero-padded to the longest one)
+};
+
+/** Receiver-side forward-error-correction for the multicast data channel; the counterpart of PZGMulticastFECEncoder. */
+class PZGMulticastFECDecoder
+{
+public:
+   PZGMulticastFECDecoder() : _active(false) {/* empty */}
+
+   /** Must be called for each (non-duplicate) data Message we receive via multicast.  Does nothing until
+     * we've received at least one parity Message, so that there is no overhead if the sender isn't using FEC.
+     * @param key identifies the Message's sender and multicast-tag ID
+     * @param msg the received Message
+     */
+   void DataMessageReceived(const PZGFECMessageKey & key, const Message & msg);
+
+   /** Must be called for each parity Message we receive via multicast.
+     * @param sourcePeerID the peer who sent the parity Message
+     * @param parityMsg the received parity Message
+     * @returns the reconstructed data Message if exactly one of the parity group's data Messages was missing and could be rebuilt,
+     *          or a NULL reference otherwise.
+     */
+   MessageRef ParityMessageReceived(const ZGPeerID & sourcePeerID, const Message & parityMsg);
+
+private:
+   bool _active;  // set true when we receive our first parity Message
+   Hashtable<PZGFECMessageKey, ConstByteBufferRef> _recentMessages;  // flattened copies of recently-received data Messages, in LRU order
+};
+
+}  // end namespace zg_private
+
+#endif
@@ -9,7 +9,9 @@
 #include "zg/ZGPeerSettings.h"
 #include "zg/private/PZGBeaconData.h"
 #include "zg/private/PZGDatabaseUpdate.h"
+#include "zg/private/PZGFullStateTransfer.h"
 #include "zg/private/PZGThreadedSession.h"
+#include "zg/private/PZGTokenBucket.h"
 #include "zg/private/PZGUnicastSession.h"
 #include "zg/private/PZGHeartbeatSession.h"
 #include "zg/private/PZGHeartbeatSettings.h"
@@ -41,7 +43,10 @@ public:
      * @param msg Should be one of the PZG_PEER_COMMAND_* Message types.
      * @returns B_NO_ERROR on success, or an error code on failure.
      */
-   status_t SendMulticastMessageToAllPeers(const ConstMessageRef & msg) {return SendMessageToInternalThread(CastAwayConstFromRef(msg));}
+   status_t SendMulticastMessageToAllPeers(const ConstMessageRef & msg);
+
+   /** Returns the number of database-updates that have been handed to our multicast I/O thread but not yet sent (e.g. due to pacing) */
+   MUSCLE_NODISCARD uint32 GetMulticastBacklog() const {return _multicastBacklog.load();}
 
    /** Sends the specified Message to all peers via unicast/TCP.
      * @param msg Should be one of the PZG_PEER_COMMAND_* Message types.
@@ -89,15 +94,42 @@ public:
 
    MUSCLE_NODISCARD const ZGPeerID & GetLocalPeerID() const {return _localPeerID;}
 
-   ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID) const;
+   ConstPZGDatabaseUpdateRef GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID, bool * optRetReadFromDisk = NULL) const;
    void VerifyOrFixLocalDatabaseChecksum(uint32 whichDB);
 
+   /** Returns the full current state of the specified database as a flattened PZG_DATABASE_UPDATE_TYPE_REPLACE PZGDatabaseUpdate,
+     * for a PZGUnicastSession to stream to a junior peer in chunks.  Flattened states are cached for a while, so that any number of
+     * junior peers requesting the same database-state cost only a single serialization, and so that an interrupted transfer can be resumed.
+     * @param whichDB index of the database to get the full state of
+     * @param resumeTransferID if we still have the flattened state with this transfer ID, we'll return that rather than flattening a new one.
+     * @param retState on success, the flattened state is written here.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t GetFlattenedFullDatabaseState(uint32 whichDB, uint64 resumeTransferID, PZGFlattenedFullState & retState);
+
+   /** Returns a pointer to our partially-received full-state-transfer for the specified database, or NULL if there isn't one.
+     * @param whichDB index of the database to get the transfer-state of
+     * @param allocIfNecessary if true, and there is no existing transfer-state, a new (empty) one will be created and returned.
+     */
+   PZGIncomingFullStateTransfer * GetIncomingFullStateTransfer(uint32 whichDB, bool allocIfNecessary);
+
+   /** Discards our partially-received full-state-transfer for the specified database (if any) */
+   void ClearIncomingFullStateTransfer(uint32 whichDB) {(void) _incomingFullStateTransfers.Remove(whichDB);}
+
    MUSCLE_NODISCARD int64 GetToNetworkTimeOffset() const;
 
    MUSCLE_NODISCARD IPAddressAndPort GetUnicastIPAddressAndPortForPeerID(const ZGPeerID & peerID, uint32 sourceIndex=0) const;
 
    MUSCLE_NODISCARD const INetworkInterfaceFilter * GetNetworkInterfaceFilter() const;
 
+   /** Adds our network-level replication-health counters to (msg), as described in ZGPeerSession::GetReplicationStatistics(). */
+   status_t SaveReplicationStatisticsToMessage(Message & msg) const;
+
+   /** Tells our multicast I/O thread to forget the beacon data it most recently received, so that it will pass
+     * the next beacon it receives from each peer through to the main thread even if its contents haven't changed.
+     */
+   void InvalidateLastReceivedBeaconData();
+
 protected:
    virtual void InternalThreadEntry();
    virtual void MessageReceivedFromInternalThread(const MessageRef & msg, uint32 numLeft);
@@ -110,6 +142,7 @@ private:
    void PeerHasComeOnline(const ZGPeerID & peerID, const ConstMessageRef & optPeerInfo);
    void PeerHasGoneOffline(const ZGPeerID & peerID, const ConstMessageRef & optPeerInfo);
    void SeniorPeerChanged(const ZGPeerID & oldSeniorPeerID, const ZGPeerID & newSeniorPeerID);
+   void OrderedFullPeersListChanged(const Queue<ZGPeerID> & orderedFullPeerIDs);
 
    PZGUnicastSessionRef GetUnicastSessionForPeerID(const ZGPeerID & peerID, bool allocIfNecessary);
 
@@ -120,7 +153,12 @@ private:
    void UnicastMessageReceivedFromPeer(const ZGPeerID & remotePeerID, const MessageRef & msg);
    void ShutdownChildSessions();
    MUSCLE_NODISCARD bool IAmTheSeniorPeer() const {return _seniorPeerID == _localPeerID;}
-   void BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData);
+   void BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply);
+   void MulticastLossReported(uint32 whichDatabase, uint64 updateID);  // called when a junior peer requests a back-order, which implies it missed some of our multicast packets
+   MUSCLE_NODISCARD bool IsDatabaseUpdateAwaitingMulticast(uint32 whichDatabase, uint64 updateID);
+   void TrimUnsentMulticastUpdatesList();
+   void BackOrderServed(bool isFullResend) {if (isFullResend) _fullResendsServed++; else _backOrdersServed++;}
+   void UnicastBytesTransferred(uint64 numBytesSent, uint64 numBytesReceived) {_unicastBytesSent += numBytesSent; _unicastBytesReceived += numBytesReceived;}
    status_t SetupHeartbeatSession();
 
    const ZGPeerSettings _peerSettings;
@@ -138,6 +176,24 @@ private:
    ZGPeerID _seniorPeerID;
    std::atomic<bool> _computerIsAsleep;
 
+   Hashtable<PZGFullStateCacheKey, PZGFlattenedFullState> _flattenedFullStates;   // cache of recently flattened full states (senior side)
+   Hashtable<uint32, PZGIncomingFullStateTransfer> _incomingFullStateTransfers;   // database index -> partially-received full state (junior side)
+   uint64 _fullStateTransferIDCounter;
+   uint64 _nextLossReportTime;   // we won't send another PZG_NETWORK_COMMAND_MULTICAST_LOSS_REPORTED to our internal thread before this time
+
+   // Replication-health counters.  Some of these are updated by our multicast I/O thread, so they are all atomic.
+   std::atomic<uint64> _multicastBytesSent;
+   std::atomic<uint64> _multicastBytesReceived;
+   std::atomic<uint64> _multicastDuplicatesDropped;  // multicast Messages we received more than once (e.g. via multiple network interfaces)
+   std::atomic<uint64> _unicastBytesSent;
+   std::atomic<uint64> _unicastBytesReceived;
+   std::atomic<uint64> _backOrdersServed;            // update-back-order requests we've replied to (as the senior peer)
+   std::atomic<uint64> _fullResendsServed;           // full-database-resend requests we've replied to (as the senior peer)
+
+   std::atomic<uint32> _multicastBacklog;            // database-updates handed to our multicast I/O thread that it hasn't sent yet
+   Queue<uint64> _unsentMulticastUpdateIDs;          // IDs of the database-updates we most recently handed to our multicast I/O thread (oldest first; main thread only)
+   Queue<uint32> _unsentMulticastUpdateDatabases;    // database indices of the database-updates in (_unsentMulticastUpdateIDs)
+
    Mutex _hbSessionPtrMutex;
    PZGHeartbeatSession * _hbSessionPtr; // this separate pointer is maintained just so the main thread can access it without provoking the ThreadSanitizer
 };
@@ -1,8 +1,10 @@
 #ifndef PZGThreadedSession_h
 #define PZGThreadedSession_h
 
+#include <atomic>
 #include "reflector/AbstractReflectSession.h"
 #include "system/Thread.h"
+#include "zg/private/PZGMessageHandoffQueue.h"
 #include "zg/private/PZGNameSpace.h"
 
 namespace zg_private
@@ -48,6 +50,25 @@ protected:
 
    /** Must be implemented by the subclass to handle the Message that was received from the internal thread. */
    virtual void MessageReceivedFromInternalThread(const MessageRef & msgFromInternalThread, uint32 numLeft) = 0;
+
+   /** Called by the internal thread to hand a Message to the main thread.  Unlike SendMessageToOwner(), this method
+     * doesn't lock a mutex or wake up the main thread; it just appends the Message to a lock-free queue.  The main thread
+     * will be woken up (at most once per batch of Messages) by the internal thread's next call to FlushMessagesToOwner().
+     * @param msg the Message to hand to the main thread
+     * @note this method must only be called from within the internal thread.
+     */
+   status_t EnqueueMessageToOwner(const MessageRef & msg);
+
+   /** Called by the internal thread after it has enqueued a batch of Messages via EnqueueMessageToOwner().
+     * Wakes up the main thread so that it can process them, unless a previous wakeup is still pending.
+     * @note this method must only be called from within the internal thread.
+     */
+   void FlushMessagesToOwner();
+
+private:
+   PZGMessageHandoffQueue _messagesToOwner;    // Messages enqueued by the internal thread for the main thread to process
+   bool _ownerSignalNeeded;                     // accessed only by the internal thread:  true iff we've enqueued Messages since our last FlushMessagesToOwner()
+   std::atomic<bool> _ownerWakeupPending;       // true iff we've signalled the main thread, and the main thread hasn't yet started processing our Messages
 };
 
 }  // end namespace zg_private
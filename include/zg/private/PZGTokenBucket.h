@@ -0,0 +1,87 @@
+#ifndef PZGTokenBucket_h
+#define PZGTokenBucket_h
+
+#include "util/TimeUtilityFunctions.h"
+#include "zg/private/PZGNameSpace.h"
+
+namespace zg_private
+{
+
+/** Token-bucket rate-limiter used by the multicast I/O thread to pace its outgoing database-update traffic,
+  * so that a burst of updates doesn't overflow switch buffers or the junior peers' socket buffers.
+  * Tokens (bytes) accrue at the configured rate, up to the configured burst size; a Message may be sent
+  * whenever the token count is positive, and sending it subtracts its size (which may leave the count negative,
+  * so that Messages larger than the burst size can still be sent, followed by a correspondingly longer pause).
+  * The effective rate is additionally scaled down (multiplicatively) whenever packet loss is reported,
+  * and recovers (linearly) back up to the configured rate while no further loss is reported.
+  */
+class PZGTokenBucket
+{
+public:
+   PZGTokenBucket() : _bytesPerSecond(0), _burstBytes(0), _tokens(0.0), _rateScale(1.0), _lastUpdateTime(0) {/* empty */}
+
+   /** Sets our pacing parameters.
+     * @param bytesPerSecond the maximum long-term send rate, in bytes per second, or 0 to disable pacing.
+     * @param burstBytes the maximum number of bytes that may be sent back-to-back after an idle period.
+     */
+   void SetParameters(uint64 bytesPerSecond, uint32 burstBytes)
+   {
+      _bytesPerSecond = bytesPerSecond;
+      _burstBytes     = muscleMax(burstBytes, (uint32)1);
+      _tokens         = _burstBytes;
+      _rateScale      = 1.0;
+      _lastUpdateTime = GetRunTime64();
+   }
+
+   /** Returns true iff pacing is enabled */
+   MUSCLE_NODISCARD bool IsEnabled() const {return (_bytesPerSecond > 0);}
+
+   /** Adds the tokens that have accrued since our last call, and lets our rate-scale recover a bit.
+     * @param now the current time, as returned by GetRunTime64()
+     */
+   void UpdateTokens(uint64 now)
+   {
+      if (now <= _lastUpdateTime) return;
+
+      const double elapsedSeconds = ((double)(now-_lastUpdateTime))/MICROS_PER_SECOND;
+      _lastUpdateTime = now;
+      _tokens    = muscleMin(_tokens+(elapsedSeconds*GetEffectiveBytesPerSecond()), (double)_burstBytes);
+      _rateScale = muscleMin(_rateScale+(elapsedSeconds/PZG_TOKEN_BUCKET_RECOVERY_SECONDS), 1.0);
+   }
+
+   /** Returns true iff we currently have tokens available to send another Message with. */
+   MUSCLE_NODISCARD bool IsSendAllowed() const {return ((IsEnabled() == false)||(_tokens > 0.0));}
+
+   /** Removes the specified number of tokens from the bucket (called when a Message is sent).
+     * @param numBytes the number of bytes that were sent
+     */
+   void ConsumeTokens(uint32 numBytes) {_tokens -= numBytes;}
+
+   /** Returns the time at which IsSendAllowed() will next return true, or MUSCLE_TIME_NEVER if pacing is disabled. */
+   MUSCLE_NODISCARD uint64 GetNextSendTime() const
+   {
+      if (IsEnabled() == false) return MUSCLE_TIME_NEVER;
+      if (_tokens > 0.0) return _lastUpdateTime;
+      return _lastUpdateTime + 1 + (uint64)(((-_tokens)*MICROS_PER_SECOND)/GetEffectiveBytesPerSecond());
+   }
+
+   /** Called when a receiver has indicated that it lost some of our packets; halves our effective send rate (down to a minimum). */
+   void ReportLoss() {_rateScale = muscleMax(_rateScale*0.5, PZG_TOKEN_BUCKET_MIN_RATE_SCALE);}
+
+   /** Returns our current effective send rate, in bytes per second */
+   MUSCLE_NODISCARD double GetEffectiveBytesPerSecond() const {return muscleMax(_bytesPerSecond*_rateScale, 1.0);}
+
+private:
+   static constexpr double PZG_TOKEN_BUCKET_MIN_RATE_SCALE   = 1.0/16.0;  // we'll never back off to less than this fraction of the configured rate
+   static constexpr double PZG_TOKEN_BUCKET_RECOVERY_SECONDS = 10.0;      // how long it takes the rate-scale to recover from 0.0 to 1.0
+
+   uint64 _bytesPerSecond;
+   uint32 _burstBytes;
+   double _tokens;          // number of bytes we may send right now (may be negative, after sending a large Message)
+   double _rateScale;       // fraction of (_bytesPerSecond) we are currently allowing (reduced when loss is reported)
+   uint64 _lastUpdateTime;  // time of our most recent UpdateTokens() call
+};
+
+}  // end namespace zg_private
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "reflector/AbstractReflectSession.h"
 #include "zg/ZGPeerID.h"
+#include "zg/private/PZGFullStateTransfer.h"
 #include "zg/private/PZGUpdateBackOrderKey.h"
 
 namespace zg_private
@@ -22,6 +23,10 @@ public:
    virtual void AboutToDetachFromServer();
    virtual void EndSession();
    virtual void MessageReceivedFromGateway(const MessageRef & msg, void *) ;
+   virtual io_status_t DoInput(AbstractGatewayMessageReceiver & receiver, uint32 maxBytes);
+   virtual io_status_t DoOutput(uint32 maxBytes);
+   virtual uint64 GetPulseTime(const PulseArgs & args);
+   virtual void Pulse(const PulseArgs & args);
 
    MUSCLE_NODISCARD virtual const char * GetTypeName() const {return "Unicast";}
 
@@ -31,6 +36,10 @@ public:
    status_t RequestBackOrderFromSeniorPeer(const PZGUpdateBackOrderKey & ubok, bool dueToChecksumError);
 
 private:
+   status_t SendBackOrderRangeReplies(const PZGUpdateBackOrderKey & ubok, uint64 firstUpdateID);
+   status_t StartFullStateTransfer(const PZGUpdateBackOrderKey & ubok, uint64 resumeTransferID, uint32 resumeOffset);
+   status_t SendMoreFullStateChunks(uint32 whichDB);
+   void FullStateChunkReceived(const Message & chunkMsg);
    void RegisterMyself();
    void UnregisterMyself(bool forGood);
 
@@ -38,6 +47,8 @@ private:
    PZGNetworkIOSession * _master;
 
    Hashtable<PZGUpdateBackOrderKey, Void> _backorders;
+   Hashtable<PZGUpdateBackOrderKey, uint64> _pendingRangeReplies;  // range-back-orders we're part-way through answering -> next update ID to send
+   Hashtable<uint32, PZGOutgoingFullStateTransfer> _outgoingFullStateTransfers;  // database index -> full-state we're streaming to the remote (junior) peer
 };
 DECLARE_REFTYPES(PZGUnicastSession);
 
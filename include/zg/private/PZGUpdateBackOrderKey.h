@@ -9,34 +9,47 @@ namespace zg_private
 
 enum {PZG_UPDATE_BACKORDER_KEY_TYPE = 1969385323}; /**< 'ubok' -- the type code of the PZGUpdateBackOrderKey class */
 
-/** This key represents a request to the senior peer to resend a PZGDatabaseUpdate to us, since we need it and don't have it.
-  * That way the junior peer can keep track of what it has on order so as not to send orders for a given update more than once.
+/** This key represents a request to the senior peer to resend a PZGDatabaseUpdate (or a contiguous range of PZGDatabaseUpdates) to us,
+  * since we need it and don't have it.  That way the junior peer can keep track of what it has on order so as not to send orders for a given update more than once.
   */
 class PZGUpdateBackOrderKey : public PseudoFlattenable<PZGUpdateBackOrderKey>
 {
 public:
-   PZGUpdateBackOrderKey() : _whichDatabase(0), _updateID(0) {/* empty */}
-   PZGUpdateBackOrderKey(const ZGPeerID & targetPeerID, uint32 whichDatabase, uint64 updateID) : _targetPeerID(targetPeerID), _whichDatabase(whichDatabase), _updateID(updateID) {/* empty */}
+   PZGUpdateBackOrderKey() : _whichDatabase(0), _updateID(0), _numUpdates(1) {/* empty */}
+   PZGUpdateBackOrderKey(const ZGPeerID & targetPeerID, uint32 whichDatabase, uint64 updateID, uint32 numUpdates = 1) : _targetPeerID(targetPeerID), _whichDatabase(whichDatabase), _updateID(updateID), _numUpdates(numUpdates) {/* empty */}
 
    MUSCLE_NODISCARD const ZGPeerID & GetTargetPeerID() const {return _targetPeerID;}
    MUSCLE_NODISCARD uint32 GetDatabaseIndex() const {return _whichDatabase;}
    MUSCLE_NODISCARD uint64 GetDatabaseUpdateID() const {return _updateID;}
 
-   bool operator == (const PZGUpdateBackOrderKey & rhs) const {return ((_targetPeerID == rhs._targetPeerID)&&(_whichDatabase == rhs._whichDatabase)&&(_updateID == rhs._updateID));}
+   /** Returns the number of consecutive database updates (starting at GetDatabaseUpdateID()) that this key represents.  Usually 1. */
+   MUSCLE_NODISCARD uint32 GetNumUpdates() const {return _numUpdates;}
+
+   /** Returns true iff this key represents a range of more than one database update */
+   MUSCLE_NODISCARD bool IsRange() const {return (_numUpdates > 1);}
+
+   /** Returns the ID of the last database update that this key represents */
+   MUSCLE_NODISCARD uint64 GetLastDatabaseUpdateID() const {return _updateID+muscleMax(_numUpdates, (uint32)1)-1;}
+
+   /** Returns true iff the specified database update ID is one of the ones represented by this key */
+   MUSCLE_NODISCARD bool ContainsDatabaseUpdateID(uint64 updateID) const {return ((updateID >= _updateID)&&((updateID-_updateID) < _numUpdates));}
+
+   bool operator == (const PZGUpdateBackOrderKey & rhs) const {return ((_targetPeerID == rhs._targetPeerID)&&(_whichDatabase == rhs._whichDatabase)&&(_updateID == rhs._updateID)&&(_numUpdates == rhs._numUpdates));}
    bool operator != (const PZGUpdateBackOrderKey & rhs) const {return !(*this==rhs);}
 
-   MUSCLE_NODISCARD uint32 HashCode() const {return _targetPeerID.HashCode()+(_whichDatabase*333)+CalculateHashCode(_updateID);}
-   MUSCLE_NODISCARD String ToString() const {return String("UBOK:  [%1] db=%2 updateID=%3").Arg(_targetPeerID).Arg(_whichDatabase).Arg(_updateID);}
+   MUSCLE_NODISCARD uint32 HashCode() const {return _targetPeerID.HashCode()+(_whichDatabase*333)+CalculateHashCode(_updateID)+(_numUpdates*777);}
+   MUSCLE_NODISCARD String ToString() const {return String("UBOK:  [%1] db=%2 updateID=%3 numUpdates=%4").Arg(_targetPeerID).Arg(_whichDatabase).Arg(_updateID).Arg(_numUpdates);}
 
    MUSCLE_NODISCARD static MUSCLE_CONSTEXPR bool IsFixedSize()     {return true;}
    MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 TypeCode()      {return PZG_UPDATE_BACKORDER_KEY_TYPE;}
-   MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 FlattenedSize() {return ZGPeerID::FlattenedSize() + sizeof(_whichDatabase) + sizeof(_updateID);}
+   MUSCLE_NODISCARD static MUSCLE_CONSTEXPR uint32 FlattenedSize() {return ZGPeerID::FlattenedSize() + sizeof(_whichDatabase) + sizeof(_updateID) + sizeof(_numUpdates);}
 
    void Flatten(DataFlattener flat) const
    {
       flat.WriteFlat(_targetPeerID);
       flat.WriteInt32(_whichDatabase);
       flat.WriteInt64(_updateID);
+      flat.WriteInt32(_numUpdates);
    }
 
    status_t Unflatten(DataUnflattener & unflat)
@@ -44,6 +57,7 @@ public:
       MRETURN_ON_ERROR(unflat.ReadFlat(_targetPeerID));
       _whichDatabase = unflat.ReadInt32();
       _updateID      = unflat.ReadInt64();
+      _numUpdates    = unflat.ReadInt32();
       return unflat.GetStatus();
    }
 
@@ -51,6 +65,7 @@ private:
    ZGPeerID _targetPeerID;
    uint32 _whichDatabase;
    uint64 _updateID;
+   uint32 _numUpdates;
 };
 
 }  // end namespace zg_private
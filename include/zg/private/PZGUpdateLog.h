@@ -0,0 +1,164 @@
+#ifndef PZGUpdateLog_h
+#define PZGUpdateLog_h
+
+#include "util/Queue.h"
+#include "zg/private/PZGNameSpace.h"
+#include "zg/private/PZGDatabaseUpdate.h"
+
+namespace zg_private
+{
+
+/** This class holds a database's recent PZGDatabaseUpdates, indexed by update ID.  Since update IDs are
+  * (nearly) consecutive, the updates are stored in a ring buffer (a Queue) of slots, where the slot at index
+  * (updateID-GetFirstKeyWithDefault()) holds the update with that ID.  That makes appending an update, trimming the oldest
+  * update, and looking up an update by ID all O(1) operations, with no per-update allocations and no hashing.
+  * A junior peer's log can have gaps in it (e.g. due to lost multicast packets); the slots of the missing updates
+  * simply hold NULL references until the missing updates arrive.  The first and last slots are never NULL.
+  */
+class PZGUpdateLog
+{
+public:
+   PZGUpdateLog() : _firstID(0), _numItems(0) {/* empty */}
+
+   /** Adds (dbUp) to the log at the slot for (updateID), replacing any update that was already there.
+     * @param updateID the ID to store the update under
+     * @param dbUp the update to store.  Must not be a NULL reference.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t Put(uint64 updateID, const ConstPZGDatabaseUpdateRef & dbUp)
+   {
+      if (dbUp() == NULL) return B_BAD_ARGUMENT;
+
+      if (_slots.IsEmpty())
+      {
+         MRETURN_ON_ERROR(_slots.AddTail(dbUp));
+         _firstID  = updateID;
+         _numItems = 1;
+         return B_NO_ERROR;
+      }
+
+      if (updateID < _firstID)
+      {
+         // Prepend empty slots for any gap between (updateID) and our current first update
+         const uint64 numNewSlots = _firstID-updateID;
+         if ((_slots.GetNumItems()+numNewSlots) >= MUSCLE_NO_LIMIT) return B_RESOURCE_LIMIT;
+         MRETURN_ON_ERROR(_slots.EnsureSize((uint32)(_slots.GetNumItems()+numNewSlots)));
+         for (uint64 i=1; i<numNewSlots; i++) MRETURN_ON_ERROR(_slots.AddHead());
+         MRETURN_ON_ERROR(_slots.AddHead(dbUp));
+         _firstID = updateID;
+         _numItems++;
+         return B_NO_ERROR;
+      }
+
+      const uint64 idx = updateID-_firstID;
+      if (idx < _slots.GetNumItems())
+      {
+         ConstPZGDatabaseUpdateRef & slot = _slots[(uint32)idx];
+         if (slot() == NULL) _numItems++;
+         slot = dbUp;
+         return B_NO_ERROR;
+      }
+
+      // Append empty slots for any gap between our current last update and (updateID)
+      if (idx >= MUSCLE_NO_LIMIT) return B_RESOURCE_LIMIT;
+      MRETURN_ON_ERROR(_slots.EnsureSize((uint32)(idx+1)));
+      while(_slots.GetNumItems() < idx) MRETURN_ON_ERROR(_slots.AddTail());
+      MRETURN_ON_ERROR(_slots.AddTail(dbUp));
+      _numItems++;
+      return B_NO_ERROR;
+   }
+
+   /** Returns the number of empty slots that a call to Put() with the specified ID would need to add to the log to bridge
+     * the gap between (updateID) and the updates already in the log.  Returns zero if the log is empty, or if (updateID) falls
+     * within (or immediately adjacent to) the log's current range of IDs.
+     * @param updateID the ID that might be passed to Put()
+     */
+   MUSCLE_NODISCARD uint64 GetNumGapSlotsForKey(uint64 updateID) const
+   {
+      if (_slots.IsEmpty()) return 0;
+      if (updateID < _firstID) return _firstID-updateID-1;
+
+      const uint64 idx = updateID-_firstID;
+      return (idx > _slots.GetNumItems()) ? (idx-_slots.GetNumItems()) : 0;
+   }
+
+   /** Removes the update with the specified ID from the log.
+     * @param updateID the ID of the update to remove
+     * @param retValue on success, the removed update is written here.
+     * @returns B_NO_ERROR on success, or B_DATA_NOT_FOUND if there was no update with the specified ID in the log.
+     */
+   status_t Remove(uint64 updateID, ConstPZGDatabaseUpdateRef & retValue)
+   {
+      ConstPZGDatabaseUpdateRef * slot = GetSlot(updateID);
+      if ((slot == NULL)||((*slot)() == NULL)) return B_DATA_NOT_FOUND;
+
+      retValue = *slot;
+      slot->Reset();
+      _numItems--;
+
+      // Keep the invariant that our first and last slots are never empty
+      while((_slots.HasItems())&&(_slots.Head()() == NULL)) {(void) _slots.RemoveHead(); _firstID++;}
+      while((_slots.HasItems())&&(_slots.Tail()() == NULL)) (void) _slots.RemoveTail();
+      return B_NO_ERROR;
+   }
+
+   /** Removes all updates from the log. */
+   void Clear() {_slots.Clear(); _firstID = 0; _numItems = 0;}
+
+   /** Returns a pointer to the update with the specified ID, or NULL if there is no such update in the log. */
+   MUSCLE_NODISCARD const ConstPZGDatabaseUpdateRef * Get(uint64 updateID) const
+   {
+      const ConstPZGDatabaseUpdateRef * slot = GetSlot(updateID);
+      return ((slot)&&((*slot)())) ? slot : NULL;
+   }
+
+   /** Returns the update with the specified ID, or a NULL reference if there is no such update in the log. */
+   MUSCLE_NODISCARD ConstPZGDatabaseUpdateRef GetWithDefault(uint64 updateID) const
+   {
+      const ConstPZGDatabaseUpdateRef * slot = GetSlot(updateID);
+      return slot ? *slot : ConstPZGDatabaseUpdateRef();
+   }
+
+   /** Returns true iff the log contains an update with the specified ID. */
+   MUSCLE_NODISCARD bool ContainsKey(uint64 updateID) const {return (Get(updateID) != NULL);}
+
+   /** Returns the number of updates currently in the log (not counting any empty slots) */
+   MUSCLE_NODISCARD uint32 GetNumItems() const {return _numItems;}
+
+   /** Returns true iff the log contains no updates */
+   MUSCLE_NODISCARD bool IsEmpty() const {return (_numItems == 0);}
+
+   /** Returns true iff the log contains at least one update */
+   MUSCLE_NODISCARD bool HasItems() const {return (_numItems > 0);}
+
+   /** Returns the ID of the oldest update in the log, or (defaultID) if the log is empty. */
+   MUSCLE_NODISCARD uint64 GetFirstKeyWithDefault(uint64 defaultID = 0) const {return _slots.HasItems() ? _firstID : defaultID;}
+
+   /** Returns the ID of the newest update in the log, or (defaultID) if the log is empty. */
+   MUSCLE_NODISCARD uint64 GetLastKeyWithDefault(uint64 defaultID = 0) const {return _slots.HasItems() ? (_firstID+_slots.GetNumItems()-1) : defaultID;}
+
+   /** Returns the oldest update in the log, or a NULL reference if the log is empty. */
+   MUSCLE_NODISCARD ConstPZGDatabaseUpdateRef GetFirstValue() const {return _slots.HasItems() ? _slots.Head() : ConstPZGDatabaseUpdateRef();}
+
+   /** Returns the number of slots in our ring buffer, i.e. (GetLastKeyWithDefault()-GetFirstKeyWithDefault()+1), or zero if the log is empty.
+     * Use this along with GetSlotAt() to iterate over the log in order of update ID.
+     */
+   MUSCLE_NODISCARD uint32 GetNumSlots() const {return _slots.GetNumItems();}
+
+   /** Returns the contents of the (idx)'th slot of the log, i.e. the update with ID (GetFirstKeyWithDefault()+idx), or a NULL reference if that update isn't present.
+     * @param idx a slot index, which must be less than GetNumSlots().
+     */
+   MUSCLE_NODISCARD const ConstPZGDatabaseUpdateRef & GetSlotAt(uint32 idx) const {return _slots[idx];}
+
+private:
+   const ConstPZGDatabaseUpdateRef * GetSlot(uint64 updateID) const {return ((updateID >= _firstID)&&((updateID-_firstID) < _slots.GetNumItems())) ? &_slots[(uint32)(updateID-_firstID)] : NULL;}
+   ConstPZGDatabaseUpdateRef * GetSlot(uint64 updateID) {return ((updateID >= _firstID)&&((updateID-_firstID) < _slots.GetNumItems())) ? &_slots[(uint32)(updateID-_firstID)] : NULL;}
+
+   Queue<ConstPZGDatabaseUpdateRef> _slots;  // _slots[i] holds the update whose ID is (_firstID+i), or a NULL reference if we don't have that update
+   uint64 _firstID;                          // ID of the update in _slots.Head()
+   uint32 _numItems;                         // number of non-NULL references in (_slots)
+};
+
+}  // end namespace zg_private
+
+#endif
@@ -105,6 +105,22 @@ void ZGDatabasePeerSession :: PeerHasGoneOffline(const ZGPeerID & peerID, const
    for (uint32 i=0; i<numDBs; i++) _databaseObjects[i]()->PeerHasGoneOffline(peerID, peerInfo);
 }
 
+void ZGDatabasePeerSession :: ReadBarrierPassed(uint32 whichDatabase, uint64 barrierID, uint64 databaseStateID)
+{
+   ZGPeerSession::ReadBarrierPassed(whichDatabase, barrierID, databaseStateID);
+
+   IDatabaseObject * dbObj = GetDatabaseObject(whichDatabase);
+   if (dbObj) dbObj->ReadBarrierPassed(barrierID, databaseStateID);
+}
+
+void ZGDatabasePeerSession :: ReadBarrierLost(uint32 whichDatabase, uint64 barrierID)
+{
+   ZGPeerSession::ReadBarrierLost(whichDatabase, barrierID);
+
+   IDatabaseObject * dbObj = GetDatabaseObject(whichDatabase);
+   if (dbObj) dbObj->ReadBarrierLost(barrierID);
+}
+
 void ZGDatabasePeerSession :: PeerHasComeOnline(const ZGPeerID & peerID, const ConstMessageRef & peerInfo)
 {
    ZGPeerSession::PeerHasComeOnline(peerID, peerInfo);
@@ -221,6 +237,12 @@ status_t IDatabaseObject :: RequestUpdateDatabaseState(const MessageRef & databa
    return dbps ? dbps->RequestUpdateDatabaseState(_dbIndex, databaseUpdateMsg) : B_BAD_OBJECT;
 }
 
+status_t IDatabaseObject :: RequestReadBarrier(uint64 * optRetBarrierID, bool probeSeniorPeer)
+{
+   ZGDatabasePeerSession * dbps = GetDatabasePeerSession();
+   return dbps ? dbps->RequestReadBarrier(_dbIndex, optRetBarrierID, probeSeniorPeer) : B_BAD_OBJECT;
+}
+
 bool IDatabaseObject :: IsInSeniorDatabaseUpdateContext() const
 {
    ZGDatabasePeerSession * dbps = GetDatabasePeerSession();
@@ -17,6 +17,9 @@ namespace zg
 
 using namespace zg_private;
 
+// Minimum interval between a junior peer's reports of its database-state IDs to the senior peer (for lag tracking and adaptive update-log sizing)
+static const uint64 PZG_JUNIOR_DATABASE_STATES_REPORT_INTERVAL = MillisToMicros(100);
+
 static uint32 GetNextUniqueObjectID()
 {
    static Mutex _counterMutex;
@@ -79,12 +82,15 @@ static ZGPeerID GenerateLocalPeerID()
    return ZGPeerID((macAddress<<16)|((uint64)GetNextUniqueObjectID()), (((uint64)processID)<<32)|((uint64)salt));
 }
 
-ZGPeerSession :: ZGPeerSession(const ZGPeerSettings & zgPeerSettings) : _peerSettings(zgPeerSettings), _localPeerID(GenerateLocalPeerID()), _iAmFullyAttached(false), _setBeaconDataPending(false)
+ZGPeerSession :: ZGPeerSession(const ZGPeerSettings & zgPeerSettings) : _peerSettings(zgPeerSettings), _localPeerID(GenerateLocalPeerID()), _iAmFullyAttached(false), _setBeaconDataPending(false), _juniorDatabaseStatesReportPending(false), _nextJuniorDatabaseStatesReportTime(0), _lastUpdateTicketID(0), _lastReadBarrierID(0)
 {
+   _durableLog.SetParameters(_peerSettings.GetDurableStorageDirectory(), _peerSettings.GetNumDatabases());
+
    (void) _databases.EnsureSize(_peerSettings.GetNumDatabases(), true);
+   (void) _databaseSeniorPeerIDs.EnsureSize(_peerSettings.GetNumDatabases(), true);
    for (uint32 i=0; i<_databases.GetNumItems(); i++)
    {
-      _databases[i].SetParameters(this, i, zgPeerSettings.GetMaximumUpdateLogSizeForDatabase(i));
+      _databases[i].SetParameters(this, i, zgPeerSettings, &_durableLog);
       (void) PutPulseChild(&_databases[i]);  // So the PZGDatabaseState objects can use GetPulseTime() and Pulse() directly
    }
 }
@@ -109,12 +115,24 @@ status_t ZGPeerSession :: AttachedToServer()
    // Make sure all of our databases are in their expected default states
    for (uint32 i=0; i<_databases.GetNumItems(); i++) _databases[i].ResetLocalDatabaseToDefaultState();
 
+   // ... or in the states we saved to disk during our previous run, if durable storage is enabled
+   if (_durableLog.IsEnabled())
+   {
+      MRETURN_ON_ERROR(_durableLog.Start());
+      for (uint32 i=0; i<_databases.GetNumItems(); i++)
+      {
+         const status_t ret = _databases[i].RestoreFromDurableLog();
+         if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Unable to restore database #" UINT32_FORMAT_SPEC " from durable storage! [%s]\n", i, ret());
+      }
+   }
+
    return B_NO_ERROR;
 }
 
 void ZGPeerSession :: AboutToDetachFromServer()
 {
    ShutdownChildSessions();
+   _durableLog.Stop();  // makes sure everything that was handed to the durable log has been written to disk
    StorageReflectSession::AboutToDetachFromServer();
    _iAmFullyAttached = false;
    _onlinePeers.Clear();
@@ -141,6 +159,13 @@ static MessageRef GetForwardedTextMessage(const String & cmd)
    return ((msg())&&(msg()->AddString(PZG_PEER_NAME_TEXT, cmd).IsOK())) ? msg : MessageRef();
 }
 
+// Given the (optional) argument text after a command like "print latency", returns the database index it specifies, or -1 meaning "all databases"
+static int32 ParseDatabaseIndexArgument(const String & arg)
+{
+   const String t = arg.Trimmed();
+   return t.HasChars() ? (int32) atol(t()) : -1;
+}
+
 bool ZGPeerSession :: TextCommandReceived(const String & s)
 {
    if (s.StartsWith("all peers "))
@@ -201,7 +226,25 @@ bool ZGPeerSession :: TextCommandReceived(const String & s)
       {
          int i=0;
          for (ConstHashtableIterator<ZGPeerID, Queue<ConstPZGHeartbeatPacketWithMetaDataRef> > iter(static_cast<PZGNetworkIOSession*>(_networkIOSession())->GetMainThreadPeers()); iter.HasData(); iter++,i++)
-            printf("Peer #%i: %s%s%s\n", i+1, iter.GetKey().ToString()(), (iter.GetKey()==GetLocalPeerID())?" <-- THIS PEER":"", (i==0)?" (SENIOR)":"");
+         {
+            const ZGPeerID & pid = iter.GetKey();
+
+            // With per-database senior peers enabled, also show which databases each peer is the senior peer of
+            String dbSeniorStr;
+            if (_peerSettings.ArePerDatabaseSeniorPeersEnabled())
+            {
+               for (uint32 j=0; j<_databaseSeniorPeerIDs.GetNumItems(); j++)
+               {
+                  if (_databaseSeniorPeerIDs[j] == pid)
+                  {
+                     dbSeniorStr += dbSeniorStr.HasChars() ? "," : " (SENIOR OF DB #";
+                     dbSeniorStr += String("%1").Arg(j);
+                  }
+               }
+               if (dbSeniorStr.HasChars()) dbSeniorStr += ")";
+            }
+            printf("Peer #%i: %s%s%s%s\n", i+1, pid.ToString()(), (pid==GetLocalPeerID())?" <-- THIS PEER":"", (pid==GetSeniorPeerID())?" (SENIOR)":"", dbSeniorStr());
+         }
       }
       else printf("Can't print peers list, network I/O session is missing!\n");
    }
@@ -210,6 +253,23 @@ bool ZGPeerSession :: TextCommandReceived(const String & s)
       LogTime(MUSCLE_LOG_INFO, "Requesting controlled process shutdown.\n");
       EndServer();
    }
+   else if ((s.StartsWith("print latency"))||(s == "pl")) PrintDatabaseLatencyHistograms(s.StartsWith("print latency") ? ParseDatabaseIndexArgument(s.Substring(13)) : -1);
+   else if (s.StartsWith("clear latency"))
+   {
+      ClearDatabaseLatencyHistograms(ParseDatabaseIndexArgument(s.Substring(13)));
+      LogTime(MUSCLE_LOG_INFO, "Latency histograms cleared.\n");
+   }
+   else if ((s.StartsWith("print stats"))||(s == "ps"))
+   {
+      MessageRef stats = GetReplicationStatistics();
+      if (stats()) stats()->Print(stdout);
+              else printf("Unable to gather replication statistics! [%s]\n", stats.GetStatus()());
+   }
+   else if (s.StartsWith("print lag"))
+   {
+      const int32 whichDB = ParseDatabaseIndexArgument(s.Substring(9));
+      for (uint32 i=0; i<_databases.GetNumItems(); i++) if ((whichDB < 0)||(whichDB == (int32)i)) _databases[i].PrintJuniorLags();
+   }
    else if ((s == "enable time sync prints") ||(s == "etsp")) SetEnableTimeSynchronizationDebugging(true);
    else if ((s == "disable time sync prints")||(s == "dtsp")) SetEnableTimeSynchronizationDebugging(false);
 
@@ -233,6 +293,7 @@ void ZGPeerSession :: PeerHasComeOnline(const ZGPeerID & peerID, const ConstMess
 void ZGPeerSession :: PeerHasGoneOffline(const ZGPeerID & peerID, const ConstMessageRef & /*peerInfo*/)
 {
    (void) _onlinePeers.Remove(peerID);
+   for (uint32 i=0; i<_databases.GetNumItems(); i++) _databases[i].ForgetJuniorDatabaseState(peerID);
 }
 
 void ZGPeerSession :: SeniorPeerChanged(const ZGPeerID & oldSeniorPeerID, const ZGPeerID & newSeniorPeerID)
@@ -244,15 +305,186 @@ void ZGPeerSession :: SeniorPeerChanged(const ZGPeerID & oldSeniorPeerID, const
    }
    else LogTime(MUSCLE_LOG_ERROR, "There is no longer any senior peer!\n");
 
+   if ((_peerSettings.ArePerDatabaseSeniorPeersEnabled() == false)||(newSeniorPeerID.IsValid() == false))
+   {
+      // By default, the system's senior peer is also the senior peer of every database (and if there's no senior peer, there are no database-senior peers either)
+      Queue<ZGPeerID> newDatabaseSeniorPeerIDs;
+      if (newDatabaseSeniorPeerIDs.EnsureSize(_databases.GetNumItems(), true).IsOK())
+      {
+         for (uint32 i=0; i<newDatabaseSeniorPeerIDs.GetNumItems(); i++) newDatabaseSeniorPeerIDs[i] = newSeniorPeerID;
+         SetDatabaseSeniorPeerIDs(newDatabaseSeniorPeerIDs);
+      }
+      else LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession::SeniorPeerChanged:  Unable to update the databases' senior peer IDs!\n");
+   }
+
    const bool iWasSeniorPeer = IAmTheSeniorPeer();
    _seniorPeerID = newSeniorPeerID;
-   const bool iAmSeniorPeer = IAmTheSeniorPeer();
-
-   if (iWasSeniorPeer != iAmSeniorPeer)
+   if (IAmTheSeniorPeer() != iWasSeniorPeer)
    {
       LogTime(MUSCLE_LOG_INFO, "I am %s the senior peer of %s system [%s]!\n", IAmTheSeniorPeer()?"now":"no longer", GetPeerSettings().GetSignature()(), GetPeerSettings().GetSystemName()());
       LocalSeniorPeerStatusChanged();
-      ScheduleSetBeaconData();
+   }
+}
+
+void ZGPeerSession :: OrderedFullPeersListChanged(const Queue<ZGPeerID> & orderedFullPeerIDs)
+{
+   _orderedFullPeerIDs = orderedFullPeerIDs;
+   if (_peerSettings.ArePerDatabaseSeniorPeersEnabled() == false) return;  // SeniorPeerChanged() handles everything in this case
+
+   // Database-senior assignments are sticky:  peers joining the system never take any databases away from their current
+   // senior peers (see CheckDatabaseSeniorHandoffs() for how databases get moved to their preferred senior peers).
+   // Only a database whose senior peer has gone away (or that never had one) is taken over, by the system's senior peer,
+   // exactly as every database would be if per-database senior peers weren't enabled.
+   const ZGPeerID & systemSeniorPeerID = orderedFullPeerIDs.HeadWithDefault();
+   Queue<ZGPeerID> newDatabaseSeniorPeerIDs(_databaseSeniorPeerIDs);
+   for (uint32 i=0; i<newDatabaseSeniorPeerIDs.GetNumItems(); i++) if (orderedFullPeerIDs.Contains(newDatabaseSeniorPeerIDs[i]) == false) newDatabaseSeniorPeerIDs[i] = systemSeniorPeerID;
+   SetDatabaseSeniorPeerIDs(newDatabaseSeniorPeerIDs);
+
+   CheckDatabaseSeniorHandoffs();
+}
+
+ZGPeerID ZGPeerSession :: GetPreferredDatabaseSeniorPeerID(uint32 whichDB) const
+{
+   // Rendezvous hashing:  every peer computes the same answer, and a full peer joining or leaving
+   // only changes the answer for the databases that that peer is (or was) the preferred senior peer of
+   ZGPeerID ret;
+   uint32 bestWeight = 0;
+   for (uint32 i=0; i<_orderedFullPeerIDs.GetNumItems(); i++)
+   {
+      const ZGPeerID & pid = _orderedFullPeerIDs[i];
+      const uint32 weight  = CalculateHashCode((((uint64)pid.HashCode())<<32)|whichDB);
+      if ((ret.IsValid() == false)||(weight > bestWeight)||((weight == bestWeight)&&(pid > ret)))
+      {
+         ret        = pid;
+         bestWeight = weight;
+      }
+   }
+   return ret;
+}
+
+void ZGPeerSession :: CheckDatabaseSeniorHandoffs()
+{
+   if (_peerSettings.ArePerDatabaseSeniorPeersEnabled() == false) return;
+
+   // We only hand a database off to its preferred senior peer once that peer has reported that it is fully caught up with us,
+   // so that the new senior peer never starts executing updates on top of an out-of-date database.
+   Queue<ZGPeerID> newDatabaseSeniorPeerIDs(_databaseSeniorPeerIDs);
+   Queue<uint32> handedOffDatabases;
+   for (uint32 i=0; i<newDatabaseSeniorPeerIDs.GetNumItems(); i++)
+   {
+      if (IAmTheDatabaseSeniorPeer(i))
+      {
+         const ZGPeerID preferredPeerID = GetPreferredDatabaseSeniorPeerID(i);
+         if ((preferredPeerID.IsValid())&&(preferredPeerID != _localPeerID)&&(_databases[i].IsReadyForSeniorHandoffTo(preferredPeerID))&&(handedOffDatabases.AddTail(i).IsOK()))
+         {
+            LogTime(MUSCLE_LOG_INFO, "Handing database #" UINT32_FORMAT_SPEC " off to peer [%s] at database-state " UINT64_FORMAT_SPEC "\n", i, preferredPeerID.ToString()(), _databases[i].GetCurrentDatabaseStateID());
+            newDatabaseSeniorPeerIDs[i] = preferredPeerID;
+         }
+      }
+   }
+   if (handedOffDatabases.IsEmpty()) return;
+
+   SetDatabaseSeniorPeerIDs(newDatabaseSeniorPeerIDs, _localPeerID);
+
+   // We'll keep sending beacons that announce the hand-offs until the new senior peers' own beacons show they've taken over
+   for (uint32 i=0; i<handedOffDatabases.GetNumItems(); i++)
+   {
+      const uint32 whichDB = handedOffDatabases[i];
+      if (_unconfirmedDatabaseHandoffs.Put(whichDB, newDatabaseSeniorPeerIDs[whichDB]).IsError()) LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession::CheckDatabaseSeniorHandoffs:  Unable to track the hand-off of database #" UINT32_FORMAT_SPEC "!\n", whichDB);
+   }
+   ScheduleSetBeaconData();
+}
+
+void ZGPeerSession :: UpdateDatabaseSeniorPeerIDsFromBeacon(const ZGPeerID & sourcePeerID, const Queue<ZGPeerID> & beaconSeniorPeerIDs)
+{
+   if (beaconSeniorPeerIDs.GetNumItems() != _databaseSeniorPeerIDs.GetNumItems()) return;
+
+   const int32 sourceSeniority = _orderedFullPeerIDs.IndexOf(sourcePeerID);
+   if (sourceSeniority < 0) return;  // only full peers can be database-senior peers
+
+   Queue<ZGPeerID> newDatabaseSeniorPeerIDs(_databaseSeniorPeerIDs);
+   for (uint32 i=0; i<newDatabaseSeniorPeerIDs.GetNumItems(); i++)
+   {
+      const ZGPeerID & claimedPeerID = beaconSeniorPeerIDs[i];
+      if (newDatabaseSeniorPeerIDs[i] == sourcePeerID)
+      {
+         // The database's senior peer is telling us who its senior peer is (itself, or the peer it has handed the database off to)
+         if (_orderedFullPeerIDs.Contains(claimedPeerID)) newDatabaseSeniorPeerIDs[i] = claimedPeerID;
+      }
+      else if (claimedPeerID == sourcePeerID)
+      {
+         // Some other peer says it is this database's senior peer (e.g. because we just came online, or we missed a hand-off)
+         // If we think *we* are the senior peer of this database, then the more senior of the two of us keeps it.
+         if ((newDatabaseSeniorPeerIDs[i] != _localPeerID)||(sourceSeniority < _orderedFullPeerIDs.IndexOf(_localPeerID))) newDatabaseSeniorPeerIDs[i] = sourcePeerID;
+      }
+   }
+   SetDatabaseSeniorPeerIDs(newDatabaseSeniorPeerIDs, sourcePeerID);  // changes announced by a database's own senior peer are hand-offs
+
+   // See if this beacon confirms that the source peer has taken over any databases that we handed off to it
+   const bool hadUnconfirmedHandoffs = _unconfirmedDatabaseHandoffs.HasItems();
+   for (HashtableIterator<uint32, ZGPeerID> iter(_unconfirmedDatabaseHandoffs); iter.HasData(); iter++) if ((iter.GetValue() == sourcePeerID)&&(beaconSeniorPeerIDs[iter.GetKey()] == sourcePeerID)) (void) _unconfirmedDatabaseHandoffs.Remove(iter.GetKey());
+   if ((hadUnconfirmedHandoffs)&&(_unconfirmedDatabaseHandoffs.IsEmpty())) ScheduleSetBeaconData();  // so we'll stop sending beacons if we're no longer the senior peer of any database
+}
+
+void ZGPeerSession :: SetDatabaseSeniorPeerIDs(const Queue<ZGPeerID> & newDatabaseSeniorPeerIDs, const ZGPeerID & handoffFromPeerID)
+{
+   const uint32 numDBs = muscleMin(_databases.GetNumItems(), newDatabaseSeniorPeerIDs.GetNumItems());
+
+   // we accepted these while we were senior, so execute them while we still are
+   for (uint32 i=0; i<numDBs; i++)
+   {
+      if ((IAmTheDatabaseSeniorPeer(i))&&(newDatabaseSeniorPeerIDs[i] != _localPeerID))
+      {
+         _databases[i].ReleaseDelayedSeniorUpdates(true);
+         _databases[i].FlushPendingSeniorUpdates();
+      }
+   }
+
+   bool anyChanged = false;
+   bool localStatusChanged = false;
+   for (uint32 i=0; i<numDBs; i++)
+   {
+      if (newDatabaseSeniorPeerIDs[i] != _databaseSeniorPeerIDs[i])
+      {
+         const bool iWasDatabaseSeniorPeer = IAmTheDatabaseSeniorPeer(i);
+         const bool isHandoff = ((handoffFromPeerID.IsValid())&&(_databaseSeniorPeerIDs[i] == handoffFromPeerID)&&(newDatabaseSeniorPeerIDs[i].IsValid()));
+         _databaseSeniorPeerIDs[i] = newDatabaseSeniorPeerIDs[i];
+         (void) _unconfirmedDatabaseHandoffs.Remove(i);  // whatever hand-off we were announcing for this database is moot now
+         _databases[i].DatabaseSeniorPeerChanged(isHandoff);
+         anyChanged = true;
+
+         if (IAmTheDatabaseSeniorPeer(i) != iWasDatabaseSeniorPeer)
+         {
+            localStatusChanged = true;
+            _databases[i].ForgetJuniorDatabaseState(ZGPeerID());  // any junior-state reports we have are stale now
+            if (_peerSettings.ArePerDatabaseSeniorPeersEnabled()) LogTime(MUSCLE_LOG_INFO, "I am %s the senior peer of database #" UINT32_FORMAT_SPEC "!\n", iWasDatabaseSeniorPeer?"no longer":"now", i);
+         }
+      }
+   }
+
+   if ((localStatusChanged)||((anyChanged)&&(_peerSettings.ArePerDatabaseSeniorPeersEnabled()))) ScheduleSetBeaconData();  // our beacons list the database-senior peers too, in that mode
+   if (anyChanged)
+   {
+      JuniorDatabaseStateChanged();  // so that the new senior peer(s) will learn our database-states ASAP (if we're a junior peer)
+
+      // so that we'll pass on the new database-senior peers' beacons even if they haven't changed since we last saw them
+      PZGNetworkIOSession * nios = static_cast<PZGNetworkIOSession *>(_networkIOSession());
+      if ((nios)&&(_peerSettings.ArePerDatabaseSeniorPeersEnabled())) nios->InvalidateLastReceivedBeaconData();
+   }
+}
+
+bool ZGPeerSession :: IAmTheSeniorPeerOfAnyDatabase() const
+{
+   for (uint32 i=0; i<_databaseSeniorPeerIDs.GetNumItems(); i++) if (IAmTheDatabaseSeniorPeer(i)) return true;
+   return false;
+}
+
+void ZGPeerSession :: GetRemoteDatabaseSeniorPeerIDs(Hashtable<ZGPeerID, Void> & retPeerIDs) const
+{
+   for (uint32 i=0; i<_databaseSeniorPeerIDs.GetNumItems(); i++)
+   {
+      const ZGPeerID & pid = _databaseSeniorPeerIDs[i];
+      if ((pid.IsValid())&&(pid != _localPeerID)) (void) retPeerIDs.PutWithDefault(pid);
    }
 }
 
@@ -291,6 +523,68 @@ void ZGPeerSession :: PrivateMessageReceivedFromPeer(const ZGPeerID & fromPeerID
       }
       break;
 
+      case PZG_PEER_COMMAND_JUNIOR_DATABASE_STATES:
+      {
+         int64 juniorStateID;
+         for (uint32 i=0; (i<_databases.GetNumItems())&&(msg()->FindInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID, i, juniorStateID).IsOK()); i++) _databases[i].JuniorDatabaseStateReported(fromPeerID, (uint64) juniorStateID);
+         CheckDatabaseSeniorHandoffs();  // the reporting peer may have caught up enough for us to hand it a database
+      }
+      break;
+
+      case PZG_PEER_COMMAND_UPDATE_COMMITTED:
+      {
+         const uint32 whichDB         = msg()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
+         const uint64 ticketID        = msg()->GetInt64(PZG_PEER_NAME_TICKET_ID);
+         const uint64 databaseStateID = msg()->GetInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID);
+         if ((_databases.IsIndexValid(whichDB))&&(ticketID > 0))
+         {
+            status_t result;
+            switch(msg()->GetInt32(PZG_PEER_NAME_UPDATE_RESULT))
+            {
+               case PZG_UPDATE_RESULT_COMMITTED: result = B_NO_ERROR;               break;
+               case PZG_UPDATE_RESULT_STALE:     result = B_STALE_DATABASE_STATE;   break;
+               case PZG_UPDATE_RESULT_BUSY:      result = B_REPLICATION_BUSY;       break;
+               default:                          result = B_DATABASE_UPDATE_FAILED; break;
+            }
+
+            DatabaseUpdateCommitted(whichDB, ticketID, result, databaseStateID);
+            if (result.IsOK()) _databases[whichDB].UpdateTicketCommitted(ticketID, databaseStateID);
+         }
+      }
+      break;
+
+      case PZG_PEER_COMMAND_READ_BARRIER_PROBE:
+      {
+         // Only the senior peer knows the database's current state ID; any other peer's idea of it could be stale, which would break the barrier's guarantee
+         const uint32 whichDB   = msg()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
+         const uint64 barrierID = msg()->GetInt64(PZG_PEER_NAME_READ_BARRIER_ID);
+         status_t ret = B_BAD_ARGUMENT;
+         if (_databases.IsIndexValid(whichDB))
+         {
+            ret = IAmTheDatabaseSeniorPeer(whichDB) ? SendReadBarrierMessage(fromPeerID, PZG_PEER_COMMAND_READ_BARRIER_REPLY, whichDB, barrierID, _databases[whichDB].GetCurrentDatabaseStateID())
+                                                     : SendReadBarrierMessage(fromPeerID, PZG_PEER_COMMAND_READ_BARRIER_REPLY, whichDB, barrierID, 0, true);
+         }
+         if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession:  Unable to answer read-barrier probe from peer [%s] [%s]\n", fromPeerID.ToString()(), ret());
+      }
+      break;
+
+      case PZG_PEER_COMMAND_READ_BARRIER_REPLY:
+      {
+         const uint32 whichDB   = msg()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
+         const uint64 barrierID = msg()->GetInt64(PZG_PEER_NAME_READ_BARRIER_ID);
+         if (_databases.IsIndexValid(whichDB))
+         {
+            if (msg()->GetBool(PZG_PEER_NAME_NOT_SENIOR))
+            {
+               // The peer we probed had already stopped being the senior peer; if we've since heard about a different one, ask that one instead
+               const ZGPeerID & seniorPeerID = GetDatabaseSeniorPeerID(whichDB);
+               if ((seniorPeerID.IsValid() == false)||(seniorPeerID == fromPeerID)||(SendReadBarrierMessage(seniorPeerID, PZG_PEER_COMMAND_READ_BARRIER_PROBE, whichDB, barrierID, 0).IsError())) ReadBarrierLost(whichDB, barrierID);
+            }
+            else _databases[whichDB].ReadBarrierTargetReceived(barrierID, msg()->GetInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID));
+         }
+      }
+      break;
+
       case PZG_PEER_COMMAND_USER_TEXT_MESSAGE:
       {
          const String * textStr = msg()->GetStringPointer(PZG_PEER_NAME_TEXT);
@@ -311,29 +605,25 @@ void ZGPeerSession :: PrivateMessageReceivedFromPeer(const ZGPeerID & fromPeerID
 
 status_t ZGPeerSession :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPeerID, const ConstMessageRef & msg, bool isMessageMeantForSeniorPeer)
 {
-   const bool iAmSenior = IAmTheSeniorPeer();
-   if (isMessageMeantForSeniorPeer != iAmSenior)
-   {
-      LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Message " UINT32_FORMAT_SPEC " from peer [%s] was intended for %s peer, but I am %s\n", msg()->what, fromPeerID.ToString()(), isMessageMeantForSeniorPeer?"the senior":"a junior", iAmSenior?"the senior peer":"a junior peer");
-      return B_BAD_DATA;
-   }
-   if ((isMessageMeantForSeniorPeer == false)&&(fromPeerID != GetSeniorPeerID()))
-   {
-      if (_iAmFullyAttached) LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Message " UINT32_FORMAT_SPEC " was received from [%s], but the senior peer is [%s]\n", msg()->what, fromPeerID.ToString()(), GetSeniorPeerID().ToString()());
-      return B_BAD_DATA;
-   }
-
    uint32 whichDatabase;
    PZGDatabaseUpdateRef dbUp;
    if (msg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE)
    {
-      dbUp = GetPZGDatabaseUpdateFromPool();
-      if ((dbUp() == NULL)||(msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()).IsError()))
+      // Usually the multicast I/O thread has already unflattened the PZGDatabaseUpdate (and its payload) for us; if not, we'll do it here
+      if (msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, dbUp).IsError())
       {
-         LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Couldn't get PZGDatabaseUpdate from junior-update Message!\n");
-         return B_BAD_DATA;
+         dbUp = GetPZGDatabaseUpdateFromPool();
+         if ((dbUp() == NULL)||(msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()).IsError()))
+         {
+            LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Couldn't get PZGDatabaseUpdate from junior-update Message!\n");
+            return B_BAD_DATA;
+         }
       }
       whichDatabase = dbUp()->GetDatabaseIndex();
+
+      // Latency-tracing stamps added by the senior's and our own multicast threads (if any)
+      dbUp()->SetMulticastSendTimeMicros(msg()->GetInt64(PZG_PEER_NAME_MULTICAST_SEND_TIME));
+      dbUp()->SetJuniorReceiveTimeMicros(msg()->GetInt64(PZG_PEER_NAME_MULTICAST_RECEIVE_TIME));
    }
    else whichDatabase = msg()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
 
@@ -343,7 +633,49 @@ status_t ZGPeerSession :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPeerI
       return B_BAD_ARGUMENT;
    }
 
-   return _databases[whichDatabase].HandleDatabaseUpdateRequest(fromPeerID, msg, dbUp, *this);
+   const bool iAmSenior = IAmTheDatabaseSeniorPeer(whichDatabase);
+   if ((isMessageMeantForSeniorPeer)&&(iAmSenior == false)) return ForwardRequestToDatabaseSeniorPeer(fromPeerID, whichDatabase, msg);
+   if (isMessageMeantForSeniorPeer != iAmSenior)
+   {
+      LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Message " UINT32_FORMAT_SPEC " from peer [%s] was intended for %s peer of database #" UINT32_FORMAT_SPEC ", but I am %s\n", msg()->what, fromPeerID.ToString()(), isMessageMeantForSeniorPeer?"the senior":"a junior", whichDatabase, iAmSenior?"the senior peer":"a junior peer");
+      return B_BAD_DATA;
+   }
+   if ((isMessageMeantForSeniorPeer == false)&&(fromPeerID != GetDatabaseSeniorPeerID(whichDatabase)))
+   {
+      if (_iAmFullyAttached) LogTime(MUSCLE_LOG_ERROR, "HandleDatabaseUpdateRequest:  Message " UINT32_FORMAT_SPEC " was received from [%s], but the senior peer of database #" UINT32_FORMAT_SPEC " is [%s]\n", msg()->what, fromPeerID.ToString()(), whichDatabase, GetDatabaseSeniorPeerID(whichDatabase).ToString()());
+      return B_BAD_DATA;
+   }
+
+   // If a former senior peer forwarded this request to us, then the peer that will want to hear about its outcome is the one that sent it originally
+   ZGPeerID requesterID = fromPeerID;
+   if ((isMessageMeantForSeniorPeer)&&(msg()->FindFlat(PZG_PEER_NAME_ORIGINAL_REQUESTER, requesterID).IsError())) requesterID = fromPeerID;
+
+   return _databases[whichDatabase].HandleDatabaseUpdateRequest(requesterID, msg, dbUp, *this);
+}
+
+status_t ZGPeerSession :: ForwardRequestToDatabaseSeniorPeer(const ZGPeerID & fromPeerID, uint32 whichDatabase, const ConstMessageRef & msg)
+{
+   // Requests can still arrive after we've handed the database off (e.g. ones sent before the requester heard about the hand-off),
+   // so we pass them on to the peer we now think is the senior.  Each request gets forwarded at most once, so that two peers who
+   // briefly disagree about who the senior peer is can't bounce a request back and forth between them.
+   const bool alreadyForwarded = msg()->HasName(PZG_PEER_NAME_ORIGINAL_REQUESTER);
+   ZGPeerID requesterID = fromPeerID;
+   if ((alreadyForwarded)&&(msg()->FindFlat(PZG_PEER_NAME_ORIGINAL_REQUESTER, requesterID).IsError())) requesterID = fromPeerID;
+
+   const ZGPeerID & seniorPeerID = GetDatabaseSeniorPeerID(whichDatabase);
+   status_t ret = B_BAD_OBJECT;
+   if ((alreadyForwarded == false)&&(seniorPeerID.IsValid())&&(seniorPeerID != _localPeerID))
+   {
+      MessageRef fwdMsg = GetMessageFromPool(*msg());
+      ret = fwdMsg() ? fwdMsg()->AddFlat(PZG_PEER_NAME_ORIGINAL_REQUESTER, requesterID) : B_OUT_OF_MEMORY;
+      if (ret.IsOK()) ret = SendUnicastInternalMessageToPeer(seniorPeerID, fwdMsg);
+      if (ret.IsOK()) return B_NO_ERROR;
+   }
+
+   // If we can't forward the request, at least tell the requester it failed, so that it can retry rather than wait forever
+   LogTime(MUSCLE_LOG_WARNING, "HandleDatabaseUpdateRequest:  Message " UINT32_FORMAT_SPEC " from peer [%s] was intended for the senior peer of database #" UINT32_FORMAT_SPEC ", but I am a junior peer and couldn't forward it to [%s] [%s]\n", msg()->what, requesterID.ToString()(), whichDatabase, seniorPeerID.ToString()(), ret());
+   ReportUpdateTicketCommitted(requesterID, whichDatabase, (uint64) msg()->GetInt64(PZG_PEER_NAME_TICKET_ID), PZG_UPDATE_RESULT_FAILED, _databases[whichDatabase].GetSeniorDatabaseStateID());
+   return ret;
 }
 
 status_t ZGPeerSession :: RequestResetDatabaseStateToDefault(uint32 whichDatabase)
@@ -357,24 +689,70 @@ status_t ZGPeerSession :: RequestReplaceDatabaseState(uint32 whichDatabase, cons
    return SendRequestToSeniorPeer(whichDatabase, PZG_PEER_COMMAND_REPLACE_SENIOR_DATABASE, newDatabaseStateMsg);
 }
 
-status_t ZGPeerSession :: RequestUpdateDatabaseState(uint32 whichDatabase, const MessageRef & databaseUpdateMsg)
+status_t ZGPeerSession :: RequestUpdateDatabaseState(uint32 whichDatabase, const MessageRef & databaseUpdateMsg, uint64 * optRetTicketID)
+{
+   return RequestUpdateDatabaseStateAux(whichDatabase, databaseUpdateMsg, NULL, optRetTicketID);
+}
+
+status_t ZGPeerSession :: RequestConditionalUpdateDatabaseState(uint32 whichDatabase, uint64 expectedDatabaseStateID, const MessageRef & databaseUpdateMsg, uint64 * optRetTicketID)
+{
+   return RequestUpdateDatabaseStateAux(whichDatabase, databaseUpdateMsg, &expectedDatabaseStateID, optRetTicketID);
+}
+
+status_t ZGPeerSession :: RequestUpdateDatabaseStateAux(uint32 whichDatabase, const MessageRef & databaseUpdateMsg, const uint64 * optExpectedStateID, uint64 * optRetTicketID)
 {
    if (databaseUpdateMsg() == NULL) return B_BAD_ARGUMENT;  // user's gotta specify something for us to base the new state on!
-   return SendRequestToSeniorPeer(whichDatabase, PZG_PEER_COMMAND_UPDATE_SENIOR_DATABASE, databaseUpdateMsg);
+   if ((_peerSettings.IsAdmissionControlRejectModeForDatabase(whichDatabase))&&(GetDatabaseUpdateHeadroom(whichDatabase) == 0)) return B_REPLICATION_BUSY;
+   if (optRetTicketID == NULL) return SendRequestToSeniorPeer(whichDatabase, PZG_PEER_COMMAND_UPDATE_SENIOR_DATABASE, databaseUpdateMsg, 0, optExpectedStateID);
+
+   const uint64 ticketID = _lastUpdateTicketID+1;
+   MRETURN_ON_ERROR(SendRequestToSeniorPeer(whichDatabase, PZG_PEER_COMMAND_UPDATE_SENIOR_DATABASE, databaseUpdateMsg, ticketID, optExpectedStateID));
+   *optRetTicketID = _lastUpdateTicketID = ticketID;
+   return B_NO_ERROR;
+}
+
+status_t ZGPeerSession :: RequestReadBarrier(uint32 whichDatabase, uint64 * optRetBarrierID, bool probeSeniorPeer)
+{
+   if (_databases.IsIndexValid(whichDatabase) == false) return B_BAD_ARGUMENT;
+   const ZGPeerID & seniorPeerID = GetDatabaseSeniorPeerID(whichDatabase);
+   if (seniorPeerID.IsValid() == false) return B_BAD_OBJECT;  // can't catch up to the senior peer if we don't know who he is!
+
+   // Either way, the barrier's target state ID comes back to us as a PZG_PEER_COMMAND_READ_BARRIER_REPLY, so that ReadBarrierPassed() is never called from within this method
+   const uint64 barrierID = _lastReadBarrierID+1;
+   MRETURN_ON_ERROR(probeSeniorPeer ? SendReadBarrierMessage(seniorPeerID,     PZG_PEER_COMMAND_READ_BARRIER_PROBE, whichDatabase, barrierID, 0)
+                                    : SendReadBarrierMessage(GetLocalPeerID(), PZG_PEER_COMMAND_READ_BARRIER_REPLY, whichDatabase, barrierID, _databases[whichDatabase].GetSeniorDatabaseStateID()));
+   _lastReadBarrierID = barrierID;
+   if (optRetBarrierID) *optRetBarrierID = barrierID;
+   return B_NO_ERROR;
+}
+
+status_t ZGPeerSession :: SendReadBarrierMessage(const ZGPeerID & destinationPeerID, uint32 whatCode, uint32 whichDatabase, uint64 barrierID, uint64 databaseStateID, bool isNotSeniorReply)
+{
+   MessageRef msg = GetMessageFromPool(whatCode);
+   MRETURN_OOM_ON_NULL(msg());
+   MRETURN_ON_ERROR(msg()->AddInt32(PZG_PEER_NAME_DATABASE_ID, whichDatabase));
+   MRETURN_ON_ERROR(msg()->AddInt64(PZG_PEER_NAME_READ_BARRIER_ID, barrierID));
+   MRETURN_ON_ERROR(msg()->AddInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID, databaseStateID));
+   MRETURN_ON_ERROR(msg()->CAddBool(PZG_PEER_NAME_NOT_SENIOR, isNotSeniorReply));  // CAddBool() won't add anything if (isNotSeniorReply) is false
+   return SendUnicastInternalMessageToPeer(destinationPeerID, msg);
 }
 
-status_t ZGPeerSession :: SendRequestToSeniorPeer(uint32 whichDatabase, uint32 whatCode, const ConstMessageRef & userMsg)
+status_t ZGPeerSession :: SendRequestToSeniorPeer(uint32 whichDatabase, uint32 whatCode, const ConstMessageRef & userMsg, uint64 ticketID, const uint64 * optExpectedStateID)
 {
    if (whichDatabase >= _peerSettings.GetNumDatabases()) return B_BAD_ARGUMENT;  // invalid database index!
-   if (_seniorPeerID.IsValid() == false) return B_BAD_OBJECT;  // can't send to senior peer if we don't know who he is!
+   const ZGPeerID & seniorPeerID = GetDatabaseSeniorPeerID(whichDatabase);
+   if (seniorPeerID.IsValid() == false) return B_BAD_OBJECT;  // can't send to senior peer if we don't know who he is!
 
    MessageRef sendMsg = GetMessageFromPool(whatCode);
    MRETURN_OOM_ON_NULL(sendMsg());
 
    MRETURN_ON_ERROR(sendMsg()->CAddInt32(  PZG_PEER_NAME_DATABASE_ID,  whichDatabase));
    MRETURN_ON_ERROR(sendMsg()->CAddMessage(PZG_PEER_NAME_USER_MESSAGE, CastAwayConstFromRef(userMsg)));
+   if (_peerSettings.IsLatencyTracingEnabled()) MRETURN_ON_ERROR(sendMsg()->CAddInt64(PZG_PEER_NAME_SUBMIT_TIME, GetNetworkTime64()));
+   MRETURN_ON_ERROR(sendMsg()->CAddInt64(PZG_PEER_NAME_TICKET_ID, ticketID));  // CAddInt64() won't add anything if (ticketID) is 0
+   if (optExpectedStateID) MRETURN_ON_ERROR(sendMsg()->AddInt64(PZG_PEER_NAME_EXPECTED_STATE_ID, *optExpectedStateID));
 
-   return SendUnicastInternalMessageToPeer(_seniorPeerID, sendMsg);
+   return SendUnicastInternalMessageToPeer(seniorPeerID, sendMsg);
 }
 
 status_t ZGPeerSession :: RequestBackOrderFromSeniorPeer(const PZGUpdateBackOrderKey & ubok, bool dueToChecksumError)
@@ -452,6 +830,72 @@ void ZGPeerSession :: PrintDatabaseStateInfo(int32 whichDatabase) const
    }
 }
 
+void ZGPeerSession :: PrintDatabaseLatencyHistograms(int32 whichDatabase) const
+{
+   if (_databases.IsIndexValid(whichDatabase)) _databases[whichDatabase].PrintLatencyHistograms();
+   else
+   {
+      for (uint32 i=0; i<_databases.GetNumItems(); i++) _databases[i].PrintLatencyHistograms();
+   }
+}
+
+const ZGLatencyHistogram * ZGPeerSession :: GetDatabaseLatencyHistogram(uint32 whichDatabase, uint32 whichStage) const
+{
+   return _databases.IsIndexValid(whichDatabase) ? _databases[whichDatabase].GetLatencyHistogram(whichStage) : NULL;
+}
+
+void ZGPeerSession :: ClearDatabaseLatencyHistograms(int32 whichDatabase)
+{
+   if (_databases.IsIndexValid(whichDatabase)) _databases[whichDatabase].ClearLatencyHistograms();
+   else
+   {
+      for (uint32 i=0; i<_databases.GetNumItems(); i++) _databases[i].ClearLatencyHistograms();
+   }
+}
+
+uint64 ZGPeerSession :: GetJuniorPeerDatabaseLag(uint32 whichDatabase, const ZGPeerID & juniorPeerID) const
+{
+   return _databases.IsIndexValid(whichDatabase) ? _databases[whichDatabase].GetJuniorLag(juniorPeerID) : (uint64)-1;
+}
+
+uint32 ZGPeerSession :: GetDatabaseReplicationLag(uint32 whichDatabase, uint64 & retMinLag, uint64 & retMaxLag, double & retMeanLag) const
+{
+   if (_databases.IsIndexValid(whichDatabase)) return _databases[whichDatabase].GetJuniorLagStatistics(retMinLag, retMaxLag, retMeanLag);
+
+   retMinLag = retMaxLag = 0;
+   retMeanLag = 0.0;
+   return 0;
+}
+
+uint64 ZGPeerSession :: GetDatabaseUpdateHeadroom(uint32 whichDatabase) const
+{
+   return _databases.IsIndexValid(whichDatabase) ? _databases[whichDatabase].GetUpdateHeadroom() : (uint64)-1;
+}
+
+uint32 ZGPeerSession :: GetMulticastBacklog() const
+{
+   const PZGNetworkIOSession * nios = static_cast<const PZGNetworkIOSession *>(_networkIOSession());
+   return nios ? nios->GetMulticastBacklog() : 0;
+}
+
+MessageRef ZGPeerSession :: GetReplicationStatistics() const
+{
+   MessageRef ret = GetMessageFromPool();
+   MRETURN_OOM_ON_NULL(ret());
+
+   const PZGNetworkIOSession * nios = static_cast<const PZGNetworkIOSession *>(_networkIOSession());
+   if (nios) MRETURN_ON_ERROR(nios->SaveReplicationStatisticsToMessage(*ret()));
+
+   for (uint32 i=0; i<_databases.GetNumItems(); i++)
+   {
+      MessageRef dbStats = GetMessageFromPool();
+      MRETURN_OOM_ON_NULL(dbStats());
+      MRETURN_ON_ERROR(_databases[i].SaveReplicationStatisticsToMessage(*dbStats()));
+      MRETURN_ON_ERROR(ret()->AddMessage("databases", dbStats));
+   }
+   return ret;
+}
+
 void ZGPeerSession :: PrintDatabaseUpdateLog(int32 whichDatabase) const
 {
    if (_databases.IsIndexValid(whichDatabase)) _databases[whichDatabase].PrintDatabaseUpdateLog();
@@ -473,7 +917,7 @@ void ZGPeerSession :: ScheduleSetBeaconData()
 uint64 ZGPeerSession :: GetPulseTime(const PulseArgs & args)
 {
    if (_setBeaconDataPending) return 0;
-   return StorageReflectSession::GetPulseTime(args);
+   return muscleMin(IsJuniorDatabaseStatesReportReady() ? _nextJuniorDatabaseStatesReportTime : MUSCLE_TIME_NEVER, StorageReflectSession::GetPulseTime(args));
 }
 
 ConstPZGBeaconDataRef ZGPeerSession :: GetNewSeniorBeaconData() const
@@ -488,12 +932,14 @@ ConstPZGBeaconDataRef ZGPeerSession :: GetNewSeniorBeaconData() const
    if (q.EnsureSize(numDBs).IsError()) return ConstPZGBeaconDataRef();
 
    for (uint32 i=0; i<numDBs; i++) (void) q.AddTail(_databases[i].GetDatabaseStateInfo());
+   if ((_peerSettings.ArePerDatabaseSeniorPeersEnabled())&&(beaconDataRef()->GetDatabaseSeniorPeerIDs().AddTailMulti(_databaseSeniorPeerIDs).IsError())) return ConstPZGBeaconDataRef();
    return AddConstToRef(beaconDataRef);
 }
 
 void ZGPeerSession :: Pulse(const PulseArgs & args)
 {
    StorageReflectSession::Pulse(args);
+   if ((IsJuniorDatabaseStatesReportReady())&&(args.GetCallbackTime() >= _nextJuniorDatabaseStatesReportTime)) ReportJuniorDatabaseStatesToSeniorPeer(args.GetCallbackTime());
    if (_setBeaconDataPending)
    {
       _setBeaconDataPending = false;
@@ -508,27 +954,77 @@ void ZGPeerSession :: Pulse(const PulseArgs & args)
       if (nios)
       {
          ConstPZGBeaconDataRef beaconData;
-         if (IAmTheSeniorPeer()) beaconData = GetNewSeniorBeaconData();
+         if ((IAmTheSeniorPeerOfAnyDatabase())||(_unconfirmedDatabaseHandoffs.HasItems())) beaconData = GetNewSeniorBeaconData();
          if (nios->SetBeaconData(beaconData).IsError()) LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession:  Couldn't set beacon data!\n");
       }
    }
 }
 
-void ZGPeerSession :: BeaconDataChanged(const ConstPZGBeaconDataRef & beaconData)
+void ZGPeerSession :: JuniorDatabaseStateChanged()
+{
+   if (_juniorDatabaseStatesReportPending == false)
+   {
+      _juniorDatabaseStatesReportPending = true;
+      InvalidatePulseTime();
+   }
+}
+
+bool ZGPeerSession :: IsJuniorDatabaseStatesReportReady() const
+{
+   if (_juniorDatabaseStatesReportPending == false) return false;
+
+   // We're ready iff there is at least one database that we are a junior peer of
+   for (uint32 i=0; i<_databaseSeniorPeerIDs.GetNumItems(); i++) if ((_databaseSeniorPeerIDs[i].IsValid())&&(_databaseSeniorPeerIDs[i] != _localPeerID)) return true;
+   return false;
+}
+
+void ZGPeerSession :: ReportJuniorDatabaseStatesToSeniorPeer(uint64 now)
+{
+   _juniorDatabaseStatesReportPending  = false;
+   _nextJuniorDatabaseStatesReportTime = now + PZG_JUNIOR_DATABASE_STATES_REPORT_INTERVAL;  // so we won't flood the senior peer with reports
+
+   MessageRef msg = GetMessageFromPool(PZG_PEER_COMMAND_JUNIOR_DATABASE_STATES);
+   for (uint32 i=0; (msg())&&(i<_databases.GetNumItems()); i++) if (msg()->AddInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID, _databases[i].GetCurrentDatabaseStateID()).IsError()) msg.Reset();
+
+   // Every database's senior peer gets the full report; each one just ignores the states of the databases it isn't the senior peer of
+   Hashtable<ZGPeerID, Void> seniorPeerIDs;
+   GetRemoteDatabaseSeniorPeerIDs(seniorPeerIDs);
+   for (HashtableIterator<ZGPeerID, Void> iter(seniorPeerIDs); iter.HasData(); iter++)
+   {
+      const status_t ret = msg() ? SendUnicastInternalMessageToPeer(iter.GetKey(), msg) : B_OUT_OF_MEMORY;
+      if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession:  Unable to report junior database states to senior peer [%s] [%s]\n", iter.GetKey().ToString()(), ret());
+   }
+}
+
+void ZGPeerSession :: ReportUpdateTicketCommitted(const ZGPeerID & requesterID, uint32 whichDatabase, uint64 ticketID, uint32 updateResult, uint64 databaseStateID)
+{
+   if (ticketID == 0) return;  // the requester didn't ask to hear about this update
+
+   MessageRef msg = GetMessageFromPool(PZG_PEER_COMMAND_UPDATE_COMMITTED);
+   if ((msg())&&((msg()->AddInt32(PZG_PEER_NAME_DATABASE_ID, whichDatabase).IsError())||(msg()->AddInt64(PZG_PEER_NAME_TICKET_ID, ticketID).IsError())||(msg()->CAddInt32(PZG_PEER_NAME_UPDATE_RESULT, updateResult).IsError())||(msg()->AddInt64(PZG_PEER_NAME_DATABASE_UPDATE_ID, databaseStateID).IsError()))) msg.Reset();
+
+   const status_t ret = msg() ? SendUnicastInternalMessageToPeer(requesterID, msg) : B_OUT_OF_MEMORY;
+   if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession:  Unable to report commit of ticket " UINT64_FORMAT_SPEC " to peer [%s] [%s]\n", ticketID, requesterID.ToString()(), ret());
+}
+
+void ZGPeerSession :: BeaconDataChanged(const ZGPeerID & sourcePeerID, const ConstPZGBeaconDataRef & beaconData)
 {
    const uint32 numDBIs = beaconData() ? beaconData()->GetDatabaseStateInfos().GetNumItems() : 0;
    if (numDBIs == _databases.GetNumItems())
    {
-      for (uint32 i=0; i<numDBIs; i++) _databases[i].SeniorDatabaseStateInfoChanged(beaconData()->GetDatabaseStateInfos()[i]);
+      if (_peerSettings.ArePerDatabaseSeniorPeersEnabled()) UpdateDatabaseSeniorPeerIDsFromBeacon(sourcePeerID, beaconData()->GetDatabaseSeniorPeerIDs());
+
+      // A beacon's info about a database is only authoritative if it came from that database's senior peer
+      for (uint32 i=0; i<numDBIs; i++) if (sourcePeerID == GetDatabaseSeniorPeerID(i)) _databases[i].SeniorDatabaseStateInfoChanged(beaconData()->GetDatabaseStateInfos()[i]);
    }
    else LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession::BeaconDataChanged:  Wrong number of DBIs in update!  (Expected " UINT32_FORMAT_SPEC ", got " UINT32_FORMAT_SPEC ")\n", _databases.GetNumItems(),  numDBIs);
 }
 
 
-void ZGPeerSession :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData)
+void ZGPeerSession :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply)
 {
    const uint32 whichDB = ubok.GetDatabaseIndex();
-   if (_databases.IsIndexValid(whichDB)) _databases[whichDB].BackOrderResultReceived(ubok, optUpdateData);
+   if (_databases.IsIndexValid(whichDB)) _databases[whichDB].BackOrderResultReceived(ubok, optUpdateData, isFinalReply);
 }
 
 void ZGPeerSession :: VerifyOrFixLocalDatabaseChecksum(uint32 whichDB)
@@ -537,7 +1033,7 @@ void ZGPeerSession :: VerifyOrFixLocalDatabaseChecksum(uint32 whichDB)
                                     else LogTime(MUSCLE_LOG_ERROR, "ZGPeerSession::VerifyOrFixLocalDatabaseChecksum:  Unknown database ID #" UINT32_FORMAT_SPEC "\n", whichDB);
 }
 
-ConstPZGDatabaseUpdateRef ZGPeerSession :: GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID) const
+ConstPZGDatabaseUpdateRef ZGPeerSession :: GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID, bool * optRetReadFromDisk) const
 {
    if (_databases.IsIndexValid(whichDB) == false)
    {
@@ -545,7 +1041,12 @@ ConstPZGDatabaseUpdateRef ZGPeerSession :: GetDatabaseUpdateByID(uint32 whichDB,
       return ConstPZGDatabaseUpdateRef();
    }
 
-   return _databases[whichDB].GetDatabaseUpdateByID(updateID, *this);
+   return _databases[whichDB].GetDatabaseUpdateByID(updateID, *this, optRetReadFromDisk);
+}
+
+PZGDatabaseStateInfo ZGPeerSession :: GetLocalDatabaseStateInfo(uint32 whichDB) const
+{
+   return _databases.IsIndexValid(whichDB) ? _databases[whichDB].GetDatabaseStateInfo() : PZGDatabaseStateInfo();
 }
 
 int64 ZGPeerSession :: GetToNetworkTimeOffset() const
@@ -0,0 +1,224 @@
+#include "zg/private/PZGBatchedUDPSocketDataIO.h"
+
+#ifdef PZG_USE_RECVMMSG
+# include <errno.h>
+# include <string.h>
+#endif
+
+namespace zg_private
+{
+
+PZGBatchedUDPSocketDataIO :: PZGBatchedUDPSocketDataIO(const ConstSocketRef & sock, uint32 maxPacketSize)
+   : UDPSocketDataIO(sock, false)
+   , _lastPacketReceiveTime(0)
+#ifdef PZG_USE_RECVMMSG
+   , _batchingEnabled(true)
+#else
+   , _batchingEnabled(false)
+#endif
+#ifdef PZG_USE_SENDMMSG
+   , _sendBatchingEnabled(true)
+#else
+   , _sendBatchingEnabled(false)
+#endif
+#ifdef PZG_USE_RECVMMSG
+   , _maxPacketSize(muscleMax(maxPacketSize, (uint32)1))
+   , _numPacketsInBatch(0)
+   , _nextPacketIndex(0)
+#endif
+{
+#ifdef PZG_USE_RECVMMSG
+   if (_slab.SetNumBytes(PZG_MAX_PACKETS_PER_BATCH*_maxPacketSize, false).IsError()) _batchingEnabled = false;
+
+   // Ask the kernel to tag each packet with the time it arrived, since we may not get around to reading it until a bit later
+   const int fd = sock.GetFileDescriptor();
+   const int enable = 1;
+   if ((fd >= 0)&&(setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0)) LogTime(MUSCLE_LOG_DEBUG, "PZGBatchedUDPSocketDataIO:  Couldn't enable SO_TIMESTAMPNS on socket, packet receive-times will be approximate.\n");
+#else
+   (void) maxPacketSize;
+#endif
+}
+
+#ifdef PZG_USE_RECVMMSG
+// Converts a received packet's source address into MUSCLE's representation
+static IPAddressAndPort SockAddrToIPAddressAndPort(const struct sockaddr_storage & sa)
+{
+   if (sa.ss_family == AF_INET6)
+   {
+      const struct sockaddr_in6 & sin6 = reinterpret_cast<const struct sockaddr_in6 &>(sa);
+      IPAddress ip(BigEndianConverter::Import<uint64>(sin6.sin6_addr.s6_addr+sizeof(uint64)), BigEndianConverter::Import<uint64>(sin6.sin6_addr.s6_addr));  // (lowBits, highBits)
+      if (sin6.sin6_scope_id != 0) ip.SetInterfaceIndex(sin6.sin6_scope_id);
+      return IPAddressAndPort(ip, ntohs(sin6.sin6_port));
+   }
+   else if (sa.ss_family == AF_INET)
+   {
+      const struct sockaddr_in & sin = reinterpret_cast<const struct sockaddr_in &>(sa);
+      IPAddress ip; ip.SetIPv4AddressFromUint32(ntohl(sin.sin_addr.s_addr));
+      return IPAddressAndPort(ip, ntohs(sin.sin_port));
+   }
+   else return IPAddressAndPort();
+}
+
+status_t PZGBatchedUDPSocketDataIO :: ReceiveNextBatch()
+{
+   _numPacketsInBatch = _nextPacketIndex = 0;
+
+   const int fd = GetReadSelectSocket().GetFileDescriptor();
+   if (fd < 0) return B_BAD_OBJECT;
+
+   // recvmmsg() overwrites some of these fields, so they need to be reset before every call
+   for (uint32 i=0; i<PZG_MAX_PACKETS_PER_BATCH; i++)
+   {
+      _iovecs[i].iov_base = _slab.GetBuffer()+(i*_maxPacketSize);
+      _iovecs[i].iov_len  = _maxPacketSize;
+
+      struct msghdr & mh = _msgHeaders[i].msg_hdr;
+      mh.msg_name       = &_sourceAddresses[i];
+      mh.msg_namelen    = sizeof(_sourceAddresses[i]);
+      mh.msg_iov        = &_iovecs[i];
+      mh.msg_iovlen     = 1;
+      mh.msg_control    = _controlBufs[i];
+      mh.msg_controllen = sizeof(_controlBufs[i]);
+      mh.msg_flags      = 0;
+      _msgHeaders[i].msg_len = 0;
+   }
+
+   const int numReceived = recvmmsg(fd, _msgHeaders, PZG_MAX_PACKETS_PER_BATCH, MSG_DONTWAIT, NULL);
+   if (numReceived < 0)
+   {
+      if ((errno == EAGAIN)||(errno == EWOULDBLOCK)||(errno == EINTR)) return B_NO_ERROR;  // nothing to read right now
+      if ((errno == ENOSYS)||(errno == EOPNOTSUPP))
+      {
+         LogTime(MUSCLE_LOG_DEBUG, "PZGBatchedUDPSocketDataIO:  recvmmsg() isn't supported, falling back to reading one packet per call.\n");
+         _batchingEnabled = false;
+         return B_NO_ERROR;
+      }
+      return B_IO_ERROR;
+   }
+
+   // Convert the kernel's (wall-clock) receive-timestamps into our GetRunTime64() time-base
+   const uint64 nowRunTime = GetRunTime64();
+   struct timespec nowRealTime;
+   const bool haveRealTime = (clock_gettime(CLOCK_REALTIME, &nowRealTime) == 0);
+   for (int i=0; i<numReceived; i++)
+   {
+      _packetReceiveTimes[i] = nowRunTime;  // default, in case the kernel didn't give us a timestamp
+
+      struct msghdr & mh = _msgHeaders[i].msg_hdr;
+      for (struct cmsghdr * cm = haveRealTime ? CMSG_FIRSTHDR(&mh) : NULL; cm != NULL; cm = CMSG_NXTHDR(&mh, cm))
+      {
+         if ((cm->cmsg_level == SOL_SOCKET)&&(cm->cmsg_type == SCM_TIMESTAMPNS))
+         {
+            struct timespec kernelTime; memcpy(&kernelTime, CMSG_DATA(cm), sizeof(kernelTime));
+            const int64 ageMicros = ((((int64)nowRealTime.tv_sec)-kernelTime.tv_sec)*MICROS_PER_SECOND)+((((int64)nowRealTime.tv_nsec)-kernelTime.tv_nsec)/1000);
+            if ((ageMicros > 0)&&(((uint64)ageMicros) < nowRunTime)) _packetReceiveTimes[i] = nowRunTime-ageMicros;
+            break;
+         }
+      }
+   }
+
+   _numPacketsInBatch = (uint32) numReceived;
+   return B_NO_ERROR;
+}
+#endif
+
+io_status_t PZGBatchedUDPSocketDataIO :: ReadFrom(void * buffer, uint32 size, IPAddressAndPort & retPacketSource)
+{
+#ifdef PZG_USE_RECVMMSG
+   if (_batchingEnabled)
+   {
+      // Skip any zero-length packets, since returning 0 would make our caller think there's nothing left to read
+      while((_nextPacketIndex < _numPacketsInBatch)&&(_msgHeaders[_nextPacketIndex].msg_len == 0)) _nextPacketIndex++;
+      if (_nextPacketIndex >= _numPacketsInBatch)
+      {
+         MRETURN_ON_ERROR(ReceiveNextBatch());
+         while((_nextPacketIndex < _numPacketsInBatch)&&(_msgHeaders[_nextPacketIndex].msg_len == 0)) _nextPacketIndex++;
+      }
+
+      if (_batchingEnabled)  // ReceiveNextBatch() may have disabled it
+      {
+         if (_nextPacketIndex >= _numPacketsInBatch) return io_status_t(0);  // nothing more to read, for now
+
+         const uint32 idx      = _nextPacketIndex++;
+         const uint32 numBytes = muscleMin((uint32) _msgHeaders[idx].msg_len, _maxPacketSize, size);
+         memcpy(buffer, _slab.GetBuffer()+(idx*_maxPacketSize), numBytes);
+         _lastPacketReceiveTime = _packetReceiveTimes[idx];
+         _lastPacketSource      = SockAddrToIPAddressAndPort(_sourceAddresses[idx]);
+         if (&retPacketSource != &_lastPacketSource) retPacketSource = _lastPacketSource;
+         return io_status_t(numBytes);
+      }
+   }
+#endif
+
+   const io_status_t ret = UDPSocketDataIO::ReadFrom(buffer, size, retPacketSource);
+   if (ret.GetByteCount() > 0)
+   {
+      _lastPacketReceiveTime = GetRunTime64();
+      if (&retPacketSource != &_lastPacketSource) _lastPacketSource = retPacketSource;
+   }
+   return ret;
+}
+
+io_status_t PZGBatchedUDPSocketDataIO :: WritePackets(Queue<ConstByteBufferRef> & packets)
+{
+#ifdef PZG_USE_SENDMMSG
+   const IPAddressAndPort & dest = GetPacketSendDestination();
+   if ((_sendBatchingEnabled == false)||(dest.GetIPAddress().IsIPv4())) return B_UNIMPLEMENTED;
+
+   const int fd = GetWriteSelectSocket().GetFileDescriptor();
+   if (fd < 0) return B_BAD_OBJECT;
+
+   struct sockaddr_in6 destAddr; memset(&destAddr, 0, sizeof(destAddr));
+   destAddr.sin6_family   = AF_INET6;
+   destAddr.sin6_port     = htons(dest.GetPort());
+   destAddr.sin6_scope_id = dest.GetIPAddress().GetInterfaceIndex();
+   BigEndianConverter::Export(dest.GetIPAddress().GetHighBits(), destAddr.sin6_addr.s6_addr);
+   BigEndianConverter::Export(dest.GetIPAddress().GetLowBits(),  destAddr.sin6_addr.s6_addr+sizeof(uint64));
+
+   uint32 totalBytesSent = 0;
+   while(packets.HasItems())
+   {
+      const uint32 numToSend = muscleMin(packets.GetNumItems(), (uint32) PZG_MAX_PACKETS_PER_BATCH);
+      for (uint32 i=0; i<numToSend; i++)
+      {
+         const ByteBuffer & packet = *packets[i]();
+         _sendIovecs[i].iov_base = const_cast<uint8 *>(packet.GetBuffer());
+         _sendIovecs[i].iov_len  = packet.GetNumBytes();
+
+         struct msghdr & mh = _sendMsgHeaders[i].msg_hdr;
+         memset(&mh, 0, sizeof(mh));
+         mh.msg_name    = &destAddr;
+         mh.msg_namelen = sizeof(destAddr);
+         mh.msg_iov     = &_sendIovecs[i];
+         mh.msg_iovlen  = 1;
+         _sendMsgHeaders[i].msg_len = 0;
+      }
+
+      const int numSent = sendmmsg(fd, _sendMsgHeaders, numToSend, MSG_DONTWAIT);
+      if (numSent < 0)
+      {
+         if ((errno == EAGAIN)||(errno == EWOULDBLOCK)||(errno == EINTR)) break;  // send-buffer is full; we'll send the rest when the socket is ready-for-write
+         if ((totalBytesSent == 0)&&((errno == ENOSYS)||(errno == EOPNOTSUPP)))
+         {
+            LogTime(MUSCLE_LOG_DEBUG, "PZGBatchedUDPSocketDataIO:  sendmmsg() isn't supported, falling back to sending one packet per call.\n");
+            _sendBatchingEnabled = false;  // but leave batched receives alone, since recvmmsg() may still work fine
+            return B_UNIMPLEMENTED;
+         }
+         return (totalBytesSent > 0) ? io_status_t(totalBytesSent) : io_status_t(B_IO_ERROR);
+      }
+
+      for (int i=0; i<numSent; i++)
+      {
+         totalBytesSent += packets.Head()()->GetNumBytes();
+         (void) packets.RemoveHead();
+      }
+      if (((uint32)numSent) < numToSend) break;  // send-buffer is full
+   }
+   return io_status_t(totalBytesSent);
+#else
+   (void) packets;
+   return B_UNIMPLEMENTED;
+#endif
+}
+
+}  // end namespace zg_private
@@ -7,6 +7,9 @@ void PZGBeaconData :: Flatten(DataFlattener flat) const
 {
    flat.WriteInt32(_dbis.GetNumItems());
    for (uint32 i=0; i<_dbis.GetNumItems(); i++) flat.WriteFlat(_dbis[i]);
+
+   flat.WriteInt32(_databaseSeniorPeerIDs.GetNumItems());
+   for (uint32 i=0; i<_databaseSeniorPeerIDs.GetNumItems(); i++) flat.WriteFlat(_databaseSeniorPeerIDs[i]);
 }
 
 status_t PZGBeaconData :: Unflatten(DataUnflattener & unflat)
@@ -16,6 +19,12 @@ status_t PZGBeaconData :: Unflatten(DataUnflattener & unflat)
 
    MRETURN_ON_ERROR(_dbis.EnsureSize(newNumItems, true));
    for (uint32 i=0; i<newNumItems; i++) MRETURN_ON_ERROR(unflat.ReadFlat(_dbis[i]));
+
+   const uint32 newNumSeniorPeerIDs = unflat.ReadInt32();
+   if (unflat.GetNumBytesAvailable() < SaturatingUnsignedMultiply(newNumSeniorPeerIDs, ZGPeerID::FlattenedSize())) return B_BAD_DATA;
+
+   MRETURN_ON_ERROR(_databaseSeniorPeerIDs.EnsureSize(newNumSeniorPeerIDs, true));
+   for (uint32 i=0; i<newNumSeniorPeerIDs; i++) MRETURN_ON_ERROR(unflat.ReadFlat(_databaseSeniorPeerIDs[i]));
    return unflat.GetStatus();
 }
 
@@ -31,6 +40,7 @@ uint32 PZGBeaconData :: CalculateChecksum() const
 
    uint32 ret = numItems;
    for (uint32 i=0; i<numItems; i++) ret += (i+1)*(_dbis[i].CalculateChecksum());
+   for (uint32 i=0; i<_databaseSeniorPeerIDs.GetNumItems(); i++) ret += (i+1)*(_databaseSeniorPeerIDs[i].CalculateChecksum());
    return ret;
 }
 
@@ -49,6 +59,11 @@ String PZGBeaconData :: ToString() const
       muscleSprintf(buf, "   DBI #" UINT32_FORMAT_SPEC ": ", i);
       ret += buf;
       ret += _dbis[i].ToString();
+      if (_databaseSeniorPeerIDs.IsIndexValid(i))
+      {
+         ret += " senior=";
+         ret += _databaseSeniorPeerIDs[i].ToString();
+      }
       ret += '\n';
    }
    return ret;
@@ -56,7 +71,7 @@ String PZGBeaconData :: ToString() const
 
 bool PZGBeaconData :: operator == (const PZGBeaconData & rhs) const
 {
-   return (_dbis == rhs._dbis);
+   return ((_dbis == rhs._dbis)&&(_databaseSeniorPeerIDs == rhs._databaseSeniorPeerIDs));
 }
 
 }  // end namespace zg_private
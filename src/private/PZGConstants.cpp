@@ -4,13 +4,22 @@
 namespace zg_private
 {
 
-const String PZG_PEER_NAME_USER_MESSAGE        = "ums";
-const String PZG_PEER_NAME_DATABASE_ID         = "dbi";
-const String PZG_PEER_NAME_DATABASE_UPDATE     = "dbu";
-const String PZG_PEER_NAME_DATABASE_UPDATE_ID  = "dui";
-const String PZG_PEER_NAME_TEXT                = "txt";
-const String PZG_PEER_NAME_CHECKSUM_MISMATCH   = "chk";
-const String PZG_PEER_NAME_BACK_ORDER          = "ubok";
+const String PZG_PEER_NAME_USER_MESSAGE            = "ums";
+const String PZG_PEER_NAME_DATABASE_ID             = "dbi";
+const String PZG_PEER_NAME_DATABASE_UPDATE         = "dbu";
+const String PZG_PEER_NAME_DATABASE_UPDATE_ID      = "dui";
+const String PZG_PEER_NAME_TEXT                    = "txt";
+const String PZG_PEER_NAME_CHECKSUM_MISMATCH       = "chk";
+const String PZG_PEER_NAME_BACK_ORDER              = "ubok";
+const String PZG_PEER_NAME_SUBMIT_TIME             = "sbt";
+const String PZG_PEER_NAME_MULTICAST_SEND_TIME     = "mst";
+const String PZG_PEER_NAME_MULTICAST_RECEIVE_TIME  = "mrt";
+const String PZG_PEER_NAME_TICKET_ID               = "tkt";
+const String PZG_PEER_NAME_READ_BARRIER_ID         = "rbi";
+const String PZG_PEER_NAME_EXPECTED_STATE_ID       = "esi";
+const String PZG_PEER_NAME_UPDATE_RESULT           = "urs";
+const String PZG_PEER_NAME_NOT_SENIOR              = "nsr";
+const String PZG_PEER_NAME_ORIGINAL_REQUESTER      = "orq";
 
 /** Return a brief description of the peerInfo data that we can display easily on a single line */
 String PeerInfoToString(const ConstMessageRef & peerInfo)
@@ -5,11 +5,26 @@
 namespace zg_private
 {
 
+// Maximum number of consecutive database updates we'll request from the senior peer via a single range-back-order
+static const uint32 PZG_MAX_UPDATES_PER_BACK_ORDER = 1024;
+
+// Expected-state-ID value for an update-request that isn't conditional
+static const uint64 PZG_UNCONDITIONAL_UPDATE = (uint64)-1;
+
+// How often the senior peer re-checks its update-headroom while admission control is holding back update-requests
+static const uint64 PZG_ADMISSION_CONTROL_RECHECK_INTERVAL = MillisToMicros(10);
+static const uint32 PZG_MAX_DELAYED_SENIOR_UPDATE_REQUESTS = 16384;  // beyond this many held-back requests, admission control rejects new ones instead
+static const uint64 PZG_MIN_UPDATE_LOG_GAP_SLOTS = 1024;  // we'll always tolerate at least this many missing updates in a row in our update log
+
 PZGDatabaseState :: PZGDatabaseState()
    : _master(NULL)
    , _whichDatabase((uint32)-1)
    , _maxPayloadBytesInLog(0)
+   , _minPayloadBytesInLog(0)
+   , _maxUpdateLogGapSlots(PZG_MIN_UPDATE_LOG_GAP_SLOTS)
    , _totalPayloadBytesInLog(0)
+   , _keepUpdateLogCompressed(false)
+   , _payloadCompressionLevel(9)
    , _totalElapsedMillisInLog(0)
    , _localDatabaseStateID(0)
    , _seniorDatabaseStateID(0)
@@ -20,15 +35,46 @@ PZGDatabaseState :: PZGDatabaseState()
    , _rescanLogPending(false)
    , _printDatabaseStatesComparisonOnNextReplace(false)
    , _seniorUpdateTimeForJuniorUpdate(0)
+   , _groupCommitMaxBatchSize(1)
+   , _groupCommitMaxAddedLatency(0)
+   , _groupCommitFlushTime(MUSCLE_TIME_NEVER)
+   , _pendingSeniorUpdatesSubmitTime(0)
+   , _admissionMaxJuniorLag(0)
+   , _admissionMaxMulticastBacklog(0)
+   , _admissionRecheckTime(MUSCLE_TIME_NEVER)
+   , _seniorUpdateHeadroom((uint64)-1)
+   , _durableLog(NULL)
+   , _durableSnapshotInterval(0)
+   , _updatesSinceDurableSnapshot(0)
+   , _verifyRestoredStateOnNextBeacon(false)
+   , _latencyTracingEnabled(false)
+   , _numBackOrdersRequested(0)
+   , _numFullResendsRequested(0)
+   , _numChecksumMismatches(0)
+   , _numUpdatesTrimmedFromLog(0)
+   , _numStaleUpdatesRejected(0)
+   , _updateLogDepthTotal(0)
+   , _numUpdateLogDepthSamples(0)
 {
    // empty
 }
 
-void PZGDatabaseState :: SetParameters(ZGPeerSession * master, uint32 whichDatabase, uint64 maxPayloadBytesInLog)
+void PZGDatabaseState :: SetParameters(ZGPeerSession * master, uint32 whichDatabase, const ZGPeerSettings & peerSettings, PZGDurableLog * optDurableLog)
 {
-   _master               = master;
-   _whichDatabase        = whichDatabase;
-   _maxPayloadBytesInLog = maxPayloadBytesInLog;
+   _master                     = master;
+   _whichDatabase              = whichDatabase;
+   _maxPayloadBytesInLog       = peerSettings.GetMaximumUpdateLogSizeForDatabase(whichDatabase);
+   _minPayloadBytesInLog       = muscleMin(peerSettings.GetMinimumUpdateLogSizeForDatabase(whichDatabase), _maxPayloadBytesInLog);
+   _maxUpdateLogGapSlots       = muscleMax((uint64)PZG_MIN_UPDATE_LOG_GAP_SLOTS, _maxPayloadBytesInLog/sizeof(ConstPZGDatabaseUpdateRef));
+   _keepUpdateLogCompressed    = peerSettings.IsUpdateLogCompressedForDatabase(whichDatabase);
+   _payloadCompressionLevel    = (uint8) peerSettings.GetPayloadCompressionLevelForDatabase(whichDatabase);
+   _groupCommitMaxBatchSize    = peerSettings.GetGroupCommitMaxBatchSizeForDatabase(whichDatabase);
+   _groupCommitMaxAddedLatency = peerSettings.GetGroupCommitMaxAddedLatencyForDatabase(whichDatabase);
+   _admissionMaxJuniorLag        = peerSettings.GetAdmissionControlMaxJuniorLagForDatabase(whichDatabase);
+   _admissionMaxMulticastBacklog = peerSettings.GetAdmissionControlMaxMulticastBacklogForDatabase(whichDatabase);
+   _durableLog                 = ((optDurableLog)&&(optDurableLog->IsEnabled())) ? optDurableLog : NULL;
+   _durableSnapshotInterval    = peerSettings.GetDurableSnapshotInterval();
+   _latencyTracingEnabled      = peerSettings.IsLatencyTracingEnabled();
 }
 
 void PZGDatabaseState :: ScheduleLogContentsRescan()
@@ -44,16 +90,32 @@ status_t PZGDatabaseState :: AddDatabaseUpdateToUpdateLog(const ConstPZGDatabase
 {
    if (dbUp() == NULL) return B_BAD_ARGUMENT;
 
+   const uint64 updateID = dbUp()->GetUpdateID();
+   const uint64 gapSize  = _updateLog.GetNumGapSlotsForKey(updateID);
+   if (gapSize > _maxUpdateLogGapSlots)
+   {
+      // Bridging a gap this large would cost more RAM than our whole log budget, and the updates in between would likely
+      // be trimmed before they could ever arrive anyway.  So we start the log over again at (updateID) instead.
+      LogTime(MUSCLE_LOG_DEBUG, "Database #" UINT32_FORMAT_SPEC ":  Update #" UINT64_FORMAT_SPEC " would leave a gap of " UINT64_FORMAT_SPEC " slots in the update log, clearing the log.\n", _whichDatabase, updateID, gapSize);
+      ClearUpdateLog();
+   }
+
    const bool logWasEmpty = _updateLog.IsEmpty();
 
-   MRETURN_ON_ERROR(_updateLog.Put(dbUp()->GetUpdateID(), dbUp));
+   MRETURN_ON_ERROR(_updateLog.Put(updateID, dbUp));
+
+   // The multicast I/O thread pre-inflates each junior update's payload for us.  Normally that inflated Message is dropped after
+   // the update gets executed, but an update our local database already reflects (e.g. a duplicate) will never be executed here
+   if ((_keepUpdateLogCompressed)&&(updateID <= _localDatabaseStateID)) dbUp()->UncachePayloadBufferAsMessage();
+   _updateLogDepthTotal += _updateLog.GetNumItems();
+   _numUpdateLogDepthSamples++;
 
    const ConstByteBufferRef & payloadBuf = dbUp()->GetPayloadBuffer();
    if (payloadBuf()) _totalPayloadBytesInLog += payloadBuf()->GetNumBytes();
 
    _totalElapsedMillisInLog += dbUp()->GetSeniorElapsedTimeMillis();
 
-   if ((logWasEmpty)&&(_master->IAmTheSeniorPeer())) _seniorOldestIDInLog = dbUp()->GetUpdateID();  // probably not necessary but I like to keep it correct
+   if ((logWasEmpty)&&(_master->IAmTheDatabaseSeniorPeer(_whichDatabase))) _seniorOldestIDInLog = updateID;  // probably not necessary but I like to keep it correct
    ScheduleLogContentsRescan();
    return B_NO_ERROR;
 }
@@ -68,7 +130,7 @@ void PZGDatabaseState :: RemoveDatabaseUpdateFromUpdateLog(const ConstPZGDatabas
 
       _totalElapsedMillisInLog -= temp()->GetSeniorElapsedTimeMillis();
 
-      if ((_updateLog.IsEmpty())&&(_master->IAmTheSeniorPeer())) _seniorOldestIDInLog = (uint64)-1;  // probably not necessary but I like to keep it correct
+      if ((_updateLog.IsEmpty())&&(_master->IAmTheDatabaseSeniorPeer(_whichDatabase))) _seniorOldestIDInLog = (uint64)-1;  // probably not necessary but I like to keep it correct
    }
 }
 
@@ -79,15 +141,29 @@ void PZGDatabaseState :: ClearUpdateLog()
    _totalElapsedMillisInLog = 0;
 }
 
+void PZGDatabaseState :: TrimUpdateLogThrough(uint64 lastUpdateID)
+{
+   while((_updateLog.HasItems())&&(_updateLog.GetFirstKeyWithDefault() <= lastUpdateID)) RemoveDatabaseUpdateFromUpdateLog(_updateLog.GetFirstValue());
+}
+
 void PZGDatabaseState :: SeniorUpdateCompleted(const PZGDatabaseUpdateRef & dbUp, uint64 startTime, const ConstMessageRef & payloadMsg, const INetworkTimeProvider & networkTimeProvider)
 {
    // Gotta update our running time and byte tallies as we update dbUp
    _totalElapsedMillisInLog -= dbUp()->GetSeniorElapsedTimeMillis();
+   const uint64 endTime = GetRunTime64();
    dbUp()->SetSeniorStartTimeMicros(networkTimeProvider.GetNetworkTime64ForRunTime64(startTime));
-   dbUp()->SetSeniorElapsedTimeMicros(GetRunTime64()-startTime);
+   dbUp()->SetSeniorElapsedTimeMicros(endTime-startTime);
    _totalElapsedMillisInLog += dbUp()->GetSeniorElapsedTimeMillis();
 
+   if (_latencyTracingEnabled)
+   {
+      dbUp()->SetSeniorCommitTimeMicros(networkTimeProvider.GetNetworkTime64ForRunTime64(endTime));
+      AddLatencySample(ZG_LATENCY_STAGE_SUBMIT_TO_SENIOR_START, dbUp()->GetRequestSubmitTimeMicros(), dbUp()->GetSeniorStartTimeMicros());
+      _latencyHistograms[ZG_LATENCY_STAGE_SENIOR_EXECUTE].AddSample(endTime-startTime);
+   }
+
    dbUp()->SetPostUpdateDBChecksum(_dbChecksum);
+   dbUp()->SetPayloadCompressionLevel(_payloadCompressionLevel);
 
    if (payloadMsg() != dbUp()->GetPayloadBufferAsMessage()())
    {
@@ -102,6 +178,80 @@ void PZGDatabaseState :: SeniorUpdateCompleted(const PZGDatabaseUpdateRef & dbUp
 
    _seniorDatabaseStateID = ++_localDatabaseStateID;
    _master->ScheduleSetBeaconData();
+   ReportLocallyAppliedUpdateTickets();  // in case we requested some updates (or read barriers) back when we were still a junior peer
+   ReportPassedReadBarriers();
+
+   if (_keepUpdateLogCompressed)
+   {
+      (void) dbUp()->GetPayloadBuffer();        // make sure the compressed version exists (we'll need it for multicast anyway)
+      dbUp()->UncachePayloadBufferAsMessage();  // so that our update-log entry's RAM usage is just its compressed size
+   }
+
+   RecordDatabaseUpdateDurably(dbUp);
+}
+
+void PZGDatabaseState :: RecordDatabaseUpdateDurably(const ConstPZGDatabaseUpdateRef & dbUp)
+{
+   if (_durableLog == NULL) return;
+
+   status_t ret;
+   if (_durableLog->AppendDatabaseUpdate(_whichDatabase, dbUp).IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_WARNING, "PZGDatabaseState:  Unable to append update #" UINT64_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " to the durable log [%s], saving a new snapshot instead.\n", dbUp()->GetUpdateID(), _whichDatabase, ret());
+      SaveDurableSnapshot();
+   }
+   else if (++_updatesSinceDurableSnapshot >= _durableSnapshotInterval) SaveDurableSnapshot();
+}
+
+void PZGDatabaseState :: SaveDurableSnapshot()
+{
+   if (_durableLog == NULL) return;
+
+   _updatesSinceDurableSnapshot = 0;  // set this now so that if we fail, we won't retry on every subsequent update
+
+   status_t ret;
+   ConstPZGDatabaseUpdateRef fullStateUpdate = GetDatabaseUpdateByID(DATABASE_UPDATE_ID_FULL_UPDATE, *_master);
+   if ((fullStateUpdate() == NULL)||(_durableLog->SaveSnapshot(_whichDatabase, fullStateUpdate).IsError(ret))) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState:  Unable to save durable snapshot of database #" UINT32_FORMAT_SPEC " at state " UINT64_FORMAT_SPEC "! [%s]\n", _whichDatabase, _localDatabaseStateID, fullStateUpdate() ? ret() : fullStateUpdate.GetStatus()());
+}
+
+status_t PZGDatabaseState :: RestoreFromDurableLog()
+{
+   if (_durableLog == NULL) return B_NO_ERROR;  // nothing to restore from
+
+   ConstPZGDatabaseUpdateRef snapshot;
+   Queue<ConstPZGDatabaseUpdateRef> updates;
+   MRETURN_ON_ERROR(_durableLog->LoadDatabaseState(_whichDatabase, snapshot, updates));
+
+   {
+      NestCountGuard ncg(_inJuniorDatabaseUpdate);
+
+      status_t ret;
+      if ((snapshot())&&(JuniorExecuteDatabaseReplace(*snapshot()).IsError(ret)))
+      {
+         LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState:  Unable to restore database #" UINT32_FORMAT_SPEC " from its durable snapshot [%s], resetting it to default instead.\n", _whichDatabase, ret());
+         ResetLocalDatabaseToDefaultState();
+         _localDatabaseStateID = 0;
+      }
+
+      // Replay any updates that were logged after the snapshot was taken (JuniorExecuteDatabaseUpdate() will verify their sequence and checksums)
+      for (uint32 i=0; i<updates.GetNumItems(); i++)
+      {
+         if (JuniorExecuteDatabaseUpdate(*updates[i]()).IsError(ret))
+         {
+            LogTime(MUSCLE_LOG_WARNING, "PZGDatabaseState:  Stopped replaying durable log of database #" UINT32_FORMAT_SPEC " at update #" UINT64_FORMAT_SPEC " [%s]\n", _whichDatabase, updates[i]()->GetUpdateID(), ret());
+            break;
+         }
+         (void) AddDatabaseUpdateToUpdateLog(updates[i]);
+      }
+   }
+
+   _firstUnsentUpdateID             = _localDatabaseStateID+1;  // the other peers either have these already, or will get them via back-order
+   _verifyRestoredStateOnNextBeacon = (_localDatabaseStateID > 0);
+   if (_localDatabaseStateID > 0) LogTime(MUSCLE_LOG_INFO, "Restored database #" UINT32_FORMAT_SPEC " to state #" UINT64_FORMAT_SPEC " from durable storage.\n", _whichDatabase, _localDatabaseStateID);
+
+   // Start a fresh snapshot and log-segment from here, so that we'll never append to a log that we couldn't fully replay
+   SaveDurableSnapshot();
+   return B_NO_ERROR;
 }
 
 void PZGDatabaseState :: ResetLocalDatabaseToDefaultState()
@@ -115,12 +265,17 @@ void PZGDatabaseState :: ResetLocalDatabaseToDefaultState()
 // So we don't do that checking here.
 status_t PZGDatabaseState :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPeerID, const ConstMessageRef & msg, const ConstPZGDatabaseUpdateRef & optDBUp, const INetworkTimeProvider & networkTimeProvider)
 {
+   const uint64 submitTime = msg()->GetInt64(PZG_PEER_NAME_SUBMIT_TIME);  // will be 0 if the requesting peer isn't tracing latencies
    switch(msg()->what)
    {
       case PZG_PEER_COMMAND_RESET_SENIOR_DATABASE:
       {
+         ReleaseDelayedSeniorUpdates(true);  // any requests admission-control is holding back were accepted before this one,
+         FlushPendingSeniorUpdates();        // and they (and any batched-up updates) need to be applied before the reset, to preserve ordering
+
          PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_RESET, (uint16) _whichDatabase, _localDatabaseStateID+1, fromPeerID, _dbChecksum);
          MRETURN_OOM_ON_NULL(dbUp());
+         dbUp()->SetRequestSubmitTimeMicros(submitTime);
          MRETURN_ON_ERROR(AddDatabaseUpdateToUpdateLog(dbUp));
 
          const uint64 startTime = GetRunTime64();
@@ -142,8 +297,12 @@ status_t PZGDatabaseState :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPe
             return B_BAD_DATA;
          }
 
+         ReleaseDelayedSeniorUpdates(true);  // any requests admission-control is holding back were accepted before this one,
+         FlushPendingSeniorUpdates();        // and they (and any batched-up updates) need to be applied before the replace, to preserve ordering
+
          PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_REPLACE, (uint16) _whichDatabase, _localDatabaseStateID+1, fromPeerID, _dbChecksum);
          MRETURN_OOM_ON_NULL(dbUp());
+         dbUp()->SetRequestSubmitTimeMicros(submitTime);
 
          MRETURN_ON_ERROR(AddDatabaseUpdateToUpdateLog(dbUp));
 
@@ -173,28 +332,29 @@ status_t PZGDatabaseState :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPe
             return B_BAD_DATA;
          }
 
-         PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_UPDATE, (uint16) _whichDatabase, _localDatabaseStateID+1, fromPeerID, _dbChecksum);
-         MRETURN_OOM_ON_NULL(dbUp());
-         MRETURN_ON_ERROR(AddDatabaseUpdateToUpdateLog(dbUp));
-
-         const uint64 startTime = GetRunTime64();
-         ConstMessageRef juniorMsg;
+         if ((IsAdmissionControlEnabled())&&((_delayedSeniorUpdateRequests.HasItems())||(CalculateSeniorUpdateHeadroom() == 0)))
          {
-            NestCountGuard ncg(_inSeniorDatabaseUpdate);
-            juniorMsg = _master->SeniorUpdateLocalDatabase(_whichDatabase, _dbChecksum, userDBUpdateMsg);
-         }
+            // Admission control:  the junior peers (or our multicast thread) are too far behind, so we'll hold on to this request until they catch up
+            if (_delayedSeniorUpdateRequests.GetNumItems() >= PZG_MAX_DELAYED_SENIOR_UPDATE_REQUESTS)
+            {
+               // We're already holding back as many requests as we're willing to, so this one gets rejected instead
+               LogTime(MUSCLE_LOG_DEBUG, "PZGDatabaseState:  Rejecting update-request from [%s] for database #" UINT32_FORMAT_SPEC ", since " UINT32_FORMAT_SPEC " requests are already being held back.\n", fromPeerID.ToString()(), _whichDatabase, _delayedSeniorUpdateRequests.GetNumItems());
+               _master->ReportUpdateTicketCommitted(fromPeerID, _whichDatabase, msg()->GetInt64(PZG_PEER_NAME_TICKET_ID), PZG_UPDATE_RESULT_BUSY, _localDatabaseStateID);
+               return B_REPLICATION_BUSY;
+            }
 
-         if (juniorMsg())
-         {
-            SeniorUpdateCompleted(dbUp, startTime, juniorMsg, networkTimeProvider);
+            MRETURN_ON_ERROR(_delayedSeniorUpdateRequests.AddTail(msg));
+            const status_t ret = _delayedSeniorUpdateRequesters.AddTail(fromPeerID);
+            if (ret.IsError()) {(void) _delayedSeniorUpdateRequests.RemoveTail(); return ret;}
+            if (_admissionRecheckTime == MUSCLE_TIME_NEVER)
+            {
+               _admissionRecheckTime = GetRunTime64()+PZG_ADMISSION_CONTROL_RECHECK_INTERVAL;
+               InvalidatePulseTime();
+            }
             return B_NO_ERROR;
          }
-         else
-         {
-            LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseUpdateState:  Error setting senior database #" UINT32_FORMAT_SPEC " to state!\n", _whichDatabase);
-            RemoveDatabaseUpdateFromUpdateLog(dbUp);  // roll back!
-            return B_LOGIC_ERROR;
-         }
+
+         return SeniorAcceptDatabaseUpdate(fromPeerID, submitTime, msg()->GetInt64(PZG_PEER_NAME_TICKET_ID), msg()->GetInt64(PZG_PEER_NAME_EXPECTED_STATE_ID, PZG_UNCONDITIONAL_UPDATE), userDBUpdateMsg, networkTimeProvider);
       }
       break;
 
@@ -218,9 +378,200 @@ status_t PZGDatabaseState :: HandleDatabaseUpdateRequest(const ZGPeerID & fromPe
    return B_UNIMPLEMENTED;
 }
 
+status_t PZGDatabaseState :: SeniorExecuteDatabaseUpdate(const ZGPeerID & fromPeerID, uint64 submitTime, uint64 ticketID, const MessageRef & userDBUpdateMsg, const INetworkTimeProvider & networkTimeProvider)
+{
+   PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_UPDATE, (uint16) _whichDatabase, _localDatabaseStateID+1, fromPeerID, _dbChecksum);
+   MRETURN_OOM_ON_NULL(dbUp());
+   dbUp()->SetRequestSubmitTimeMicros(submitTime);
+   MRETURN_ON_ERROR(AddDatabaseUpdateToUpdateLog(dbUp));
+
+   const uint64 startTime = GetRunTime64();
+   ConstMessageRef juniorMsg;
+   {
+      NestCountGuard ncg(_inSeniorDatabaseUpdate);
+      juniorMsg = _master->SeniorUpdateLocalDatabase(_whichDatabase, _dbChecksum, userDBUpdateMsg);
+   }
+
+   if (juniorMsg())
+   {
+      SeniorUpdateCompleted(dbUp, startTime, juniorMsg, networkTimeProvider);
+      _master->ReportUpdateTicketCommitted(fromPeerID, _whichDatabase, ticketID, PZG_UPDATE_RESULT_COMMITTED, dbUp()->GetUpdateID());
+      return B_NO_ERROR;
+   }
+   else
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseUpdateState:  Error setting senior database #" UINT32_FORMAT_SPEC " to state!\n", _whichDatabase);
+      RemoveDatabaseUpdateFromUpdateLog(dbUp);  // roll back!
+      _master->ReportUpdateTicketCommitted(fromPeerID, _whichDatabase, ticketID, PZG_UPDATE_RESULT_FAILED, _localDatabaseStateID);
+      return B_LOGIC_ERROR;
+   }
+}
+
+status_t PZGDatabaseState :: SeniorExecuteDatabaseUpdateBatch(uint64 submitTime, const Queue<MessageRef> & userDBUpdateMsgs, const Queue<ZGPeerID> & requesterIDs, const Queue<uint64> & ticketIDs, const INetworkTimeProvider & networkTimeProvider)
+{
+   if (userDBUpdateMsgs.GetNumItems() == 1) return SeniorExecuteDatabaseUpdate(requesterIDs.Head(), submitTime, ticketIDs.Head(), userDBUpdateMsgs.Head(), networkTimeProvider);  // no point wrapping a batch-of-one
+
+   MessageRef batchMsg = GetMessageFromPool();
+   MRETURN_OOM_ON_NULL(batchMsg());
+
+   Queue<bool> succeeded;  // which of the batched updates executed successfully (for reporting on their tickets afterwards)
+   MRETURN_ON_ERROR(succeeded.EnsureSize(userDBUpdateMsgs.GetNumItems(), true));
+
+   // A PZGDatabaseUpdate has room for only one source peer ID, so the batch is attributed to the requester of its first sub-update;
+   // the other requesters are tracked only via (requesterIDs), for the commit reports below
+   PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_BATCH, (uint16) _whichDatabase, _localDatabaseStateID+1, requesterIDs.Head(), _dbChecksum);
+   MRETURN_OOM_ON_NULL(dbUp());
+   dbUp()->SetRequestSubmitTimeMicros(submitTime);  // i.e. the submit-time of the batch's oldest request
+   MRETURN_ON_ERROR(AddDatabaseUpdateToUpdateLog(dbUp));
+
+   status_t ret;
+   const uint64 startTime = GetRunTime64();
+   {
+      NestCountGuard ncg(_inSeniorDatabaseUpdate);
+      for (uint32 i=0; i<userDBUpdateMsgs.GetNumItems(); i++)
+      {
+         ConstMessageRef juniorMsg = _master->SeniorUpdateLocalDatabase(_whichDatabase, _dbChecksum, userDBUpdateMsgs[i]);
+         if (juniorMsg() == NULL) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseUpdateState:  Error executing batched update #" UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC " on senior database #" UINT32_FORMAT_SPEC "!\n", i+1, userDBUpdateMsgs.GetNumItems(), _whichDatabase);
+         else if (batchMsg()->AddMessage(PZG_PEER_NAME_USER_MESSAGE, CastAwayConstFromRef(juniorMsg)).IsError(ret))
+         {
+            // The senior database has already been modified, so there's no clean way to roll back here; the junior peers will detect the checksum mismatch and recover via a full resend
+            LogTime(MUSCLE_LOG_CRITICALERROR, "PZGDatabaseUpdateState:  Unable to add junior message to batch for database #" UINT32_FORMAT_SPEC "! [%s]\n", _whichDatabase, ret());
+         }
+         else succeeded[i] = true;
+      }
+   }
+
+   const bool batchSucceeded = batchMsg()->HasNames();
+   if (batchSucceeded) SeniorUpdateCompleted(dbUp, startTime, batchMsg, networkTimeProvider);
+   else
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseUpdateState:  No updates in batch of " UINT32_FORMAT_SPEC " succeeded on senior database #" UINT32_FORMAT_SPEC "!\n", userDBUpdateMsgs.GetNumItems(), _whichDatabase);
+      RemoveDatabaseUpdateFromUpdateLog(dbUp);  // roll back!
+   }
+
+   for (uint32 i=0; i<userDBUpdateMsgs.GetNumItems(); i++)
+   {
+      const bool itemSucceeded = ((batchSucceeded)&&(succeeded[i]));
+      _master->ReportUpdateTicketCommitted(requesterIDs[i], _whichDatabase, ticketIDs[i], itemSucceeded ? PZG_UPDATE_RESULT_COMMITTED : PZG_UPDATE_RESULT_FAILED, _localDatabaseStateID);
+   }
+   return batchSucceeded ? B_NO_ERROR : B_LOGIC_ERROR;
+}
+
+status_t PZGDatabaseState :: SeniorAcceptDatabaseUpdate(const ZGPeerID & fromPeerID, uint64 submitTime, uint64 ticketID, uint64 expectedStateID, const MessageRef & userDBUpdateMsg, const INetworkTimeProvider & networkTimeProvider)
+{
+   if (expectedStateID != PZG_UNCONDITIONAL_UPDATE)
+   {
+      FlushPendingSeniorUpdates();  // so that the precondition gets checked against the state this update would actually be applied to
+      if (_localDatabaseStateID != expectedStateID)
+      {
+         _numStaleUpdatesRejected++;
+         LogTime(MUSCLE_LOG_DEBUG, "Rejecting conditional update to database #" UINT32_FORMAT_SPEC " from [%s]:  expected state #" UINT64_FORMAT_SPEC ", current state is #" UINT64_FORMAT_SPEC "\n", _whichDatabase, fromPeerID.ToString()(), expectedStateID, _localDatabaseStateID);
+         _master->ReportUpdateTicketCommitted(fromPeerID, _whichDatabase, ticketID, PZG_UPDATE_RESULT_STALE, _localDatabaseStateID);
+         return B_STALE_DATABASE_STATE;
+      }
+      return SeniorExecuteDatabaseUpdate(fromPeerID, submitTime, ticketID, userDBUpdateMsg, networkTimeProvider);  // never batched, since the precondition applies only to this update
+   }
+
+   if (_groupCommitMaxBatchSize <= 1) return SeniorExecuteDatabaseUpdate(fromPeerID, submitTime, ticketID, userDBUpdateMsg, networkTimeProvider);
+
+   // Group-commit mode:  hold on to this request so that it can be executed along with any others that arrive soon
+   if (_pendingSeniorUpdates.IsEmpty())
+   {
+      _pendingSeniorUpdatesSubmitTime = submitTime;
+      _groupCommitFlushTime         = GetRunTime64()+_groupCommitMaxAddedLatency;
+      InvalidatePulseTime();
+   }
+   MRETURN_ON_ERROR(_pendingSeniorUpdates.AddTail(userDBUpdateMsg));
+   if ((_pendingSeniorUpdateRequesters.AddTail(fromPeerID).IsError())||(_pendingSeniorUpdateTickets.AddTail(ticketID).IsError()))
+   {
+      // roll back, so that our three queues stay in sync
+      (void) _pendingSeniorUpdates.RemoveTail();
+      if (_pendingSeniorUpdateRequesters.GetNumItems() > _pendingSeniorUpdates.GetNumItems()) (void) _pendingSeniorUpdateRequesters.RemoveTail();
+      return B_OUT_OF_MEMORY;
+   }
+
+   if (_pendingSeniorUpdates.GetNumItems() >= _groupCommitMaxBatchSize) FlushPendingSeniorUpdates();
+   return B_NO_ERROR;
+}
+
+void PZGDatabaseState :: FlushPendingSeniorUpdates()
+{
+   if (_pendingSeniorUpdates.IsEmpty()) return;
+
+   Queue<MessageRef> batch;       batch.SwapContents(_pendingSeniorUpdates);
+   Queue<ZGPeerID> requesterIDs;  requesterIDs.SwapContents(_pendingSeniorUpdateRequesters);
+   Queue<uint64> ticketIDs;       ticketIDs.SwapContents(_pendingSeniorUpdateTickets);
+   _groupCommitFlushTime = MUSCLE_TIME_NEVER;
+   InvalidatePulseTime();
+
+   const status_t ret = SeniorExecuteDatabaseUpdateBatch(_pendingSeniorUpdatesSubmitTime, batch, requesterIDs, ticketIDs, *_master);
+   if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState::FlushPendingSeniorUpdates:  Batch of " UINT32_FORMAT_SPEC " updates to database #" UINT32_FORMAT_SPEC " failed! [%s]\n", batch.GetNumItems(), _whichDatabase, ret());
+}
+
+uint64 PZGDatabaseState :: CalculateSeniorUpdateHeadroom() const
+{
+   uint64 ret = (uint64)-1;
+   if (_admissionMaxJuniorLag > 0)
+   {
+      // A junior peer that has fallen off the end of our update-log can only catch up via a full database resend, which holding
+      // back new update-requests won't speed up, so we leave those peers out (otherwise they could stall all writers indefinitely)
+      const uint64 oldestUpdateID = _updateLog.GetFirstKeyWithDefault();
+      bool gotLag = false;
+      uint64 maxLag = 0;
+      for (ConstHashtableIterator<ZGPeerID, uint64> iter(_juniorStateIDs); iter.HasData(); iter++)
+      {
+         if ((iter.GetValue()+1) >= oldestUpdateID)
+         {
+            gotLag = true;
+            maxLag = muscleMax(maxLag, GetJuniorLag(iter.GetKey()));
+         }
+      }
+      if (gotLag) ret = muscleMin(ret, (maxLag < _admissionMaxJuniorLag) ? (_admissionMaxJuniorLag-maxLag) : (uint64)0);
+   }
+   if (_admissionMaxMulticastBacklog > 0)
+   {
+      const uint32 backlog = _master->GetMulticastBacklog();
+      ret = muscleMin(ret, (uint64) ((backlog < _admissionMaxMulticastBacklog) ? (_admissionMaxMulticastBacklog-backlog) : 0));
+   }
+   return ret;
+}
+
+uint64 PZGDatabaseState :: GetUpdateHeadroom() const
+{
+   if (IsAdmissionControlEnabled() == false) return (uint64)-1;
+   if (_master->IAmTheDatabaseSeniorPeer(_whichDatabase) == false) return _seniorUpdateHeadroom;
+
+   const uint64 headroom   = CalculateSeniorUpdateHeadroom();
+   const uint32 numDelayed = _delayedSeniorUpdateRequests.GetNumItems();
+   if (headroom == (uint64)-1) return headroom;  // no limit is currently in effect (e.g. no junior peers have reported their states yet)
+   return (headroom > numDelayed) ? (headroom-numDelayed) : 0;
+}
+
+void PZGDatabaseState :: ReleaseDelayedSeniorUpdates(bool force)
+{
+   while(_delayedSeniorUpdateRequests.HasItems())
+   {
+      if ((force == false)&&(CalculateSeniorUpdateHeadroom() == 0)) break;
+
+      ConstMessageRef msg;
+      ZGPeerID fromPeerID;
+      (void) _delayedSeniorUpdateRequests.RemoveHead(msg);
+      (void) _delayedSeniorUpdateRequesters.RemoveHead(fromPeerID);
+
+      const status_t ret = SeniorAcceptDatabaseUpdate(fromPeerID, msg()->GetInt64(PZG_PEER_NAME_SUBMIT_TIME), msg()->GetInt64(PZG_PEER_NAME_TICKET_ID), msg()->GetInt64(PZG_PEER_NAME_EXPECTED_STATE_ID, PZG_UNCONDITIONAL_UPDATE), msg()->GetMessage(PZG_PEER_NAME_USER_MESSAGE), *_master);
+      if ((ret.IsError())&&(ret != B_STALE_DATABASE_STATE)) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState::ReleaseDelayedSeniorUpdates:  Delayed update to database #" UINT32_FORMAT_SPEC " failed! [%s]\n", _whichDatabase, ret());
+   }
+
+   _admissionRecheckTime = _delayedSeniorUpdateRequests.HasItems() ? (GetRunTime64()+PZG_ADMISSION_CONTROL_RECHECK_INTERVAL) : MUSCLE_TIME_NEVER;
+   InvalidatePulseTime();
+   if (IsAdmissionControlEnabled()) _master->ScheduleSetBeaconData();  // so that the junior peers will learn our new headroom
+}
+
 void PZGDatabaseState :: Pulse(const PulseArgs & args)
 {
    PulseNode::Pulse(args);
+   if (args.GetCallbackTime() >= _admissionRecheckTime) ReleaseDelayedSeniorUpdates(false);
+   if (args.GetCallbackTime() >= _groupCommitFlushTime) FlushPendingSeniorUpdates();
    RescanUpdateLogIfNecessary();
 }
 
@@ -235,25 +586,21 @@ void PZGDatabaseState :: RescanUpdateLogIfNecessary()
 
 void PZGDatabaseState :: RescanUpdateLog()
 {
-   if (_master->IAmTheSeniorPeer())
+   if (_master->IAmTheDatabaseSeniorPeer(_whichDatabase))
    {
       if (_updateLog.HasItems())
       {
-         // Start iterating backwards from the end of the table (i.e. the most recent updates) until we get past all the unsent ones
-         const uint64 oldestUpdateID = *_updateLog.GetFirstKey();
-         for (ConstHashtableIterator<uint64, ConstPZGDatabaseUpdateRef> iter(_updateLog, HTIT_FLAG_BACKWARDS); iter.HasData(); iter++)
+         // Since the log is indexed by update ID, we can jump straight to the first unsent update and send everything from there onwards
+         const uint64 oldestUpdateID = _updateLog.GetFirstKeyWithDefault();
+         const uint32 numSlots       = _updateLog.GetNumSlots();
+         for (uint32 i=(uint32)muscleMin((uint64)numSlots, (_firstUnsentUpdateID>oldestUpdateID)?(_firstUnsentUpdateID-oldestUpdateID):0); i<numSlots; i++)
          {
-            const uint64 nextUpdateID = iter.GetKey();
-
-            // Stage 1: When we get to the first already-sent update, then we'll re-reverse the iterator so that it iterates forwards again
-            if ((iter.IsBackwards())&&((nextUpdateID <= _firstUnsentUpdateID)||(nextUpdateID == oldestUpdateID))) iter.SetBackwards(false);
-
-            // Stage 2: When iterating forwards, we'll send every unsent-update we encounter
-            if ((!iter.IsBackwards())&&(nextUpdateID >= _firstUnsentUpdateID)&&(_master->SendDatabaseUpdateViaMulticast(iter.GetValue()).IsOK())) _firstUnsentUpdateID = nextUpdateID+1;
+            const ConstPZGDatabaseUpdateRef & dbUp = _updateLog.GetSlotAt(i);
+            if ((dbUp())&&(_master->SendDatabaseUpdateViaMulticast(dbUp).IsOK())) _firstUnsentUpdateID = oldestUpdateID+i+1;
          }
 
          // Finally, let's trim old ConstPZGDatabaseUpdates from our _updateLog if necessary, until it again fits within our memory budget
-         while((_totalPayloadBytesInLog > _maxPayloadBytesInLog)&&(_updateLog.GetNumItems() > 1)) RemoveDatabaseUpdateFromUpdateLog(*_updateLog.GetFirstValue());
+         while(ShouldTrimSeniorUpdateLog()) {RemoveDatabaseUpdateFromUpdateLog(_updateLog.GetFirstValue()); _numUpdatesTrimmedFromLog++;}
       }
    }
    else if (_seniorDatabaseStateReceived)  // no point trying to scan if we don't know where we want to scan to!
@@ -284,13 +631,15 @@ void PZGDatabaseState :: RescanUpdateLog()
             while(_localDatabaseStateID < targetDatabaseStateID)
             {
                const uint64 nextStateID = _localDatabaseStateID+1;
-               ConstPZGDatabaseUpdateRef dbUp = _updateLog[nextStateID];
+               ConstPZGDatabaseUpdateRef dbUp = _updateLog.GetWithDefault(nextStateID);
                if (dbUp())
                {
                   status_t ret;
                   if (JuniorExecuteDatabaseUpdate(*dbUp()).IsOK(ret))
                   {
                      LogTime(MUSCLE_LOG_DEBUG, "Database #" UINT32_FORMAT_SPEC " successfully executed junior update to state #" UINT64_FORMAT_SPEC "\n", _whichDatabase, nextStateID);
+                     RecordJuniorLatencySamples(*dbUp());
+                     RecordDatabaseUpdateDurably(dbUp);
                   }
                   else
                   {
@@ -301,7 +650,7 @@ void PZGDatabaseState :: RescanUpdateLog()
                }
                else
                {
-                  const ZGPeerID & seniorPeerID = _master->GetSeniorPeerID();
+                  const ZGPeerID & seniorPeerID = _master->GetDatabaseSeniorPeerID(_whichDatabase);
                   if (seniorPeerID.IsValid())
                   {
                      if (nextStateID < _seniorOldestIDInLog)
@@ -313,28 +662,39 @@ void PZGDatabaseState :: RescanUpdateLog()
                      else
                      {
                         // Oops, we can't update our local DB any further (for now), but we can at least make sure
-                        // that the PZGDatabaseUpdates we need are on back-order from the senior peer
-                        for (uint64 updateID=nextStateID; updateID<=targetDatabaseStateID; updateID++)
+                        // that the PZGDatabaseUpdates we need are on back-order from the senior peer.  Each contiguous
+                        // run of missing updates goes on order as a single range, so that catching up after a burst of
+                        // lost multicast packets costs one round-trip per run rather than one round-trip per update.
+                        // We walk the sorted list of ranges already on back-order alongside (updateID), so that this is a single pass.
+                        Hashtable<uint64, uint64> onOrder;  // first update ID -> last update ID, sorted by first update ID
+                        GetBackOrderedRanges(seniorPeerID, onOrder);
+                        ConstHashtableIterator<uint64, uint64> onOrderIter(onOrder);
+
+                        uint64 updateID = nextStateID;
+                        while(updateID <= targetDatabaseStateID)
                         {
-                           if (_updateLog.ContainsKey(updateID) == false)
+                           while((onOrderIter.HasData())&&(onOrderIter.GetValue() < updateID)) onOrderIter++;  // skip ranges that are entirely behind us
+                           if ((onOrderIter.HasData())&&(onOrderIter.GetKey() <= updateID)) {updateID = onOrderIter.GetValue()+1; continue;}  // already on order
+                           if (_updateLog.ContainsKey(updateID)) {updateID++; continue;}
+
+                           const uint64 nextOnOrderID = onOrderIter.HasData() ? onOrderIter.GetKey() : DATABASE_UPDATE_ID_FULL_UPDATE;
+                           uint32 numUpdates = 1;
+                           while((numUpdates < PZG_MAX_UPDATES_PER_BACK_ORDER)&&((updateID+numUpdates) <= targetDatabaseStateID)&&((updateID+numUpdates) < nextOnOrderID)&&(_updateLog.ContainsKey(updateID+numUpdates) == false)) numUpdates++;
+
+                           const PZGUpdateBackOrderKey ubok(seniorPeerID, _whichDatabase, updateID, numUpdates);
+                           status_t ret;
+                           if (RequestBackOrderFromSeniorPeer(ubok, false).IsOK(ret))
                            {
-                              const PZGUpdateBackOrderKey ubok(seniorPeerID, _whichDatabase, updateID);
-                              if (_backorders.ContainsKey(ubok) == false)
-                              {
-                                 status_t ret;
-                                 if (RequestBackOrderFromSeniorPeer(ubok, false).IsOK(ret))
-                                 {
-                                    LogTime(MUSCLE_LOG_DEBUG, "Database " UINT32_FORMAT_SPEC ":  Placed update #" UINT64_FORMAT_SPEC " on back-order from senior peer [%s]\n", ubok.GetDatabaseIndex(), ubok.GetDatabaseUpdateID(), ubok.GetTargetPeerID().ToString()());
-                                 }
-                                 else
-                                 {
-                                    LogTime(MUSCLE_LOG_ERROR, "Database " UINT32_FORMAT_SPEC ":  Requested back order of update #" UINT64_FORMAT_SPEC " failed (%s), requesting full resend\n", ubok.GetDatabaseIndex(), ubok.GetDatabaseUpdateID(), ret());
-                                    ret = RequestFullDatabaseResendFromSeniorPeer(false);
-                                    if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Request for full database resend failed! [%s]\n", ret());
-                                    break;
-                                 }
-                              }
+                              LogTime(MUSCLE_LOG_DEBUG, "Database " UINT32_FORMAT_SPEC ":  Placed updates #" UINT64_FORMAT_SPEC "-#" UINT64_FORMAT_SPEC " on back-order from senior peer [%s]\n", ubok.GetDatabaseIndex(), ubok.GetDatabaseUpdateID(), ubok.GetLastDatabaseUpdateID(), ubok.GetTargetPeerID().ToString()());
                            }
+                           else
+                           {
+                              LogTime(MUSCLE_LOG_ERROR, "Database " UINT32_FORMAT_SPEC ":  Requested back order of updates #" UINT64_FORMAT_SPEC "-#" UINT64_FORMAT_SPEC " failed (%s), requesting full resend\n", ubok.GetDatabaseIndex(), ubok.GetDatabaseUpdateID(), ubok.GetLastDatabaseUpdateID(), ret());
+                              ret = RequestFullDatabaseResendFromSeniorPeer(false);
+                              if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Request for full database resend failed! [%s]\n", ret());
+                              break;
+                           }
+                           updateID += numUpdates;
                         }
                      }
                   }
@@ -345,10 +705,135 @@ void PZGDatabaseState :: RescanUpdateLog()
       }
 
       // Finally, let's trim old/unneeded ConstPZGDatabaseUpdates from our _updateLog if necessary, until it again fits within our memory budget
-      while((_totalPayloadBytesInLog > _maxPayloadBytesInLog)&&(_updateLog.GetNumItems() > 1)&&(IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(*_updateLog.GetFirstKey()) == false)) RemoveDatabaseUpdateFromUpdateLog(*_updateLog.GetFirstValue());
+      while((_totalPayloadBytesInLog > _maxPayloadBytesInLog)&&(_updateLog.GetNumItems() > 1)&&(IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(_updateLog.GetFirstKeyWithDefault()) == false)) {RemoveDatabaseUpdateFromUpdateLog(_updateLog.GetFirstValue()); _numUpdatesTrimmedFromLog++;}
    }
 }
 
+bool PZGDatabaseState :: ShouldTrimSeniorUpdateLog() const
+{
+   if (_updateLog.GetNumItems() <= 1) return false;
+   if (_totalPayloadBytesInLog > _maxPayloadBytesInLog) return true;  // the maximum size is a hard limit, in any mode
+   if ((IsAdaptiveUpdateLogSizingEnabled() == false)||(_totalPayloadBytesInLog <= _minPayloadBytesInLog)) return false;
+
+   // In adaptive mode, we can trim the oldest update only if every junior peer has told us it already has that update.
+   // If any online junior peer hasn't reported its state yet, we'll assume it might still need it.
+   const Hashtable<ZGPeerID, ConstMessageRef> & onlinePeers = _master->GetOnlinePeers();
+   const uint32 numJuniorPeers = onlinePeers.GetNumItems()-(onlinePeers.ContainsKey(_master->GetLocalPeerID())?1:0);
+   if (_juniorStateIDs.GetNumItems() < numJuniorPeers) return false;
+
+   const uint64 oldestUpdateID = _updateLog.GetFirstKeyWithDefault();
+   for (ConstHashtableIterator<ZGPeerID, uint64> iter(_juniorStateIDs); iter.HasData(); iter++) if (iter.GetValue() < oldestUpdateID) return false;
+   return true;
+}
+
+void PZGDatabaseState :: JuniorDatabaseStateReported(const ZGPeerID & juniorPeerID, uint64 juniorStateID)
+{
+   if ((_master->IAmTheDatabaseSeniorPeer(_whichDatabase) == false)||(_master->IsPeerOnline(juniorPeerID) == false)) return;
+
+   const uint64 * oldStateID = _juniorStateIDs.Get(juniorPeerID);
+   if ((oldStateID == NULL)||(*oldStateID < juniorStateID))
+   {
+      (void) _juniorStateIDs.Put(juniorPeerID, juniorStateID);
+      if (IsAdaptiveUpdateLogSizingEnabled()) ScheduleLogContentsRescan();  // so that we'll trim our update-log, if possible
+      if (IsAdmissionControlEnabled())
+      {
+         if (_delayedSeniorUpdateRequests.HasItems()) ReleaseDelayedSeniorUpdates(false);  // the junior peer may have caught up enough to let more requests through
+                                                 else _master->ScheduleSetBeaconData();     // so that the junior peers will learn our new headroom
+      }
+   }
+}
+
+uint32 PZGDatabaseState :: GetJuniorLagStatistics(uint64 & retMinLag, uint64 & retMaxLag, double & retMeanLag) const
+{
+   retMinLag = retMaxLag = 0;
+   retMeanLag = 0.0;
+   if (_juniorStateIDs.IsEmpty()) return 0;
+
+   uint64 totalLag = 0;
+   retMinLag = (uint64)-1;
+   for (ConstHashtableIterator<ZGPeerID, uint64> iter(_juniorStateIDs); iter.HasData(); iter++)
+   {
+      const uint64 lag = GetJuniorLag(iter.GetKey());
+      retMinLag = muscleMin(retMinLag, lag);
+      retMaxLag = muscleMax(retMaxLag, lag);
+      totalLag += lag;
+   }
+   retMeanLag = ((double)totalLag)/_juniorStateIDs.GetNumItems();
+   return _juniorStateIDs.GetNumItems();
+}
+
+void PZGDatabaseState :: UpdateTicketCommitted(uint64 ticketID, uint64 databaseStateID)
+{
+   if (_localDatabaseStateID >= databaseStateID) _master->DatabaseUpdateAppliedLocally(_whichDatabase, ticketID, databaseStateID);  // we already have it (e.g. we're the senior peer)
+   else if (_updateTicketsAwaitingLocalApply.Put(ticketID, databaseStateID).IsError()) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState::UpdateTicketCommitted:  Unable to track ticket " UINT64_FORMAT_SPEC " for database #" UINT32_FORMAT_SPEC "!\n", ticketID, _whichDatabase);
+}
+
+void PZGDatabaseState :: ReportLocallyAppliedUpdateTickets()
+{
+   // Commit-reports can arrive out of order (e.g. when the database's senior peer changes), so we check every entry rather than stopping at the first one that's still pending
+   for (HashtableIterator<uint64, uint64> iter(_updateTicketsAwaitingLocalApply); iter.HasData(); iter++)
+   {
+      const uint64 ticketID        = iter.GetKey();
+      const uint64 databaseStateID = iter.GetValue();
+      if (databaseStateID <= _localDatabaseStateID)
+      {
+         (void) _updateTicketsAwaitingLocalApply.Remove(ticketID);
+         _master->DatabaseUpdateAppliedLocally(_whichDatabase, ticketID, databaseStateID);
+      }
+   }
+}
+
+void PZGDatabaseState :: DatabaseSeniorPeerChanged(bool isHandoff)
+{
+   ReportLocallyAppliedUpdateTickets();  // report whatever we've already got, before we forget the rest
+   ReportPassedReadBarriers();
+
+   // A hand-off only happens once the new senior peer has caught up with the old one, so the old senior peer's database-state IDs are still valid
+   if (isHandoff) return;
+
+   // The remaining tickets' database-state IDs were assigned by the old senior peer, and the new one's history may not include them, so they're lost
+   while(_updateTicketsAwaitingLocalApply.HasItems())
+   {
+      const uint64 ticketID = *_updateTicketsAwaitingLocalApply.GetFirstKey();
+      (void) _updateTicketsAwaitingLocalApply.RemoveFirst();
+      _master->DatabaseUpdateTicketLost(_whichDatabase, ticketID);
+   }
+
+   // Likewise, the remaining barriers' targets are the old senior peer's database-state IDs
+   while(_readBarriersAwaitingLocalApply.HasItems())
+   {
+      const uint64 barrierID = *_readBarriersAwaitingLocalApply.GetFirstKey();
+      (void) _readBarriersAwaitingLocalApply.RemoveFirst();
+      _master->ReadBarrierLost(_whichDatabase, barrierID);
+   }
+}
+
+void PZGDatabaseState :: ReadBarrierTargetReceived(uint64 barrierID, uint64 databaseStateID)
+{
+   if (_localDatabaseStateID >= databaseStateID) _master->ReadBarrierPassed(_whichDatabase, barrierID, _localDatabaseStateID);  // we're already caught up
+   else if (_readBarriersAwaitingLocalApply.Put(barrierID, databaseStateID).IsError()) LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState::ReadBarrierTargetReceived:  Unable to track read barrier " UINT64_FORMAT_SPEC " for database #" UINT32_FORMAT_SPEC "!\n", barrierID, _whichDatabase);
+}
+
+void PZGDatabaseState :: ReportPassedReadBarriers()
+{
+   // Barrier targets don't necessarily arrive in ascending order (a beacon-based target can be older than a probed one), so we check every entry
+   for (HashtableIterator<uint64, uint64> iter(_readBarriersAwaitingLocalApply); iter.HasData(); iter++)
+   {
+      const uint64 barrierID = iter.GetKey();
+      if (iter.GetValue() <= _localDatabaseStateID)
+      {
+         (void) _readBarriersAwaitingLocalApply.Remove(barrierID);
+         _master->ReadBarrierPassed(_whichDatabase, barrierID, _localDatabaseStateID);
+      }
+   }
+}
+
+void PZGDatabaseState :: ForgetJuniorDatabaseState(const ZGPeerID & juniorPeerID)
+{
+   if (juniorPeerID.IsValid()) (void) _juniorStateIDs.Remove(juniorPeerID);
+                          else _juniorStateIDs.Clear();
+}
+
 status_t PZGDatabaseState :: RequestBackOrderFromSeniorPeer(const PZGUpdateBackOrderKey & ubok, bool dueToChecksumError)
 {
    if (_backorders.ContainsKey(ubok)) return B_NO_ERROR;  // paranoia:  it's already on order, no need to ask again
@@ -356,7 +841,12 @@ status_t PZGDatabaseState :: RequestBackOrderFromSeniorPeer(const PZGUpdateBackO
    status_t ret;
    if (_backorders.PutWithDefault(ubok).IsOK(ret))
    {
-      if (_master->RequestBackOrderFromSeniorPeer(ubok, dueToChecksumError).IsOK(ret)) return B_NO_ERROR;
+      if (_master->RequestBackOrderFromSeniorPeer(ubok, dueToChecksumError).IsOK(ret))
+      {
+         if (ubok.GetDatabaseUpdateID() == DATABASE_UPDATE_ID_FULL_UPDATE) _numFullResendsRequested++;
+                                                                      else _numBackOrdersRequested++;
+         return B_NO_ERROR;
+      }
       (void) _backorders.Remove(ubok);  // roll back!
    }
    return ret;
@@ -364,12 +854,12 @@ status_t PZGDatabaseState :: RequestBackOrderFromSeniorPeer(const PZGUpdateBackO
 
 status_t PZGDatabaseState :: RequestFullDatabaseResendFromSeniorPeer(bool dueToChecksumError)
 {
-   return RequestBackOrderFromSeniorPeer(PZGUpdateBackOrderKey(_master->GetSeniorPeerID(), _whichDatabase, DATABASE_UPDATE_ID_FULL_UPDATE), dueToChecksumError);
+   return RequestBackOrderFromSeniorPeer(PZGUpdateBackOrderKey(_master->GetDatabaseSeniorPeerID(_whichDatabase), _whichDatabase, DATABASE_UPDATE_ID_FULL_UPDATE), dueToChecksumError);
 }
 
 bool PZGDatabaseState :: IsAwaitingFullDatabaseResendReply() const
 {
-   return (_backorders.ContainsKey(PZGUpdateBackOrderKey(_master->GetSeniorPeerID(), _whichDatabase, DATABASE_UPDATE_ID_FULL_UPDATE)));
+   return (_backorders.ContainsKey(PZGUpdateBackOrderKey(_master->GetDatabaseSeniorPeerID(_whichDatabase), _whichDatabase, DATABASE_UPDATE_ID_FULL_UPDATE)));
 }
 
 status_t PZGDatabaseState :: JuniorExecuteDatabaseUpdate(const PZGDatabaseUpdate & dbUp)
@@ -384,6 +874,8 @@ status_t PZGDatabaseState :: JuniorExecuteDatabaseUpdate(const PZGDatabaseUpdate
    if (_dbChecksum != dbUp.GetPreUpdateDBChecksum())
    {
       LogTime(MUSCLE_LOG_ERROR, "Error, DB checksum " UINT32_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " doesn't match required pre-update DB checksum " UINT32_FORMAT_SPEC " for junior update #" UINT64_FORMAT_SPEC "\n", _dbChecksum, _whichDatabase, dbUp.GetPreUpdateDBChecksum(), newDatabaseStateID);
+      _numChecksumMismatches++;
+      if (_keepUpdateLogCompressed) dbUp.UncachePayloadBufferAsMessage();  // since we won't be executing it (and so won't uncache it below)
       const String dbContents = _master->GetLocalDatabaseContentsAsString(_whichDatabase);
       if (dbContents.HasChars()) printf("Mismatched Local pre-update state was:\n%s\n", dbContents());
       return B_BAD_OBJECT;
@@ -394,6 +886,7 @@ status_t PZGDatabaseState :: JuniorExecuteDatabaseUpdate(const PZGDatabaseUpdate
    if (_dbChecksum != dbUp.GetPostUpdateDBChecksum())
    {
       LogTime(MUSCLE_LOG_ERROR, "Error, DB checksum " UINT32_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " doesn't match required post-update DB checksum " UINT32_FORMAT_SPEC " for junior update #" UINT64_FORMAT_SPEC "\n", _dbChecksum, _whichDatabase, dbUp.GetPostUpdateDBChecksum(), newDatabaseStateID);
+      _numChecksumMismatches++;
       const String dbContents = _master->GetLocalDatabaseContentsAsString(_whichDatabase);
       if (dbContents.HasChars()) printf("Mismatched Local post-update state was:\n%s\n", dbContents());
 
@@ -402,6 +895,9 @@ status_t PZGDatabaseState :: JuniorExecuteDatabaseUpdate(const PZGDatabaseUpdate
    }
 
    _localDatabaseStateID = newDatabaseStateID;
+   _master->JuniorDatabaseStateChanged();
+   ReportLocallyAppliedUpdateTickets();
+   ReportPassedReadBarriers();
    return B_NO_ERROR;  // success!
 }
 
@@ -429,10 +925,15 @@ status_t PZGDatabaseState :: JuniorExecuteDatabaseReplace(const PZGDatabaseUpdat
    if (_dbChecksum != dbUp.GetPostUpdateDBChecksum())
    {
       LogTime(MUSCLE_LOG_ERROR, "Error, DB checksum " UINT32_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " doesn't match required post-replace DB checksum " UINT32_FORMAT_SPEC " for junior replace #" UINT64_FORMAT_SPEC "\n", _dbChecksum, _whichDatabase, dbUp.GetPostUpdateDBChecksum(), newDatabaseStateID);
+      _numChecksumMismatches++;
       return B_BAD_OBJECT;
    }
 
    _localDatabaseStateID = newDatabaseStateID;
+   TrimUpdateLogThrough(newDatabaseStateID);  // the updates leading up to the replaced state are obsolete now, and would leave a gap before the updates that follow it
+   _master->JuniorDatabaseStateChanged();
+   ReportLocallyAppliedUpdateTickets();
+   ReportPassedReadBarriers();
    LogTime(MUSCLE_LOG_DEBUG, "Junior database #" UINT32_FORMAT_SPEC " is now replaced by the senior database at state #" UINT64_FORMAT_SPEC "\n", _whichDatabase, _localDatabaseStateID);
    return B_NO_ERROR;
 }
@@ -477,6 +978,22 @@ status_t PZGDatabaseState :: JuniorExecuteDatabaseUpdateAux(const PZGDatabaseUpd
          return ret;
       }
 
+      case PZG_DATABASE_UPDATE_TYPE_BATCH:
+      {
+         const ConstMessageRef & batchMsg = dbUp.GetPayloadBufferAsMessage();
+         if (batchMsg() == NULL)
+         {
+            LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseUpdateState:  Error, no batch message to update junior database #" UINT32_FORMAT_SPEC "!\n", _whichDatabase);
+            return B_BAD_OBJECT;
+         }
+
+         status_t ret;
+         ConstMessageRef userDBUpdateMsg;
+         for (uint32 i=0; batchMsg()->FindMessage(PZG_PEER_NAME_USER_MESSAGE, i, userDBUpdateMsg).IsOK(); i++) if (_master->JuniorUpdateLocalDatabase(_whichDatabase, _dbChecksum, userDBUpdateMsg).IsError(ret)) break;
+         dbUp.UncachePayloadBufferAsMessage();  // might as well free up the memory, now that we've executed it we won't need the Message again
+         return ret;
+      }
+
       default:
          LogTime(MUSCLE_LOG_ERROR, "PZGDatabaseState::JuniorExecuteDatabaseUpdateAux:  Unknown update type code " UINT32_FORMAT_SPEC "\n", dbUp.GetUpdateType());
       return B_UNIMPLEMENTED;
@@ -496,18 +1013,97 @@ void PZGDatabaseState :: PrintDatabaseStateInfo() const
 void PZGDatabaseState :: PrintDatabaseUpdateLog() const
 {
    printf("Update log for database #" UINT32_FORMAT_SPEC " has " UINT32_FORMAT_SPEC " items (" UINT64_FORMAT_SPEC "/" UINT64_FORMAT_SPEC " bytes, " UINT64_FORMAT_SPEC " milliseconds):\n", _whichDatabase, _updateLog.GetNumItems(), _totalPayloadBytesInLog, _maxPayloadBytesInLog, _totalElapsedMillisInLog);
-   for (ConstHashtableIterator<uint64, ConstPZGDatabaseUpdateRef> iter(_updateLog); iter.HasData(); iter++) printf("  %s\n", iter.GetValue()()->ToString()());
+   for (uint32 i=0; i<_updateLog.GetNumSlots(); i++)
+   {
+      const ConstPZGDatabaseUpdateRef & dbUp = _updateLog.GetSlotAt(i);
+      if (dbUp()) printf("  %s\n", dbUp()->ToString()());
+   }
+}
+
+void PZGDatabaseState :: PrintLatencyHistograms() const
+{
+   printf("Latency histograms for database #" UINT32_FORMAT_SPEC "%s:\n", _whichDatabase, _latencyTracingEnabled ? "" : " (latency tracing is disabled on this peer)");
+   for (uint32 i=0; i<NUM_ZG_LATENCY_STAGES; i++) printf("  %-32s %s\n", GetLatencyStageName(i), _latencyHistograms[i].ToString()());
+}
+
+void PZGDatabaseState :: PrintJuniorLags() const
+{
+   printf("Junior peer lags for database #" UINT32_FORMAT_SPEC " (senior state is " UINT64_FORMAT_SPEC "):\n", _whichDatabase, _localDatabaseStateID);
+   for (ConstHashtableIterator<ZGPeerID, uint64> iter(_juniorStateIDs); iter.HasData(); iter++) printf("  [%s] is at state " UINT64_FORMAT_SPEC " (" UINT64_FORMAT_SPEC " behind)\n", iter.GetKey().ToString()(), iter.GetValue(), GetJuniorLag(iter.GetKey()));
+}
+
+void PZGDatabaseState :: AddLatencySample(uint32 whichStage, uint64 fromNetworkTime, uint64 toNetworkTime)
+{
+   // A zero (or never) timestamp means that stage wasn't traced, or the peer wasn't time-synced yet.  Slight clock-synchronization
+   // errors between peers could make an interval appear negative; we'll record those as zero, rather than as huge unsigned values.
+   if ((fromNetworkTime > 0)&&(toNetworkTime > 0)&&(fromNetworkTime != MUSCLE_TIME_NEVER)&&(toNetworkTime != MUSCLE_TIME_NEVER)) _latencyHistograms[whichStage].AddSample((toNetworkTime > fromNetworkTime) ? (toNetworkTime-fromNetworkTime) : 0);
+}
+
+void PZGDatabaseState :: RecordJuniorLatencySamples(const PZGDatabaseUpdate & dbUp)
+{
+   if (_latencyTracingEnabled == false) return;
+
+   const uint64 now = _master->GetNetworkTime64();
+   AddLatencySample(ZG_LATENCY_STAGE_SENIOR_COMMIT_TO_MULTICAST_SEND,  dbUp.GetSeniorCommitTimeMicros(),  dbUp.GetMulticastSendTimeMicros());
+   AddLatencySample(ZG_LATENCY_STAGE_MULTICAST_SEND_TO_JUNIOR_RECEIVE, dbUp.GetMulticastSendTimeMicros(), dbUp.GetJuniorReceiveTimeMicros());
+   AddLatencySample(ZG_LATENCY_STAGE_JUNIOR_RECEIVE_TO_APPLY,          dbUp.GetJuniorReceiveTimeMicros(), now);
+   AddLatencySample(ZG_LATENCY_STAGE_SUBMIT_TO_JUNIOR_APPLY,           dbUp.GetRequestSubmitTimeMicros(), now);
+}
+
+status_t PZGDatabaseState :: SaveReplicationStatisticsToMessage(Message & msg) const
+{
+   MRETURN_ON_ERROR(msg.AddInt32("database",             _whichDatabase));
+   MRETURN_ON_ERROR(msg.AddInt64("state_id",             _localDatabaseStateID));
+   MRETURN_ON_ERROR(msg.AddInt64("backorders_requested", _numBackOrdersRequested));
+   MRETURN_ON_ERROR(msg.AddInt64("full_resends",         _numFullResendsRequested));
+   MRETURN_ON_ERROR(msg.AddInt64("checksum_mismatches",  _numChecksumMismatches));
+   MRETURN_ON_ERROR(msg.AddInt64("log_trims",            _numUpdatesTrimmedFromLog));
+   MRETURN_ON_ERROR(msg.AddInt64("stale_updates",        _numStaleUpdatesRejected));
+   MRETURN_ON_ERROR(msg.AddInt32("log_depth",            _updateLog.GetNumItems()));
+   MRETURN_ON_ERROR(msg.AddInt64("log_bytes",            _totalPayloadBytesInLog));
+
+   uint64 minLag, maxLag;
+   double meanLag;
+   MRETURN_ON_ERROR(msg.AddInt32("juniors_reporting",    GetJuniorLagStatistics(minLag, maxLag, meanLag)));
+   MRETURN_ON_ERROR(msg.AddInt64("junior_lag_min",       minLag));
+   MRETURN_ON_ERROR(msg.AddInt64("junior_lag_max",       maxLag));
+   MRETURN_ON_ERROR(msg.AddDouble("junior_lag_mean",     meanLag));
+   MRETURN_ON_ERROR(msg.AddInt64("update_headroom",      GetUpdateHeadroom()));
+   MRETURN_ON_ERROR(msg.AddInt32("delayed_updates",      _delayedSeniorUpdateRequests.GetNumItems()));
+   return msg.AddDouble("log_depth_mean", (_numUpdateLogDepthSamples > 0) ? (((double)_updateLogDepthTotal)/_numUpdateLogDepthSamples) : 0.0);
 }
 
 PZGDatabaseStateInfo PZGDatabaseState :: GetDatabaseStateInfo() const
 {
-   return PZGDatabaseStateInfo(_localDatabaseStateID, _updateLog.GetFirstKeyWithDefault((uint64)-1), _dbChecksum);
+   uint64 oldestIDInLog = _updateLog.GetFirstKeyWithDefault((uint64)-1);
+   if (_durableLog) oldestIDInLog = muscleMin(oldestIDInLog, _durableLog->GetOldestAvailableUpdateID(_whichDatabase));  // updates we can read back from disk count too
+   return PZGDatabaseStateInfo(_localDatabaseStateID, oldestIDInLog, _dbChecksum, GetUpdateHeadroom());
 }
 
 void PZGDatabaseState :: SeniorDatabaseStateInfoChanged(const PZGDatabaseStateInfo & seniorDBInfo)
 {
    const uint64 seniorState         = seniorDBInfo.GetCurrentDatabaseStateID();
    const uint64 seniorOldestIDInLog = seniorDBInfo.GetOldestDatabaseIDInLog();
+   _seniorUpdateHeadroom = seniorDBInfo.GetUpdateHeadroom();
+
+   if ((_verifyRestoredStateOnNextBeacon)&&(_master->IAmTheDatabaseSeniorPeer(_whichDatabase) == false))
+   {
+      _verifyRestoredStateOnNextBeacon = false;
+
+      // If the state we restored from disk is ahead of the senior peer's state, or is at the same state ID but with
+      // different contents, then it's from a different history than the senior's, and we'll need to start over from his.
+      if ((_localDatabaseStateID > seniorState)||((_localDatabaseStateID == seniorState)&&(_dbChecksum != seniorDBInfo.GetDBChecksum())))
+      {
+         LogTime(MUSCLE_LOG_WARNING, "Restored database #" UINT32_FORMAT_SPEC " (state #" UINT64_FORMAT_SPEC ") doesn't match the senior peer's state #" UINT64_FORMAT_SPEC ", requesting full database resend.\n", _whichDatabase, _localDatabaseStateID, seniorState);
+         ClearUpdateLog();
+         _seniorDatabaseStateReceived = true;
+         _seniorDatabaseStateID       = seniorState;
+         _seniorOldestIDInLog         = seniorOldestIDInLog;
+         const status_t ret = RequestFullDatabaseResendFromSeniorPeer(false);
+         if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Request for full database resend failed! [%s]\n", ret());
+         return;
+      }
+   }
    if ((seniorState != _seniorDatabaseStateID)||(seniorOldestIDInLog != _seniorOldestIDInLog))
    {
       _seniorDatabaseStateReceived = true;
@@ -517,10 +1113,16 @@ void PZGDatabaseState :: SeniorDatabaseStateInfoChanged(const PZGDatabaseStateIn
    }
 }
 
-void PZGDatabaseState :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData)
+void PZGDatabaseState :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply)
 {
-   const ZGPeerID & seniorPeerID = _master->GetSeniorPeerID();
-   if ((_backorders.Remove(ubok).IsOK())&&(ubok.GetTargetPeerID() == seniorPeerID)&&(_master->IAmTheSeniorPeer() == false))
+   if (ubok.IsRange())
+   {
+      BackOrderRangeResultReceived(ubok, optUpdateData, isFinalReply);
+      return;
+   }
+
+   const ZGPeerID & seniorPeerID = _master->GetDatabaseSeniorPeerID(_whichDatabase);
+   if ((_backorders.Remove(ubok).IsOK())&&(ubok.GetTargetPeerID() == seniorPeerID)&&(_master->IAmTheDatabaseSeniorPeer(_whichDatabase) == false))
    {
       if (ubok.GetDatabaseUpdateID() == DATABASE_UPDATE_ID_FULL_UPDATE)
       {
@@ -528,7 +1130,16 @@ void PZGDatabaseState :: BackOrderResultReceived(const PZGUpdateBackOrderKey & u
          {
             LogTime(MUSCLE_LOG_DEBUG, "Database #" UINT32_FORMAT_SPEC ":  Received full-database-state from senior peer (%s)\n", _whichDatabase, seniorPeerID.ToString()());
             NestCountGuard ncg(_inJuniorDatabaseUpdate);
-            if (JuniorExecuteDatabaseReplace(*optUpdateData()).IsOK()) ScheduleLogContentsRescan();
+            if (JuniorExecuteDatabaseReplace(*optUpdateData()).IsOK())
+            {
+               if (_durableLog)
+               {
+                  // The full-database-state we just received makes a perfectly good snapshot, so we might as well use it as one
+                  _updatesSinceDurableSnapshot = 0;
+                  if (_durableLog->SaveSnapshot(_whichDatabase, optUpdateData).IsError()) SaveDurableSnapshot();
+               }
+               ScheduleLogContentsRescan();
+            }
          }
          else LogTime(MUSCLE_LOG_ERROR, "Database #" UINT32_FORMAT_SPEC ":  Senior peer (%s) failed to send full-database-state to us!\n", _whichDatabase, seniorPeerID.ToString()());  // now what do we do?
       }
@@ -551,6 +1162,62 @@ void PZGDatabaseState :: BackOrderResultReceived(const PZGUpdateBackOrderKey & u
    }
 }
 
+void PZGDatabaseState :: BackOrderRangeResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optUpdateData, bool isFinalReply)
+{
+   if (_backorders.ContainsKey(ubok) == false) return;
+
+   const ZGPeerID & seniorPeerID = _master->GetDatabaseSeniorPeerID(_whichDatabase);
+   const bool replyIsRelevant = ((ubok.GetTargetPeerID() == seniorPeerID)&&(_master->IAmTheDatabaseSeniorPeer(_whichDatabase) == false));
+   if (isFinalReply == false)
+   {
+      if ((replyIsRelevant)&&(optUpdateData()))
+      {
+         const uint64 updateID = optUpdateData()->GetUpdateID();
+         if ((ubok.ContainsDatabaseUpdateID(updateID))&&(IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(updateID))&&(_updateLog.ContainsKey(updateID) == false))
+         {
+            status_t ret;
+            if (AddDatabaseUpdateToUpdateLog(optUpdateData).IsError(ret)) LogTime(MUSCLE_LOG_ERROR, "Database #" UINT32_FORMAT_SPEC ":  Unable to add back-ordered database update #" UINT64_FORMAT_SPEC " to the update log! [%s]\n", _whichDatabase, updateID, ret());
+         }
+      }
+      return;
+   }
+
+   (void) _backorders.Remove(ubok);
+   if (replyIsRelevant == false) return;
+
+   // If the senior peer didn't have every update we still need from the range, we'll have to fall back to a full resend
+   for (uint64 updateID=ubok.GetDatabaseUpdateID(); updateID<=ubok.GetLastDatabaseUpdateID(); updateID++)
+   {
+      if ((IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(updateID))&&(_updateLog.ContainsKey(updateID) == false))
+      {
+         LogTime(MUSCLE_LOG_WARNING, "Database #" UINT32_FORMAT_SPEC ":  Range-back-order of database updates #" UINT64_FORMAT_SPEC "-#" UINT64_FORMAT_SPEC " from senior peer (%s) didn't include update #" UINT64_FORMAT_SPEC ", requesting full database to recover.\n", _whichDatabase, ubok.GetDatabaseUpdateID(), ubok.GetLastDatabaseUpdateID(), seniorPeerID.ToString()(), updateID);
+
+         const status_t ret = RequestFullDatabaseResendFromSeniorPeer(false);
+         if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Request to senior peer (%s) for full-database-resend failed! [%s]\n", seniorPeerID.ToString()(), ret());
+         return;
+      }
+   }
+
+   LogTime(MUSCLE_LOG_DEBUG, "Database #" UINT32_FORMAT_SPEC ":  Range-back-order of database updates #" UINT64_FORMAT_SPEC "-#" UINT64_FORMAT_SPEC " received from senior peer (%s)\n", _whichDatabase, ubok.GetDatabaseUpdateID(), ubok.GetLastDatabaseUpdateID(), seniorPeerID.ToString()());
+   ScheduleLogContentsRescan();
+}
+
+void PZGDatabaseState :: GetBackOrderedRanges(const ZGPeerID & targetPeerID, Hashtable<uint64, uint64> & retRanges) const
+{
+   for (ConstHashtableIterator<PZGUpdateBackOrderKey, Void> iter(_backorders); iter.HasData(); iter++)
+   {
+      const PZGUpdateBackOrderKey & ubok = iter.GetKey();
+      if ((ubok.GetTargetPeerID() == targetPeerID)&&(ubok.GetDatabaseUpdateID() != DATABASE_UPDATE_ID_FULL_UPDATE))
+      {
+         // Ranges we place on order never overlap, but if two did start at the same ID, we'll keep the longer one
+         const uint64 lastID = ubok.GetLastDatabaseUpdateID();
+         const uint64 * oldLastID = retRanges.Get(ubok.GetDatabaseUpdateID());
+         if ((oldLastID == NULL)||(*oldLastID < lastID)) (void) retRanges.Put(ubok.GetDatabaseUpdateID(), lastID);
+      }
+   }
+   retRanges.SortByKey();
+}
+
 bool PZGDatabaseState :: IsDatabaseUpdateStillNeededToAdvanceJuniorPeerState(uint64 databaseUpdateID) const
 {
    if (databaseUpdateID <= _localDatabaseStateID)      return false;  // we already handled that one
@@ -569,8 +1236,9 @@ void PZGDatabaseState :: VerifyOrFixLocalDatabaseChecksum()
    }
 }
 
-ConstPZGDatabaseUpdateRef PZGDatabaseState :: GetDatabaseUpdateByID(uint64 updateID, const INetworkTimeProvider & networkTimeProvider) const
+ConstPZGDatabaseUpdateRef PZGDatabaseState :: GetDatabaseUpdateByID(uint64 updateID, const INetworkTimeProvider & networkTimeProvider, bool * optRetReadFromDisk) const
 {
+   if (optRetReadFromDisk) *optRetReadFromDisk = false;
    if (updateID == DATABASE_UPDATE_ID_FULL_UPDATE)
    {
       // For this special value we'll save our full current database state and return that
@@ -584,6 +1252,7 @@ ConstPZGDatabaseUpdateRef PZGDatabaseState :: GetDatabaseUpdateByID(uint64 updat
          dbUp()->SetSeniorStartTimeMicros(networkTimeProvider.GetNetworkTime64ForRunTime64(startTime));
          dbUp()->SetSeniorElapsedTimeMicros(GetRunTime64()-startTime);
          dbUp()->SetPostUpdateDBChecksum(_dbChecksum);
+         dbUp()->SetPayloadCompressionLevel(_payloadCompressionLevel);
          dbUp()->SetPayloadMessage(savedDBMsg);
          return AddConstToRef(dbUp);
       }
@@ -593,13 +1262,26 @@ ConstPZGDatabaseUpdateRef PZGDatabaseState :: GetDatabaseUpdateByID(uint64 updat
          return savedDBMsg.GetStatus();
       }
    }
-   else return _updateLog[updateID];
+   else
+   {
+      const ConstPZGDatabaseUpdateRef * dbUp = _updateLog.Get(updateID);
+      if (dbUp) return *dbUp;
+      if (_durableLog == NULL) return ConstPZGDatabaseUpdateRef();
+
+      if (optRetReadFromDisk) *optRetReadFromDisk = true;
+      return _durableLog->ReadDatabaseUpdate(_whichDatabase, updateID);  // maybe it's still on disk?
+   }
 }
 
 ConstMessageRef PZGDatabaseState :: GetDatabaseUpdatePayloadByID(uint64 updateID) const
 {
    const ConstPZGDatabaseUpdateRef * dbur = _updateLog.Get(updateID);
-   return dbur ? dbur->GetItemPointer()->GetPayloadBufferAsMessage() : ConstMessageRef();
+   if (dbur == NULL) return ConstMessageRef();
+
+   const PZGDatabaseUpdate * dbUp = dbur->GetItemPointer();
+   const ConstMessageRef ret = dbUp->GetPayloadBufferAsMessage();
+   if (_keepUpdateLogCompressed) dbUp->UncachePayloadBufferAsMessage();  // the caller gets a temporarily-inflated copy; our update-log keeps only the compressed version
+   return ret;
 }
 
 }  // end namespace zg_private
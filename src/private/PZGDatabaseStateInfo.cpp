@@ -8,6 +8,7 @@ PZGDatabaseStateInfo :: PZGDatabaseStateInfo()
    : _currentDatabaseStateID(0)
    , _oldestDatabaseIDInLog(0)
    , _dbChecksum(0)
+   , _updateHeadroom((uint64)-1)
 {
    // empty
 }
@@ -16,14 +17,16 @@ PZGDatabaseStateInfo :: PZGDatabaseStateInfo(const PZGDatabaseStateInfo & stateI
    : _currentDatabaseStateID(stateInfo._currentDatabaseStateID)
    , _oldestDatabaseIDInLog(stateInfo._oldestDatabaseIDInLog)
    , _dbChecksum(stateInfo._dbChecksum)
+   , _updateHeadroom(stateInfo._updateHeadroom)
 {
    // empty
 }
 
-PZGDatabaseStateInfo :: PZGDatabaseStateInfo(uint64 dbID, uint64 oldestDatabaseIDInLog, uint32 dbChecksum)
+PZGDatabaseStateInfo :: PZGDatabaseStateInfo(uint64 dbID, uint64 oldestDatabaseIDInLog, uint32 dbChecksum, uint64 updateHeadroom)
    : _currentDatabaseStateID(dbID)
    , _oldestDatabaseIDInLog(oldestDatabaseIDInLog)
    , _dbChecksum(dbChecksum)
+   , _updateHeadroom(updateHeadroom)
 {
    // empty
 }
@@ -33,6 +36,7 @@ PZGDatabaseStateInfo & PZGDatabaseStateInfo :: operator=(const PZGDatabaseStateI
    _currentDatabaseStateID = rhs._currentDatabaseStateID;
    _oldestDatabaseIDInLog  = rhs._oldestDatabaseIDInLog;
    _dbChecksum             = rhs._dbChecksum;
+   _updateHeadroom         = rhs._updateHeadroom;
    return *this;
 }
 
@@ -41,6 +45,7 @@ void PZGDatabaseStateInfo :: Flatten(DataFlattener flat) const
    flat.WriteInt64(_currentDatabaseStateID);
    flat.WriteInt64(_oldestDatabaseIDInLog);
    flat.WriteInt32(_dbChecksum);
+   flat.WriteInt64(_updateHeadroom);
 }
 
 status_t PZGDatabaseStateInfo :: Unflatten(DataUnflattener & unflat)
@@ -48,6 +53,7 @@ status_t PZGDatabaseStateInfo :: Unflatten(DataUnflattener & unflat)
    _currentDatabaseStateID = unflat.ReadInt64();
    _oldestDatabaseIDInLog  = unflat.ReadInt64();
    _dbChecksum             = unflat.ReadInt32();
+   _updateHeadroom         = unflat.ReadInt64();
    return unflat.GetStatus();
 }
 
@@ -58,17 +64,17 @@ void PZGDatabaseStateInfo :: Print(const OutputPrinter & p) const
 
 String PZGDatabaseStateInfo :: ToString() const
 {
-   return String("DBState:  curDBID=%1 oldestID=%2 dbChecksum=%3").Arg(_currentDatabaseStateID).Arg(_oldestDatabaseIDInLog).Arg(_dbChecksum);
+   return String("DBState:  curDBID=%1 oldestID=%2 dbChecksum=%3 headroom=%4").Arg(_currentDatabaseStateID).Arg(_oldestDatabaseIDInLog).Arg(_dbChecksum).Arg(_updateHeadroom);
 }
 
 uint32 PZGDatabaseStateInfo :: CalculateChecksum() const
 {
-   return CalculatePODChecksum(_currentDatabaseStateID) + (CalculatePODChecksum(_oldestDatabaseIDInLog)*3) + (_dbChecksum*7);
+   return CalculatePODChecksum(_currentDatabaseStateID) + (CalculatePODChecksum(_oldestDatabaseIDInLog)*3) + (_dbChecksum*7) + (CalculatePODChecksum(_updateHeadroom)*11);
 }
 
 bool PZGDatabaseStateInfo :: operator == (const PZGDatabaseStateInfo & rhs) const
 {
-   return ((_currentDatabaseStateID == rhs._currentDatabaseStateID)&&(_oldestDatabaseIDInLog == rhs._oldestDatabaseIDInLog)&&(_dbChecksum == rhs._dbChecksum));
+   return ((_currentDatabaseStateID == rhs._currentDatabaseStateID)&&(_oldestDatabaseIDInLog == rhs._oldestDatabaseIDInLog)&&(_dbChecksum == rhs._dbChecksum)&&(_updateHeadroom == rhs._updateHeadroom));
 }
 
 }  // end namespace zg_private
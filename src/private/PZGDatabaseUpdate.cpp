@@ -33,6 +33,11 @@ PZGDatabaseUpdate :: PZGDatabaseUpdate()
    , _updateID(0)
    , _preUpdateDBChecksum(0)
    , _postUpdateDBChecksum(0)
+   , _payloadCompressionLevel(9)
+   , _requestSubmitTimeMicros(0)
+   , _seniorCommitTimeMicros(0)
+   , _multicastSendTimeMicros(0)
+   , _juniorReceiveTimeMicros(0)
 {
    // empty
 }
@@ -46,6 +51,11 @@ PZGDatabaseUpdate :: PZGDatabaseUpdate(const PZGDatabaseUpdate & rhs)
    , _updateID(rhs._updateID)
    , _preUpdateDBChecksum(rhs._preUpdateDBChecksum)
    , _postUpdateDBChecksum(rhs._postUpdateDBChecksum)
+   , _payloadCompressionLevel(rhs._payloadCompressionLevel)
+   , _requestSubmitTimeMicros(rhs._requestSubmitTimeMicros)
+   , _seniorCommitTimeMicros(rhs._seniorCommitTimeMicros)
+   , _multicastSendTimeMicros(rhs._multicastSendTimeMicros)
+   , _juniorReceiveTimeMicros(rhs._juniorReceiveTimeMicros)
    , _updateBuf(rhs._updateBuf)
    , _updateMsg(rhs._updateMsg)
 {
@@ -62,6 +72,11 @@ PZGDatabaseUpdate & PZGDatabaseUpdate :: operator=(const PZGDatabaseUpdate & rhs
    _updateID                = rhs._updateID;
    _preUpdateDBChecksum     = rhs._preUpdateDBChecksum;
    _postUpdateDBChecksum    = rhs._postUpdateDBChecksum;
+   _payloadCompressionLevel = rhs._payloadCompressionLevel;
+   _requestSubmitTimeMicros = rhs._requestSubmitTimeMicros;
+   _seniorCommitTimeMicros  = rhs._seniorCommitTimeMicros;
+   _multicastSendTimeMicros = rhs._multicastSendTimeMicros;
+   _juniorReceiveTimeMicros = rhs._juniorReceiveTimeMicros;
    _updateBuf               = rhs._updateBuf;
    _updateMsg               = rhs._updateMsg;
    return *this;
@@ -69,7 +84,8 @@ PZGDatabaseUpdate & PZGDatabaseUpdate :: operator=(const PZGDatabaseUpdate & rhs
 
 uint32 PZGDatabaseUpdate :: CalculateChecksum() const
 {
-   return CalculatePODChecksums(_updateType, _databaseIndex, _seniorElapsedTimeMillis, _seniorStartTimeMicros, _sourcePeerID, _updateID, _preUpdateDBChecksum, _postUpdateDBChecksum, GetPayloadBuffer());  // we're deliberately using GetPayloadBuffer() version here, rather than the Message version
+   const uint32 ret = CalculatePODChecksums(_updateType, _databaseIndex, _seniorElapsedTimeMillis, _seniorStartTimeMicros, _sourcePeerID, _updateID, _preUpdateDBChecksum, _postUpdateDBChecksum, GetPayloadBuffer());  // we're deliberately using GetPayloadBuffer() version here, rather than the Message version
+   return IsTraced() ? (ret+CalculatePODChecksums(_requestSubmitTimeMicros, _seniorCommitTimeMicros)) : ret;
 }
 
 uint32 PZGDatabaseUpdate :: FlattenedSize() const
@@ -83,7 +99,7 @@ uint32 PZGDatabaseUpdate :: FlattenedSizeNotIncludingPayload() const
 {
    return sizeof(uint32)                   + /* will be the PZG_DATABASE_UPDATE_TYPE_CODE header */
           sizeof(_updateType)              +
-          sizeof(uint8)                    + /* this is a reserved byte for now */
+          sizeof(uint8)                    + /* PZG_DATABASE_UPDATE_FLAG_* bits */
           sizeof(_databaseIndex)           +
           sizeof(_seniorElapsedTimeMillis) +
           sizeof(_seniorStartTimeMicros)   +
@@ -92,6 +108,7 @@ uint32 PZGDatabaseUpdate :: FlattenedSizeNotIncludingPayload() const
           sizeof(_updateID)                +
           sizeof(_preUpdateDBChecksum)     +
           sizeof(_postUpdateDBChecksum)    +
+          (IsTraced() ? (sizeof(_requestSubmitTimeMicros)+sizeof(_seniorCommitTimeMicros)) : 0) +
           sizeof(uint32)                   + /* this will be this object's checksum */
           sizeof(uint32)                   ; /* this will be updateBuf.FlattenedSize() */
 }
@@ -100,7 +117,7 @@ void PZGDatabaseUpdate :: Flatten(DataFlattener flat) const
 {
    flat.WriteInt32(PZG_DATABASE_UPDATE_TYPE_CODE);
    flat.WriteInt8(_updateType);
-   flat.WriteInt8(0);  /* this field is reserved for now */
+   flat.WriteInt8(IsTraced() ? PZG_DATABASE_UPDATE_FLAG_TRACED : 0);
    flat.WriteInt16(_databaseIndex);
    flat.WriteInt16(_seniorElapsedTimeMillis);
    flat.WriteInt16(0);  /* this field is reserved */
@@ -109,6 +126,11 @@ void PZGDatabaseUpdate :: Flatten(DataFlattener flat) const
    flat.WriteInt64(_updateID);
    flat.WriteInt32(_preUpdateDBChecksum);
    flat.WriteInt32(_postUpdateDBChecksum);
+   if (IsTraced())
+   {
+      flat.WriteInt64(_requestSubmitTimeMicros);
+      flat.WriteInt64(_seniorCommitTimeMicros);
+   }
    flat.WriteInt32(CalculateChecksum());
 
    const ConstByteBufferRef & updateBuf = GetPayloadBuffer();
@@ -131,7 +153,7 @@ status_t PZGDatabaseUpdate :: Unflatten(DataUnflattener & unflat)
    _updateMsg.Reset();
 
    _updateType                          = unflat.ReadInt8();
-   (void)                                 unflat.ReadInt8();   // skip the reserved/padding byte
+   const uint8 flags                    = unflat.ReadInt8();
    _databaseIndex                       = unflat.ReadInt16();
    _seniorElapsedTimeMillis             = unflat.ReadInt16();
    (void)                                 unflat.ReadInt16();  // reserved 16-bit field is here; maybe we'll do something with it someday
@@ -140,6 +162,10 @@ status_t PZGDatabaseUpdate :: Unflatten(DataUnflattener & unflat)
    _updateID                            = unflat.ReadInt64();
    _preUpdateDBChecksum                 = unflat.ReadInt32();
    _postUpdateDBChecksum                = unflat.ReadInt32();
+   _requestSubmitTimeMicros             = (flags & PZG_DATABASE_UPDATE_FLAG_TRACED) ? unflat.ReadInt64() : 0;
+   _seniorCommitTimeMicros              = (flags & PZG_DATABASE_UPDATE_FLAG_TRACED) ? unflat.ReadInt64() : 0;
+   _multicastSendTimeMicros             = 0;
+   _juniorReceiveTimeMicros             = 0;
    const uint32 chk                     = unflat.ReadInt32();
    const uint32 dataSize                = unflat.ReadInt32();
    if (unflat.GetNumBytesAvailable() < dataSize) return B_BAD_DATA;  // truncated buffer, oh no!
@@ -165,7 +191,9 @@ String PZGDatabaseUpdate :: ToString() const
 {
    char buf[512];
    muscleSprintf(buf, "UpdateID=" UINT64_FORMAT_SPEC " Type=%u db=%u elapsed=%umS seniorTime=" UINT64_FORMAT_SPEC " sourcePeerID=%s preChk=" UINT32_FORMAT_SPEC " postChk=" UINT32_FORMAT_SPEC " _updateBuf=" INT32_FORMAT_SPEC " _updateMsg=" INT32_FORMAT_SPEC, _updateID, _updateType, _databaseIndex, _seniorElapsedTimeMillis, _seniorStartTimeMicros, _sourcePeerID.ToString()(), _preUpdateDBChecksum, _postUpdateDBChecksum, _updateBuf()?_updateBuf()->GetNumBytes():0, _updateMsg()?_updateMsg()->FlattenedSize():0);
-   return buf;
+   String ret = buf;
+   if (IsTraced()) ret += String(" submitTime=%1 commitTime=%2").Arg(_requestSubmitTimeMicros).Arg(_seniorCommitTimeMicros);
+   return ret;
 }
 
 void PZGDatabaseUpdate :: Print(const OutputPrinter & p) const
@@ -197,7 +225,7 @@ const ConstMessageRef & PZGDatabaseUpdate :: GetPayloadBufferAsMessage() const
 const ConstByteBufferRef & PZGDatabaseUpdate :: GetPayloadBuffer() const
 {
    if (_updateBuf()) return _updateBuf;  // re-use the prevously-constructed buffer, if we have one
-   if (_updateMsg()) _updateBuf = DeflateByteBuffer(_updateMsg()->FlattenToByteBuffer(), 9);  // demand-calculate and cache one if we don't
+   if (_updateMsg()) _updateBuf = DeflateByteBuffer(_updateMsg()->FlattenToByteBuffer(), _payloadCompressionLevel);  // demand-calculate and cache one if we don't
    return _updateBuf;
 }
 
@@ -0,0 +1,477 @@
+#ifdef WIN32
+# include <io.h>      // for _commit()
+#else
+# include <unistd.h>  // for fsync()
+#endif
+
+#include "util/Directory.h"
+#include "zg/private/PZGDurableLog.h"
+#include "zg/private/PZGConstants.h"
+
+namespace zg_private
+{
+
+static const String PZG_DURABLE_LOG_NAME_NEW_SEGMENT_ID  = "nsg";
+static const String PZG_DURABLE_LOG_NAME_KEEP_SEGMENT_ID = "ksg";
+
+// Makes sure that the data we've written to (fdio) has actually made it to disk, and isn't just sitting in a buffer somewhere
+static void SyncFileToDisk(FileDataIO & fdio)
+{
+   fdio.FlushOutput();
+
+   FILE * fpOut = fdio.GetFile();
+   if (fpOut)
+   {
+#ifdef WIN32
+      (void) _commit(_fileno(fpOut));
+#else
+      (void) fsync(fileno(fpOut));
+#endif
+   }
+}
+
+static status_t WriteRecord(FileDataIO & fdio, const ByteBuffer & recordBytes)
+{
+   uint8 lenBuf[sizeof(uint32)];
+   DefaultEndianConverter::Export(recordBytes.GetNumBytes(), lenBuf);
+   if (fdio.WriteFully(lenBuf, sizeof(lenBuf)).GetByteCount() != (int32) sizeof(lenBuf)) return B_IO_ERROR;
+   if (fdio.WriteFully(recordBytes.GetBuffer(), recordBytes.GetNumBytes()).GetByteCount() != (int32) recordBytes.GetNumBytes()) return B_IO_ERROR;
+   return B_NO_ERROR;
+}
+
+// Reads the next length-prefixed record from (fdio) into (retBuf).  Returns B_DATA_NOT_FOUND at a clean end-of-file.
+static status_t ReadRecord(FileDataIO & fdio, ByteBuffer & retBuf)
+{
+   uint8 lenBuf[sizeof(uint32)];
+   const int32 numLenBytesRead = fdio.ReadFully(lenBuf, sizeof(lenBuf)).GetByteCount();
+   if (numLenBytesRead == 0) return B_DATA_NOT_FOUND;
+   if (numLenBytesRead != (int32) sizeof(lenBuf)) return B_BAD_DATA;  // truncated record!
+
+   const uint32 recordSize = DefaultEndianConverter::Import<uint32>(lenBuf);
+   MRETURN_ON_ERROR(retBuf.SetNumBytes(recordSize, false));
+   return (fdio.ReadFully(retBuf.GetBuffer(), recordSize).GetByteCount() == (int32) recordSize) ? B_NO_ERROR : B_BAD_DATA;
+}
+
+PZGDurableLog :: PZGDurableLog()
+   : _filesNeedFlush(false)
+   , _hasWriteFailures(false)
+{
+   // empty
+}
+
+PZGDurableLog :: ~PZGDurableLog()
+{
+   Stop();
+}
+
+void PZGDurableLog :: SetParameters(const String & dirPath, uint32 numDatabases)
+{
+   _dirPath = dirPath;
+
+   (void) _currentSegments.EnsureSize(numDatabases, true);
+   (void) _previousSegments.EnsureSize(numDatabases, true);
+   (void) _segmentFiles.EnsureSize(numDatabases, true);
+   (void) _threadCurrentSegmentIDs.EnsureSize(numDatabases, true);
+   (void) _threadPreviousSegmentIDs.EnsureSize(numDatabases, true);
+   (void) _threadNumRecordsWritten.EnsureSize(numDatabases, true);
+   (void) _threadSegmentFailed.EnsureSize(numDatabases, true);
+   for (uint32 i=0; i<numDatabases; i++)
+   {
+      _currentSegments[i].Reset(1);
+      _threadCurrentSegmentIDs[i]  = 1;
+      _threadPreviousSegmentIDs[i] = (uint64)-1;
+      _threadNumRecordsWritten[i]  = 0;
+      _threadSegmentFailed[i]      = false;
+   }
+}
+
+String PZGDurableLog :: GetSnapshotFilePath(uint32 whichDB) const
+{
+   return _dirPath + "/" + String("zgdb_%1.snapshot").Arg(whichDB);
+}
+
+String PZGDurableLog :: GetSegmentFilePath(uint32 whichDB, uint64 firstUpdateID) const
+{
+   return _dirPath + "/" + String("zgdb_%1_%2.log").Arg(whichDB).Arg(firstUpdateID);
+}
+
+status_t PZGDurableLog :: Start()
+{
+   if (IsEnabled() == false) return B_NO_ERROR;  // nothing to do
+   if (IsInternalThreadRunning()) return B_NO_ERROR;  // already running
+
+   return StartInternalThread();
+}
+
+void PZGDurableLog :: Stop()
+{
+   if (IsInternalThreadRunning()) ShutdownInternalThread();  // the internal thread will process all queued Messages before it exits
+
+   for (uint32 i=0; i<_segmentFiles.GetNumItems(); i++)
+   {
+      if (_segmentFiles[i]()) SyncFileToDisk(*_segmentFiles[i]());
+      _segmentFiles[i].Reset();
+   }
+}
+
+status_t PZGDurableLog :: LoadDatabaseState(uint32 whichDB, ConstPZGDatabaseUpdateRef & retSnapshot, Queue<ConstPZGDatabaseUpdateRef> & retUpdates)
+{
+   if (IsEnabled() == false) return B_NO_ERROR;  // nothing to load
+   if (whichDB >= _currentSegments.GetNumItems()) return B_BAD_ARGUMENT;
+
+   (void) Directory::MakeDirectory(_dirPath(), true, false);  // make sure our directory exists, so that we can write to it later
+
+   retSnapshot.Reset();
+   retUpdates.Clear();
+
+   uint64 snapshotStateID    = 0;
+   uint64 prevSegmentFirstID = (uint64)-1;
+   {
+      FileDataIO fdio(fopen(GetSnapshotFilePath(whichDB)(), "rb"));
+      if (fdio.GetFile())
+      {
+         uint8 headerBuf[sizeof(uint32)+sizeof(uint64)];
+         ByteBuffer recordBuf;
+         status_t ret;
+         if ((fdio.ReadFully(headerBuf, sizeof(headerBuf)).GetByteCount() == (int32) sizeof(headerBuf))&&(DefaultEndianConverter::Import<uint32>(headerBuf) == PZG_DURABLE_SNAPSHOT_FILE_MAGIC)&&(ReadRecord(fdio, recordBuf).IsOK(ret)))
+         {
+            PZGDatabaseUpdateRef snapshot = GetPZGDatabaseUpdateFromPool();
+            MRETURN_OOM_ON_NULL(snapshot());
+
+            if (snapshot()->UnflattenFromByteBuffer(recordBuf).IsOK(ret))
+            {
+               snapshotStateID    = snapshot()->GetUpdateID();
+               prevSegmentFirstID = DefaultEndianConverter::Import<uint64>(headerBuf+sizeof(uint32));
+               retSnapshot        = snapshot;
+            }
+            else LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Unable to parse snapshot file for database #" UINT32_FORMAT_SPEC " [%s]\n", whichDB, ret());
+         }
+         else LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Snapshot file for database #" UINT32_FORMAT_SPEC " is corrupt, ignoring it. [%s]\n", whichDB, ret());
+      }
+   }
+
+   // The previous segment is only useful to us as history (for serving back-orders); the current segment is what we will replay
+   PZGDurableLogSegment & prevSeg = _previousSegments[whichDB];
+   prevSeg.Reset((prevSegmentFirstID == (uint64)-1) ? 0 : prevSegmentFirstID);
+   if (prevSegmentFirstID != (uint64)-1) (void) ReadSegmentFile(whichDB, prevSeg, NULL);
+
+   PZGDurableLogSegment & curSeg = _currentSegments[whichDB];
+   curSeg.Reset(snapshotStateID+1);
+   const bool curSegIsDamaged = (ReadSegmentFile(whichDB, curSeg, &retUpdates) == B_BAD_DATA);
+
+   _threadCurrentSegmentIDs[whichDB]  = curSeg._firstUpdateID;
+   _threadPreviousSegmentIDs[whichDB] = prevSegmentFirstID;
+   _threadNumRecordsWritten[whichDB]  = curSeg._recordOffsets.GetNumItems();
+   _threadSegmentFailed[whichDB]      = false;
+   if (curSegIsDamaged)
+   {
+      // Appending after the damaged record would put our new records at the wrong offsets, so we'll start a new segment file instead
+      LogTime(MUSCLE_LOG_WARNING, "PZGDurableLog:  Log-segment file for database #" UINT32_FORMAT_SPEC " ends with a damaged record; a new snapshot will be saved.\n", whichDB);
+      ReportWriteFailure(whichDB);
+   }
+
+   LogTime(MUSCLE_LOG_DEBUG, "PZGDurableLog:  Loaded database #" UINT32_FORMAT_SPEC " from [%s]:  snapshot state is " UINT64_FORMAT_SPEC ", " UINT32_FORMAT_SPEC " subsequent updates were logged.\n", whichDB, _dirPath(), snapshotStateID, retUpdates.GetNumItems());
+   return B_NO_ERROR;
+}
+
+status_t PZGDurableLog :: ReadSegmentFile(uint32 whichDB, PZGDurableLogSegment & segment, Queue<ConstPZGDatabaseUpdateRef> * optRetUpdates) const
+{
+   FileDataIO fdio(fopen(GetSegmentFilePath(whichDB, segment._firstUpdateID)(), "rb"));
+   if (fdio.GetFile() == NULL) return B_FILE_NOT_FOUND;
+
+   ByteBuffer recordBuf;
+   while(true)
+   {
+      const uint64 recordOffset = segment._nextRecordOffset;
+      const status_t ret = ReadRecord(fdio, recordBuf);
+      if (ret == B_DATA_NOT_FOUND) break;  // clean end of file
+      if (ret.IsError()) return B_BAD_DATA;  // a truncated record at the end of the file, which we'll ignore
+
+      if (optRetUpdates)
+      {
+         PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+         MRETURN_OOM_ON_NULL(dbUp());
+
+         if ((dbUp()->UnflattenFromByteBuffer(recordBuf).IsError())||(dbUp()->GetUpdateID() != (segment._firstUpdateID+segment._recordOffsets.GetNumItems()))) return B_BAD_DATA;  // corrupt or out-of-sequence record; ignore everything from here on
+         MRETURN_ON_ERROR(optRetUpdates->AddTail(dbUp));
+      }
+
+      MRETURN_ON_ERROR(segment._recordOffsets.AddTail(recordOffset));
+      segment._nextRecordOffset += sizeof(uint32)+recordBuf.GetNumBytes();
+   }
+   return B_NO_ERROR;
+}
+
+status_t PZGDurableLog :: AppendDatabaseUpdate(uint32 whichDB, const ConstPZGDatabaseUpdateRef & dbUp)
+{
+   if ((IsEnabled() == false)||(IsInternalThreadRunning() == false)) return B_BAD_OBJECT;
+   if ((dbUp() == NULL)||(whichDB >= _currentSegments.GetNumItems())) return B_BAD_ARGUMENT;
+
+   if (HandleWriteFailure(whichDB)) return B_IO_ERROR;  // the current segment file is damaged, so the caller will need to save a new snapshot
+
+   PZGDurableLogSegment & curSeg = _currentSegments[whichDB];
+   if (dbUp()->GetUpdateID() != (curSeg._firstUpdateID+curSeg._recordOffsets.GetNumItems())) return B_BAD_ARGUMENT;  // we only store contiguous runs of updates
+
+   // The internal thread gets its own shallow copy of the update, so that it won't interfere with the main thread's
+   // demand-caching of the payload data.  The copy shares the (immutable) payload buffer, so it's cheap.
+   PZGDatabaseUpdateRef copyRef = GetPZGDatabaseUpdateFromPool();
+   MRETURN_OOM_ON_NULL(copyRef());
+   *copyRef() = *dbUp();
+
+   const uint32 recordSize = copyRef()->FlattenedSize();  // note:  this also demand-calculates the payload buffer, here in the main thread
+
+   MessageRef msg = GetMessageFromPool(PZG_DURABLE_LOG_COMMAND_APPEND_UPDATE);
+   MRETURN_OOM_ON_NULL(msg());
+   MRETURN_ON_ERROR(msg()->AddInt32(PZG_PEER_NAME_DATABASE_ID, whichDB));
+   MRETURN_ON_ERROR(msg()->AddFlat(PZG_PEER_NAME_DATABASE_UPDATE, FlatCountableRef(copyRef)));
+
+   MRETURN_ON_ERROR(curSeg._recordOffsets.AddTail(curSeg._nextRecordOffset));
+   curSeg._nextRecordOffset += sizeof(uint32)+recordSize;
+
+   status_t ret;
+   if (SendMessageToInternalThread(msg).IsError(ret))
+   {
+      (void) curSeg._recordOffsets.RemoveTail();  // roll back!
+      curSeg._nextRecordOffset -= sizeof(uint32)+recordSize;
+   }
+   return ret;
+}
+
+status_t PZGDurableLog :: SaveSnapshot(uint32 whichDB, const ConstPZGDatabaseUpdateRef & fullStateUpdate)
+{
+   if ((IsEnabled() == false)||(IsInternalThreadRunning() == false)) return B_BAD_OBJECT;
+   if ((fullStateUpdate() == NULL)||(fullStateUpdate()->GetUpdateType() != PZG_DATABASE_UPDATE_TYPE_REPLACE)||(whichDB >= _currentSegments.GetNumItems())) return B_BAD_ARGUMENT;
+
+   (void) HandleWriteFailure(whichDB);  // so that we won't keep any records that never made it to disk as history
+
+   PZGDatabaseUpdateRef copyRef = GetPZGDatabaseUpdateFromPool();
+   MRETURN_OOM_ON_NULL(copyRef());
+   *copyRef() = *fullStateUpdate();  // the internal thread will deflate the payload of this copy, so the main thread doesn't have to
+
+   PZGDurableLogSegment & curSeg  = _currentSegments[whichDB];
+   PZGDurableLogSegment & prevSeg = _previousSegments[whichDB];
+   const uint64 newSegmentFirstID = fullStateUpdate()->GetUpdateID()+1;
+
+   // If the current segment leads contiguously up to this snapshot, it becomes our history; otherwise
+   // we've jumped to a different point in the database's history and none of our old segments are relevant anymore.
+   if (curSeg._recordOffsets.HasItems())
+   {
+      if ((curSeg._firstUpdateID+curSeg._recordOffsets.GetNumItems()) == newSegmentFirstID) prevSeg = curSeg;
+                                                                                       else prevSeg.Reset(0);
+   }
+   else if (curSeg._firstUpdateID != newSegmentFirstID) prevSeg.Reset(0);
+   curSeg.Reset(newSegmentFirstID);
+
+   const uint64 keepSegmentFirstID = prevSeg._recordOffsets.HasItems() ? prevSeg._firstUpdateID : (uint64)-1;
+
+   MessageRef msg = GetMessageFromPool(PZG_DURABLE_LOG_COMMAND_SAVE_SNAPSHOT);
+   MRETURN_OOM_ON_NULL(msg());
+   MRETURN_ON_ERROR(msg()->AddInt32(PZG_PEER_NAME_DATABASE_ID, whichDB));
+   MRETURN_ON_ERROR(msg()->AddFlat(PZG_PEER_NAME_DATABASE_UPDATE, FlatCountableRef(copyRef)));
+   MRETURN_ON_ERROR(msg()->AddInt64(PZG_DURABLE_LOG_NAME_NEW_SEGMENT_ID,  newSegmentFirstID));
+   MRETURN_ON_ERROR(msg()->AddInt64(PZG_DURABLE_LOG_NAME_KEEP_SEGMENT_ID, keepSegmentFirstID));
+   return SendMessageToInternalThread(msg);
+}
+
+bool PZGDurableLog :: HandleWriteFailure(uint32 whichDB)
+{
+   if (_hasWriteFailures.load() == false) return false;  // the common case
+
+   PZGDurableLogWriteFailure failure;
+   {
+      DECLARE_MUTEXGUARD(_writeFailuresMutex);
+      if (_writeFailures.Remove(whichDB, failure).IsError()) return false;
+      _hasWriteFailures.store(_writeFailures.HasItems());
+   }
+
+   // Forget about any records that didn't make it into the segment file, so that we'll never try to read them back in
+   PZGDurableLogSegment * seg = NULL;
+        if (_currentSegments[whichDB]._firstUpdateID  == failure._segmentFirstUpdateID) seg = &_currentSegments[whichDB];
+   else if (_previousSegments[whichDB]._firstUpdateID == failure._segmentFirstUpdateID) seg = &_previousSegments[whichDB];
+   if (seg == NULL) return false;  // the damaged segment has already been replaced by a newer one
+
+   if (seg->_recordOffsets.GetNumItems() > failure._numRecordsWritten)
+   {
+      seg->_nextRecordOffset = seg->_recordOffsets[failure._numRecordsWritten];
+      while(seg->_recordOffsets.GetNumItems() > failure._numRecordsWritten) (void) seg->_recordOffsets.RemoveTail();
+   }
+
+   LogTime(MUSCLE_LOG_WARNING, "PZGDurableLog:  Log-segment " UINT64_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " was truncated to " UINT32_FORMAT_SPEC " records due to a write error.\n", failure._segmentFirstUpdateID, whichDB, failure._numRecordsWritten);
+   return (seg == &_currentSegments[whichDB]);
+}
+
+ConstPZGDatabaseUpdateRef PZGDurableLog :: ReadDatabaseUpdate(uint32 whichDB, uint64 updateID) const
+{
+   if (whichDB >= _currentSegments.GetNumItems()) return B_BAD_ARGUMENT;
+
+   const PZGDurableLogSegment * seg = NULL;
+        if (_currentSegments[whichDB].ContainsUpdate(updateID))  seg = &_currentSegments[whichDB];
+   else if (_previousSegments[whichDB].ContainsUpdate(updateID)) seg = &_previousSegments[whichDB];
+   else return B_DATA_NOT_FOUND;
+
+   FileDataIO fdio(fopen(GetSegmentFilePath(whichDB, seg->_firstUpdateID)(), "rb"));
+   if (fdio.GetFile() == NULL) return B_FILE_NOT_FOUND;
+   MRETURN_ON_ERROR(fdio.Seek(seg->_recordOffsets[(uint32)(updateID-seg->_firstUpdateID)], SeekableDataIO::IO_SEEK_SET));
+
+   ByteBuffer recordBuf;
+   MRETURN_ON_ERROR(ReadRecord(fdio, recordBuf));  // could fail if the internal thread hasn't flushed this record to disk yet
+
+   PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+   MRETURN_OOM_ON_NULL(dbUp());
+   MRETURN_ON_ERROR(dbUp()->UnflattenFromByteBuffer(recordBuf));
+   return (dbUp()->GetUpdateID() == updateID) ? AddConstToRef(dbUp) : ConstPZGDatabaseUpdateRef(B_BAD_DATA);
+}
+
+uint64 PZGDurableLog :: GetOldestAvailableUpdateID(uint32 whichDB) const
+{
+   if (whichDB >= _currentSegments.GetNumItems()) return (uint64)-1;
+   if (_previousSegments[whichDB]._recordOffsets.HasItems()) return _previousSegments[whichDB]._firstUpdateID;
+   if (_currentSegments[whichDB]._recordOffsets.HasItems())  return _currentSegments[whichDB]._firstUpdateID;
+   return (uint64)-1;
+}
+
+status_t PZGDurableLog :: MessageReceivedFromOwner(const MessageRef & msgRef, uint32 numLeft)
+{
+   if (msgRef() == NULL)
+   {
+      FlushSegmentFiles();
+      return B_SHUTTING_DOWN;  // time for the internal thread to go away
+   }
+
+   const uint32 whichDB = msgRef()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
+   PZGDatabaseUpdate dbUp;
+   if ((whichDB >= _segmentFiles.GetNumItems())||(msgRef()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, dbUp).IsError()))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Malformed command Message " UINT32_FORMAT_SPEC " received!\n", msgRef()->what);
+      return B_NO_ERROR;
+   }
+
+   switch(msgRef()->what)
+   {
+      case PZG_DURABLE_LOG_COMMAND_APPEND_UPDATE:
+      {
+         if (_threadSegmentFailed[whichDB]) break;  // nothing more goes into a damaged segment file; we'll start a new one at the next snapshot
+
+         FileDataIORef & segFile = _segmentFiles[whichDB];
+         if (segFile() == NULL)
+         {
+            segFile.SetRef(new FileDataIO(fopen(GetSegmentFilePath(whichDB, _threadCurrentSegmentIDs[whichDB])(), "ab")));
+            if (segFile()->GetFile() == NULL)
+            {
+               LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Unable to open log-segment file for database #" UINT32_FORMAT_SPEC "!\n", whichDB);
+               ReportWriteFailure(whichDB);
+               break;
+            }
+         }
+
+         status_t ret;
+         ConstByteBufferRef recordBytes = dbUp.FlattenToByteBuffer();
+         if ((recordBytes())&&(WriteRecord(*segFile(), *recordBytes()).IsOK(ret)))
+         {
+            _threadNumRecordsWritten[whichDB]++;
+            _filesNeedFlush = true;
+         }
+         else
+         {
+            LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Unable to append update #" UINT64_FORMAT_SPEC " to log-segment file for database #" UINT32_FORMAT_SPEC "! [%s]\n", dbUp.GetUpdateID(), whichDB, recordBytes() ? ret() : recordBytes.GetStatus()());
+            ReportWriteFailure(whichDB);
+         }
+      }
+      break;
+
+      case PZG_DURABLE_LOG_COMMAND_SAVE_SNAPSHOT:
+      {
+         const uint64 newSegmentFirstID  = msgRef()->GetInt64(PZG_DURABLE_LOG_NAME_NEW_SEGMENT_ID);
+         const uint64 keepSegmentFirstID = msgRef()->GetInt64(PZG_DURABLE_LOG_NAME_KEEP_SEGMENT_ID, (uint64)-1);
+
+         FlushSegmentFiles();  // the updates leading up to this snapshot should be on disk before the snapshot is
+
+         status_t ret;
+         if (WriteSnapshotFile(whichDB, dbUp, keepSegmentFirstID).IsOK(ret)) (void) StartNewSegmentFile(whichDB, newSegmentFirstID, keepSegmentFirstID);
+                                                                       else LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Unable to save snapshot of database #" UINT32_FORMAT_SPEC " at state " UINT64_FORMAT_SPEC "! [%s]\n", whichDB, dbUp.GetUpdateID(), ret());
+      }
+      break;
+
+      default:
+         LogTime(MUSCLE_LOG_ERROR, "PZGDurableLog:  Unknown command Message " UINT32_FORMAT_SPEC " received!\n", msgRef()->what);
+      break;
+   }
+
+   if (numLeft == 0) FlushSegmentFiles();  // flushing only when our queue is empty means that a burst of updates costs only a single sync
+   return B_NO_ERROR;
+}
+
+status_t PZGDurableLog :: WriteSnapshotFile(uint32 whichDB, const PZGDatabaseUpdate & fullStateUpdate, uint64 prevSegmentFirstID)
+{
+   ConstByteBufferRef recordBytes = fullStateUpdate.FlattenToByteBuffer();  // this is where the payload gets deflated
+   MRETURN_OOM_ON_NULL(recordBytes());
+
+   // Write to a temporary file first, and then rename it into place, so that a crash can never leave us with a half-written snapshot
+   const String snapshotPath = GetSnapshotFilePath(whichDB);
+   const String tempPath     = snapshotPath + ".tmp";
+   {
+      FileDataIO fdio(fopen(tempPath(), "wb"));
+      if (fdio.GetFile() == NULL) return B_IO_ERROR;
+
+      uint8 headerBuf[sizeof(uint32)+sizeof(uint64)];
+      DefaultEndianConverter::Export((uint32)PZG_DURABLE_SNAPSHOT_FILE_MAGIC, headerBuf);
+      DefaultEndianConverter::Export(prevSegmentFirstID, headerBuf+sizeof(uint32));
+      if (fdio.WriteFully(headerBuf, sizeof(headerBuf)).GetByteCount() != (int32) sizeof(headerBuf)) return B_IO_ERROR;
+      MRETURN_ON_ERROR(WriteRecord(fdio, *recordBytes()));
+      SyncFileToDisk(fdio);
+   }
+
+#ifdef WIN32
+   (void) remove(snapshotPath());  // Windows' rename() won't overwrite an existing file
+#endif
+   return (rename(tempPath(), snapshotPath()) == 0) ? B_NO_ERROR : B_IO_ERROR;
+}
+
+status_t PZGDurableLog :: StartNewSegmentFile(uint32 whichDB, uint64 newSegmentFirstID, uint64 keepSegmentFirstID)
+{
+   _segmentFiles[whichDB].Reset();  // closes the old segment file
+
+   // Delete any segment files that are no longer referenced by our snapshot
+   const uint64 oldSegmentIDs[] = {_threadCurrentSegmentIDs[whichDB], _threadPreviousSegmentIDs[whichDB]};
+   for (uint32 i=0; i<ARRAYITEMS(oldSegmentIDs); i++)
+   {
+      const uint64 oldID = oldSegmentIDs[i];
+      if ((oldID != (uint64)-1)&&(oldID != newSegmentFirstID)&&(oldID != keepSegmentFirstID)) (void) remove(GetSegmentFilePath(whichDB, oldID)());
+   }
+
+   _threadCurrentSegmentIDs[whichDB]  = newSegmentFirstID;
+   _threadPreviousSegmentIDs[whichDB] = keepSegmentFirstID;
+   _threadNumRecordsWritten[whichDB]  = 0;
+   _threadSegmentFailed[whichDB]      = false;
+
+   // "wb" because any old file with this name must contain stale data from a history we've abandoned
+   _segmentFiles[whichDB].SetRef(new FileDataIO(fopen(GetSegmentFilePath(whichDB, newSegmentFirstID)(), "wb")));
+   if (_segmentFiles[whichDB]()->GetFile() == NULL)
+   {
+      _segmentFiles[whichDB].Reset();
+      return B_IO_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+void PZGDurableLog :: ReportWriteFailure(uint32 whichDB)
+{
+   // Stop appending to the damaged segment file (a partially-written record is in it now), and tell the main thread
+   // which of its records are good, so that it can fix up its index and save a new snapshot (which starts a new segment file)
+   _segmentFiles[whichDB].Reset();
+   _threadSegmentFailed[whichDB] = true;
+
+   DECLARE_MUTEXGUARD(_writeFailuresMutex);
+   if (_writeFailures.Put(whichDB, PZGDurableLogWriteFailure(_threadCurrentSegmentIDs[whichDB], _threadNumRecordsWritten[whichDB])).IsOK()) _hasWriteFailures.store(true);
+}
+
+void PZGDurableLog :: FlushSegmentFiles()
+{
+   if (_filesNeedFlush)
+   {
+      _filesNeedFlush = false;
+      for (uint32 i=0; i<_segmentFiles.GetNumItems(); i++) if (_segmentFiles[i]()) SyncFileToDisk(*_segmentFiles[i]());
+   }
+}
+
+}  // end namespace zg_private
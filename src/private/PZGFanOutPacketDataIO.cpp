@@ -0,0 +1,81 @@
+#include "zg/private/PZGFanOutPacketDataIO.h"
+
+namespace zg_private
+{
+
+PZGFanOutPacketDataIO :: PZGFanOutPacketDataIO(const Queue<PacketDataIORef> & childIOs)
+   : _numPacketsDropped(0)
+{
+   for (uint32 i=0; i<childIOs.GetNumItems(); i++) MLOG_ON_ERROR("AddTail", _children.AddTail(PZGFanOutChild(childIOs[i])));
+}
+
+io_status_t PZGFanOutPacketDataIO :: Write(const void * buffer, uint32 size)
+{
+   ConstByteBufferRef packet = GetByteBufferFromPool(size, (const uint8 *) buffer);
+   MRETURN_ON_ERROR(packet);
+
+   for (uint32 i=0; i<_children.GetNumItems(); i++)
+   {
+      Queue<ConstByteBufferRef> & q = _children[i]._packets;
+      if ((q.GetNumItems() >= PZG_FANOUT_MAX_QUEUED_PACKETS_PER_CHILD)||(q.AddTail(packet).IsError())) _numPacketsDropped++;
+   }
+   return io_status_t(size);
+}
+
+io_status_t PZGFanOutPacketDataIO :: WriteTo(const void * buffer, uint32 size, const IPAddressAndPort & packetDest)
+{
+   return packetDest.IsValid() ? io_status_t(B_UNIMPLEMENTED) : Write(buffer, size);  // each child sends to its own destination
+}
+
+uint32 PZGFanOutPacketDataIO :: GetMaximumPacketSize() const
+{
+   uint32 ret = MUSCLE_NO_LIMIT;
+   for (uint32 i=0; i<_children.GetNumItems(); i++) ret = muscleMin(ret, _children[i]._dio()->GetMaximumPacketSize());
+   return ret;
+}
+
+io_status_t PZGFanOutPacketDataIO :: FlushQueuedPackets(uint32 childIdx)
+{
+   if (childIdx >= _children.GetNumItems()) return B_BAD_ARGUMENT;
+
+   PZGFanOutChild & child = _children[childIdx];
+   if (child._batchedIO)
+   {
+      const io_status_t ret = child._batchedIO->WritePackets(child._packets);
+      if (ret.GetStatus() != B_UNIMPLEMENTED)
+      {
+         if (ret.IsError()) DropQueuedPackets(child);
+         return ret;
+      }
+   }
+
+   // Fall back to sending our packets one at a time
+   uint32 totalBytesSent = 0;
+   while(child._packets.HasItems())
+   {
+      const ByteBuffer & packet = *child._packets.Head()();
+      const io_status_t ret = child._dio()->Write(packet.GetBuffer(), packet.GetNumBytes());
+      if (ret.IsError())
+      {
+         if (totalBytesSent > 0) return io_status_t(totalBytesSent);  // if the error persists, we'll drop the rest on our next call
+
+         DropQueuedPackets(child);
+         return ret;
+      }
+      if (ret.GetByteCount() == 0) break;  // send-buffer is full; we'll send the rest when the socket is ready-for-write
+
+      totalBytesSent += ret.GetByteCount();
+      (void) child._packets.RemoveHead();
+   }
+   return io_status_t(totalBytesSent);
+}
+
+void PZGFanOutPacketDataIO :: DropQueuedPackets(PZGFanOutChild & child)
+{
+   // A hard send-error (e.g. ENETUNREACH) isn't going to go away by itself, and if we kept the packets around, our caller
+   // would keep waking up to retry them.  The junior peers will recover any database-updates they miss via back-orders.
+   _numPacketsDropped += child._packets.GetNumItems();
+   child._packets.Clear();
+}
+
+}  // end namespace zg_private
@@ -86,6 +86,14 @@ void PZGHeartbeatSession :: MessageReceivedFromInternalThread(const MessageRef &
 
          const ZGPeerID & newSeniorPeerID = GetSeniorPeerID();
          if (newSeniorPeerID != oldSeniorPeerID) _master->SeniorPeerChanged(oldSeniorPeerID, newSeniorPeerID);
+
+         // Finally, let the master know the current seniority-ordering of the full peers (used to assign per-database senior peers)
+         Queue<ZGPeerID> orderedFullPeerIDs;
+         for (ConstHashtableIterator<ZGPeerID, Queue<ConstPZGHeartbeatPacketWithMetaDataRef> > iter(_mainThreadPeers); iter.HasData(); iter++)
+         {
+            if ((iter.GetValue().Head()()->GetPeerType() == PEER_TYPE_FULL_PEER)&&(orderedFullPeerIDs.AddTail(iter.GetKey()).IsError())) break;  // junior-only peers are never candidates for seniority
+         }
+         _master->OrderedFullPeersListChanged(orderedFullPeerIDs);
       }
       break;
 
@@ -204,7 +212,8 @@ void PZGHeartbeatSession :: InternalThreadEntry()
          _hbtState.Pulse(messagesForOwnerThread);
 
          MessageRef nextMsgToOwner;
-         while(messagesForOwnerThread.RemoveHead(nextMsgToOwner).IsOK()) (void) SendMessageToOwner(nextMsgToOwner);
+         while(messagesForOwnerThread.RemoveHead(nextMsgToOwner).IsOK()) (void) EnqueueMessageToOwner(nextMsgToOwner);
+         FlushMessagesToOwner();
       }
       if (waitRet.IsOK())
       {
@@ -225,10 +234,10 @@ const ZGPeerID & PZGHeartbeatSession :: GetSeniorPeerID() const
 {
    if (_mainThreadPeers.IsEmpty()) return GetDefaultObjectForType<ZGPeerID>();
 
-   // Since we sort the list such that full-peers always appear above junior-only peers,
-   // we can safely assume that if the first peer isn't a full-peer, then none of them are.
-   const ZGPeerID * firstPeer = _mainThreadPeers.GetFirstKey();
-   return ((firstPeer)&&(_mainThreadPeers.GetFirstValue()->Head()()->GetPeerType() == PEER_TYPE_FULL_PEER)) ? *firstPeer : GetDefaultObjectForType<ZGPeerID>();
+   // The senior peer is the most-senior full peer.  Junior-only peers are never eligible, so if only junior-only peers are online, there is no senior peer.
+   // (We don't rely on full peers always being listed first, since existing entries don't get re-sorted when the official ordering changes)
+   for (ConstHashtableIterator<ZGPeerID, Queue<ConstPZGHeartbeatPacketWithMetaDataRef> > iter(_mainThreadPeers); iter.HasData(); iter++) if (iter.GetValue().Head()()->GetPeerType() == PEER_TYPE_FULL_PEER) return iter.GetKey();
+   return GetDefaultObjectForType<ZGPeerID>();
 }
 
 uint64 PZGHeartbeatSession :: GetEstimatedLatencyToPeer(const ZGPeerID & peerID) const
@@ -1,6 +1,7 @@
 #include "dataio/SimulatedMulticastDataIO.h"
 #include "dataio/UDPSocketDataIO.h"
 #include "zg/discovery/common/DiscoveryUtilityFunctions.h"
+#include "zg/private/PZGBatchedUDPSocketDataIO.h"
 #include "zg/private/PZGHeartbeatSettings.h"
 #include "zg/ZGConstants.h"
 #include "zlib/ZLibUtilityFunctions.h"
@@ -80,7 +81,7 @@ static UDPSocketDataIORef CreateMulticastDataIO(const IPAddressAndPort & multica
          {
             if (AddSocketToMulticastGroup(udpSock, multicastIAP.GetIPAddress()).IsOK(ret))
             {
-               UDPSocketDataIORef udpRef(new UDPSocketDataIO(udpSock, false));
+               UDPSocketDataIORef udpRef(new PZGBatchedUDPSocketDataIO(udpSock));  // receives packets in batches, where supported
                (void) udpRef()->SetPacketSendDestination(multicastIAP);
                return udpRef;
             }
@@ -4,6 +4,7 @@
 #include "util/NetworkUtilityFunctions.h"
 
 #include "zg/ZGConstants.h"
+#include "zg/private/PZGBatchedUDPSocketDataIO.h"
 #include "zg/private/PZGConstants.h"
 #include "zg/private/PZGHeartbeatPacket.h"
 #include "zg/private/PZGHeartbeatSession.h"
@@ -168,9 +169,20 @@ status_t PZGHeartbeatThreadState :: SendHeartbeatPackets()
    if (hbRef()) hbRef()->Initialize(*_hbSettings(), (uint32) MicrosToSeconds(_now-_heartbeatThreadStateBirthdate), IsFullyAttached(), ++_hbSettings()->_outgoingHeartbeatPacketIDCounter);
 
    PZGHeartbeatPacketWithMetaData & hb = *hbRef();
-   if ((_hbSettings()->GetPeerType() == PEER_TYPE_FULL_PEER)&&(_now >= _halfAttachedTime))
+   if (_now >= _halfAttachedTime)
    {
-      const Queue<ZGPeerID> pids = CalculateOrderedPeersList();
+      // Full peers advertise the ordered list of full peers, for senior-election purposes.  Junior-only peers are left out of those lists
+      // (so that adding junior-only peers doesn't grow every full peer's heartbeats), except that the senior peer lists them too, so that
+      // they can get the timing-info they need to synchronize their network clocks.  A junior-only peer lists only the senior peer, for the same reason.
+      Queue<ZGPeerID> pids;
+      if (_hbSettings()->GetPeerType() == PEER_TYPE_FULL_PEER)
+      {
+         const bool includeJuniorOnlyPeers = IAmTheSeniorPeer();
+         const Queue<ZGPeerID> allPIDs = CalculateOrderedPeersList();
+         if (pids.EnsureSize(allPIDs.GetNumItems()).IsOK()) for (uint32 i=0; i<allPIDs.GetNumItems(); i++) if ((includeJuniorOnlyPeers)||(IsFullPeer(allPIDs[i]))) (void) pids.AddTail(allPIDs[i]);
+      }
+      else if (IsFullPeer(GetSeniorPeerID())) (void) pids.AddTail(GetSeniorPeerID());
+
       Queue<ConstPZGHeartbeatPeerInfoRef> & hpis = hb.GetOrderedPeersList();
       (void) hpis.EnsureSize(pids.GetNumItems());
       for (uint32 i=0; i<pids.GetNumItems(); i++)
@@ -260,38 +272,52 @@ void PZGHeartbeatThreadState :: UpdateToNetworkTimeOffset()
    }
 }
 
-// Returns true iff the ZGPeerIDs in (idQ) are the same as the keys in our own _peerIDToIPAddresses list (ordering doesn't matter)
-bool PZGHeartbeatThreadState :: PeersListMatchesIgnoreOrdering(const Queue<ConstPZGHeartbeatPeerInfoRef> & infoQ) const
+// Returns true iff the full peers listed in (infoQ) are the same as the full peers in our own _peerIDToIPAddresses list (ordering doesn't matter)
+// Junior-only peers are ignored, since they don't take part in senior-peer election
+bool PZGHeartbeatThreadState :: PeersListMatchesIgnoreOrdering(const Queue<ConstPZGHeartbeatPeerInfoRef> & infoQ, uint32 numLocalFullPeers) const
+{
+   uint32 numFullPeersInList = 0;
+   for (uint32 i=0; i<infoQ.GetNumItems(); i++)
+   {
+      const ZGPeerID & pid = infoQ[i]()->GetPeerID();
+      if (_peerIDToIPAddresses.ContainsKey(pid) == false) return false;  // he knows about a peer that we don't
+      if (IsFullPeer(pid)) numFullPeersInList++;
+   }
+   return (numFullPeersInList == numLocalFullPeers);
+}
+
+// Returns true iff we are receiving heartbeats from the specified peer, and it is a PEER_TYPE_FULL_PEER
+bool PZGHeartbeatThreadState :: IsFullPeer(const ZGPeerID & pid) const
+{
+   const Queue<IPAddressAndPort> * q = _peerIDToIPAddresses.Get(pid);
+   return ((q)&&(q->HasItems())&&(GetPeerTypeFromQueue(pid, *q) == PEER_TYPE_FULL_PEER));
+}
+
+uint32 PZGHeartbeatThreadState :: GetNumFullPeers() const
 {
-   if (infoQ.GetNumItems() != _peerIDToIPAddresses.GetNumItems()) return false;
-   for (uint32 i=0; i<infoQ.GetNumItems(); i++) if (_peerIDToIPAddresses.ContainsKey(infoQ[i]()->GetPeerID()) == false) return false;
-   return true;
+   uint32 ret = 0;
+   for (ConstHashtableIterator<ZGPeerID, Queue<IPAddressAndPort> > iter(_peerIDToIPAddresses); iter.HasData(); iter++) if (GetPeerTypeFromQueue(iter.GetKey(), iter.GetValue()) == PEER_TYPE_FULL_PEER) ret++;
+   return ret;
 }
 
-// Returns the peer with the lowest peer ID that also has the same advertised peer-IDs-list that we do (not counting peer-ordering)
+// Returns the full peer with the lowest peer ID that also has the same advertised full-peer-IDs-list that we do (not counting peer-ordering)
 ZGPeerID PZGHeartbeatThreadState :: GetKingmakerPeerID() const
 {
-   ZGPeerID minPeerID;
-   for (ConstHashtableIterator<PZGHeartbeatSourceKey, PZGHeartbeatSourceStateRef> iter(_onlineSources); iter.HasData(); iter++)
-   {
-      const PZGHeartbeatPacketWithMetaData & hbPacket = *iter.GetValue()()->GetHeartbeatPacket()();
-      const ZGPeerID & nextPID = hbPacket.GetSourcePeerID();
-      if (((minPeerID.IsValid() == false)||(nextPID < minPeerID))&&(PeersListMatchesIgnoreOrdering(hbPacket.GetOrderedPeersList()))) minPeerID = nextPID;
-   }
-   return minPeerID;
+   return GetKingmakerPeerSource().GetPeerID();
 }
 
-// Returns the source with the lowest peer ID that also has the same advertised peer-IDs-list that we do (not counting peer-ordering)
+// Returns the source of the full peer with the lowest peer ID that also has the same advertised full-peer-IDs-list that we do (not counting peer-ordering)
 PZGHeartbeatSourceKey PZGHeartbeatThreadState :: GetKingmakerPeerSource() const
 {
    PZGHeartbeatSourceKey ret;
 
+   const uint32 numLocalFullPeers = GetNumFullPeers();
    ZGPeerID minPeerID;
    for (ConstHashtableIterator<PZGHeartbeatSourceKey, PZGHeartbeatSourceStateRef> iter(_onlineSources); iter.HasData(); iter++)
    {
       const PZGHeartbeatPacketWithMetaData & hbPacket = *iter.GetValue()()->GetHeartbeatPacket()();
       const ZGPeerID & nextPID = hbPacket.GetSourcePeerID();
-      if (((minPeerID.IsValid() == false)||(nextPID < minPeerID))&&(PeersListMatchesIgnoreOrdering(hbPacket.GetOrderedPeersList())))
+      if ((hbPacket.GetPeerType() == PEER_TYPE_FULL_PEER)&&((minPeerID.IsValid() == false)||(nextPID < minPeerID))&&(PeersListMatchesIgnoreOrdering(hbPacket.GetOrderedPeersList(), numLocalFullPeers)))
       {
          ret       = iter.GetKey();
          minPeerID = nextPID;
@@ -341,7 +367,7 @@ int PZGHeartbeatThreadState :: ComparePeerIDsBySeniority(const ZGPeerID & pid1,
       // so that junior-only peers always stay towards the end of the list
       const uint16 pt1 = GetPeerTypeFromQueue(pid1, *q1);
       const uint16 pt2 = GetPeerTypeFromQueue(pid2, *q2);
-      int ret = -muscleCompare(pt1, pt2);
+      int ret = muscleCompare(pt1, pt2);
       if (ret) return ret;
 
       // Mostly we sort by uptime though, so that any newbies or peers who crashed and restarted will be seen as more junior
@@ -363,26 +389,31 @@ int PZGHeartbeatThreadState :: ComparePeerIDsBySeniority(const ZGPeerID & pid1,
 Queue<ZGPeerID> PZGHeartbeatThreadState :: CalculateOrderedPeersList()
 {
    Queue<ZGPeerID> ret;
+   if (ret.EnsureSize(_peerIDToIPAddresses.GetNumItems()).IsError()) return ret;
 
    const PZGHeartbeatSourceKey kmSource = GetKingmakerPeerSource();
-   if (kmSource.IsValid())
+   const PZGHeartbeatSourceStateRef * kmSourceData = kmSource.IsValid() ? _onlineSources.Get(kmSource) : NULL;
+   if (kmSourceData)
    {
-      // If we know who the kingmaker peer is, we'll just adopt the peer-ordering he is advertising, for uniformity's sake
-      // Note that if we got here, we are guaranteed that kmPeer's IDs-list has the same entries as our _peerIDToIPAddresses list (albeit maybe not in the same order)
-      const PZGHeartbeatSourceStateRef * kmSourceData = _onlineSources.Get(kmSource);
-      if (kmSourceData)
-      {
-         const Queue<ConstPZGHeartbeatPeerInfoRef> & kmq = kmSourceData->GetItemPointer()->GetHeartbeatPacket()()->GetOrderedPeersList();
-         if (ret.EnsureSize(kmq.GetNumItems()).IsOK()) for (uint32 i=0; i<kmq.GetNumItems(); i++) (void) ret.AddTail(kmq[i]()->GetPeerID());
-      }
+      // If we know who the kingmaker peer is, we'll just adopt the full-peer-ordering he is advertising, for uniformity's sake
+      // Note that if we got here, we are guaranteed that kmPeer's IDs-list has the same full peers as our _peerIDToIPAddresses list (albeit maybe not in the same order)
+      // Only full peers are taken from his list, since the senior peer's list includes the junior-only peers as well.
+      const Queue<ConstPZGHeartbeatPeerInfoRef> & kmq = kmSourceData->GetItemPointer()->GetHeartbeatPacket()()->GetOrderedPeersList();
+      for (uint32 i=0; i<kmq.GetNumItems(); i++) if (IsFullPeer(kmq[i]()->GetPeerID())) (void) ret.AddTail(kmq[i]()->GetPeerID());
    }
    else
    {
       // If we don't know who the kingmaker peer is, then we'll populate the list based solely on our own local sorting-criteria.
       _peerIDToIPAddresses.SortByKey(ComparePeerIDsBySeniorityFunctor(), this);
-      if (ret.EnsureSize(_peerIDToIPAddresses.GetNumItems()).IsOK()) for (ConstHashtableIterator<ZGPeerID, Queue<IPAddressAndPort> > iter(_peerIDToIPAddresses); iter.HasData(); iter++) (void) ret.AddTail(iter.GetKey());
+      for (ConstHashtableIterator<ZGPeerID, Queue<IPAddressAndPort> > iter(_peerIDToIPAddresses); iter.HasData(); iter++) if (IsFullPeer(iter.GetKey())) (void) ret.AddTail(iter.GetKey());
    }
 
+   // Junior-only peers always go at the end of the list (so that they'll never be chosen as senior peer), sorted by peer ID so that every peer agrees on their order
+   Queue<ZGPeerID> juniorOnlyPeers;
+   for (ConstHashtableIterator<ZGPeerID, Queue<IPAddressAndPort> > iter(_peerIDToIPAddresses); iter.HasData(); iter++) if (IsFullPeer(iter.GetKey()) == false) (void) juniorOnlyPeers.AddTail(iter.GetKey());
+   juniorOnlyPeers.Sort();
+   (void) ret.AddTailMulti(juniorOnlyPeers);
+
    return ret;
 }
 
@@ -430,16 +461,14 @@ void PZGHeartbeatThreadState :: MessageReceivedFromOwner(const MessageRef & msgF
    }
 }
 
-PZGHeartbeatPacketWithMetaDataRef PZGHeartbeatThreadState :: ParseHeartbeatPacketBuffer(const ByteBuffer & defBuf, const IPAddressAndPort & sourceIAP, uint64 localReceiveTimeMicros)
+PZGHeartbeatPacketWithMetaDataRef PZGHeartbeatThreadState :: ParseHeartbeatPacketBuffer(const uint8 * dsb, uint32 numBytes, const IPAddressAndPort & sourceIAP, uint64 localReceiveTimeMicros)
 {
-   const uint32 numBytes = defBuf.GetNumBytes();
    if (numBytes < HB_HEADER_SIZE)
    {
-      LogTime(MUSCLE_LOG_ERROR, "ParseHeartbeatPacketBuffer from [%s]:  buffer is too short!  (" UINT32_FORMAT_SPEC " bytes:  %s)\n", sourceIAP.ToString()(), numBytes, HexBytesToString(defBuf)());
+      LogTime(MUSCLE_LOG_ERROR, "ParseHeartbeatPacketBuffer from [%s]:  buffer is too short!  (" UINT32_FORMAT_SPEC " bytes:  %s)\n", sourceIAP.ToString()(), numBytes, HexBytesToString(dsb, numBytes)());
       return B_BAD_DATA;
    }
 
-   const uint8 * dsb = defBuf.GetBuffer();
    const uint16 hbMagic = DefaultEndianConverter::Import<uint16>(dsb);
    if (hbMagic != HB_HEADER_MAGIC)
    {
@@ -459,9 +488,9 @@ PZGHeartbeatPacketWithMetaDataRef PZGHeartbeatThreadState :: ParseHeartbeatPacke
    MRETURN_ON_ERROR(newHB);
 
    status_t ret;
-   if (_zlibCodec.Inflate(defBuf.GetBuffer()+HB_HEADER_SIZE, defBuf.GetNumBytes()-HB_HEADER_SIZE, _rawScratchBuf).IsError(ret))
+   if (_zlibCodec.Inflate(dsb+HB_HEADER_SIZE, numBytes-HB_HEADER_SIZE, _rawScratchBuf).IsError(ret))
    {
-      LogTime(MUSCLE_LOG_ERROR, "ParseHeartbeatPacketBuffer from [%s]:  Couldn't inflate " UINT32_FORMAT_SPEC " bytes of compressed PZGHeartbeatPacket data!\n", sourceIAP.ToString()(), defBuf.GetNumBytes()-HB_HEADER_SIZE);
+      LogTime(MUSCLE_LOG_ERROR, "ParseHeartbeatPacketBuffer from [%s]:  Couldn't inflate " UINT32_FORMAT_SPEC " bytes of compressed PZGHeartbeatPacket data!\n", sourceIAP.ToString()(), numBytes-HB_HEADER_SIZE);
       return ret;
    }
 
@@ -479,12 +508,13 @@ PZGHeartbeatPacketWithMetaDataRef PZGHeartbeatThreadState :: ParseHeartbeatPacke
 
 void PZGHeartbeatThreadState :: ReceiveMulticastTraffic(PacketDataIO & dio)
 {
-   while(_deflatedScratchBuf.SetNumBytes(2048, false).IsOK())  // we want to start each read with the full space available
+   const PZGBatchedUDPSocketDataIO * batchedIO = dynamic_cast<const PZGBatchedUDPSocketDataIO *>(&dio);  // so we can use its per-packet receive-times, if available
+   while(1)
    {
-      io_status_t numBytesRead = dio.Read(_deflatedScratchBuf.GetBuffer(), _deflatedScratchBuf.GetNumBytes());
+      io_status_t numBytesRead = dio.Read(_receiveScratchBuf, sizeof(_receiveScratchBuf));
       if (numBytesRead.GetByteCount() != 0)
       {
-         const uint64 localReceiveTimeMicros = GetRunTime64();
+         const uint64 localReceiveTimeMicros = batchedIO ? batchedIO->GetLocalReceiveTimeOfLastReadPacket() : GetRunTime64();
 
          if (numBytesRead.IsError())
          {
@@ -492,10 +522,8 @@ void PZGHeartbeatThreadState :: ReceiveMulticastTraffic(PacketDataIO & dio)
             break;
          }
 
-         (void) _deflatedScratchBuf.SetNumBytes(numBytesRead.GetByteCount(), true);  // we only care about valid bytes now
-
          const IPAddressAndPort & sourceIAP = dio.GetSourceOfLastReadPacket();
-         PZGHeartbeatPacketWithMetaDataRef newHB = ParseHeartbeatPacketBuffer(_deflatedScratchBuf, sourceIAP, localReceiveTimeMicros);
+         PZGHeartbeatPacketWithMetaDataRef newHB = ParseHeartbeatPacketBuffer(_receiveScratchBuf, numBytesRead.GetByteCount(), sourceIAP, localReceiveTimeMicros);
          if (newHB())
          {
             const ZGPeerID & pid = newHB()->GetSourcePeerID();
@@ -555,7 +583,7 @@ void PZGHeartbeatThreadState :: ReceiveMulticastTraffic(PacketDataIO & dio)
                   IntroduceSource(source, newHB, localExpirationTimeMicros); // and in with the new
                }
 
-               if ((_updateOfficialPeersListPending == false)&&(pid == GetKingmakerPeerID())) ScheduleUpdateOfficialPeersList(false);
+               if ((_updateOfficialPeersListPending == false)&&(newHB()->GetPeerType() == PEER_TYPE_FULL_PEER)&&(pid == GetKingmakerPeerID())) ScheduleUpdateOfficialPeersList(false);  // junior-only peers can't be the kingmaker
                if (pid == GetSeniorPeerID()) ScheduleUpdateToNetworkTimeOffset();
             }
             else LogTime(MUSCLE_LOG_WARNING, "Incoming HeartbeatPacket from [%s] had wrong systemKey hash for system [%s / %s] (" UINT64_FORMAT_SPEC ", expected " UINT64_FORMAT_SPEC ")\n", source.ToString()(), _hbSettings()->GetSignature()(), _hbSettings()->GetSystemName()(), newHB()->GetSystemKey(), _hbSettings()->GetSystemKey());
@@ -586,6 +614,10 @@ MessageRef PZGHeartbeatThreadState :: UpdateOfficialPeersList(bool forceUpdate)
    if ((forceUpdate)||(newPeers != _lastSourcesSentToMaster))
    {
       _lastSourcesSentToMaster = newPeers;
+
+      // Only a full peer can be the senior peer; if only junior-only peers are online, then there is no senior peer
+      _officialSeniorPeerID = ZGPeerID();
+      for (uint32 i=0; i<idQ.GetNumItems(); i++) if (IsFullPeer(idQ[i])) {_officialSeniorPeerID = idQ[i]; break;}
       if (IsFullyAttached())
       {
          ret = GetMessageFromPool(PZG_HEARTBEAT_COMMAND_PEERS_UPDATE);
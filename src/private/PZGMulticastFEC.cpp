@@ -0,0 +1,97 @@
+#include "zg/private/PZGMulticastFEC.h"
+
+namespace zg_private
+{
+
+static const String PZG_FEC_NAME_MESSAGE_IDS     = "fid";
+static const String PZG_FEC_NAME_MESSAGE_LENGTHS = "fln";
+static const String PZG_FEC_NAME_PARITY_BYTES    = "fxr";
+
+// Max number of flattened data Messages a receiver keeps around for reconstruction purposes
+static const uint32 PZG_FEC_MAX_CACHED_MESSAGES = 256;
+
+// XORs (numBytes) bytes of (src) into (dst)
+static void XorBytes(uint8 * dst, const uint8 * src, uint32 numBytes)
+{
+   for (uint32 i=0; i<numBytes; i++) dst[i] ^= src[i];
+}
+
+MessageRef PZGMulticastFECEncoder :: DataMessageSent(uint32 messageID, const Message & msg)
+{
+   if (IsEnabled() == false) return MessageRef();
+
+   ConstByteBufferRef flatBuf = msg.FlattenToByteBuffer();
+   if (flatBuf() == NULL) {Reset(); return MessageRef();}  // can't protect this group, so start a new one
+
+   const uint32 flatSize = flatBuf()->GetNumBytes();
+   const uint32 oldSize  = _parityBytes.GetNumBytes();
+   if ((flatSize > oldSize)&&(_parityBytes.SetNumBytes(flatSize, true).IsError())) {Reset(); return MessageRef();}
+   if (flatSize > oldSize) memset(_parityBytes.GetBuffer()+oldSize, 0, flatSize-oldSize);
+   XorBytes(_parityBytes.GetBuffer(), flatBuf()->GetBuffer(), flatSize);
+
+   if ((_messageIDs.AddTail((int32)messageID).IsError())||(_messageLengths.AddTail((int32)flatSize).IsError())) {Reset(); return MessageRef();}
+   if (_messageIDs.GetNumItems() < _groupSize) return MessageRef();
+
+   MessageRef parityMsg = GetMessageFromPool(PZG_MULTICAST_FEC_PARITY_MESSAGE);
+   if ((parityMsg() == NULL)||(parityMsg()->AddData(PZG_FEC_NAME_PARITY_BYTES, B_RAW_TYPE, _parityBytes.GetBuffer(), _parityBytes.GetNumBytes()).IsError())) parityMsg.Reset();
+   for (uint32 i=0; (parityMsg())&&(i<_messageIDs.GetNumItems()); i++)
+   {
+      if ((parityMsg()->AddInt32(PZG_FEC_NAME_MESSAGE_IDS, _messageIDs[i]).IsError())||(parityMsg()->AddInt32(PZG_FEC_NAME_MESSAGE_LENGTHS, _messageLengths[i]).IsError())) parityMsg.Reset();
+   }
+
+   Reset();
+   return parityMsg;
+}
+
+void PZGMulticastFECDecoder :: DataMessageReceived(const PZGFECMessageKey & key, const Message & msg)
+{
+   if (_active == false) return;
+
+   ConstByteBufferRef flatBuf = msg.FlattenToByteBuffer();
+   if ((flatBuf())&&(_recentMessages.Put(key, flatBuf).IsOK()))
+   {
+      (void) _recentMessages.MoveToBack(key);
+      while(_recentMessages.GetNumItems() > PZG_FEC_MAX_CACHED_MESSAGES) (void) _recentMessages.RemoveFirst();
+   }
+}
+
+MessageRef PZGMulticastFECDecoder :: ParityMessageReceived(const ZGPeerID & sourcePeerID, const Message & parityMsg)
+{
+   _active = true;
+
+   const uint8 * parityBytes;
+   uint32 numParityBytes;
+   if (parityMsg.FindData(PZG_FEC_NAME_PARITY_BYTES, B_RAW_TYPE, (const void **) &parityBytes, &numParityBytes).IsError()) return MessageRef();
+
+   // Find the one data Message (if any) that we didn't receive
+   int32 missingIdx = -1;
+   int32 messageID;
+   for (uint32 i=0; parityMsg.FindInt32(PZG_FEC_NAME_MESSAGE_IDS, i, messageID).IsOK(); i++)
+   {
+      if (_recentMessages.ContainsKey(PZGFECMessageKey(sourcePeerID, (uint32)messageID)) == false)
+      {
+         if (missingIdx >= 0) return MessageRef();  // more than one Message missing; XOR parity can't help us
+         missingIdx = i;
+      }
+   }
+   if (missingIdx < 0) return MessageRef();  // nothing is missing, yay
+
+   int32 missingLength;
+   if ((parityMsg.FindInt32(PZG_FEC_NAME_MESSAGE_LENGTHS, missingIdx, missingLength).IsError())||(missingLength <= 0)||(((uint32)missingLength) > numParityBytes)) return MessageRef();
+
+   // The missing Message's bytes are the parity bytes XOR'd with all the other Messages' bytes
+   ByteBuffer rebuilt;
+   if (rebuilt.SetBuffer(missingLength, parityBytes).IsError()) return MessageRef();
+   for (uint32 i=0; parityMsg.FindInt32(PZG_FEC_NAME_MESSAGE_IDS, i, messageID).IsOK(); i++)
+   {
+      if (i == (uint32)missingIdx) continue;
+
+      const ConstByteBufferRef * otherBuf = _recentMessages.Get(PZGFECMessageKey(sourcePeerID, (uint32)messageID));
+      if (otherBuf) XorBytes(rebuilt.GetBuffer(), (*otherBuf)()->GetBuffer(), muscleMin((*otherBuf)()->GetNumBytes(), (uint32)missingLength));
+   }
+
+   MessageRef ret = GetMessageFromPool();
+   return ((ret())&&(ret()->UnflattenFromByteBuffer(rebuilt).IsOK())) ? ret : MessageRef();
+}
+
+}  // end namespace zg_private
@@ -4,6 +4,9 @@
 
 #include "zg/ZGConstants.h"
 #include "zg/private/PZGConstants.h"
+#include "zg/private/PZGFanOutPacketDataIO.h"
+#include "zg/private/PZGMessageIDWindow.h"
+#include "zg/private/PZGMulticastFEC.h"
 #include "zg/private/PZGNetworkIOSession.h"
 
 namespace zg_private
@@ -12,7 +15,8 @@ namespace zg_private
 enum {
    PZG_NETWORK_COMMAND_SET_SENIOR_PEER_ID = 1886283124, // 'pnet'
    PZG_NETWORK_COMMAND_SET_BEACON_DATA,
-   PZG_NETWORK_COMMAND_INVALIDATE_LAST_RECEIVED_BEACON_DATA
+   PZG_NETWORK_COMMAND_INVALIDATE_LAST_RECEIVED_BEACON_DATA,
+   PZG_NETWORK_COMMAND_MULTICAST_LOSS_REPORTED
 };
 
 static const String PZG_NETWORK_NAME_PEER_ID           = "pid";
@@ -21,6 +25,20 @@ static const String PZG_NETWORK_NAME_DATABASE_UPDATE   = "dbu";
 static const String PZG_NETWORK_NAME_MULTICAST_MESSAGE = "mms";
 static const String PZG_NETWORK_NAME_MULTICAST_TAG     = "mgt";
 
+// How long we'll hold on to a flattened full-database-state after it was last requested, in case another junior peer wants it too, or wants to
+// resume receiving it after a quick reconnect.  Kept short, since a cached state costs as much RAM as the database's flattened size.
+static const uint64 PZG_FLATTENED_FULL_STATE_RETENTION_PERIOD = SecondsToMicros(10);
+
+// Maximum number of flattened full-database-states we'll cache for any one database.  Only the newest is useful to new requests, and
+// transfers that are still in progress hold their own references to older ones, so we never need to cache more than one.
+static const uint32 PZG_MAX_CACHED_FULL_STATES_PER_DATABASE = 1;
+
+// Maximum number of outgoing Messages our multicast I/O thread will hold back for pacing purposes; beyond this, it sends them regardless of the pacer
+static const uint32 PZG_MAX_PACED_MESSAGES = 4096;
+
+// Minimum time between multicast-loss reports to our multicast I/O thread (so that a single burst of lost packets backs off the pacer only once)
+static const uint64 PZG_MULTICAST_LOSS_REPORT_HOLDOFF = MillisToMicros(250);
+
 enum {
    PZG_MULTICAST_MESSAGE_TAG_TYPE = 1886219636 // 'pmmt'
 };
@@ -148,6 +166,16 @@ PZGNetworkIOSession :: PZGNetworkIOSession(const ZGPeerSettings & peerSettings,
    , _beaconIntervalMicros(SecondsToMicros(1)/muscleMax((uint32)1, peerSettings.GetBeaconsPerSecond()))
    , _master(master)
    , _computerIsAsleep(false)
+   , _fullStateTransferIDCounter(0)
+   , _nextLossReportTime(0)
+   , _multicastBytesSent(0)
+   , _multicastBytesReceived(0)
+   , _multicastDuplicatesDropped(0)
+   , _unicastBytesSent(0)
+   , _unicastBytesReceived(0)
+   , _backOrdersServed(0)
+   , _fullResendsServed(0)
+   , _multicastBacklog(0)
    , _hbSessionPtr(NULL)
 {
    (void) SetThreadPriority(PRIORITY_HIGH);
@@ -160,19 +188,15 @@ void PZGNetworkIOSession :: MessageReceivedFromInternalThread(const MessageRef &
    {
       if (msg()->what == PZG_NETWORK_COMMAND_SET_BEACON_DATA)
       {
-         if (tag.GetPeerID() == _seniorPeerID)
+         // When per-database senior peers are enabled, any full peer might be the senior peer of some database,
+         // so we pass everyone's beacons along and let the ZGPeerSession decide which parts of each beacon to use.
+         if ((tag.GetPeerID() == _seniorPeerID)||(_peerSettings.ArePerDatabaseSeniorPeersEnabled()))
          {
             ConstPZGBeaconDataRef beaconData = GetBeaconDataFromMessage(msg);
-            if (beaconData()) _master->BeaconDataChanged(beaconData);
+            if (beaconData()) _master->BeaconDataChanged(tag.GetPeerID(), beaconData);
                          else LogTime(MUSCLE_LOG_ERROR, "PZGNetworkIOSession:  Unable to get beacon data from internal thread Message\n");
          }
-         else
-         {
-            // Hmm, race condition caused us to end up with beacon data from the wrong senior peer?
-            // we'd better as the I/O thread to try again
-            static Message _retryMsg(PZG_NETWORK_COMMAND_INVALIDATE_LAST_RECEIVED_BEACON_DATA);
-            if (SendMessageToInternalThread(DummyMessageRef(_retryMsg)).IsError()) LogTime(MUSCLE_LOG_ERROR, "Couldn't send message to invalidate last received beacon data!\n");
-         }
+         else InvalidateLastReceivedBeaconData();  // Hmm, race condition caused us to end up with beacon data from the wrong senior peer?  we'd better ask the I/O thread to try again
       }
       else _master->PrivateMessageReceivedFromPeer(tag.GetPeerID(), msg);
    }
@@ -324,11 +348,24 @@ void PZGNetworkIOSession :: PeerHasGoneOffline(const ZGPeerID & peerID, const Co
    for (uint32 i=0; i<q.GetNumItems(); i++) q[i]()->EndSession();  // tell the session to unregister itself and go away
 }
 
+void PZGNetworkIOSession :: InvalidateLastReceivedBeaconData()
+{
+   static Message _invalidateMsg(PZG_NETWORK_COMMAND_INVALIDATE_LAST_RECEIVED_BEACON_DATA);
+   if (SendMessageToInternalThread(DummyMessageRef(_invalidateMsg)).IsError()) LogTime(MUSCLE_LOG_ERROR, "Couldn't send message to invalidate last received beacon data!\n");
+}
+
+void PZGNetworkIOSession :: OrderedFullPeersListChanged(const Queue<ZGPeerID> & orderedFullPeerIDs)
+{
+   if (_master) _master->OrderedFullPeersListChanged(orderedFullPeerIDs);
+}
+
 void PZGNetworkIOSession :: SeniorPeerChanged(const ZGPeerID & oldSeniorPeerID, const ZGPeerID & newSeniorPeerID)
 {
    if (newSeniorPeerID != _seniorPeerID)
    {
       _seniorPeerID = newSeniorPeerID;
+      _incomingFullStateTransfers.Clear();  // partially-received full-states can only be resumed from the senior peer who was sending them
+      _flattenedFullStates.Clear();         // and if we were the senior peer, we don't need to keep ours around anymore
       if (_master) _master->SeniorPeerChanged(oldSeniorPeerID, newSeniorPeerID);
 
       // Let's tell the internal thread what the senior peer ID is too, so he
@@ -338,6 +375,25 @@ void PZGNetworkIOSession :: SeniorPeerChanged(const ZGPeerID & oldSeniorPeerID,
    }
 }
 
+// Adds the current network-time to (msg) under the given field name, for latency tracing.  Does nothing if we aren't time-synced yet.
+static status_t AddNetworkTimeStamp(Message & msg, const String & fieldName, int64 toNetworkTimeOffset)
+{
+   return (toNetworkTimeOffset == INVALID_TIME_OFFSET) ? B_NO_ERROR : msg.AddInt64(fieldName, GetRunTime64()+toNetworkTimeOffset);
+}
+
+// Unflattens the PZGDatabaseUpdate (and its payload Message) contained in (msg), and replaces its flattened bytes with the
+// decoded object, so that the decoding work gets done here in the multicast I/O thread rather than in the main thread.
+static status_t DecodeDatabaseUpdate(Message & msg)
+{
+   PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+   MRETURN_ON_ERROR(dbUp);
+   MRETURN_ON_ERROR(msg.FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()));
+   if ((dbUp()->GetPayloadBuffer()())&&(dbUp()->GetPayloadBufferAsMessage()() == NULL)) return B_BAD_DATA;  // corrupt payload?  We'll leave it to the main thread to complain about it
+
+   (void) msg.RemoveName(PZG_PEER_NAME_DATABASE_UPDATE);
+   return msg.AddFlat(PZG_PEER_NAME_DATABASE_UPDATE, FlatCountableRef(dbUp));
+}
+
 void PZGNetworkIOSession :: InternalThreadEntry()
 {
    // multicast I/O for data payloads will go here
@@ -345,15 +401,31 @@ void PZGNetworkIOSession :: InternalThreadEntry()
 
    uint32 outgoingMulticastMessageTagCounter = 0; // tagging our outgoing Messages with a unique ID allows us to do de-duplication more easily
    Queue<PacketDataIORef> dios;
-   Queue<PacketTunnelIOGatewayRef> ptGateways; // our mechanism for transporting Message objects by packing them into UDP packets
+   Queue<PacketTunnelIOGatewayRef> ptGateways; // our mechanism for receiving Message objects that were packed into UDP packets (one per DataIO)
+   PZGFanOutPacketDataIORef fanOutIO;          // shares each outgoing UDP packet across all of our DataIOs' outgoing-packet queues
+   PacketTunnelIOGatewayRef sendGateway;       // flattens and fragments each outgoing Message just once, into (fanOutIO)
    QueueGatewayMessageReceiver messageReceiver;   // a place that the ptGateways can store incoming/received Messages for us to collect
-   Hashtable<PZGMulticastMessageTag, Void> recentlyReceived;  // PZGMulticastMessageTags that we have received recently
+   Hashtable<ZGPeerID, PZGMessageIDWindow> recentlyReceived;  // source peer -> which of that peer's multicast message IDs we have received recently
+
+   PZGTokenBucket pacer;                // limits the rate at which we hand database-updates to the ptGateways, if pacing is enabled
+   pacer.SetParameters(_peerSettings.GetMulticastPacingBytesPerSecond(), _peerSettings.GetMulticastPacingBurstBytes());
+   Queue<MessageRef> pacedMessages;     // outgoing Messages that are waiting for the pacer to let them through
+   uint32 numPacedDatabaseUpdates = 0;  // how many of the Messages in (pacedMessages) are database-updates
+   uint32 numUpdatesBeforeBeacon  = 0;  // our beacon mustn't go out until this many more database-updates have left (pacedMessages), since it advertises their database-states
+
+   PZGMulticastFECEncoder fecEncoder;   // generates parity Messages for our outgoing Messages, if FEC is enabled
+   fecEncoder.SetGroupSize(_peerSettings.GetMulticastFECGroupSize());
+   PZGMulticastFECDecoder fecDecoder;   // reconstructs lost incoming Messages from parity Messages, when possible
+
+   const bool traceLatency = _peerSettings.IsLatencyTracingEnabled();  // if true, we'll stamp database-updates with their multicast send/receive times
 
    ZGPeerID seniorPeerID;
    MessageRef outgoingBeaconMsg;
    ConstPZGBeaconDataRef outgoingBeaconData;     // should be non-NULL only when when we are the senior peer
-   ConstPZGBeaconDataRef lastReceivedBeaconData;
+   Hashtable<ZGPeerID, ConstPZGBeaconDataRef> lastReceivedBeaconData;  // source peer -> most recent beacon data we passed on from that peer
+   const bool perDatabaseSeniors = _peerSettings.ArePerDatabaseSeniorPeersEnabled();  // if true, we'll accept beacons from any peer, not just the senior peer
    uint64 nextBeaconSendTime = MUSCLE_TIME_NEVER;
+   uint64 lastSendErrorLogTime = 0;  // so that a network interface that can't send won't flood the log
 
    // Multicast-data I/O thread's main event loop
    while(1)
@@ -372,6 +444,8 @@ void PZGNetworkIOSession :: InternalThreadEntry()
          }
          dios.Clear();
          ptGateways.Clear();
+         fanOutIO.Reset();
+         sendGateway.Reset();
 
          // Install the new DataIO
          dios = _hbSettings()->CreateMulticastDataIOs(false, GetNetworkInterfaceFilter());
@@ -385,6 +459,10 @@ void PZGNetworkIOSession :: InternalThreadEntry()
                PacketTunnelIOGatewayRef ptRef(new PacketTunnelIOGateway);
                if (ptGateways.AddTail(ptRef).IsOK()) ptRef()->SetDataIO(dio);
             }
+
+            fanOutIO.SetRef(new PZGFanOutPacketDataIO(dios));
+            sendGateway.SetRef(new PacketTunnelIOGateway);
+            sendGateway()->SetDataIO(fanOutIO);
          }
          else LogTime(MUSCLE_LOG_ERROR, "PZGNetworkIOSession:  Couldn't create Multicast DataIOs!\n");
       }
@@ -393,14 +471,14 @@ void PZGNetworkIOSession :: InternalThreadEntry()
       for (uint32 i=0; i<dios.GetNumItems(); i++)
       {
          PacketDataIO & dio = *dios[i]();  // guaranteed non-NULL
-         const bool hasBytesToOutput = ptGateways[i]()->HasBytesToOutput();
+         const bool hasBytesToOutput = fanOutIO()->HasQueuedPackets(i);
          if (hasBytesToOutput) (void)   RegisterInternalThreadSocket(dio.GetWriteSelectSocket(), SOCKET_SET_WRITE);
                           else (void) UnregisterInternalThreadSocket(dio.GetWriteSelectSocket(), SOCKET_SET_WRITE);
       }
 
       // Wait until there is data to receive (or until there is buffer space to send, if we need to send anything), or until we get a Message from the main thread
       MessageRef msgFromOwner;
-      if (WaitForNextMessageFromOwner(msgFromOwner, nextBeaconSendTime).IsOK())
+      if (WaitForNextMessageFromOwner(msgFromOwner, muscleMin((numUpdatesBeforeBeacon > 0) ? MUSCLE_TIME_NEVER : nextBeaconSendTime, pacedMessages.HasItems() ? pacer.GetNextSendTime() : MUSCLE_TIME_NEVER)).IsOK())
       {
          if (msgFromOwner())
          {
@@ -414,10 +492,19 @@ void PZGNetworkIOSession :: InternalThreadEntry()
                break;
 
                case PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE: case PZG_PEER_COMMAND_USER_MESSAGE:
-                  if (msgFromOwner()->AddFlat(PZG_NETWORK_NAME_MULTICAST_TAG, PZGMulticastMessageTag(GetLocalPeerID(), _hbSettings()->GetCompatibilityVersionCode(), ++outgoingMulticastMessageTagCounter)).IsOK())
+                  if ((msgFromOwner()->AddFlat(PZG_NETWORK_NAME_MULTICAST_TAG, PZGMulticastMessageTag(GetLocalPeerID(), _hbSettings()->GetCompatibilityVersionCode(), ++outgoingMulticastMessageTagCounter)).IsError())||(pacedMessages.AddTail(msgFromOwner).IsError()))
                   {
-                     for (uint32 i=0; i<ptGateways.GetNumItems(); i++)
-                        (void) ptGateways[i]()->AddOutgoingMessage(msgFromOwner);
+                     LogTime(MUSCLE_LOG_ERROR, "Multicast I/O thread:  Unable to enqueue outgoing Message!\n");
+                     if (msgFromOwner()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE) _multicastBacklog--;  // since it will never be sent
+                  }
+                  else if (msgFromOwner()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE) numPacedDatabaseUpdates++;
+               break;
+
+               case PZG_NETWORK_COMMAND_MULTICAST_LOSS_REPORTED:
+                  if (pacer.IsEnabled())
+                  {
+                     pacer.ReportLoss();
+                     LogTime(MUSCLE_LOG_DEBUG, "Multicast I/O thread:  junior peer reported multicast loss, pacing rate reduced to %.0f bytes/second\n", pacer.GetEffectiveBytesPerSecond());
                   }
                break;
 
@@ -430,11 +517,12 @@ void PZGNetworkIOSession :: InternalThreadEntry()
                   outgoingBeaconMsg.Reset();  // will be demand-allocated next time we send
                   outgoingBeaconData = GetBeaconDataFromMessage(msgFromOwner);
                   nextBeaconSendTime = (outgoingBeaconData() == NULL) ? MUSCLE_TIME_NEVER : 0;
+                  numUpdatesBeforeBeacon = numPacedDatabaseUpdates;  // the main thread queued those updates before it generated this beacon data
                }
                break;
 
                case PZG_NETWORK_COMMAND_INVALIDATE_LAST_RECEIVED_BEACON_DATA:
-                  lastReceivedBeaconData.Reset();  // so that we'll resend to the owner thread when that happens
+                  lastReceivedBeaconData.Clear();  // so that we'll resend to the owner thread when that happens
                break;
 
                default:
@@ -446,7 +534,35 @@ void PZGNetworkIOSession :: InternalThreadEntry()
       }
 
       const uint64 now = GetRunTime64();
-      if (now >= nextBeaconSendTime)
+      // Hand as many outgoing Messages to the sendGateway as our token bucket currently allows (i.e. all of them, if pacing is disabled)
+      // If too many Messages have piled up, we'll send the excess anyway, rather than let (pacedMessages) grow without bound.
+      if (pacer.IsEnabled()) pacer.UpdateTokens(now);
+      while((pacedMessages.HasItems())&&((pacer.IsSendAllowed())||(pacedMessages.GetNumItems() > PZG_MAX_PACED_MESSAGES)))
+      {
+         MessageRef nextMsg; (void) pacedMessages.RemoveHead(nextMsg);
+         if (nextMsg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE)
+         {
+            _multicastBacklog--;
+            numPacedDatabaseUpdates--;
+            if (numUpdatesBeforeBeacon > 0) numUpdatesBeforeBeacon--;
+         }
+         if ((traceLatency)&&(nextMsg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE)) (void) AddNetworkTimeStamp(*nextMsg(), PZG_PEER_NAME_MULTICAST_SEND_TIME, GetToNetworkTimeOffset());
+         if (pacer.IsEnabled()) pacer.ConsumeTokens(nextMsg()->FlattenedSize());
+         if (sendGateway()) (void) sendGateway()->AddOutgoingMessage(nextMsg);
+
+         // If FEC is enabled, every so often we'll follow up with a parity Message too.  This is done here rather than when
+         // the Message is enqueued, so that the parity covers the Message's final (send-time-stamped) bytes.
+         PZGMulticastMessageTag dataTag;
+         if ((fecEncoder.IsEnabled())&&(nextMsg()->what != PZG_MULTICAST_FEC_PARITY_MESSAGE)&&(nextMsg()->FindFlat(PZG_NETWORK_NAME_MULTICAST_TAG, dataTag).IsOK()))
+         {
+            MessageRef parityMsg = fecEncoder.DataMessageSent(dataTag.GetMessageID(), *nextMsg());
+            if ((parityMsg())&&((parityMsg()->AddFlat(PZG_NETWORK_NAME_MULTICAST_TAG, PZGMulticastMessageTag(GetLocalPeerID(), _hbSettings()->GetCompatibilityVersionCode(), ++outgoingMulticastMessageTagCounter)).IsError())||(pacedMessages.AddHead(parityMsg).IsError()))) LogTime(MUSCLE_LOG_ERROR, "Multicast I/O thread:  Unable to enqueue outgoing FEC parity Message!\n");
+         }
+      }
+
+      // Our beacon is held back until the database-updates it advertises have been sent; otherwise the junior peers
+      // would see database-state IDs they don't have yet, and request back-orders of updates that are still on their way.
+      if ((numUpdatesBeforeBeacon == 0)&&(now >= nextBeaconSendTime))
       {
          if (outgoingBeaconData())
          {
@@ -458,7 +574,7 @@ void PZGNetworkIOSession :: InternalThreadEntry()
                if (outgoingBeaconMsg() == NULL) outgoingBeaconMsg = CreateBeaconDataMessage(outgoingBeaconData, true, PZGMulticastMessageTag(GetLocalPeerID(), _hbSettings()->GetCompatibilityVersionCode(), 0));
                if (outgoingBeaconMsg())
                {
-                  for (uint32 i=0; i<ptGateways.GetNumItems(); i++) if (ptGateways[i]()->AddOutgoingMessage(outgoingBeaconMsg).IsError()) LogTime(MUSCLE_LOG_ERROR, "Unable to add outgoing beacon to gateway # " UINT32_FORMAT_SPEC "!\n", i);
+                  if ((sendGateway())&&(sendGateway()->AddOutgoingMessage(outgoingBeaconMsg).IsError())) LogTime(MUSCLE_LOG_ERROR, "Unable to add outgoing beacon to gateway!\n");
                }
                else LogTime(MUSCLE_LOG_ERROR, "Unable to create Outgoing Beacon Message!\n");
             }
@@ -466,62 +582,92 @@ void PZGNetworkIOSession :: InternalThreadEntry()
          else nextBeaconSendTime = MUSCLE_TIME_NEVER;
       }
 
+      // Flatten and fragment our outgoing Messages into UDP packets (just once, no matter how many network interfaces we're sending on)
+      if (sendGateway()) while(sendGateway()->DoOutput().GetByteCount() > 0) {/* empty */}
+
       for (uint32 i=0; i<dios.GetNumItems(); i++)
       {
          PacketDataIORef & dio = dios[i];
          if (IsInternalThreadSocketReady(dio()->GetReadSelectSocket(), SOCKET_SET_READ))
          {
             // Read incoming multicast data
-            while(ptGateways[i]()->DoInput(messageReceiver).GetByteCount() > 0)
+            io_status_t inputStatus;
+            while((inputStatus = ptGateways[i]()->DoInput(messageReceiver)).GetByteCount() > 0)
             {
+               _multicastBytesReceived += inputStatus.GetByteCount();
+
                MessageRef msg;
                while(messageReceiver.RemoveHead(msg).IsOK())
                {
+                  if (msg()->what == PZG_MULTICAST_FEC_PARITY_MESSAGE)
+                  {
+                     // See if this parity Message lets us reconstruct a data Message that we missed; if so, we'll handle that Message instead
+                     PZGMulticastMessageTag parityTag;
+                     if ((msg()->FindFlat(PZG_NETWORK_NAME_MULTICAST_TAG, parityTag).IsError())||(parityTag.GetCompatibilityVersionCode() != _hbSettings()->GetCompatibilityVersionCode())||(parityTag.GetPeerID() == GetLocalPeerID())) continue;
+
+                     msg = fecDecoder.ParityMessageReceived(parityTag.GetPeerID(), *msg());
+                     if (msg() == NULL) continue;
+                     LogTime(MUSCLE_LOG_DEBUG, "Multicast thread:  Reconstructed a lost multicast Message from peer [%s] via FEC\n", parityTag.GetPeerID().ToString()());
+                  }
+
                   // no point in forwarding-to-owner a dup Message, or a Message that came from us, or a Message from an incompatibile peer
                   PZGMulticastMessageTag tag;
-                  if ((msg()->FindFlat(PZG_NETWORK_NAME_MULTICAST_TAG, tag).IsOK())&&(tag.GetCompatibilityVersionCode() == _hbSettings()->GetCompatibilityVersionCode())&&(tag.GetPeerID() != GetLocalPeerID())&&((msg()->what == PZG_NETWORK_COMMAND_SET_BEACON_DATA)||((recentlyReceived.ContainsKey(tag) == false)&&(recentlyReceived.PutWithDefault(tag).IsOK()))))
+                  if ((msg()->FindFlat(PZG_NETWORK_NAME_MULTICAST_TAG, tag).IsError())||(tag.GetCompatibilityVersionCode() != _hbSettings()->GetCompatibilityVersionCode())||(tag.GetPeerID() == GetLocalPeerID())) continue;
+                  if ((msg()->what != PZG_NETWORK_COMMAND_SET_BEACON_DATA)&&(MarkMulticastMessageReceived(recentlyReceived, tag.GetPeerID(), tag.GetMessageID()) == false)) {_multicastDuplicatesDropped++; continue;}
+
+                  if (msg()->what == PZG_NETWORK_COMMAND_SET_BEACON_DATA)
                   {
-                     if (msg()->what == PZG_NETWORK_COMMAND_SET_BEACON_DATA)
+                     if (seniorPeerID.IsValid())  // no point trying to handle beacon data until we know who the senior peer is!
                      {
-                        if (seniorPeerID.IsValid())  // no point trying to handle beacon data until we know who the senior peer is!
+                        if ((perDatabaseSeniors)||(tag.GetPeerID() == seniorPeerID))
                         {
-                           if (tag.GetPeerID() == seniorPeerID)
+                           ConstPZGBeaconDataRef incomingBeaconData = GetBeaconDataFromMessage(msg);
+                           if (incomingBeaconData())
                            {
-                              ConstPZGBeaconDataRef incomingBeaconData = GetBeaconDataFromMessage(msg);
-                              if (incomingBeaconData())
+                              // we'll only notify the main thread if the beacon data actually changed
+                              const ConstPZGBeaconDataRef * lastReceived = lastReceivedBeaconData.Get(tag.GetPeerID());
+                              if ((lastReceived == NULL)||(*incomingBeaconData() != *(*lastReceived)()))
                               {
-                                 // we'll only notify the main thread if the beacon data actually changed
-                                 if ((lastReceivedBeaconData() == NULL)||(*incomingBeaconData() != *lastReceivedBeaconData()))
-                                 {
-                                    lastReceivedBeaconData = incomingBeaconData;
-                                    if (SendMessageToOwner(CreateBeaconDataMessage(incomingBeaconData, false, tag)).IsError()) LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to send beacon data to main thread!\n");
-                                 }
+                                 (void) lastReceivedBeaconData.Put(tag.GetPeerID(), incomingBeaconData);
+                                 if (EnqueueMessageToOwner(CreateBeaconDataMessage(incomingBeaconData, false, tag)).IsError()) LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to send beacon data to main thread!\n");
                               }
-                              else LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to retrieve beacon data from incoming multicast Message!\n");
                            }
-                           else if (_master->IAmFullyAttached()) LogTime(MUSCLE_LOG_WARNING, "Multicast thread received beacon data from peer [%s], but peer [%s] is the senior peer.  Multiple senior peers present?\n", tag.GetPeerID().ToString()(), seniorPeerID.ToString()());
+                           else LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to retrieve beacon data from incoming multicast Message!\n");
                         }
-                     }
-                     else
-                     {
-                        (void) recentlyReceived.MoveToBack(tag);  // might as well use the full LRU semantics
-                        if (SendMessageToOwner(msg).IsError()) LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to send Message to main thread!\n");
-                        while(recentlyReceived.GetNumItems() > 1000) (void) recentlyReceived.RemoveFirst();  // don't let our cache get too large
+                        else if (_master->IAmFullyAttached()) LogTime(MUSCLE_LOG_WARNING, "Multicast thread received beacon data from peer [%s], but peer [%s] is the senior peer.  Multiple senior peers present?\n", tag.GetPeerID().ToString()(), seniorPeerID.ToString()());
                      }
                   }
+                  else
+                  {
+                     fecDecoder.DataMessageReceived(PZGFECMessageKey(tag.GetPeerID(), tag.GetMessageID()), *msg());
+                     if ((traceLatency)&&(msg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE)&&(msg()->HasName(PZG_PEER_NAME_MULTICAST_SEND_TIME))) (void) AddNetworkTimeStamp(*msg(), PZG_PEER_NAME_MULTICAST_RECEIVE_TIME, GetToNetworkTimeOffset());
+                     if (msg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE) (void) DecodeDatabaseUpdate(*msg());  // must be done after the FEC decoder has seen the Message's original bytes
+                     if (EnqueueMessageToOwner(msg).IsError()) LogTime(MUSCLE_LOG_ERROR, "Multicast thread:  Unable to send Message to main thread!\n");
+                  }
                }
             }
          }
 
          if (IsInternalThreadSocketReady(dio()->GetWriteSelectSocket(), SOCKET_SET_WRITE))
-            while(ptGateways[i]()->DoOutput().GetByteCount() > 0) {/* empty */} // Write outgoing multicast data
+         {
+            // Write outgoing multicast data
+            const io_status_t outputStatus = fanOutIO()->FlushQueuedPackets(i);
+            if (outputStatus.GetByteCount() > 0) _multicastBytesSent += outputStatus.GetByteCount();
+            else if ((outputStatus.IsError())&&(OnceEvery(SecondsToMicros(5), lastSendErrorLogTime))) LogTime(MUSCLE_LOG_ERROR, "Multicast I/O thread:  Error [%s] sending multicast packets via DataIO # " UINT32_FORMAT_SPEC ", " UINT64_FORMAT_SPEC " packets dropped so far\n", outputStatus.GetStatus()(), i, fanOutIO()->GetNumPacketsDropped());
+         }
       }
+
+      FlushMessagesToOwner();  // wake up the main thread (once) to handle all of the Messages we received during this iteration
    }
 }
 
 uint64 PZGNetworkIOSession :: GetPulseTime(const PulseArgs & args)
 {
-   return _messagesSentToSelf.HasItems() ? 0 : PZGThreadedSession::GetPulseTime(args);
+   if (_messagesSentToSelf.HasItems()) return 0;
+
+   uint64 ret = PZGThreadedSession::GetPulseTime(args);
+   for (HashtableIterator<PZGFullStateCacheKey, PZGFlattenedFullState> iter(_flattenedFullStates); iter.HasData(); iter++) ret = muscleMin(ret, iter.GetValue()._expirationTime);
+   return ret;
 }
 
 void PZGNetworkIOSession :: Pulse(const PulseArgs & args)
@@ -530,6 +676,65 @@ void PZGNetworkIOSession :: Pulse(const PulseArgs & args)
 
    ConstMessageRef nextMsgToSelf;
    while(_messagesSentToSelf.RemoveHead(nextMsgToSelf).IsOK()) UnicastMessageReceivedFromPeer(GetLocalPeerID(), CastAwayConstFromRef(nextMsgToSelf));
+
+   // Drop any flattened full-database-states that nobody has asked for in a while (any transfers still in progress keep their own references)
+   for (HashtableIterator<PZGFullStateCacheKey, PZGFlattenedFullState> iter(_flattenedFullStates); iter.HasData(); iter++) if (args.GetCallbackTime() >= iter.GetValue()._expirationTime) (void) _flattenedFullStates.Remove(iter.GetKey());
+}
+
+status_t PZGNetworkIOSession :: SendMulticastMessageToAllPeers(const ConstMessageRef & msg)
+{
+   const bool isDatabaseUpdate = (msg()->what == PZG_PEER_COMMAND_UPDATE_JUNIOR_DATABASE);
+
+   // Note which update this is now, since once (msg) has been handed to the I/O thread, that thread may be modifying it
+   bool haveUpdateInfo = false;
+   uint64 updateID = 0;
+   uint32 whichDB  = 0;
+   if (isDatabaseUpdate)
+   {
+      PZGDatabaseUpdateRef dbUp;
+      if (msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, dbUp).IsOK())
+      {
+         haveUpdateInfo = true;
+         updateID       = dbUp()->GetUpdateID();
+         whichDB        = dbUp()->GetDatabaseIndex();
+      }
+   }
+
+   if (isDatabaseUpdate) _multicastBacklog++;  // incremented before sending, so that the I/O thread can't decrement it first
+
+   const status_t ret = SendMessageToInternalThread(CastAwayConstFromRef(msg));  // (msg) must not be accessed after this point
+   if (isDatabaseUpdate)
+   {
+      if (ret.IsError()) _multicastBacklog--;  // roll back!
+      else if (haveUpdateInfo)
+      {
+         // Remember which update this was, so that MulticastLossReported() can tell whether it has actually been sent yet
+         TrimUnsentMulticastUpdatesList();
+         if (_unsentMulticastUpdateIDs.AddTail(updateID).IsOK())
+         {
+            if (_unsentMulticastUpdateDatabases.AddTail(whichDB).IsError()) (void) _unsentMulticastUpdateIDs.RemoveTail();
+         }
+      }
+   }
+   return ret;
+}
+
+void PZGNetworkIOSession :: TrimUnsentMulticastUpdatesList()
+{
+   // Our multicast I/O thread sends database-updates in the order we handed them to it, so all but the newest (_multicastBacklog) of them have been sent
+   const uint32 backlog = _multicastBacklog.load();
+   while(_unsentMulticastUpdateIDs.GetNumItems() > backlog)
+   {
+      (void) _unsentMulticastUpdateIDs.RemoveHead();
+      (void) _unsentMulticastUpdateDatabases.RemoveHead();
+   }
+}
+
+bool PZGNetworkIOSession :: IsDatabaseUpdateAwaitingMulticast(uint32 whichDatabase, uint64 updateID)
+{
+   TrimUnsentMulticastUpdatesList();
+   for (uint32 i=0; i<_unsentMulticastUpdateIDs.GetNumItems(); i++) if ((_unsentMulticastUpdateDatabases[i] == whichDatabase)&&(_unsentMulticastUpdateIDs[i] <= updateID)) return true;
+   return false;
 }
 
 status_t PZGNetworkIOSession :: SendUnicastMessageToAllPeers(const ConstMessageRef & msg, bool sendToSelf)
@@ -661,14 +866,40 @@ status_t PZGNetworkIOSession :: RequestBackOrderFromSeniorPeer(const PZGUpdateBa
    }
 }
 
-void PZGNetworkIOSession :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optDBUp)
+void PZGNetworkIOSession :: MulticastLossReported(uint32 whichDatabase, uint64 updateID)
+{
+   if (_peerSettings.GetMulticastPacingBytesPerSecond() == 0) return;  // no pacer to tell
+   if (IsDatabaseUpdateAwaitingMulticast(whichDatabase, updateID)) return;  // the junior peer can't have lost an update we haven't sent yet
+
+   const uint64 now = GetRunTime64();
+   if (now >= _nextLossReportTime)
+   {
+      _nextLossReportTime = now + PZG_MULTICAST_LOSS_REPORT_HOLDOFF;
+      MessageRef msg = GetMessageFromPool(PZG_NETWORK_COMMAND_MULTICAST_LOSS_REPORTED);
+      if ((msg() == NULL)||(SendMessageToInternalThread(msg).IsError())) LogTime(MUSCLE_LOG_ERROR, "PZGNetworkIOSession::MulticastLossReported:  Couldn't inform multicast thread!\n");
+   }
+}
+
+status_t PZGNetworkIOSession :: SaveReplicationStatisticsToMessage(Message & msg) const
+{
+   MRETURN_ON_ERROR(msg.AddInt64("multicast_bytes_sent",     _multicastBytesSent.load()));
+   MRETURN_ON_ERROR(msg.AddInt64("multicast_bytes_received", _multicastBytesReceived.load()));
+   MRETURN_ON_ERROR(msg.AddInt64("multicast_duplicates",     _multicastDuplicatesDropped.load()));
+   MRETURN_ON_ERROR(msg.AddInt64("unicast_bytes_sent",       _unicastBytesSent.load()));
+   MRETURN_ON_ERROR(msg.AddInt64("unicast_bytes_received",   _unicastBytesReceived.load()));
+   MRETURN_ON_ERROR(msg.AddInt64("backorders_served",        _backOrdersServed.load()));
+   return msg.AddInt64("full_resends_served", _fullResendsServed.load());
+}
+
+void PZGNetworkIOSession :: BackOrderResultReceived(const PZGUpdateBackOrderKey & ubok, const ConstPZGDatabaseUpdateRef & optDBUp, bool isFinalReply)
 {
-   if (_master) _master->BackOrderResultReceived(ubok, optDBUp);
+   if (_master) _master->BackOrderResultReceived(ubok, optDBUp, isFinalReply);
 }
 
-ConstPZGDatabaseUpdateRef PZGNetworkIOSession :: GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID) const
+ConstPZGDatabaseUpdateRef PZGNetworkIOSession :: GetDatabaseUpdateByID(uint32 whichDB, uint64 updateID, bool * optRetReadFromDisk) const
 {
-   return _master ? _master->GetDatabaseUpdateByID(whichDB, updateID) : ConstPZGDatabaseUpdateRef();
+   if (optRetReadFromDisk) *optRetReadFromDisk = false;
+   return _master ? _master->GetDatabaseUpdateByID(whichDB, updateID, optRetReadFromDisk) : ConstPZGDatabaseUpdateRef();
 }
 
 void PZGNetworkIOSession :: VerifyOrFixLocalDatabaseChecksum(uint32 whichDB)
@@ -676,6 +907,78 @@ void PZGNetworkIOSession :: VerifyOrFixLocalDatabaseChecksum(uint32 whichDB)
    if (_master) _master->VerifyOrFixLocalDatabaseChecksum(whichDB);
 }
 
+status_t PZGNetworkIOSession :: GetFlattenedFullDatabaseState(uint32 whichDB, uint64 resumeTransferID, PZGFlattenedFullState & retState)
+{
+   if (_master == NULL) return B_BAD_OBJECT;
+
+   const uint64 expirationTime = GetRunTime64()+PZG_FLATTENED_FULL_STATE_RETENTION_PERIOD;
+   InvalidatePulseTime();
+
+   // Our first choice is the exact flattened-state that the junior peer was already receiving, so that he can resume where he left off.
+   // Our second choice is an already-flattened copy of the database's current state (e.g. one we flattened for another junior peer who is joining at the same time)
+   PZGFlattenedFullState * fs = NULL;
+   if (resumeTransferID != 0)
+   {
+      for (HashtableIterator<PZGFullStateCacheKey, PZGFlattenedFullState> iter(_flattenedFullStates); iter.HasData(); iter++)
+      {
+         if ((iter.GetKey().GetDatabaseIndex() == whichDB)&&(iter.GetValue()._transferID == resumeTransferID))
+         {
+            fs = &iter.GetValue();
+            break;
+         }
+      }
+   }
+
+   const PZGDatabaseStateInfo dbInfo = _master->GetLocalDatabaseStateInfo(whichDB);
+   if (fs == NULL) fs = _flattenedFullStates.Get(PZGFullStateCacheKey(whichDB, dbInfo.GetCurrentDatabaseStateID(), dbInfo.GetDBChecksum()));
+   if (fs)
+   {
+      LogTime(MUSCLE_LOG_DEBUG, "PZGNetworkIOSession:  Using cached flattened-state #" UINT64_FORMAT_SPEC " of database #" UINT32_FORMAT_SPEC " for full-state transfer.\n", fs->_transferID, whichDB);
+      fs->_expirationTime = expirationTime;
+      retState = *fs;
+      return B_NO_ERROR;
+   }
+
+   ConstPZGDatabaseUpdateRef dbUp = GetDatabaseUpdateByID(whichDB, DATABASE_UPDATE_ID_FULL_UPDATE);
+   MRETURN_ON_ERROR(dbUp);
+
+   ConstByteBufferRef flatBytes = dbUp()->FlattenToByteBuffer();
+   MRETURN_ON_ERROR(flatBytes);
+
+   retState = PZGFlattenedFullState(++_fullStateTransferIDCounter, flatBytes, expirationTime);
+   MRETURN_ON_ERROR(_flattenedFullStates.Put(PZGFullStateCacheKey(whichDB, dbUp()->GetUpdateID(), dbUp()->GetPostUpdateDBChecksum()), retState));
+
+   // Don't let the cache grow without bound if the database is changing while junior peers are joining; the oldest entries go first
+   while(true)
+   {
+      uint32 numCachedStates = 0;
+      PZGFullStateCacheKey oldestKey;  // a copy, rather than a pointer, since Remove() shouldn't be handed a reference into the table it's modifying
+      uint64 oldestTransferID = 0;
+      for (HashtableIterator<PZGFullStateCacheKey, PZGFlattenedFullState> iter(_flattenedFullStates); iter.HasData(); iter++)
+      {
+         if (iter.GetKey().GetDatabaseIndex() == whichDB)
+         {
+            if ((numCachedStates == 0)||(iter.GetValue()._transferID < oldestTransferID))
+            {
+               oldestKey        = iter.GetKey();
+               oldestTransferID = iter.GetValue()._transferID;
+            }
+            numCachedStates++;
+         }
+      }
+
+      if (numCachedStates <= PZG_MAX_CACHED_FULL_STATES_PER_DATABASE) break;
+      (void) _flattenedFullStates.Remove(oldestKey);
+   }
+   return B_NO_ERROR;
+}
+
+PZGIncomingFullStateTransfer * PZGNetworkIOSession :: GetIncomingFullStateTransfer(uint32 whichDB, bool allocIfNecessary)
+{
+   PZGIncomingFullStateTransfer * ret = _incomingFullStateTransfers.Get(whichDB);
+   return ((ret == NULL)&&(allocIfNecessary)) ? _incomingFullStateTransfers.GetOrPut(whichDB) : ret;
+}
+
 uint64 PZGNetworkIOSession :: GetEstimatedLatencyToPeer(const ZGPeerID & peerID) const
 {
    return _hbSession() ? _hbSession()->GetEstimatedLatencyToPeer(peerID) : MUSCLE_TIME_NEVER;
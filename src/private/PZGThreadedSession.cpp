@@ -6,6 +6,8 @@ namespace zg_private
 {
 
 PZGThreadedSession :: PZGThreadedSession()
+   : _ownerSignalNeeded(false)
+   , _ownerWakeupPending(false)
 {
    // empty
 }
@@ -42,11 +44,38 @@ void PZGThreadedSession :: EndSession()
 
 void PZGThreadedSession :: MessageReceivedFromGateway(const MessageRef & /*msg*/, void * /*userData*/)
 {
+   // Must be cleared before we check the queue, so that any Messages the internal thread enqueues after this point will cause another wakeup
+   _ownerWakeupPending.store(false);
+
+   // The fence keeps the queue-reads below from being reordered before the store above (store->load reordering is allowed
+   // even for seq_cst stores followed by acquire loads); it pairs with the fence in FlushMessagesToOwner(), so that either
+   // we'll see the internal thread's newly pushed Messages, or the internal thread will see the cleared flag and signal us again.
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+
    MessageRef msgFromThread;
+   while(_messagesToOwner.Pop(msgFromThread)) MessageReceivedFromInternalThread(msgFromThread, _messagesToOwner.GetNumItems());
+
    uint32 numLeft = 0;
    while(GetNextReplyFromInternalThread(msgFromThread, 0, &numLeft).IsOK()) MessageReceivedFromInternalThread(msgFromThread, numLeft);
 }
 
+status_t PZGThreadedSession :: EnqueueMessageToOwner(const MessageRef & msg)
+{
+   MRETURN_ON_ERROR(_messagesToOwner.Push(msg));
+   _ownerSignalNeeded = true;
+   return B_NO_ERROR;
+}
+
+void PZGThreadedSession :: FlushMessagesToOwner()
+{
+   if (_ownerSignalNeeded)
+   {
+      std::atomic_thread_fence(std::memory_order_seq_cst);  // pairs with the fence in MessageReceivedFromGateway(); our Push()es must be visible before we test the flag
+      if (_ownerWakeupPending.exchange(true) == false) SignalOwner();
+   }
+   _ownerSignalNeeded = false;
+}
+
 status_t PZGThreadedSession :: TellInternalThreadToRecreateMulticastSockets()
 {
    static Message _recreateSocketsMsg(PZG_THREADED_SESSION_RECREATE_SOCKETS);
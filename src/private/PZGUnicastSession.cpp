@@ -12,10 +12,27 @@ namespace zg_private
 enum {
    PZG_UNICAST_COMMAND_ANNOUNCE_UNICAST_PEER_ID = 1970170211,   // 'unic'
    PZG_UNICAST_COMMAND_REQUEST_BACK_ORDER,
-   PZG_UNICAST_COMMAND_REPLY_BACK_ORDER
+   PZG_UNICAST_COMMAND_REPLY_BACK_ORDER,
+   PZG_UNICAST_COMMAND_FULL_STATE_CHUNK,      // senior -> junior:  the next chunk of a flattened full-database-state
+   PZG_UNICAST_COMMAND_FULL_STATE_CHUNK_ACK   // junior -> senior:  tells the senior how much of the full-database-state we've received so far
 };
 
-static const String PZG_UNICAST_NAME_PEER_ID = "pid";
+static const String PZG_UNICAST_NAME_PEER_ID           = "pid";
+static const String PZG_UNICAST_NAME_MORE_COMING       = "mor";  // present in a range-back-order reply iff more replies for the same range will follow
+static const String PZG_UNICAST_NAME_TRANSFER_ID       = "fti";  // the senior peer's ID for a particular flattened full-database-state
+static const String PZG_UNICAST_NAME_TRANSFER_SIZE     = "fts";  // total size of the flattened full-database-state, in bytes
+static const String PZG_UNICAST_NAME_TRANSFER_OFFSET   = "fto";  // byte-offset of the chunk (or in a request or ack, of the first byte not yet received)
+static const String PZG_UNICAST_NAME_TRANSFER_DATA     = "ftd";  // the chunk's bytes
+
+// Soft limit on how many bytes of PZGDatabaseUpdates we'll pack into a single range-back-order reply Message
+static const uint32 PZG_MAX_BYTES_PER_BACK_ORDER_REPLY = 64*1024;
+
+// Maximum number of back-ordered updates we'll read back from the durable log per Pulse(), since each one is a blocking disk read
+static const uint32 PZG_MAX_DURABLE_LOG_READS_PER_PULSE = 32;
+
+// Full-database-states are streamed in chunks of this size, with at most this many un-acknowledged chunks in flight at once
+static const uint32 PZG_FULL_STATE_CHUNK_SIZE           = 64*1024;
+static const uint32 PZG_FULL_STATE_MAX_UNACKED_CHUNKS   = 8;
 
 PZGUnicastSession :: PZGUnicastSession(PZGNetworkIOSession * master, const ZGPeerID & remotePeerID)
    : _remotePeerID(remotePeerID)
@@ -56,6 +73,43 @@ void PZGUnicastSession :: EndSession()
    AbstractReflectSession::EndSession();
 }
 
+io_status_t PZGUnicastSession :: DoInput(AbstractGatewayMessageReceiver & receiver, uint32 maxBytes)
+{
+   const io_status_t ret = AbstractReflectSession::DoInput(receiver, maxBytes);
+   if ((_master)&&(ret.GetByteCount() > 0)) _master->UnicastBytesTransferred(0, ret.GetByteCount());
+   return ret;
+}
+
+io_status_t PZGUnicastSession :: DoOutput(uint32 maxBytes)
+{
+   const io_status_t ret = AbstractReflectSession::DoOutput(maxBytes);
+   if ((_master)&&(ret.GetByteCount() > 0)) _master->UnicastBytesTransferred(ret.GetByteCount(), 0);
+   return ret;
+}
+
+uint64 PZGUnicastSession :: GetPulseTime(const PulseArgs & args)
+{
+   return _pendingRangeReplies.HasItems() ? 0 : AbstractReflectSession::GetPulseTime(args);
+}
+
+void PZGUnicastSession :: Pulse(const PulseArgs & args)
+{
+   AbstractReflectSession::Pulse(args);
+
+   // Continue sending any range-back-order replies that SendBackOrderRangeReplies() had to put off
+   Hashtable<PZGUpdateBackOrderKey, uint64> pending; pending.SwapContents(_pendingRangeReplies);
+   for (HashtableIterator<PZGUpdateBackOrderKey, uint64> iter(pending); iter.HasData(); iter++)
+   {
+      status_t ret;
+      if (SendBackOrderRangeReplies(iter.GetKey(), iter.GetValue()).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_ERROR, "Unable to send range-back-order replies back to junior peer [%s] [%s]\n", _remotePeerID.ToString()(), ret());
+         EndSession();  // so that the remote peer won't wait forever for his final reply
+         return;
+      }
+   }
+}
+
 void PZGUnicastSession :: MessageReceivedFromGateway(const MessageRef & msg, void *)
 {
    switch(msg()->what)
@@ -90,8 +144,28 @@ void PZGUnicastSession :: MessageReceivedFromGateway(const MessageRef & msg, voi
          const uint32 whichDB  = ubok.GetDatabaseIndex();
          const uint64 updateID = ubok.GetDatabaseUpdateID();
          if ((updateID == DATABASE_UPDATE_ID_FULL_UPDATE)&&(msg()->HasName(PZG_PEER_NAME_CHECKSUM_MISMATCH))) _master->VerifyOrFixLocalDatabaseChecksum(whichDB);  // so we can recover if the checksum has gone wrong
+         if (updateID != DATABASE_UPDATE_ID_FULL_UPDATE) _master->MulticastLossReported(whichDB, updateID);  // the junior peer missed some of our multicast updates, so our pacer should back off a bit
+         _master->BackOrderServed(updateID == DATABASE_UPDATE_ID_FULL_UPDATE);
+
+         if (ubok.IsRange())
+         {
+            if (SendBackOrderRangeReplies(ubok, ubok.GetDatabaseUpdateID()).IsError(ret))
+            {
+               LogTime(MUSCLE_LOG_ERROR, "Unable to send range-back-order replies back to junior peer [%s] [%s]\n", _remotePeerID.ToString()(), ret());
+               EndSession();  // so that the remote peer won't wait forever for his final reply
+            }
+            return;
+         }
 
-         ConstPZGDatabaseUpdateRef dbUp = _master->GetDatabaseUpdateByID(whichDB, updateID);
+         if (updateID == DATABASE_UPDATE_ID_FULL_UPDATE)
+         {
+            // Full-database-states can be huge, so rather than sending one giant reply Message, we'll stream them in chunks
+            if (StartFullStateTransfer(ubok, msg()->GetInt64(PZG_UNICAST_NAME_TRANSFER_ID), msg()->GetInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET)).IsOK(ret)) return;
+            LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession:  Unable to start full-state transfer of database #" UINT32_FORMAT_SPEC " to junior peer [%s] [%s]\n", whichDB, _remotePeerID.ToString()(), ret());
+            (void) _outgoingFullStateTransfers.Remove(whichDB);
+         }
+
+         ConstPZGDatabaseUpdateRef dbUp = (updateID == DATABASE_UPDATE_ID_FULL_UPDATE) ? ConstPZGDatabaseUpdateRef() : _master->GetDatabaseUpdateByID(whichDB, updateID);
          if ((dbUp() == NULL)||(msg()->AddFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()).IsError())) LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession::MessageReceivedFromGateway()():  Database #" UINT32_FORMAT_SPEC " doesn't have requested back-order " UINT64_FORMAT_SPEC " to send back to junior peer [%s]\n", whichDB, updateID, _remotePeerID.ToString()());
 
          msg()->what = PZG_UNICAST_COMMAND_REPLY_BACK_ORDER;  // we're going to send this Message right back as our reply
@@ -105,9 +179,6 @@ void PZGUnicastSession :: MessageReceivedFromGateway(const MessageRef & msg, voi
 
       case PZG_UNICAST_COMMAND_REPLY_BACK_ORDER:
       {
-         PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
-         if ((dbUp())&&(msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()).IsError())) dbUp.Reset();
-
          status_t ret;
          PZGUpdateBackOrderKey ubok;
          if (msg()->FindFlat(PZG_PEER_NAME_BACK_ORDER, ubok).IsError(ret))
@@ -116,11 +187,56 @@ void PZGUnicastSession :: MessageReceivedFromGateway(const MessageRef & msg, voi
             return;
          }
 
-         if (_backorders.Remove(ubok).IsOK())
+         if (_backorders.ContainsKey(ubok) == false)
          {
-            _master->BackOrderResultReceived(ubok, dbUp);
+            LogTime(MUSCLE_LOG_WARNING, "PZGUnicastSession:  Got a back-order reply that I don't remember asking for (%s)\n", ubok.ToString()());
+            return;
+         }
+
+         if (ubok.IsRange())
+         {
+            // A range-reply contains whichever of the requested updates the senior peer still had, and may be followed by more replies
+            for (uint32 i=0; /* empty */; i++)
+            {
+               PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+               if ((dbUp() == NULL)||(msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, i, *dbUp()).IsError())) break;
+               _master->BackOrderResultReceived(ubok, dbUp, false);
+            }
+            if (msg()->HasName(PZG_UNICAST_NAME_MORE_COMING)) return;  // the rest of the range is still on its way to us
+
+            (void) _backorders.Remove(ubok);
+            _master->BackOrderResultReceived(ubok, ConstPZGDatabaseUpdateRef(), true);
+         }
+         else
+         {
+            PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+            if ((dbUp())&&(msg()->FindFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()).IsError())) dbUp.Reset();
+
+            (void) _backorders.Remove(ubok);
+            _master->BackOrderResultReceived(ubok, dbUp, true);
+         }
+      }
+      break;
+
+      case PZG_UNICAST_COMMAND_FULL_STATE_CHUNK:
+         FullStateChunkReceived(*msg());
+      break;
+
+      case PZG_UNICAST_COMMAND_FULL_STATE_CHUNK_ACK:
+      {
+         const uint32 whichDB = msg()->GetInt32(PZG_PEER_NAME_DATABASE_ID);
+         PZGOutgoingFullStateTransfer * xfer = _outgoingFullStateTransfers.Get(whichDB);
+         if ((xfer)&&(xfer->_transferID == (uint64) msg()->GetInt64(PZG_UNICAST_NAME_TRANSFER_ID)))
+         {
+            xfer->_numBytesAcked = muscleClamp((uint32) msg()->GetInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET), xfer->_numBytesAcked, xfer->_numBytesSent);
+
+            status_t ret;
+            if (SendMoreFullStateChunks(whichDB).IsError(ret))
+            {
+               LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession:  Unable to continue full-state transfer of database #" UINT32_FORMAT_SPEC " to junior peer [%s] [%s]\n", whichDB, _remotePeerID.ToString()(), ret());
+               EndSession();  // the junior peer will re-request (and resume) the transfer when it reconnects
+            }
          }
-         else LogTime(MUSCLE_LOG_WARNING, "PZGUnicastSession:  Got a back-order reply that I don't remember asking for (%s)\n", ubok.ToString()());
       }
       break;
 
@@ -140,9 +256,10 @@ void PZGUnicastSession :: UnregisterMyself(bool forGood)
    if (_master)
    {
       // If we have any back-orders outstanding, make sure the master knows they aren't going to happen
-      for (ConstHashtableIterator<PZGUpdateBackOrderKey, Void> iter(_backorders); iter.HasData(); iter++) _master->BackOrderResultReceived(iter.GetKey(), ConstPZGDatabaseUpdateRef());
+      for (ConstHashtableIterator<PZGUpdateBackOrderKey, Void> iter(_backorders); iter.HasData(); iter++) _master->BackOrderResultReceived(iter.GetKey(), ConstPZGDatabaseUpdateRef(), true);
    }
    _backorders.Clear();
+   if (forGood) _pendingRangeReplies.Clear();  // we're going away, so there's nobody left to send them to
 
    if (_master)
    {
@@ -159,8 +276,205 @@ status_t PZGUnicastSession :: RequestBackOrderFromSeniorPeer(const PZGUpdateBack
    MRETURN_OOM_ON_NULL(msg());
    MRETURN_ON_ERROR(msg()->AddFlat(PZG_PEER_NAME_BACK_ORDER,         ubok));
    MRETURN_ON_ERROR(msg()->CAddBool(PZG_PEER_NAME_CHECKSUM_MISMATCH, dueToChecksumError));
+
+   if (ubok.GetDatabaseUpdateID() == DATABASE_UPDATE_ID_FULL_UPDATE)
+   {
+      // If we already received part of this full-database-state from this senior peer before our connection was interrupted, ask him to resume it
+      const PZGIncomingFullStateTransfer * xfer = _master ? _master->GetIncomingFullStateTransfer(ubok.GetDatabaseIndex(), false) : NULL;
+      if ((xfer)&&(xfer->_seniorPeerID == ubok.GetTargetPeerID())&&(xfer->_numBytesReceived > 0))
+      {
+         MRETURN_ON_ERROR(msg()->AddInt64(PZG_UNICAST_NAME_TRANSFER_ID,     xfer->_transferID));
+         MRETURN_ON_ERROR(msg()->AddInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET, xfer->_numBytesReceived));
+      }
+   }
    MRETURN_ON_ERROR(AddOutgoingMessage(msg));
    return _backorders.PutWithDefault(ubok);
 }
 
+status_t PZGUnicastSession :: SendBackOrderRangeReplies(const PZGUpdateBackOrderKey & ubok, uint64 firstUpdateID)
+{
+   // We pack as many of the requested updates as is reasonable into each reply, and tag every reply except the last one
+   // as "more coming", so that the junior peer's catch-up time is limited by TCP bandwidth rather than by round-trips.
+   const uint32 whichDB      = ubok.GetDatabaseIndex();
+   const uint64 lastUpdateID = ubok.GetLastDatabaseUpdateID();
+   uint32 numMissing   = 0;
+   uint32 numDiskReads = 0;
+
+   MessageRef replyMsg;
+   uint32 replyBytes = 0;
+   for (uint64 updateID=firstUpdateID; updateID<=lastUpdateID; updateID++)
+   {
+      if (numDiskReads >= PZG_MAX_DURABLE_LOG_READS_PER_PULSE)
+      {
+         // Updates that have aged out of the in-memory update-log have to be read back from disk, so we'll send the rest of
+         // the range on our next Pulse(), rather than letting one far-behind junior peer stall the senior peer's event loop
+         if ((replyMsg())&&(replyMsg()->HasName(PZG_PEER_NAME_DATABASE_UPDATE)))
+         {
+            MRETURN_ON_ERROR(replyMsg()->AddBool(PZG_UNICAST_NAME_MORE_COMING, true));
+            MRETURN_ON_ERROR(AddOutgoingMessage(replyMsg));
+         }
+         MRETURN_ON_ERROR(_pendingRangeReplies.Put(ubok, updateID));
+         InvalidatePulseTime();
+         return B_NO_ERROR;
+      }
+
+      if (replyMsg() == NULL)
+      {
+         replyMsg = GetMessageFromPool(PZG_UNICAST_COMMAND_REPLY_BACK_ORDER);
+         MRETURN_OOM_ON_NULL(replyMsg());
+         MRETURN_ON_ERROR(replyMsg()->AddFlat(PZG_PEER_NAME_BACK_ORDER, ubok));
+         replyBytes = 0;
+      }
+
+      bool readFromDisk = false;
+      ConstPZGDatabaseUpdateRef dbUp = _master->GetDatabaseUpdateByID(whichDB, updateID, &readFromDisk);
+      if (readFromDisk) numDiskReads++;
+      if (dbUp() == NULL) {numMissing++; continue;}  // the junior peer will notice the gap when the final reply arrives
+
+      MRETURN_ON_ERROR(replyMsg()->AddFlat(PZG_PEER_NAME_DATABASE_UPDATE, *dbUp()));
+      replyBytes += dbUp()->FlattenedSize();
+      if ((replyBytes >= PZG_MAX_BYTES_PER_BACK_ORDER_REPLY)&&(updateID < lastUpdateID))
+      {
+         MRETURN_ON_ERROR(replyMsg()->AddBool(PZG_UNICAST_NAME_MORE_COMING, true));
+         MRETURN_ON_ERROR(AddOutgoingMessage(replyMsg));
+         replyMsg.Reset();
+      }
+   }
+
+   if (replyMsg() == NULL)
+   {
+      replyMsg = GetMessageFromPool(PZG_UNICAST_COMMAND_REPLY_BACK_ORDER);
+      MRETURN_OOM_ON_NULL(replyMsg());
+      MRETURN_ON_ERROR(replyMsg()->AddFlat(PZG_PEER_NAME_BACK_ORDER, ubok));
+   }
+
+   (void) _pendingRangeReplies.Remove(ubok);
+   if (numMissing > 0) LogTime(MUSCLE_LOG_WARNING, "PZGUnicastSession:  Database #" UINT32_FORMAT_SPEC " is missing " UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC " of the updates in the range-back-order requested by junior peer [%s]\n", whichDB, numMissing, ubok.GetNumUpdates(), _remotePeerID.ToString()());
+   return AddOutgoingMessage(replyMsg);
+}
+
+status_t PZGUnicastSession :: StartFullStateTransfer(const PZGUpdateBackOrderKey & ubok, uint64 resumeTransferID, uint32 resumeOffset)
+{
+   const uint32 whichDB = ubok.GetDatabaseIndex();
+
+   PZGFlattenedFullState fs;
+   MRETURN_ON_ERROR(_master->GetFlattenedFullDatabaseState(whichDB, resumeTransferID, fs));
+
+   PZGOutgoingFullStateTransfer xfer;
+   xfer._ubok          = ubok;
+   xfer._transferID    = fs._transferID;
+   xfer._bytes         = fs._bytes;
+   xfer._numBytesSent  = (fs._transferID == resumeTransferID) ? muscleMin(resumeOffset, xfer.GetTotalSize()) : 0;
+   xfer._numBytesAcked = xfer._numBytesSent;
+   if (xfer._numBytesSent > 0) LogTime(MUSCLE_LOG_DEBUG, "PZGUnicastSession:  Resuming full-state transfer of database #" UINT32_FORMAT_SPEC " to junior peer [%s] at byte " UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC "\n", whichDB, _remotePeerID.ToString()(), xfer._numBytesSent, xfer.GetTotalSize());
+
+   MRETURN_ON_ERROR(_outgoingFullStateTransfers.Put(whichDB, xfer));
+   return SendMoreFullStateChunks(whichDB);
+}
+
+status_t PZGUnicastSession :: SendMoreFullStateChunks(uint32 whichDB)
+{
+   PZGOutgoingFullStateTransfer * xfer = _outgoingFullStateTransfers.Get(whichDB);
+   if (xfer == NULL) return B_DATA_NOT_FOUND;
+
+   // Flow control:  we only keep a limited number of chunks in flight, so that a huge database never sits in our outgoing-Message-queue all at once.
+   // Note that we always send at least one chunk, even if the flattened state is zero bytes long, so that the junior peer knows we're done.
+   const uint32 totalSize = xfer->GetTotalSize();
+   const uint32 maxInFlight = PZG_FULL_STATE_CHUNK_SIZE*PZG_FULL_STATE_MAX_UNACKED_CHUNKS;
+   do
+   {
+      if ((xfer->_numBytesSent-xfer->_numBytesAcked) >= maxInFlight) return B_NO_ERROR;  // we'll send more when the junior peer acknowledges what we've sent
+
+      const uint32 chunkSize = muscleMin(totalSize-xfer->_numBytesSent, PZG_FULL_STATE_CHUNK_SIZE);
+      MessageRef chunkMsg = GetMessageFromPool(PZG_UNICAST_COMMAND_FULL_STATE_CHUNK);
+      MRETURN_OOM_ON_NULL(chunkMsg());
+      MRETURN_ON_ERROR(chunkMsg()->AddFlat(PZG_PEER_NAME_BACK_ORDER,          xfer->_ubok));
+      MRETURN_ON_ERROR(chunkMsg()->AddInt64(PZG_UNICAST_NAME_TRANSFER_ID,     xfer->_transferID));
+      MRETURN_ON_ERROR(chunkMsg()->AddInt32(PZG_UNICAST_NAME_TRANSFER_SIZE,   totalSize));
+      MRETURN_ON_ERROR(chunkMsg()->AddInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET, xfer->_numBytesSent));
+      MRETURN_ON_ERROR(chunkMsg()->AddData(PZG_UNICAST_NAME_TRANSFER_DATA, B_RAW_TYPE, xfer->_bytes()->GetBuffer()+xfer->_numBytesSent, chunkSize));
+      MRETURN_ON_ERROR(AddOutgoingMessage(chunkMsg));
+      xfer->_numBytesSent += chunkSize;
+   }
+   while(xfer->_numBytesSent < totalSize);
+
+   (void) _outgoingFullStateTransfers.Remove(whichDB);  // everything has been sent, so we're done with this transfer
+   return B_NO_ERROR;
+}
+
+void PZGUnicastSession :: FullStateChunkReceived(const Message & chunkMsg)
+{
+   status_t ret;
+   PZGUpdateBackOrderKey ubok;
+   if (chunkMsg.FindFlat(PZG_PEER_NAME_BACK_ORDER, ubok).IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZG_UNICAST_COMMAND_FULL_STATE_CHUNK:  Couldn't get PZGUpdateBackOrderKey from Message!  [%s]\n", ret());
+      return;
+   }
+   if (_backorders.ContainsKey(ubok) == false)
+   {
+      LogTime(MUSCLE_LOG_WARNING, "PZGUnicastSession:  Got a full-state chunk that I don't remember asking for (%s)\n", ubok.ToString()());
+      return;
+   }
+
+   const uint32 whichDB    = ubok.GetDatabaseIndex();
+   const uint64 transferID = chunkMsg.GetInt64(PZG_UNICAST_NAME_TRANSFER_ID);
+   const uint32 totalSize  = chunkMsg.GetInt32(PZG_UNICAST_NAME_TRANSFER_SIZE);
+   const uint32 offset     = chunkMsg.GetInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET);
+   const void * data       = NULL;
+   uint32 numBytes         = 0;
+   if (chunkMsg.FindData(PZG_UNICAST_NAME_TRANSFER_DATA, B_RAW_TYPE, &data, &numBytes).IsError()) numBytes = 0;
+
+   PZGIncomingFullStateTransfer * xfer = _master->GetIncomingFullStateTransfer(whichDB, true);
+   if ((xfer)&&(xfer->IsFrom(_remotePeerID, transferID, totalSize) == false))
+   {
+      // This is a different flattened-state than the one we (may have) been receiving before, so we need to start over
+      xfer->_seniorPeerID     = _remotePeerID;
+      xfer->_transferID       = transferID;
+      xfer->_numBytesReceived = 0;
+      if (xfer->_bytes.SetNumBytes(totalSize, false).IsError(ret)) xfer = NULL;
+   }
+
+   if ((xfer)&&((offset != xfer->_numBytesReceived)||(numBytes > (totalSize-offset)))) ret = B_BAD_DATA;  // chunks should always arrive in order
+   if ((xfer == NULL)||(ret.IsError()))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession:  Full-state transfer of database #" UINT32_FORMAT_SPEC " from senior peer [%s] failed at offset " UINT32_FORMAT_SPEC " [%s]\n", whichDB, _remotePeerID.ToString()(), offset, ret());
+      _master->ClearIncomingFullStateTransfer(whichDB);
+      (void) _backorders.Remove(ubok);
+      _master->BackOrderResultReceived(ubok, ConstPZGDatabaseUpdateRef(), true);
+      return;
+   }
+
+   if (numBytes > 0) memcpy(xfer->_bytes.GetBuffer()+offset, data, numBytes);
+   xfer->_numBytesReceived += numBytes;
+
+   if (xfer->_numBytesReceived < totalSize)
+   {
+      // Let the senior peer know we're ready for more
+      MessageRef ackMsg = GetMessageFromPool(PZG_UNICAST_COMMAND_FULL_STATE_CHUNK_ACK);
+      if ((ackMsg() == NULL)
+        ||(ackMsg()->AddInt32(PZG_PEER_NAME_DATABASE_ID,         whichDB).IsError(ret))
+        ||(ackMsg()->AddInt64(PZG_UNICAST_NAME_TRANSFER_ID,      transferID).IsError(ret))
+        ||(ackMsg()->AddInt32(PZG_UNICAST_NAME_TRANSFER_OFFSET,  xfer->_numBytesReceived).IsError(ret))
+        ||(AddOutgoingMessage(ackMsg).IsError(ret)))
+      {
+         LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession:  Unable to acknowledge full-state chunk from senior peer [%s] [%s]\n", _remotePeerID.ToString()(), ret());
+         EndSession();  // we'll resume the transfer after we reconnect
+      }
+      return;
+   }
+
+   // We've got the whole thing, so now we can reconstitute the full-database-state and hand it up to our database
+   PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool();
+   if ((dbUp())&&(dbUp()->UnflattenFromByteBuffer(xfer->_bytes).IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "PZGUnicastSession:  Unable to unflatten full-state of database #" UINT32_FORMAT_SPEC " received from senior peer [%s] [%s]\n", whichDB, _remotePeerID.ToString()(), ret());
+      dbUp.Reset();
+   }
+
+   _master->ClearIncomingFullStateTransfer(whichDB);
+   (void) _backorders.Remove(ubok);
+   _master->BackOrderResultReceived(ubok, dbUp, true);
+}
+
 }  // end namespace zg_private
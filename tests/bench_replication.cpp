@@ -0,0 +1,355 @@
+#include <atomic>
+
+#include "reflector/ReflectServer.h"
+#include "system/Mutex.h"
+#include "system/SetupSystem.h"
+#include "system/Thread.h"
+#include "util/MiscUtilityFunctions.h"
+
+#include "zg/ZGConstants.h"  // for GetRandomNumber()
+#include "zg/ZGDatabasePeerSession.h"
+
+using namespace zg;
+
+// End-to-end benchmark of ZG's replication path.  Starts (peers) ZGDatabasePeerSessions on localhost (each with its
+// own ReflectServer, running in its own thread of this process, so that all latencies are measured against a single clock),
+// then has the first peer submit a mix of update- and replace-requests at the specified rate, and reports the resulting
+// throughput and latency percentiles as a single line of JSON.  Usage:
+//    bench_replication [peers=3] [rate=1000] [duration=10] [replacefraction=0.0] [payload=64] [output=results.json]
+// (rate is in requests per second, duration is in seconds, payload is the number of payload bytes per request)
+
+static const String BENCH_NAME_SEQUENCE_NUMBER = "seq";  // uint32:  the request's sequence number
+static const String BENCH_NAME_SUBMIT_TIME     = "bst";  // uint64:  GetRunTime64() at which the request was submitted
+static const String BENCH_NAME_UPDATE_COUNT    = "cnt";  // uint32:  the database's update-counter
+static const String BENCH_NAME_PAYLOAD         = "pay";  // raw bytes:  filler, to make the requests a realistic size
+
+enum {
+   BENCH_COMMAND_UPDATE = 1651403632, // 'bnup' -- increments the database's update-counter
+   BENCH_COMMAND_STATE,               //        -- a complete database state (as used by RequestReplaceDatabaseState())
+};
+
+static const uint64 BENCH_STARTUP_TIMEOUT = SecondsToMicros(30);  // max time to wait for the peers to find each other and elect a senior
+static const uint64 BENCH_DRAIN_TIME      = SecondsToMicros(2);   // time allowed after the last submit for the updates to finish replicating
+static const uint64 BENCH_TICK_INTERVAL   = MillisToMicros(1);    // how often the driving peer checks whether it's time to submit more requests
+
+// Thread-safe collector of latency samples, shared by all of the peers
+class BenchResults
+{
+public:
+   BenchResults(uint32 numJuniors) : _numJuniors(numJuniors), _startTime(0), _numSubmitted(0), _numCommitted(0), _done(false) {/* empty */}
+
+   void SetStartTime(uint64 startTime) {DECLARE_MUTEXGUARD(_mutex); _startTime = startTime;}
+   MUSCLE_NODISCARD uint64 GetStartTime() const {DECLARE_MUTEXGUARD(_mutex); return _startTime;}
+
+   void RequestSubmitted() {DECLARE_MUTEXGUARD(_mutex); _numSubmitted++;}
+
+   void SeniorCommitted(uint64 submitTime)
+   {
+      const uint64 now = GetRunTime64();
+      DECLARE_MUTEXGUARD(_mutex);
+      _numCommitted++;
+      (void) _commitLatencies.AddTail(now-submitTime);
+   }
+
+   void JuniorApplied(uint32 seqNum, uint64 submitTime)
+   {
+      const uint64 now = GetRunTime64();
+      DECLARE_MUTEXGUARD(_mutex);
+      (void) _applyLatencies.AddTail(now-submitTime);
+
+      uint32 * numApplied = _numJuniorsApplied.GetOrPut(seqNum, 0);
+      if ((numApplied)&&(++(*numApplied) >= _numJuniors))
+      {
+         (void) _allAppliedLatencies.AddTail(now-submitTime);
+         (void) _numJuniorsApplied.Remove(seqNum);
+      }
+   }
+
+   void SetDone() {_done = true;}
+   MUSCLE_NODISCARD bool IsDone() const {return _done;}
+
+   void PrintResults(FILE * fpOut, uint32 numPeers, uint32 targetRate, float replaceFraction, uint32 payloadBytes, uint64 durationMicros)
+   {
+      DECLARE_MUTEXGUARD(_mutex);
+      fprintf(fpOut, "{\"peers\":" UINT32_FORMAT_SPEC ",\"target_rate\":" UINT32_FORMAT_SPEC ",\"replace_fraction\":%.3f,\"payload_bytes\":" UINT32_FORMAT_SPEC ",\"duration_us\":" UINT64_FORMAT_SPEC ",\"submitted\":" UINT32_FORMAT_SPEC ",\"committed\":" UINT32_FORMAT_SPEC ",\"throughput_per_sec\":%.1f", numPeers, targetRate, replaceFraction, payloadBytes, durationMicros, _numSubmitted, _numCommitted, (durationMicros>0)?((_numCommitted*((double)MICROS_PER_SECOND))/durationMicros):0.0);
+      PrintPercentiles(fpOut, "commit",      _commitLatencies);
+      PrintPercentiles(fpOut, "apply",       _applyLatencies);
+      PrintPercentiles(fpOut, "all_applied", _allAppliedLatencies);
+      fprintf(fpOut, "}\n");
+   }
+
+private:
+   static void PrintPercentiles(FILE * fpOut, const char * name, Queue<uint64> & latencies)
+   {
+      latencies.Sort();
+      fprintf(fpOut, ",\"%s_samples\":" UINT32_FORMAT_SPEC ",\"%s_p50_us\":" UINT64_FORMAT_SPEC ",\"%s_p99_us\":" UINT64_FORMAT_SPEC ",\"%s_p999_us\":" UINT64_FORMAT_SPEC, name, latencies.GetNumItems(), name, GetPercentile(latencies, 0.5), name, GetPercentile(latencies, 0.99), name, GetPercentile(latencies, 0.999));
+   }
+
+   static uint64 GetPercentile(const Queue<uint64> & sortedLatencies, double fraction)
+   {
+      const uint32 numItems = sortedLatencies.GetNumItems();
+      return (numItems > 0) ? sortedLatencies[muscleMin((uint32)(fraction*numItems), numItems-1)] : 0;
+   }
+
+   mutable Mutex _mutex;
+   const uint32 _numJuniors;
+   uint64 _startTime;  // time at which the driving peer started submitting requests, or 0 if it hasn't started yet
+   uint32 _numSubmitted;
+   uint32 _numCommitted;
+   Queue<uint64> _commitLatencies;      // submit -> executed on the senior peer
+   Queue<uint64> _applyLatencies;       // submit -> applied on a junior peer (one sample per junior per request)
+   Queue<uint64> _allAppliedLatencies;  // submit -> applied on the last of the junior peers
+   Hashtable<uint32, uint32> _numJuniorsApplied;  // sequence number -> how many juniors have applied that request so far
+   std::atomic<bool> _done;
+};
+
+// A trivial database:  just a counter plus the sequence number of the most recent request
+class BenchDatabaseObject : public IDatabaseObject
+{
+public:
+   BenchDatabaseObject(ZGDatabasePeerSession * session, int32 dbIndex, BenchResults * results) : IDatabaseObject(session, dbIndex), _results(results), _updateCount(0), _lastSeqNum(0) {/* empty */}
+
+   virtual void SetToDefaultState() {_updateCount = _lastSeqNum = 0;}
+
+   virtual status_t SetFromArchive(const ConstMessageRef & archive)
+   {
+      _updateCount = archive()->GetInt32(BENCH_NAME_UPDATE_COUNT);
+      _lastSeqNum  = archive()->GetInt32(BENCH_NAME_SEQUENCE_NUMBER);
+
+      // Only the replace-requests we submitted carry a submit-time; full-state downloads don't
+      int64 submitTime;
+      if (archive()->FindInt64(BENCH_NAME_SUBMIT_TIME, submitTime).IsOK()) RecordLatency(submitTime);
+      return B_NO_ERROR;
+   }
+
+   virtual status_t SaveToArchive(const MessageRef & archive) const
+   {
+      archive()->what = BENCH_COMMAND_STATE;
+      MRETURN_ON_ERROR(archive()->AddInt32(BENCH_NAME_UPDATE_COUNT, _updateCount));
+      return archive()->AddInt32(BENCH_NAME_SEQUENCE_NUMBER, _lastSeqNum);
+   }
+
+   MUSCLE_NODISCARD virtual uint32 GetCurrentChecksum() const {return CalculateChecksum();}
+   MUSCLE_NODISCARD virtual uint32 CalculateChecksum() const {return (_updateCount*7)+_lastSeqNum;}
+
+   MUSCLE_NODISCARD virtual String ToString() const {return String("updateCount=%1 lastSeqNum=%2").Arg(_updateCount).Arg(_lastSeqNum);}
+
+protected:
+   virtual ConstMessageRef SeniorUpdate(const ConstMessageRef & seniorDoMsg)
+   {
+      ApplyUpdate(*seniorDoMsg());
+      return seniorDoMsg;  // the juniors can apply the same Message verbatim
+   }
+
+   virtual status_t JuniorUpdate(const ConstMessageRef & juniorDoMsg)
+   {
+      ApplyUpdate(*juniorDoMsg());
+      return B_NO_ERROR;
+   }
+
+private:
+   void ApplyUpdate(const Message & msg)
+   {
+      _updateCount++;
+      _lastSeqNum = msg.GetInt32(BENCH_NAME_SEQUENCE_NUMBER);
+      RecordLatency(msg.GetInt64(BENCH_NAME_SUBMIT_TIME));
+   }
+
+   void RecordLatency(uint64 submitTime)
+   {
+      if (IsInSeniorDatabaseUpdateContext()) _results->SeniorCommitted(submitTime);
+                                        else _results->JuniorApplied(_lastSeqNum, submitTime);
+   }
+
+   BenchResults * _results;
+   uint32 _updateCount;
+   uint32 _lastSeqNum;
+};
+
+class BenchPeerSession : public ZGDatabasePeerSession
+{
+public:
+   BenchPeerSession(const ZGPeerSettings & peerSettings, BenchResults * results, bool isDriver, uint32 numPeers, uint32 targetRate, float replaceFraction, uint32 payloadBytes, uint64 durationMicros)
+      : ZGDatabasePeerSession(peerSettings)
+      , _results(results)
+      , _isDriver(isDriver)
+      , _numPeers(numPeers)
+      , _submitInterval(MICROS_PER_SECOND/muscleMax(targetRate, (uint32)1))
+      , _replaceFraction(replaceFraction)
+      , _durationMicros(durationMicros)
+      , _nextTickTime(0)
+      , _nextSubmitTime(MUSCLE_TIME_NEVER)
+      , _endSubmitTime(MUSCLE_TIME_NEVER)
+      , _nextSeqNum(1)
+      , _seed((unsigned int) time(NULL))
+   {
+      (void) _payload.SetNumBytes(payloadBytes, false);
+      if (_payload.GetNumBytes() > 0) memset(_payload.GetBuffer(), 'x', _payload.GetNumBytes());
+   }
+
+   virtual const char * GetTypeName() const {return "BenchPeer";}
+
+   MUSCLE_NODISCARD virtual uint64 GetPulseTime(const PulseArgs & args) {return muscleMin(ZGDatabasePeerSession::GetPulseTime(args), _nextTickTime);}
+
+   virtual void Pulse(const PulseArgs & args)
+   {
+      ZGDatabasePeerSession::Pulse(args);
+
+      const uint64 now = args.GetCallbackTime();
+      if (now >= _nextTickTime)
+      {
+         _nextTickTime = now + BENCH_TICK_INTERVAL;
+         if (_results->IsDone()) {EndServer(); return;}
+         if (_isDriver) DriveRequests(now);
+      }
+   }
+
+protected:
+   virtual IDatabaseObjectRef CreateDatabaseObject(uint32 whichDatabase) {return IDatabaseObjectRef(new BenchDatabaseObject(this, whichDatabase, _results));}
+
+private:
+   void DriveRequests(uint64 now)
+   {
+      if (_nextSubmitTime == MUSCLE_TIME_NEVER)
+      {
+         if (IsSystemReady() == false) return;
+
+         LogTime(MUSCLE_LOG_INFO, "All " UINT32_FORMAT_SPEC " peers are online, senior peer is [%s].  Starting benchmark.\n", _numPeers, GetSeniorPeerID().ToString()());
+         _nextSubmitTime = now;
+         _endSubmitTime  = now+_durationMicros;
+         _results->SetStartTime(now);
+      }
+
+      while((_nextSubmitTime <= now)&&(_nextSubmitTime < _endSubmitTime))
+      {
+         const bool isReplace = ((_replaceFraction > 0.0f)&&((GetRandomNumber(&_seed)%10000) < (_replaceFraction*10000.0f)));
+         MessageRef msg = GetMessageFromPool(isReplace ? BENCH_COMMAND_STATE : BENCH_COMMAND_UPDATE);
+         if ((msg())&&(msg()->AddInt32(BENCH_NAME_SEQUENCE_NUMBER, _nextSeqNum).IsOK())&&(msg()->AddInt64(BENCH_NAME_SUBMIT_TIME, GetRunTime64()).IsOK())&&
+             ((isReplace == false)||(msg()->AddInt32(BENCH_NAME_UPDATE_COUNT, 0).IsOK()))&&
+             ((_payload.GetNumBytes() == 0)||(msg()->AddData(BENCH_NAME_PAYLOAD, B_RAW_TYPE, _payload.GetBuffer(), _payload.GetNumBytes()).IsOK())))
+         {
+            const status_t ret = isReplace ? RequestReplaceDatabaseState(0, msg) : RequestUpdateDatabaseState(0, msg);
+            if (ret.IsOK()) _results->RequestSubmitted();
+                       else LogTime(MUSCLE_LOG_ERROR, "Request #" UINT32_FORMAT_SPEC " failed [%s]\n", _nextSeqNum, ret());
+         }
+         _nextSeqNum++;
+         _nextSubmitTime += _submitInterval;
+      }
+   }
+
+   // Returns true iff all of the peers are online and the system has a senior peer for us to send our requests to
+   MUSCLE_NODISCARD bool IsSystemReady() const
+   {
+      if ((IAmFullyAttached() == false)||(GetSeniorPeerID().IsValid() == false)) return false;
+
+      const Hashtable<ZGPeerID, ConstMessageRef> & onlinePeers = GetOnlinePeers();
+      const uint32 numRemotePeers = onlinePeers.GetNumItems() - (onlinePeers.ContainsKey(GetLocalPeerID()) ? 1 : 0);
+      return (numRemotePeers+1 >= _numPeers);
+   }
+
+   BenchResults * _results;
+   const bool _isDriver;
+   const uint32 _numPeers;
+   const uint64 _submitInterval;
+   const float _replaceFraction;
+   const uint64 _durationMicros;
+   ByteBuffer _payload;
+
+   uint64 _nextTickTime;
+   uint64 _nextSubmitTime;
+   uint64 _endSubmitTime;
+   uint32 _nextSeqNum;
+   unsigned int _seed;
+};
+
+// Runs one BenchPeerSession inside its own ReflectServer event loop
+class BenchPeerThread : public Thread
+{
+public:
+   BenchPeerThread(const ZGPeerSessionRef & session) : _session(session) {/* empty */}
+
+protected:
+   virtual void InternalThreadEntry()
+   {
+      ReflectServer server;
+      if (server.AddNewSession(_session).IsOK()) (void) server.ServerProcessLoop();
+      server.Cleanup();
+   }
+
+private:
+   ZGPeerSessionRef _session;
+};
+DECLARE_REFTYPES(BenchPeerThread);
+
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const char * peersStr   = args.GetCstr("peers");
+   const char * rateStr    = args.GetCstr("rate");
+   const char * durStr     = args.GetCstr("duration");
+   const char * replaceStr = args.GetCstr("replacefraction");
+   const char * payloadStr = args.GetCstr("payload");
+   const char * outputPath = args.GetCstr("output");
+
+   const uint32 numPeers        = muscleMax((uint32)2, peersStr ? (uint32)atol(peersStr) : (uint32)3);
+   const uint32 targetRate      = muscleMax((uint32)1, rateStr ? (uint32)atol(rateStr) : (uint32)1000);
+   const uint64 durationMicros  = SecondsToMicros(muscleMax((uint64)1, durStr ? (uint64)atoll(durStr) : (uint64)10));
+   const float replaceFraction  = muscleClamp(replaceStr ? (float)atof(replaceStr) : 0.0f, 0.0f, 1.0f);
+   const uint32 payloadBytes    = payloadStr ? (uint32)atol(payloadStr) : (uint32)64;
+
+   // Use a unique system name, so that we won't interfere with (or be interfered with by) any other benchmark runs
+   const String systemName = String("bench_replication_%1").Arg(GetRunTime64());
+
+   BenchResults results(numPeers-1);
+   Queue<BenchPeerThreadRef> threads;
+   for (uint32 i=0; i<numPeers; i++)
+   {
+      ZGPeerSettings settings("bench_replication", systemName, 1, true);  // true == system is on localhost only
+      ZGPeerSessionRef session(new BenchPeerSession(settings, &results, (i==0), numPeers, targetRate, replaceFraction, payloadBytes, durationMicros));
+      BenchPeerThreadRef thread(new BenchPeerThread(session));
+      if ((threads.AddTail(thread).IsError())||(thread()->StartInternalThread().IsError()))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to start thread for peer #" UINT32_FORMAT_SPEC "\n", i);
+         results.SetDone();
+         break;
+      }
+   }
+
+   // Wait for the benchmark to start, run, and drain
+   int exitCode = 0;
+   const uint64 launchTime = GetRunTime64();
+   while(results.IsDone() == false)
+   {
+      (void) Snooze64(MillisToMicros(50));
+
+      const uint64 now       = GetRunTime64();
+      const uint64 startTime = results.GetStartTime();
+      if ((startTime == 0)&&(now >= launchTime+BENCH_STARTUP_TIMEOUT))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Timed out waiting for the " UINT32_FORMAT_SPEC " peers to come online!\n", numPeers);
+         exitCode = 10;
+         results.SetDone();
+      }
+      else if ((startTime > 0)&&(now >= startTime+durationMicros+BENCH_DRAIN_TIME)) results.SetDone();
+   }
+
+   for (uint32 i=0; i<threads.GetNumItems(); i++) (void) threads[i]()->ShutdownInternalThread();
+
+   if (exitCode == 0)
+   {
+      results.PrintResults(stdout, numPeers, targetRate, replaceFraction, payloadBytes, durationMicros);
+      if (outputPath)
+      {
+         FILE * fpOut = muscleFopen(outputPath, "a");
+         if (fpOut)
+         {
+            results.PrintResults(fpOut, numPeers, targetRate, replaceFraction, payloadBytes, durationMicros);
+            fclose(fpOut);
+         }
+         else LogTime(MUSCLE_LOG_ERROR, "Unable to open output file [%s]\n", outputPath);
+      }
+   }
+   return exitCode;
+}
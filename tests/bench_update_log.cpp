@@ -0,0 +1,125 @@
+#include "system/SetupSystem.h"
+#include "util/Hashtable.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
+
+#include "zg/private/PZGUpdateLog.h"
+
+using namespace zg_private;
+
+// Microbenchmark comparing the PZGUpdateLog ring buffer against the OrderedKeysHashtable
+// that PZGDatabaseState previously used for its update-log.  Usage:  bench_update_log [numupdates=200000]
+
+typedef OrderedKeysHashtable<uint64, ConstPZGDatabaseUpdateRef> HashtableUpdateLog;
+
+static void PrintResult(const char * containerName, const char * opName, uint32 numOps, uint64 elapsedMicros)
+{
+   printf("  %-22s %-8s " UINT32_FORMAT_SPEC " ops in " UINT64_FORMAT_SPEC " microseconds (%.1f nanoseconds/op)\n", containerName, opName, numOps, elapsedMicros, (numOps>0)?((elapsedMicros*1000.0)/numOps):0.0);
+}
+
+// The lookup pattern used by both benchmarks:  a stride through the log, similar to what back-order replies and junior catch-ups do
+static uint64 GetLookupID(uint64 firstID, uint32 numUpdates, uint32 i) {return firstID+((i*7919)%numUpdates);}
+
+static uint64 BenchmarkHashtable(const Queue<ConstPZGDatabaseUpdateRef> & updates)
+{
+   const uint32 numUpdates = updates.GetNumItems();
+   const uint64 firstID    = updates.Head()()->GetUpdateID();
+   HashtableUpdateLog log;
+   uint64 checkSum = 0;
+
+   uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numUpdates; i++) (void) log.Put(updates[i]()->GetUpdateID(), updates[i]);
+   PrintResult("OrderedKeysHashtable", "append", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   for (uint32 i=0; i<numUpdates; i++)
+   {
+      const ConstPZGDatabaseUpdateRef * dbUp = log.Get(GetLookupID(firstID, numUpdates, i));
+      if (dbUp) checkSum += (*dbUp)()->GetUpdateID();
+   }
+   PrintResult("OrderedKeysHashtable", "lookup", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   for (ConstHashtableIterator<uint64, ConstPZGDatabaseUpdateRef> iter(log); iter.HasData(); iter++) checkSum += iter.GetValue()()->GetPostUpdateDBChecksum();
+   PrintResult("OrderedKeysHashtable", "iterate", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   while(log.HasItems())
+   {
+      ConstPZGDatabaseUpdateRef temp;
+      if (log.Remove(*log.GetFirstKey(), temp).IsOK()) checkSum += temp()->GetUpdateID();
+   }
+   PrintResult("OrderedKeysHashtable", "trim", numUpdates, GetRunTime64()-startTime);
+
+   return checkSum;
+}
+
+static uint64 BenchmarkRingBuffer(const Queue<ConstPZGDatabaseUpdateRef> & updates)
+{
+   const uint32 numUpdates = updates.GetNumItems();
+   const uint64 firstID    = updates.Head()()->GetUpdateID();
+   PZGUpdateLog log;
+   uint64 checkSum = 0;
+
+   uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numUpdates; i++) (void) log.Put(updates[i]()->GetUpdateID(), updates[i]);
+   PrintResult("PZGUpdateLog", "append", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   for (uint32 i=0; i<numUpdates; i++)
+   {
+      const ConstPZGDatabaseUpdateRef * dbUp = log.Get(GetLookupID(firstID, numUpdates, i));
+      if (dbUp) checkSum += (*dbUp)()->GetUpdateID();
+   }
+   PrintResult("PZGUpdateLog", "lookup", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   for (uint32 i=0; i<log.GetNumSlots(); i++)
+   {
+      const ConstPZGDatabaseUpdateRef & dbUp = log.GetSlotAt(i);
+      if (dbUp()) checkSum += dbUp()->GetPostUpdateDBChecksum();
+   }
+   PrintResult("PZGUpdateLog", "iterate", numUpdates, GetRunTime64()-startTime);
+
+   startTime = GetRunTime64();
+   while(log.HasItems())
+   {
+      ConstPZGDatabaseUpdateRef temp;
+      if (log.Remove(log.GetFirstKeyWithDefault(), temp).IsOK()) checkSum += temp()->GetUpdateID();
+   }
+   PrintResult("PZGUpdateLog", "trim", numUpdates, GetRunTime64()-startTime);
+
+   return checkSum;
+}
+
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const char * numUpdatesStr = args.GetCstr("numupdates");
+   const uint32 numUpdates = muscleMax((uint32)1, numUpdatesStr ? (uint32)atol(numUpdatesStr) : (uint32)200000);
+
+   // Create the updates up-front, so that the benchmarks measure only the update-log operations
+   Queue<ConstPZGDatabaseUpdateRef> updates;
+   if (updates.EnsureSize(numUpdates).IsError()) {MWARN_OUT_OF_MEMORY; return 10;}
+
+   const uint64 firstID = 1000;  // arbitrary, just so we're not starting at zero
+   for (uint32 i=0; i<numUpdates; i++)
+   {
+      PZGDatabaseUpdateRef dbUp = GetPZGDatabaseUpdateFromPool(PZG_DATABASE_UPDATE_TYPE_UPDATE, 0, firstID+i, ZGPeerID(), i);
+      if (dbUp() == NULL) {MWARN_OUT_OF_MEMORY; return 10;}
+      dbUp()->SetPostUpdateDBChecksum(i+1);
+      (void) updates.AddTail(dbUp);
+   }
+
+   printf("Benchmarking update-logs with " UINT32_FORMAT_SPEC " updates:\n", numUpdates);
+   const uint64 hashtableCheckSum  = BenchmarkHashtable(updates);
+   const uint64 ringBufferCheckSum = BenchmarkRingBuffer(updates);
+   if (hashtableCheckSum != ringBufferCheckSum)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Checksum mismatch! (" UINT64_FORMAT_SPEC " vs " UINT64_FORMAT_SPEC ")\n", hashtableCheckSum, ringBufferCheckSum);
+      return 10;
+   }
+   return 0;
+}
@@ -0,0 +1,149 @@
+#include <atomic>
+#include <thread>
+
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
+
+#include "zg/private/PZGMessageHandoffQueue.h"
+#include "zg/private/PZGMessageIDWindow.h"
+
+using namespace zg_private;
+
+// Self-checking test of the multicast duplicate-detection window and the lock-free
+// Message hand-off queue.  Returns 0 if all checks pass, or 10 if any check fails.
+// Usage:  check_multicast_dedup [nummessages=1000000]
+
+static uint32 _numFailures = 0;
+
+static void Check(bool condition, const char * desc)
+{
+   if (condition == false)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "CHECK FAILED:  %s\n", desc);
+      _numFailures++;
+   }
+}
+
+static void CheckMessageIDWindow()
+{
+   printf("Checking PZGMessageIDWindow...\n");
+
+   // In-order IDs, re-deliveries, and out-of-order IDs within the window
+   {
+      PZGMessageIDWindow w;
+      Check(w.MarkReceived(100) == true,  "first ID should be new");
+      Check(w.MarkReceived(100) == false, "repeated ID should be a duplicate");
+      Check(w.MarkReceived(105) == true,  "higher ID should be new");
+      Check(w.MarkReceived(102) == true,  "skipped-over ID should be new");
+      Check(w.MarkReceived(102) == false, "skipped-over ID should be a duplicate the second time");
+      Check(w.MarkReceived(101) == true,  "another skipped-over ID should be new");
+   }
+
+   // Message-ID wraparound
+   {
+      PZGMessageIDWindow w;
+      Check(w.MarkReceived(0xFFFFFFFE) == true,  "ID near wraparound should be new");
+      Check(w.MarkReceived(1)          == true,  "ID after wraparound should be new");
+      Check(w.MarkReceived(0xFFFFFFFF) == true,  "skipped-over ID before wraparound should be new");
+      Check(w.MarkReceived(0)          == true,  "skipped-over ID zero should be new");
+      Check(w.MarkReceived(0xFFFFFFFE) == false, "ID before wraparound should be a duplicate");
+      Check(w.MarkReceived(0)          == false, "ID zero should be a duplicate");
+      Check(w.MarkReceived(1)          == false, "ID after wraparound should be a duplicate");
+   }
+
+   // Large jumps forward:  the whole window must be cleared, and anything older than the window is treated as a duplicate
+   {
+      PZGMessageIDWindow w;
+      for (uint32 i=0; i<100; i++) (void) w.MarkReceived(i);
+      Check(w.MarkReceived(1000000)     == true,  "large jump forward should be new");
+      Check(w.MarkReceived(1000000-100) == true,  "ID within the window after a large jump should be new");
+      Check(w.MarkReceived(50)          == false, "ID far behind the window should be treated as a duplicate");
+
+      // A jump of just under the window size must clear the bits of the IDs it slides over
+      const uint32 base = 1000000+2047;
+      Check(w.MarkReceived(base) == true, "jump of just under the window size should be new");
+      for (uint32 i=1; i<2047; i++) if (w.MarkReceived(1000000+i) == false) {Check(false, "IDs slid over by a jump should be new"); break;}
+   }
+}
+
+static void CheckPeerCap()
+{
+   printf("Checking the per-peer window cap...\n");
+
+   Hashtable<ZGPeerID, PZGMessageIDWindow> recentlyReceived;
+   const uint32 numPeers = PZG_MAX_TRACKED_MULTICAST_SOURCES+100;
+   for (uint32 i=0; i<numPeers; i++)
+   {
+      const ZGPeerID peerID(1, i);
+      Check(MarkMulticastMessageReceived(recentlyReceived, peerID, 7) == true,  "first Message from a peer should be new");
+      Check(MarkMulticastMessageReceived(recentlyReceived, peerID, 7) == false, "repeated Message from a peer should be a duplicate");
+      Check(recentlyReceived.GetNumItems() <= PZG_MAX_TRACKED_MULTICAST_SOURCES, "table should never exceed the per-peer cap");
+   }
+   Check(recentlyReceived.GetNumItems() == PZG_MAX_TRACKED_MULTICAST_SOURCES, "table should be full after many peers");
+
+   // The oldest peers should have been evicted (and therefore forgotten), while the newest ones are still tracked
+   Check(recentlyReceived.ContainsKey(ZGPeerID(1, 0))          == false, "oldest peer should have been evicted");
+   Check(recentlyReceived.ContainsKey(ZGPeerID(1, numPeers-1)) == true,  "newest peer should still be tracked");
+   Check(MarkMulticastMessageReceived(recentlyReceived, ZGPeerID(1, numPeers-1), 7) == false, "newest peer's Message should still be a duplicate");
+}
+
+static void CheckHandoffQueue(uint32 numMessages)
+{
+   printf("Checking PZGMessageHandoffQueue with " UINT32_FORMAT_SPEC " Messages...\n", numMessages);
+
+   PZGMessageHandoffQueue q;
+   std::atomic<uint32> numPushFailures(0);
+   std::thread producer([&q, &numPushFailures, numMessages]()
+   {
+      for (uint32 i=0; i<numMessages; i++)
+      {
+         MessageRef msg = GetMessageFromPool(i);
+         if ((msg() == NULL)||(q.Push(msg).IsError())) numPushFailures++;
+      }
+   });
+
+   const uint64 startTime = GetRunTime64();
+   uint32 numPopped = 0;
+   bool inOrder = true;
+   while((numPopped+numPushFailures.load()) < numMessages)
+   {
+      MessageRef msg;
+      if (q.Pop(msg))
+      {
+         if ((msg() == NULL)||(msg()->what != numPopped)) inOrder = false;
+         numPopped++;
+      }
+      else if (GetRunTime64() > startTime+SecondsToMicros(60)) break;  // don't hang forever if something is broken
+   }
+   producer.join();
+
+   MessageRef temp;
+   Check(numPushFailures.load() == 0, "all Push() calls should succeed");
+   Check(numPopped == numMessages,    "every pushed Message should be popped");
+   Check(inOrder,                     "Messages should be popped in the order they were pushed");
+   Check(q.Pop(temp) == false,        "queue should be empty afterwards");
+   Check(q.GetNumItems() == 0,        "GetNumItems() should be zero afterwards");
+   printf("  " UINT32_FORMAT_SPEC " Messages handed off in " UINT64_FORMAT_SPEC " microseconds\n", numPopped, GetRunTime64()-startTime);
+}
+
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const char * numMessagesStr = args.GetCstr("nummessages");
+   const uint32 numMessages = muscleMax((uint32)1, numMessagesStr ? (uint32)atol(numMessagesStr) : (uint32)1000000);
+
+   CheckMessageIDWindow();
+   CheckPeerCap();
+   CheckHandoffQueue(numMessages);
+
+   if (_numFailures > 0)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, UINT32_FORMAT_SPEC " check(s) failed!\n", _numFailures);
+      return 10;
+   }
+   printf("All checks passed.\n");
+   return 0;
+}
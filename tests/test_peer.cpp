@@ -26,7 +26,10 @@ static ZGPeerSettings GetTestZGPeerSettings(const Message & args)
    (void) peerAttributes()->AddInt32("some_value", (GetRunTime64()%10000));
    (void) peerAttributes()->AddFloat("pi", 3.14159f);
 
-   ZGPeerSettings s("test_peer", "test_system", NUM_TOY_DATABASES, false);
+   const bool juniorOnly = args.HasName("junioronly");
+   if (juniorOnly) LogTime(MUSCLE_LOG_INFO, "This peer will be a junior-only (read-replica) peer.\n");
+
+   ZGPeerSettings s("test_peer", "test_system", NUM_TOY_DATABASES, false, juniorOnly ? PEER_TYPE_JUNIOR_ONLY : PEER_TYPE_FULL_PEER);
    s.SetPeerAttributes(peerAttributes);
 
    String multicastMode;
@@ -56,6 +59,97 @@ static ZGPeerSettings GetTestZGPeerSettings(const Message & args)
       else LogTime(MUSCLE_LOG_WARNING, "maxlogsizebytes argument didn't contain a value greater than zero, ignoring it.\n");
    }
 
+   String minLogSizeBytesStr;
+   if (args.FindString("minlogsizebytes", minLogSizeBytesStr).IsOK())
+   {
+      const uint32 minBytes = (uint32) atol(minLogSizeBytesStr());
+      if (minBytes > 0)
+      {
+         LogTime(MUSCLE_LOG_INFO, "Enabling adaptive update-log sizing for database #0, with a minimum log size of " UINT32_FORMAT_SPEC " bytes.\n", minBytes);
+         s.SetAdaptiveUpdateLogSizingForDatabase(0, minBytes);
+      }
+      else LogTime(MUSCLE_LOG_WARNING, "minlogsizebytes argument didn't contain a value greater than zero, ignoring it.\n");
+   }
+
+   String compressedLogStr;
+   if (args.FindString("compressedlog", compressedLogStr).IsOK())
+   {
+      // e.g. compressedlog or compressedlog=3 (zlib compression level)
+      const uint32 level = compressedLogStr.HasChars() ? (uint32) atol(compressedLogStr()) : 9;
+      LogTime(MUSCLE_LOG_INFO, "Keeping database #0's update-log compressed, with compression level " UINT32_FORMAT_SPEC ".\n", level);
+      s.SetUpdateLogCompressionForDatabase(0, true, level);
+   }
+
+   String groupCommitStr;
+   if (args.FindString("groupcommit", groupCommitStr).IsOK())
+   {
+      // e.g. groupcommit=64 or groupcommit=64,5000 (max batch size, max added latency in microseconds)
+      const uint32 maxBatchSize = (uint32) atol(groupCommitStr());
+      const int32 commaIdx      = groupCommitStr.IndexOf(',');
+      const uint64 maxLatency   = (commaIdx >= 0) ? (uint64) atol(groupCommitStr()+commaIdx+1) : 0;
+      if (maxBatchSize > 1)
+      {
+         LogTime(MUSCLE_LOG_INFO, "Enabling group-commit for database #0 (max batch size " UINT32_FORMAT_SPEC ", max added latency " UINT64_FORMAT_SPEC " microseconds).\n", maxBatchSize, maxLatency);
+         s.SetGroupCommitParametersForDatabase(0, maxBatchSize, maxLatency);
+      }
+      else LogTime(MUSCLE_LOG_WARNING, "groupcommit argument didn't contain a batch size greater than one, ignoring it.\n");
+   }
+
+   String admissionStr;
+   if (args.FindString("admission", admissionStr).IsOK())
+   {
+      // e.g. admission=500 or admission=500,64 or admission=500,64,reject (max junior lag, max multicast backlog, reject mode)
+      const uint64 maxJuniorLag  = (uint64) atol(admissionStr());
+      const int32 commaIdx       = admissionStr.IndexOf(',');
+      const uint32 maxBacklog    = (commaIdx >= 0) ? (uint32) atol(admissionStr()+commaIdx+1) : 0;
+      const bool rejectWhenBusy  = admissionStr.EndsWith(",reject");
+      if ((maxJuniorLag > 0)||(maxBacklog > 0))
+      {
+         LogTime(MUSCLE_LOG_INFO, "Enabling admission control for database #0 (max junior lag " UINT64_FORMAT_SPEC ", max multicast backlog " UINT32_FORMAT_SPEC ", %s mode).\n", maxJuniorLag, maxBacklog, rejectWhenBusy?"reject":"delay");
+         s.SetAdmissionControlParametersForDatabase(0, maxJuniorLag, maxBacklog, rejectWhenBusy);
+      }
+      else LogTime(MUSCLE_LOG_WARNING, "admission argument didn't contain a max junior lag or max multicast backlog greater than zero, ignoring it.\n");
+   }
+
+   String pacingStr;
+   if (args.FindString("pacing", pacingStr).IsOK())
+   {
+      // e.g. pacing=1000000 or pacing=1000000,32768 (max bytes per second, max burst bytes)
+      const uint64 bytesPerSecond = (uint64) atoll(pacingStr());
+      const int32 commaIdx        = pacingStr.IndexOf(',');
+      const uint32 burstBytes     = (commaIdx >= 0) ? (uint32) atol(pacingStr()+commaIdx+1) : (64*1024);
+      LogTime(MUSCLE_LOG_INFO, "Pacing multicast database-updates at " UINT64_FORMAT_SPEC " bytes/second (max burst " UINT32_FORMAT_SPEC " bytes).\n", bytesPerSecond, burstBytes);
+      s.SetMulticastPacingParameters(bytesPerSecond, burstBytes);
+   }
+
+   String fecStr;
+   if (args.FindString("fec", fecStr).IsOK())
+   {
+      // e.g. fec=8 (send one parity Message after every 8 multicast data Messages)
+      const uint32 groupSize = fecStr.HasChars() ? (uint32) atol(fecStr()) : 8;
+      LogTime(MUSCLE_LOG_INFO, "Enabling multicast FEC with one parity Message per " UINT32_FORMAT_SPEC " data Messages.\n", groupSize);
+      s.SetMulticastFECGroupSize(groupSize);
+   }
+
+   if (args.HasName("tracelatency"))
+   {
+      LogTime(MUSCLE_LOG_INFO, "Enabling end-to-end latency tracing of database updates (type \"print latency\" to see the histograms).\n");
+      s.SetLatencyTracingEnabled(true);
+   }
+
+   if (args.HasName("perdbseniors"))
+   {
+      LogTime(MUSCLE_LOG_INFO, "Enabling per-database senior peers (all peers in the system must specify this too).\n");
+      s.SetPerDatabaseSeniorPeersEnabled(true);
+   }
+
+   String durableDir;
+   if (args.FindString("durabledir", durableDir).IsOK())
+   {
+      LogTime(MUSCLE_LOG_INFO, "Storing databases durably in directory [%s]\n", durableDir());
+      s.SetDurableStorageDirectory(durableDir);
+   }
+
    return s;
 }
 